@@ -0,0 +1,246 @@
+//
+// Exercises sample::block_cache against a temporary file: hits and misses, LRU eviction,
+// sequential read-ahead, and read-ahead restarting at a seek. Every byte read is checked
+// against the file's pattern. Exits non-zero on the first failed check.
+//
+//   block_cache_check [<directory>]
+//
+// The file is created in <directory> (default /tmp) and removed again.
+//
+
+#include "block_cache.hpp"
+
+#include <boost/exception/diagnostic_information.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using sample::block_cache;
+
+    const std::size_t   kBlockSize  = 64 * 1024;
+    const std::size_t   kFileBlocks = 64;
+    const std::size_t   kChunkSize  = 4 * 1024;
+
+    std::uint8_t patternAt(std::uint64_t offset)
+    {
+        // differs between neighbouring blocks, so a read from the wrong block shows
+        return std::uint8_t((offset * 7) ^ (offset >> 16));
+    }
+
+    bool check(bool condition, const char* what)
+    {
+        std::printf("  %-56s %s\n", what, condition ? "ok" : "FAILED");
+        return condition;
+    }
+
+    // Reads and verifies [offset, offset + size).
+    bool readAndVerify(block_cache& cache, std::uint64_t offset, std::size_t size)
+    {
+        std::vector<std::uint8_t> buffer(size);
+        const ssize_t result = cache.readAt(offset, buffer.data(), size);
+        if (result != ssize_t(size))
+        {
+            std::fprintf(stderr, "readAt(%" PRIu64 ", %zu) returned %zd\n", offset, size, result);
+            return false;
+        }
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            if (buffer[i] != patternAt(offset + i))
+            {
+                std::fprintf(stderr, "wrong byte at %" PRIu64 "\n", offset + i);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Reads block by block in chunks, as an extractor walking the file would.
+    bool readSequentially(block_cache& cache, std::uint64_t offset, std::uint64_t end)
+    {
+        for (; offset < end; offset += kChunkSize)
+        {
+            if (!readAndVerify(cache, offset, kChunkSize))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The read-ahead thread works in the background; waits for it to have loaded count
+    // blocks in all.
+    bool waitForReadAhead(const block_cache& cache, std::uint64_t count)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (cache.getStatistics().readAheadBlocks < count)
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    bool checkHitsAndMisses(int fd)
+    {
+        std::printf("hits and misses\n");
+        block_cache::config cfg;
+        cfg.blockSize = kBlockSize;
+        cfg.readAheadBlocks = 0;
+        block_cache cache(fd, cfg);
+
+        bool ok = check(cache.size() == off64_t(kBlockSize * kFileBlocks), "size is the file's");
+        ok = check(readAndVerify(cache, 0, 100), "first read of a block") && ok;
+        ok = check(readAndVerify(cache, 200, 100), "second read of the same block") && ok;
+        ok = check(readAndVerify(cache, kBlockSize - 50, 100), "read across a block boundary") && ok;
+
+        const auto stats = cache.getStatistics();
+        ok = check(stats.cacheMisses == 2 && stats.cacheHits == 2, "2 misses, 2 hits") && ok;
+        ok = check(stats.bytesRead == 2 * kBlockSize, "each block read from the file once") && ok;
+
+        std::uint8_t byte = 0;
+        ok = check(cache.readAt(kBlockSize * kFileBlocks, &byte, 1) == 0, "read at end of file returns 0") && ok;
+        return ok;
+    }
+
+    bool checkEviction(int fd)
+    {
+        std::printf("LRU eviction\n");
+        block_cache::config cfg;
+        cfg.blockSize = kBlockSize;
+        cfg.maxBlocks = 4;
+        cfg.readAheadBlocks = 0;
+        block_cache cache(fd, cfg);
+
+        // blocks far enough apart not to count as sequential
+        const std::uint64_t blocks[] = { 0, 10, 20, 30 };
+        bool ok = true;
+        for (const auto b : blocks)
+        {
+            ok = readAndVerify(cache, b * kBlockSize, 1) && ok;
+        }
+        ok = readAndVerify(cache, 0, 1) && ok;                  // 0 is now the most recent
+        ok = readAndVerify(cache, 40 * kBlockSize, 1) && ok;    // evicts 10, the least
+        const auto before = cache.getStatistics();
+
+        for (const std::uint64_t b : { 0, 20, 30, 40 })
+        {
+            ok = readAndVerify(cache, b * kBlockSize, 1) && ok;
+        }
+        const auto afterResident = cache.getStatistics();
+        ok = check(afterResident.cacheHits - before.cacheHits == 4 &&
+                   afterResident.cacheMisses == before.cacheMisses, "recently used blocks stay resident") && ok;
+
+        ok = readAndVerify(cache, 10 * kBlockSize, 1) && ok;
+        const auto afterEvicted = cache.getStatistics();
+        ok = check(afterEvicted.cacheMisses - afterResident.cacheMisses == 1, "least recently used block was evicted") && ok;
+        return ok;
+    }
+
+    bool checkReadAhead(int fd)
+    {
+        std::printf("read-ahead and seek\n");
+        block_cache::config cfg;
+        cfg.blockSize = kBlockSize;
+        cfg.maxBlocks = 16;
+        cfg.readAheadBlocks = 4;
+        cfg.sequentialThreshold = 2;
+        block_cache cache(fd, cfg);
+
+        // a few chunks at the start of block 0 schedule blocks 1-4
+        bool ok = readSequentially(cache, 0, 4 * kChunkSize);
+        ok = check(waitForReadAhead(cache, 4), "sequential reads load the next blocks") && ok;
+
+        // reading on through them hits every time, and keeps the window moving to 5-8
+        const auto beforeWindow = cache.getStatistics();
+        ok = readSequentially(cache, 4 * kChunkSize, 5 * kBlockSize) && ok;
+        const auto afterWindow = cache.getStatistics();
+        ok = check(afterWindow.cacheMisses == beforeWindow.cacheMisses, "blocks read ahead are hits") && ok;
+        ok = check(waitForReadAhead(cache, 8), "read-ahead follows the reader") && ok;
+
+        // a seek stops read-ahead, which starts again from the new position once the
+        // reads there are sequential
+        const std::uint64_t seekTo = 40 * kBlockSize;
+        ok = readSequentially(cache, seekTo, seekTo + 4 * kChunkSize) && ok;
+        const auto afterSeek = cache.getStatistics();
+        ok = check(afterSeek.cacheMisses == afterWindow.cacheMisses + 1, "first read after a seek misses") && ok;
+        ok = check(waitForReadAhead(cache, 12), "read-ahead restarts after the seek") && ok;
+
+        ok = readSequentially(cache, seekTo + 4 * kChunkSize, seekTo + 5 * kBlockSize) && ok;
+        const auto afterRestart = cache.getStatistics();
+        ok = check(afterRestart.cacheMisses == afterSeek.cacheMisses, "blocks after the seek are hits") && ok;
+
+        // seeking straight after read-ahead was scheduled abandons whatever of it hasn't
+        // been loaded yet; either way each block is loaded or dropped, never both. Blocks
+        // 1-8, 41-48, 51-54 and 21-24 have been scheduled by now.
+        const std::uint64_t scheduled = 24;
+        ok = readSequentially(cache, 50 * kBlockSize, 50 * kBlockSize + 4 * kChunkSize) && ok;
+        ok = readSequentially(cache, 20 * kBlockSize, 20 * kBlockSize + 4 * kChunkSize) && ok;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        auto settled = cache.getStatistics();
+        while (settled.readAheadBlocks + settled.readAheadDropped < scheduled &&
+               std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            settled = cache.getStatistics();
+        }
+        ok = check(settled.readAheadBlocks + settled.readAheadDropped == scheduled, "queued blocks are loaded or dropped at a seek") && ok;
+
+        std::printf("  %" PRIu64 " blocks read ahead, %" PRIu64 " dropped at a seek\n",
+                    settled.readAheadBlocks,
+                    settled.readAheadDropped);
+        return ok;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string path = std::string((argc > 1) ? argv[1] : "/tmp") + "/block_cache_check.XXXXXX";
+    const int fd = mkstemp(path.data());
+    if (fd < 0)
+    {
+        std::perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    unlink(path.c_str());
+
+    std::vector<std::uint8_t> data(kBlockSize * kFileBlocks);
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = patternAt(i);
+    }
+    if (write(fd, data.data(), data.size()) != ssize_t(data.size()))
+    {
+        std::perror("write");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    try
+    {
+        ok = checkHitsAndMisses(fd) && ok;
+        ok = checkEviction(fd) && ok;
+        ok = checkReadAhead(fd) && ok;
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", boost::diagnostic_information(e).c_str());
+        ok = false;
+    }
+    close(fd);
+
+    std::printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
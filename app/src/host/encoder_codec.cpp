@@ -0,0 +1,346 @@
+//
+// A stand-in video encoder.
+//
+
+#include "encoder_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const std::int32_t  kColorFormatYUV420SemiPlanar    = 21;
+    const std::int32_t  kColorFormatSurface             = 0x7f000789;
+
+    const uint32_t      kBufferFlagKeyFrame             = 1;
+    const std::size_t   kConfigSize                     = 32;
+    const int           kKeyFrameSizeFactor             = 4;
+}
+
+namespace stand_in {
+
+    encoder_codec::encoder_codec(const config& cfg)
+            : mConfig(cfg),
+              mInputBuffers(cfg.inputBuffers),
+              mOutputBuffers(cfg.outputBuffers)
+    {
+        // this space intentionally left blank
+    }
+
+    encoder_codec::~encoder_codec()
+    {
+        (void) stop();
+
+        if (mSurface)
+        {
+            detachSurface(mSurface);
+            ANativeWindow_release(mSurface);
+        }
+    }
+
+    media_status_t encoder_codec::configure(const AMediaFormat* format, ANativeWindow*, uint32_t flags)
+    {
+        AMediaFormat* const f = const_cast<AMediaFormat*>(format);
+        const char* mime = nullptr;
+        if (0 == (flags & AMEDIACODEC_CONFIGURE_FLAG_ENCODE) ||
+            !AMediaFormat_getString(f, AMEDIAFORMAT_KEY_MIME, &mime) ||
+            !AMediaFormat_getInt32(f, AMEDIAFORMAT_KEY_WIDTH, &mWidth) ||
+            !AMediaFormat_getInt32(f, AMEDIAFORMAT_KEY_HEIGHT, &mHeight) ||
+            !AMediaFormat_getInt32(f, AMEDIAFORMAT_KEY_BIT_RATE, &mBitRate))
+        {
+            return AMEDIA_ERROR_INVALID_PARAMETER;
+        }
+
+        mMime = mime;
+        AMediaFormat_getInt32(f, AMEDIAFORMAT_KEY_FRAME_RATE, &mFrameRate);
+        AMediaFormat_getInt32(f, AMEDIAFORMAT_KEY_I_FRAME_INTERVAL, &mIFrameInterval);
+        mFrameRate = std::max(mFrameRate, 1);
+        return AMEDIA_OK;
+    }
+
+    media_status_t encoder_codec::setAsyncNotifyCallback(AMediaCodec* codec,
+                                                         AMediaCodecOnAsyncNotifyCallback callbacks,
+                                                         void* userData)
+    {
+        mCodec = codec;
+        mCallbacks = callbacks;
+        mUserData = userData;
+        return AMEDIA_OK;
+    }
+
+    media_status_t encoder_codec::createInputSurface(ANativeWindow** surface)
+    {
+        if (mSurface || mMime.empty())
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        // one reference is ours, so the surface outlives the client's handle to it
+        mSurface = createSurface(this);
+        ANativeWindow_acquire(mSurface);
+        *surface = mSurface;
+        return AMEDIA_OK;
+    }
+
+    media_status_t encoder_codec::start()
+    {
+        if (mEncodeThread.joinable())
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mInputsToOffer.clear();
+            mFreeOutputs.clear();
+            if (!mSurface)
+            {
+                for (std::size_t i = 0; i < mConfig.inputBuffers; ++i)
+                {
+                    mInputsToOffer.push_back(int32_t(i));
+                }
+            }
+            for (std::size_t i = 0; i < mConfig.outputBuffers; ++i)
+            {
+                mFreeOutputs.push_back(int32_t(i));
+            }
+            mFrames.clear();
+            mStopping = false;
+        }
+
+        mEncodeThread = std::thread(&encoder_codec::encodeThread, this);
+        return AMEDIA_OK;
+    }
+
+    media_status_t encoder_codec::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mCondition.notify_all();
+
+        if (mEncodeThread.joinable())
+        {
+            mEncodeThread.join();
+        }
+        return AMEDIA_OK;
+    }
+
+    uint8_t* encoder_codec::getInputBuffer(size_t index, size_t* capacity)
+    {
+        if (mSurface || index >= mInputBuffers.size())
+        {
+            return nullptr;
+        }
+
+        auto& buffer = mInputBuffers[index];
+        buffer.resize(std::size_t(mWidth) * mHeight * 3 / 2);
+        *capacity = buffer.size();
+        return buffer.data();
+    }
+
+    uint8_t* encoder_codec::getOutputBuffer(size_t index, size_t* capacity)
+    {
+        if (index >= mOutputBuffers.size())
+        {
+            return nullptr;
+        }
+
+        auto& buffer = mOutputBuffers[index];
+        *capacity = buffer.size();
+        return buffer.data();
+    }
+
+    media_status_t encoder_codec::queueInputBuffer(size_t index, off_t, size_t, uint64_t presentationTimeUs, uint32_t flags)
+    {
+        if (mSurface || index >= mInputBuffers.size())
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            frame f;
+            f.inputIndex = int32_t(index);
+            f.presentationTimeUs = std::int64_t(presentationTimeUs);
+            f.flags = flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM;
+            mFrames.push_back(f);
+        }
+        mCondition.notify_all();
+        return AMEDIA_OK;
+    }
+
+    media_status_t encoder_codec::signalEndOfInputStream()
+    {
+        if (!mSurface)
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            frame f;
+            f.flags = AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM;
+            mFrames.push_back(f);
+        }
+        mCondition.notify_all();
+        return AMEDIA_OK;
+    }
+
+    void encoder_codec::onFrameRendered(int64_t presentationTimeUs)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this]() { return mFrames.size() < mConfig.surfaceSlots || mStopping; });
+        if (mStopping)
+        {
+            return;
+        }
+
+        frame f;
+        f.presentationTimeUs = presentationTimeUs;
+        mFrames.push_back(f);
+        lock.unlock();
+
+        mCondition.notify_all();
+    }
+
+    media_status_t encoder_codec::releaseOutputBuffer(size_t index, bool)
+    {
+        if (index >= mOutputBuffers.size())
+        {
+            return AMEDIA_ERROR_INVALID_PARAMETER;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFreeOutputs.push_back(int32_t(index));
+        }
+        mCondition.notify_all();
+        return AMEDIA_OK;
+    }
+
+    AMediaFormat* encoder_codec::getOutputFormat()
+    {
+        static const uint8_t kConfig[kConfigSize] = { 0, 0, 0, 1, 0x67 };
+
+        AMediaFormat* const result = AMediaFormat_new();
+        AMediaFormat_setString(result, AMEDIAFORMAT_KEY_MIME, mMime.c_str());
+        AMediaFormat_setInt32(result, AMEDIAFORMAT_KEY_WIDTH, mWidth);
+        AMediaFormat_setInt32(result, AMEDIAFORMAT_KEY_HEIGHT, mHeight);
+        AMediaFormat_setBuffer(result, AMEDIAFORMAT_KEY_CSD_0, kConfig, sizeof(kConfig));
+        return result;
+    }
+
+    AMediaFormat* encoder_codec::getInputFormat()
+    {
+        // tightly packed NV12 in buffer mode
+        AMediaFormat* const result = AMediaFormat_new();
+        AMediaFormat_setString(result, AMEDIAFORMAT_KEY_MIME, "video/raw");
+        AMediaFormat_setInt32(result, AMEDIAFORMAT_KEY_WIDTH, mWidth);
+        AMediaFormat_setInt32(result, AMEDIAFORMAT_KEY_HEIGHT, mHeight);
+        AMediaFormat_setInt32(result, AMEDIAFORMAT_KEY_COLOR_FORMAT, mSurface ? kColorFormatSurface : kColorFormatYUV420SemiPlanar);
+        AMediaFormat_setInt32(result, AMEDIAFORMAT_KEY_STRIDE, mWidth);
+        AMediaFormat_setInt32(result, AMEDIAFORMAT_KEY_SLICE_HEIGHT, mHeight);
+        return result;
+    }
+
+    void encoder_codec::encodeThread()
+    {
+        const std::size_t frameSize = std::max<std::size_t>(std::size_t(mBitRate) / 8 / mFrameRate, 16);
+        const unsigned int keyFrameInterval = unsigned(std::max(mIFrameInterval * mFrameRate, 1));
+        unsigned int framesEncoded = 0;
+        bool started = false;
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStopping)
+        {
+            if (!mInputsToOffer.empty())
+            {
+                const int32_t index = mInputsToOffer.front();
+                mInputsToOffer.pop_front();
+
+                lock.unlock();
+                mCallbacks.onAsyncInputAvailable(mCodec, mUserData, index);
+                lock.lock();
+                continue;
+            }
+
+            if (mFrames.empty() || mFreeOutputs.empty())
+            {
+                mCondition.wait(lock);
+                continue;
+            }
+
+            const int32_t output = mFreeOutputs.front();
+            mFreeOutputs.pop_front();
+
+            if (!started)
+            {
+                // the format first, then the codec config it carries as a buffer of its own
+                started = true;
+
+                lock.unlock();
+                AMediaFormat* const format = getOutputFormat();
+                mCallbacks.onAsyncFormatChanged(mCodec, mUserData, format);
+                AMediaFormat_delete(format);
+
+                mOutputBuffers[output].assign(kConfigSize, 0);
+                AMediaCodecBufferInfo info;
+                info.offset = 0;
+                info.size = int32_t(kConfigSize);
+                info.presentationTimeUs = 0;
+                info.flags = AMEDIACODEC_BUFFER_FLAG_CODEC_CONFIG;
+                mCallbacks.onAsyncOutputAvailable(mCodec, mUserData, output, &info);
+                lock.lock();
+                continue;
+            }
+
+            const frame f = mFrames.front();
+            mFrames.pop_front();
+            const bool endOfStream = (0 != (f.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM));
+            lock.unlock();
+
+            // a slot in the surface, or the input buffer, is free once its frame is encoded
+            mCondition.notify_all();
+
+            AMediaCodecBufferInfo info;
+            info.offset = 0;
+            if (endOfStream)
+            {
+                info.size = 0;
+                info.presentationTimeUs = mLastPresentationTimeUs;
+                info.flags = AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM;
+            }
+            else
+            {
+                std::this_thread::sleep_for(mConfig.encodeTime);
+
+                const bool keyFrame = (framesEncoded++ % keyFrameInterval == 0);
+                const std::size_t size = keyFrame ? kKeyFrameSizeFactor * frameSize : frameSize;
+                mOutputBuffers[output].resize(size);
+                std::memset(mOutputBuffers[output].data(), int(framesEncoded & 0xff), size);
+
+                info.size = int32_t(size);
+                info.presentationTimeUs = f.presentationTimeUs;
+                info.flags = keyFrame ? kBufferFlagKeyFrame : 0;
+                mLastPresentationTimeUs = f.presentationTimeUs;
+            }
+
+            lock.lock();
+            if (f.inputIndex >= 0)
+            {
+                mInputsToOffer.push_back(f.inputIndex);
+            }
+            if (mStopping)
+            {
+                break;
+            }
+
+            lock.unlock();
+            mCallbacks.onAsyncOutputAvailable(mCodec, mUserData, output, &info);
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,101 @@
+//
+// A stand-in video encoder, fed through its input surface or its input buffers, to
+// exercise the transcoder on a host.
+//
+
+#ifndef MEDIATEST_HOST_ENCODER_CODEC_H
+#define MEDIATEST_HOST_ENCODER_CODEC_H
+
+#include "stand_in_media.hpp"
+
+#include "handles.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace stand_in {
+
+    // Encodes in the async callback model. The output format is reported before the first
+    // output, then comes a codec config buffer, then one output per frame after encodeTime,
+    // sized for the configured bitrate, with a key frame every I-frame interval. Input
+    // buffers are offered only when no input surface was created. The surface holds at
+    // most surfaceSlots frames; rendering into a full one blocks, as a full BufferQueue
+    // holds back the decoder.
+    class encoder_codec : public codec_behaviour, private surface_consumer
+    {
+    public:
+        struct config
+        {
+            std::size_t                 inputBuffers    = 4;
+            std::size_t                 outputBuffers   = 4;
+            std::size_t                 surfaceSlots    = 3;
+            std::chrono::microseconds   encodeTime      = std::chrono::microseconds(3000);
+        };
+
+        explicit encoder_codec(const config& cfg);
+        ~encoder_codec() override;
+
+        media_status_t  configure(const AMediaFormat* format, ANativeWindow* window, uint32_t flags) override;
+        media_status_t  setAsyncNotifyCallback(AMediaCodec* codec,
+                                               AMediaCodecOnAsyncNotifyCallback callbacks,
+                                               void* userData) override;
+        media_status_t  createInputSurface(ANativeWindow** surface) override;
+        media_status_t  start() override;
+        media_status_t  stop() override;
+
+        uint8_t*        getInputBuffer(size_t index, size_t* capacity) override;
+        uint8_t*        getOutputBuffer(size_t index, size_t* capacity) override;
+        media_status_t  queueInputBuffer(size_t index, off_t offset, size_t size, uint64_t presentationTimeUs, uint32_t flags) override;
+        media_status_t  signalEndOfInputStream() override;
+        media_status_t  releaseOutputBuffer(size_t index, bool render) override;
+        AMediaFormat*   getOutputFormat() override;
+        AMediaFormat*   getInputFormat() override;
+
+    private:
+        struct frame
+        {
+            int32_t         inputIndex          = -1;   // -1: from the surface
+            std::int64_t    presentationTimeUs  = 0;
+            uint32_t        flags               = 0;
+        };
+
+        void    onFrameRendered(int64_t presentationTimeUs) override;
+
+        void    encodeThread();
+
+    private:
+        const config                        mConfig;
+
+        std::string                         mMime;
+        std::int32_t                        mWidth              = 0;
+        std::int32_t                        mHeight             = 0;
+        std::int32_t                        mBitRate            = 0;
+        std::int32_t                        mFrameRate          = 30;
+        std::int32_t                        mIFrameInterval     = 1;
+
+        AMediaCodec*                        mCodec              = nullptr;
+        AMediaCodecOnAsyncNotifyCallback    mCallbacks          = {};
+        void*                               mUserData           = nullptr;
+        ANativeWindow*                      mSurface            = nullptr;
+
+        std::vector<std::vector<uint8_t>>   mInputBuffers;
+        std::vector<std::vector<uint8_t>>   mOutputBuffers;
+
+        std::mutex                          mMutex;
+        std::condition_variable             mCondition;
+        std::deque<int32_t>                 mInputsToOffer;
+        std::deque<frame>                   mFrames;
+        std::deque<int32_t>                 mFreeOutputs;
+        std::int64_t                        mLastPresentationTimeUs = 0;
+        bool                                mStopping           = false;
+        std::thread                         mEncodeThread;
+    };
+}
+
+#endif //MEDIATEST_HOST_ENCODER_CODEC_H
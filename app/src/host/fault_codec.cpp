@@ -0,0 +1,453 @@
+//
+// A stand-in decoder that fails on chosen samples.
+//
+
+#include "fault_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const std::size_t   kInputCapacity                  = 64 * 1024;
+    const std::size_t   kSampleSize                     = 4 * 1024;
+    const std::int32_t  kColorFormatYUV420SemiPlanar    = 21;
+}
+
+namespace stand_in {
+
+    const char* toString(fault_kind kind)
+    {
+        switch (kind)
+        {
+            case fault_kind::transient:     return "transient";
+            case fault_kind::recoverable:   return "recoverable";
+            case fault_kind::fatal:         return "fatal";
+            default:                        return "unknown";
+        }
+    }
+
+    bool fault_plan::take(std::int64_t presentationTimeUs, fault& result)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const auto found = std::find_if(mFaults.begin(),
+                                        mFaults.end(),
+                                        [presentationTimeUs](const fault& f) { return f.presentationTimeUs == presentationTimeUs; });
+        if (found == mFaults.end())
+        {
+            return false;
+        }
+
+        result = *found;
+        mFaults.erase(found);
+        return true;
+    }
+
+    std::size_t fault_plan::remaining()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mFaults.size();
+    }
+
+    void fault_plan::noteStaleRelease()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mStaleReleases;
+    }
+
+    std::size_t fault_plan::staleReleases()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStaleReleases;
+    }
+
+    fault_codec::fault_codec(std::shared_ptr<fault_plan> plan, const config& cfg)
+            : mPlan(std::move(plan)),
+              mConfig(cfg),
+              mOutputFormat(AMediaFormat_new()),
+              mInputBuffers(cfg.inputBuffers),
+              mOutputBuffers(cfg.outputBuffers),
+              mOutputTimes(cfg.outputBuffers, -1),
+              mClientOutputs(cfg.outputBuffers, 0)
+    {
+        // NV12 (COLOR_FormatYUV420SemiPlanar) at the configured geometry, the concrete
+        // layout a device decoder reports for ByteBuffer output
+        AMediaFormat_setInt32(mOutputFormat.get(), AMEDIAFORMAT_KEY_WIDTH, mConfig.width);
+        AMediaFormat_setInt32(mOutputFormat.get(), AMEDIAFORMAT_KEY_HEIGHT, mConfig.height);
+        AMediaFormat_setInt32(mOutputFormat.get(), AMEDIAFORMAT_KEY_COLOR_FORMAT, kColorFormatYUV420SemiPlanar);
+        AMediaFormat_setInt32(mOutputFormat.get(), AMEDIAFORMAT_KEY_STRIDE, mConfig.width);
+        AMediaFormat_setInt32(mOutputFormat.get(), AMEDIAFORMAT_KEY_SLICE_HEIGHT, mConfig.height);
+    }
+
+    fault_codec::~fault_codec()
+    {
+        (void) stop();
+    }
+
+    media_status_t fault_codec::configure(const AMediaFormat* format, ANativeWindow* window, uint32_t)
+    {
+        mWindow = window;
+        mFormatPending = true;
+
+        const char* mime = nullptr;
+        if (AMediaFormat_getString(const_cast<AMediaFormat*>(format), AMEDIAFORMAT_KEY_MIME, &mime))
+        {
+            AMediaFormat_setString(mOutputFormat.get(), AMEDIAFORMAT_KEY_MIME, mime);
+        }
+        return AMEDIA_OK;
+    }
+
+    media_status_t fault_codec::setAsyncNotifyCallback(AMediaCodec* codec,
+                                                       AMediaCodecOnAsyncNotifyCallback callbacks,
+                                                       void* userData)
+    {
+        mCodec = codec;
+        mCallbacks = callbacks;
+        mUserData = userData;
+        return AMEDIA_OK;
+    }
+
+    media_status_t fault_codec::start()
+    {
+        if (mDecodeThread.joinable())
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mInputsToOffer.clear();
+            mFreeOutputs.clear();
+            for (std::size_t i = 0; i < mConfig.inputBuffers; ++i)
+            {
+                mInputsToOffer.push_back(int32_t(i));
+            }
+            for (std::size_t i = 0; i < mConfig.outputBuffers; ++i)
+            {
+                mFreeOutputs.push_back(int32_t(i));
+            }
+            mQueuedSamples.clear();
+            mReadyOutputs.clear();
+            std::fill(mClientOutputs.begin(), mClientOutputs.end(), 0);
+            mFailed = false;
+            mError = AMEDIA_OK;
+            mStopping = false;
+        }
+
+        mDecodeThread = std::thread(&fault_codec::decodeThread, this);
+        return AMEDIA_OK;
+    }
+
+    media_status_t fault_codec::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mCondition.notify_all();
+
+        // callbacks are made from the decode thread, so none are in flight once it's gone
+        if (mDecodeThread.joinable())
+        {
+            mDecodeThread.join();
+        }
+        return AMEDIA_OK;
+    }
+
+    media_status_t fault_codec::flush()
+    {
+        // everything is dropped; in async mode nothing more is offered until the client
+        // starts the codec again, a synchronous codec carries on
+        const media_status_t status = stop();
+        return (status != AMEDIA_OK || isAsync()) ? status : start();
+    }
+
+    uint8_t* fault_codec::getInputBuffer(size_t index, size_t* capacity)
+    {
+        if (index >= mInputBuffers.size())
+        {
+            return nullptr;
+        }
+
+        auto& buffer = mInputBuffers[index];
+        buffer.resize(kInputCapacity);
+        *capacity = buffer.size();
+        return buffer.data();
+    }
+
+    uint8_t* fault_codec::getOutputBuffer(size_t index, size_t* capacity)
+    {
+        if (index >= mOutputBuffers.size())
+        {
+            return nullptr;
+        }
+
+        // allocated on first use; most runs render and never look at the pixels
+        auto& buffer = mOutputBuffers[index];
+        buffer.resize(std::size_t(mConfig.width) * mConfig.height * 3 / 2);
+        *capacity = buffer.size();
+        return buffer.data();
+    }
+
+    template <typename Predicate>
+    bool fault_codec::waitFor(std::unique_lock<std::mutex>& lock, int64_t timeoutUs, Predicate ready)
+    {
+        if (timeoutUs < 0)
+        {
+            mCondition.wait(lock, ready);
+            return true;
+        }
+        if (timeoutUs == 0)
+        {
+            // a poll, as the codec's own is: waiting, even with no time, would give up the lock
+            return ready();
+        }
+        return mCondition.wait_for(lock, std::chrono::microseconds(timeoutUs), ready);
+    }
+
+    ssize_t fault_codec::dequeueInputBuffer(int64_t timeoutUs)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!waitFor(lock, timeoutUs, [this]() { return mFailed || mStopping || !mInputsToOffer.empty(); }))
+        {
+            return AMEDIACODEC_INFO_TRY_AGAIN_LATER;
+        }
+        if (mFailed)
+        {
+            return mError;
+        }
+        if (mStopping)
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        const int32_t index = mInputsToOffer.front();
+        mInputsToOffer.pop_front();
+        return index;
+    }
+
+    ssize_t fault_codec::dequeueOutputBuffer(AMediaCodecBufferInfo* info, int64_t timeoutUs)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mFormatPending)
+        {
+            mFormatPending = false;
+            return AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED;
+        }
+        if (!waitFor(lock, timeoutUs, [this]() { return mFailed || mStopping || !mReadyOutputs.empty(); }))
+        {
+            return AMEDIACODEC_INFO_TRY_AGAIN_LATER;
+        }
+        if (mFailed)
+        {
+            return mError;
+        }
+        if (mStopping)
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        const ready_output output = mReadyOutputs.front();
+        mReadyOutputs.pop_front();
+        *info = output.info;
+        return output.index;
+    }
+
+    media_status_t fault_codec::queueInputBuffer(size_t index, off_t, size_t, uint64_t presentationTimeUs, uint32_t flags)
+    {
+        if (index >= mInputBuffers.size())
+        {
+            return AMEDIA_ERROR_INVALID_PARAMETER;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            queued_sample sample;
+            sample.index = int32_t(index);
+            sample.presentationTimeUs = std::int64_t(presentationTimeUs);
+            sample.flags = flags;
+            mQueuedSamples.push_back(sample);
+        }
+        mCondition.notify_all();
+        return AMEDIA_OK;
+    }
+
+    media_status_t fault_codec::releaseOutputBuffer(size_t index, bool render)
+    {
+        if (index >= mOutputBuffers.size())
+        {
+            return AMEDIA_ERROR_INVALID_PARAMETER;
+        }
+
+        std::int64_t presentationTimeUs = -1;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mClientOutputs[index])
+            {
+                mPlan->noteStaleRelease();
+                return AMEDIA_ERROR_INVALID_PARAMETER;
+            }
+            mClientOutputs[index] = 0;
+            presentationTimeUs = mOutputTimes[index];
+        }
+
+        // before the buffer is free again: a full surface holds the codec's output back
+        if (render && mWindow && presentationTimeUs >= 0)
+        {
+            renderToSurface(mWindow, presentationTimeUs);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFreeOutputs.push_back(int32_t(index));
+        }
+        mCondition.notify_all();
+        return AMEDIA_OK;
+    }
+
+    AMediaFormat* fault_codec::getOutputFormat()
+    {
+        AMediaFormat* const result = AMediaFormat_new();
+        for (const char* key : { AMEDIAFORMAT_KEY_WIDTH, AMEDIAFORMAT_KEY_HEIGHT, AMEDIAFORMAT_KEY_COLOR_FORMAT,
+                                 AMEDIAFORMAT_KEY_STRIDE, AMEDIAFORMAT_KEY_SLICE_HEIGHT })
+        {
+            std::int32_t value = 0;
+            if (AMediaFormat_getInt32(mOutputFormat.get(), key, &value))
+            {
+                AMediaFormat_setInt32(result, key, value);
+            }
+        }
+        return result;
+    }
+
+    void fault_codec::decodeThread()
+    {
+        // as a device decoder reports its output layout ahead of the first frame; a
+        // synchronous client dequeues it
+        if (isAsync() && mFormatPending)
+        {
+            mFormatPending = false;
+            if (!mReportedFormat)
+            {
+                mReportedFormat.reset(getOutputFormat());
+            }
+            mCallbacks.onAsyncFormatChanged(mCodec, mUserData, mReportedFormat.get());
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStopping)
+        {
+            if (isAsync() && !mInputsToOffer.empty())
+            {
+                const int32_t index = mInputsToOffer.front();
+                mInputsToOffer.pop_front();
+
+                lock.unlock();
+                mCallbacks.onAsyncInputAvailable(mCodec, mUserData, index);
+                lock.lock();
+                continue;
+            }
+
+            const bool ready = !mFailed &&
+                               !mFreeOutputs.empty() &&
+                               !mQueuedSamples.empty() &&
+                               (mQueuedSamples.size() > mConfig.decodeDelay ||
+                                0 != (mQueuedSamples.back().flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM));
+            if (!ready)
+            {
+                mCondition.wait(lock);
+                continue;
+            }
+
+            const queued_sample sample = mQueuedSamples.front();
+            mQueuedSamples.pop_front();
+
+            lock.unlock();
+            std::this_thread::sleep_for(mConfig.decodeTime);
+            fault injected;
+            const bool failed = mPlan->take(sample.presentationTimeUs, injected);
+            lock.lock();
+
+            if (mStopping)
+            {
+                break;
+            }
+
+            if (failed)
+            {
+                mFailed = true;
+                mError = injected.error;
+                if (!isAsync())
+                {
+                    mCondition.notify_all();
+                    continue;
+                }
+
+                lock.unlock();
+                mCallbacks.onAsyncError(mCodec, mUserData, injected.error, int32_t(injected.kind), "injected fault");
+                lock.lock();
+                continue;
+            }
+
+            const int32_t output = mFreeOutputs.front();
+            mFreeOutputs.pop_front();
+            mInputsToOffer.push_back(sample.index);
+
+            const bool endOfStream = (0 != (sample.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM));
+            mOutputTimes[output] = endOfStream ? -1 : sample.presentationTimeUs;
+            mClientOutputs[output] = 1;
+            AMediaCodecBufferInfo info;
+            info.offset = 0;
+            info.size = endOfStream ? 0 : int32_t(std::size_t(mConfig.width) * mConfig.height * 3 / 2);
+            info.presentationTimeUs = sample.presentationTimeUs;
+            info.flags = sample.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM;
+            if (!isAsync())
+            {
+                mReadyOutputs.push_back(ready_output{ output, info });
+                mCondition.notify_all();
+                continue;
+            }
+
+            lock.unlock();
+            mCallbacks.onAsyncOutputAvailable(mCodec, mUserData, output, &info);
+            lock.lock();
+        }
+    }
+
+    synthetic_samples::synthetic_samples(unsigned int frameCount, unsigned int gopLength, std::int64_t frameDurationUs)
+            : mFrameCount(frameCount),
+              mGopLength(std::max(gopLength, 1u)),
+              mFrameDurationUs(frameDurationUs)
+    {
+        // this space intentionally left blank
+    }
+
+    std::tuple<bool, std::size_t, std::uint64_t> synthetic_samples::operator()(void* buffer, std::size_t capacity)
+    {
+        if (mNext >= mFrameCount)
+        {
+            // an empty end-of-stream buffer, as readSampleData queues past the last sample
+            return std::make_tuple(false, std::size_t(0), std::uint64_t(mFrameDurationUs * mFrameCount));
+        }
+
+        const std::size_t size = std::min(kSampleSize, capacity);
+        std::memset(buffer, int(mNext & 0xff), size);
+
+        const std::int64_t presentationTimeUs = mFrameDurationUs * mNext++;
+        return std::make_tuple(true, size, std::uint64_t(presentationTimeUs));
+    }
+
+    std::int64_t synthetic_samples::resync(std::int64_t afterUs)
+    {
+        unsigned int frame = (afterUs < 0) ? 0 : unsigned(afterUs / mFrameDurationUs) + 1;
+        frame = (frame + mGopLength - 1) / mGopLength * mGopLength;
+
+        mNext = std::min(frame, mFrameCount);
+        return (frame < mFrameCount) ? mFrameDurationUs * frame : -1;
+    }
+
+    bool synthetic_samples::isSync(std::int64_t presentationTimeUs) const
+    {
+        return 0 == (presentationTimeUs / mFrameDurationUs) % mGopLength;
+    }
+}
@@ -0,0 +1,184 @@
+//
+// A stand-in decoder that fails on chosen samples, to exercise the decoder's error
+// recovery on a host.
+//
+
+#ifndef MEDIATEST_HOST_FAULT_CODEC_H
+#define MEDIATEST_HOST_FAULT_CODEC_H
+
+#include "stand_in_media.hpp"
+
+#include "handles.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace stand_in {
+
+    // MediaCodec.CodecException action codes, as AMediaCodec_isTransient/isRecoverable see them.
+    enum class fault_kind
+    {
+        transient   = 1,
+        recoverable = 2,
+        fatal       = 0,
+    };
+
+    const char* toString(fault_kind kind);
+
+    struct fault
+    {
+        std::int64_t    presentationTimeUs  = 0;    // the sample whose decode fails
+        fault_kind      kind                = fault_kind::fatal;
+        media_status_t  error               = AMEDIA_ERROR_MALFORMED;
+    };
+
+    // The faults still to fire. Shared by every fault_codec a run creates, so a codec the
+    // decoder recreates doesn't fail on the same sample again.
+    class fault_plan
+    {
+    public:
+        explicit fault_plan(std::vector<fault> faults) : mFaults(std::move(faults)) { }
+
+        // Removes and returns the fault for this sample, if there is one.
+        bool        take(std::int64_t presentationTimeUs, fault& result);
+
+        // Faults not yet fired, e.g. because recovery skipped their samples.
+        std::size_t remaining();
+
+        // Releases of output buffers the codec didn't hold at the time, e.g. a buffer from
+        // before a flush released after it. A device codec may take the index for one of
+        // its current buffers.
+        void        noteStaleRelease();
+        std::size_t staleReleases();
+
+    private:
+        std::mutex          mMutex;
+        std::vector<fault>  mFaults;
+        std::size_t         mStaleReleases  = 0;
+    };
+
+    // Decodes from a thread of its own. As on a device, the output format is reported on
+    // the first start after each configure, and not again when a flushed codec is started.
+    // Each queued sample becomes an output with the same pts after decodeDelay further
+    // samples and decodeTime, and its input buffer is available again once it has been
+    // decoded. A sample in the fault plan fails instead, after which the codec produces
+    // nothing until it is flushed, stopped or deleted. Configured with a window, rendered
+    // outputs go to it. Releasing an output buffer the client doesn't hold, including one
+    // handed out before the last flush or stop, fails and is noted in the plan.
+    //
+    // With async callbacks set, buffers, the format and errors are reported through them,
+    // and a flushed codec waits to be started again. Otherwise the client dequeues: the
+    // format comes as AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED, a fault as the error from
+    // either dequeue, and a flushed codec carries on, as in synchronous mode on a device.
+    class fault_codec : public codec_behaviour
+    {
+    public:
+        struct config
+        {
+            std::int32_t                width           = 1920;
+            std::int32_t                height          = 1080;
+            std::size_t                 inputBuffers    = 4;
+            std::size_t                 outputBuffers   = 4;
+            std::size_t                 decodeDelay     = 2;
+            std::chrono::microseconds   decodeTime      = std::chrono::microseconds(2000);
+        };
+
+        fault_codec(std::shared_ptr<fault_plan> plan, const config& cfg);
+        ~fault_codec() override;
+
+        media_status_t  configure(const AMediaFormat* format, ANativeWindow* window, uint32_t flags) override;
+        media_status_t  setAsyncNotifyCallback(AMediaCodec* codec,
+                                               AMediaCodecOnAsyncNotifyCallback callbacks,
+                                               void* userData) override;
+        media_status_t  start() override;
+        media_status_t  stop() override;
+        media_status_t  flush() override;
+
+        uint8_t*        getInputBuffer(size_t index, size_t* capacity) override;
+        uint8_t*        getOutputBuffer(size_t index, size_t* capacity) override;
+        ssize_t         dequeueInputBuffer(int64_t timeoutUs) override;
+        ssize_t         dequeueOutputBuffer(AMediaCodecBufferInfo* info, int64_t timeoutUs) override;
+        media_status_t  queueInputBuffer(size_t index, off_t offset, size_t size, uint64_t presentationTimeUs, uint32_t flags) override;
+        media_status_t  releaseOutputBuffer(size_t index, bool render) override;
+        AMediaFormat*   getOutputFormat() override;
+
+    private:
+        struct queued_sample
+        {
+            int32_t         index               = 0;
+            std::int64_t    presentationTimeUs  = 0;
+            uint32_t        flags               = 0;
+        };
+
+        struct ready_output
+        {
+            int32_t                 index   = 0;
+            AMediaCodecBufferInfo   info    = {};
+        };
+
+        bool    isAsync() const { return nullptr != mCallbacks.onAsyncInputAvailable; }
+
+        // Waits on mCondition as dequeue*Buffer(timeoutUs) does; false on timing out.
+        template <typename Predicate>
+        bool    waitFor(std::unique_lock<std::mutex>& lock, int64_t timeoutUs, Predicate ready);
+
+        void    decodeThread();
+
+    private:
+        const std::shared_ptr<fault_plan>   mPlan;
+        const config                        mConfig;
+
+        AMediaCodec*                        mCodec              = nullptr;
+        AMediaCodecOnAsyncNotifyCallback    mCallbacks          = {};
+        void*                               mUserData           = nullptr;
+        ANativeWindow*                      mWindow             = nullptr;
+        sample::unique_media_format         mOutputFormat;
+        sample::unique_media_format         mReportedFormat;    // outlives the callback, as the framework's does
+
+        std::vector<std::vector<uint8_t>>   mInputBuffers;
+        std::vector<std::vector<uint8_t>>   mOutputBuffers;
+        std::vector<std::int64_t>           mOutputTimes;       // pts held by each output buffer
+        std::vector<std::uint8_t>           mClientOutputs;     // output buffers the client holds
+
+        std::mutex                          mMutex;
+        std::condition_variable             mCondition;
+        std::deque<int32_t>                 mInputsToOffer;
+        std::deque<queued_sample>           mQueuedSamples;
+        std::deque<int32_t>                 mFreeOutputs;
+        std::deque<ready_output>            mReadyOutputs;      // decoded, not yet dequeued
+        bool                                mFormatPending      = false;    // configured, format not yet reported
+        bool                                mFailed             = false;
+        media_status_t                      mError              = AMEDIA_OK;    // of the fault that failed it
+        bool                                mStopping           = false;
+        std::thread                         mDecodeThread;
+    };
+
+    // A synthetic elementary stream for the decoder's readSampleData, with a sync sample
+    // every gopLength frames, and the matching resync for decoder_options::resync.
+    class synthetic_samples
+    {
+    public:
+        synthetic_samples(unsigned int frameCount, unsigned int gopLength, std::int64_t frameDurationUs);
+
+        std::tuple<bool, std::size_t, std::uint64_t>    operator()(void* buffer, std::size_t capacity);
+
+        std::int64_t    resync(std::int64_t afterUs);
+
+        bool            isSync(std::int64_t presentationTimeUs) const;
+
+    private:
+        const unsigned int  mFrameCount;
+        const unsigned int  mGopLength;
+        const std::int64_t  mFrameDurationUs;
+        unsigned int        mNext   = 0;
+    };
+}
+
+#endif //MEDIATEST_HOST_FAULT_CODEC_H
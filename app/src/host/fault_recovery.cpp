@@ -0,0 +1,340 @@
+//
+// Decodes a synthetic stream through sample::decoder with a stand-in codec that fails on
+// chosen samples, checks that the decoder recovers in place and loses only the frames up
+// to the next sync sample, that frames after a codec restart carry the layout the new
+// codec reported, that no output buffer from before a flush or stop is released to the
+// codec after it, and reports how long each recovery took. Exits non-zero if a check
+// fails.
+//
+//   fault_recovery [--frames <n>] [--gop <frames>] [--decode-us <us>] [--fault <frame>:<kind>]... [--verbose]
+//
+// <kind> is transient, recoverable or fatal; without --fault, one of each is injected.
+//
+
+#include "fault_codec.hpp"
+
+#include "StopWatch.hpp"
+#include "sample_app.hpp"
+
+#include <boost/exception/diagnostic_information.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+    const std::int64_t  kFrameDurationUs    = 33333;
+    const double        kTimeoutSeconds     = 60.0;
+
+    // Awaits frames with their buffers, and holds on to each until the next arrives, as
+    // a consumer working on one frame while the next decodes would: a recovery in
+    // between leaves it holding a buffer from the failed session.
+    sample::task consumeFrames(sample::decoder& decoder,
+                               const stand_in::fault_codec::config& codecConfig,
+                               std::vector<std::int64_t>& delivered,
+                               unsigned int& badLayouts)
+    {
+        sample::decoded_frame previous;
+        for (;;)
+        {
+            sample::decoded_frame frame = co_await decoder.next_frame();
+            if (frame.isEndOfStream())
+            {
+                break;
+            }
+            delivered.push_back(frame.presentationTimeUs);
+
+            // a codec restarted or recreated by recovery reports its format afresh, and a
+            // frame from it must carry that, not the failed codec's or none
+            const sample::buffer_layout& layout = frame.buffer.layout();
+            if (!frame.buffer.data() ||
+                layout.width != codecConfig.width || layout.height != codecConfig.height || layout.stride < layout.width)
+            {
+                if (badLayouts++ == 0)
+                {
+                    std::printf("FAIL: frame at pts %" PRId64 " has layout %dx%d stride %d\n",
+                                frame.presentationTimeUs,
+                                layout.width,
+                                layout.height,
+                                layout.stride);
+                }
+            }
+            previous = std::move(frame);
+        }
+    }
+
+    bool parseFault(const char* text, stand_in::fault& result)
+    {
+        const char* const colon = std::strchr(text, ':');
+        if (!colon)
+        {
+            return false;
+        }
+
+        result.presentationTimeUs = kFrameDurationUs * std::strtoll(text, nullptr, 10);
+        const char* const kind = colon + 1;
+        if (0 == std::strcmp(kind, "transient"))            result.kind = stand_in::fault_kind::transient;
+        else if (0 == std::strcmp(kind, "recoverable"))     result.kind = stand_in::fault_kind::recoverable;
+        else if (0 == std::strcmp(kind, "fatal"))           result.kind = stand_in::fault_kind::fatal;
+        else                                                return false;
+        return true;
+    }
+
+    // Decodes the stream once with the given faults, printing what each recovery cost.
+    // Returns whether every check passed.
+    bool runFaults(bool polling,
+                   unsigned int frameCount,
+                   unsigned int gopLength,
+                   const stand_in::fault_codec::config& codecConfig,
+                   const std::vector<stand_in::fault>& faults)
+    {
+        bool passed = true;
+
+        const auto plan = std::make_shared<stand_in::fault_plan>(faults);
+        stand_in::setCodecFactory([plan, codecConfig](const char*, bool isEncoder) {
+            return isEncoder ? nullptr
+                             : std::unique_ptr<stand_in::codec_behaviour>(new stand_in::fault_codec(plan, codecConfig));
+        });
+
+        stand_in::synthetic_samples samples(frameCount, gopLength, kFrameDurationUs);
+        std::vector<sample::recovery_event> recoveries;
+
+        sample::decoder_options options;
+        options.resync = [&samples](std::int64_t afterUs) { return samples.resync(afterUs); };
+        options.onRecovery = [&recoveries](const sample::recovery_event& event) { recoveries.push_back(event); };
+
+        const sample::unique_media_format format(AMediaFormat_new());
+        AMediaFormat_setString(format.get(), AMEDIAFORMAT_KEY_MIME, "video/avc");
+        AMediaFormat_setInt32(format.get(), AMEDIAFORMAT_KEY_WIDTH, codecConfig.width);
+        AMediaFormat_setInt32(format.get(), AMEDIAFORMAT_KEY_HEIGHT, codecConfig.height);
+
+        unsigned int badLayouts = 0;
+        std::vector<std::int64_t> delivered;
+        const StopWatch decodeTimer;
+
+        sample::decoder decoder = polling
+                ? sample::decoder(format.get(), std::ref(samples), sample::frame_output(), sample::polling_driver(), options)
+                : sample::decoder(format.get(), std::ref(samples), sample::frame_output(), sample::async_driver(), options);
+        const auto consumer = consumeFrames(decoder, codecConfig, delivered, badLayouts);
+        decoder.start();
+        while (!decoder.isDone() || !consumer.done())
+        {
+            if (decodeTimer.getSplitTime().count() > kTimeoutSeconds)
+            {
+                // the decoder's threads are stuck; there is no clean way out
+                std::fprintf(stderr, "FAIL: decode did not finish within %.0fs (%zu frames)\n",
+                             kTimeoutSeconds,
+                             delivered.size());
+                std::fflush(stderr);
+                std::_Exit(EXIT_FAILURE);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        consumer.get();
+        const double decodeSeconds = decodeTimer.getSplitTime().count();
+
+        // every frame outside the reported gaps must have been delivered, in order
+        std::set<std::int64_t> expected;
+        for (unsigned int f = 0; f < frameCount; ++f)
+        {
+            const std::int64_t pts = kFrameDurationUs * f;
+            const bool lost = std::any_of(recoveries.begin(), recoveries.end(), [pts](const sample::recovery_event& r) {
+                return pts > r.lastDeliveredUs && (r.resumedAtUs < 0 || pts < r.resumedAtUs);
+            });
+            if (!lost)
+            {
+                expected.insert(pts);
+            }
+        }
+
+        if (!std::is_sorted(delivered.begin(), delivered.end()) ||
+            std::set<std::int64_t>(delivered.begin(), delivered.end()) != expected ||
+            delivered.size() != expected.size())
+        {
+            std::printf("FAIL: delivered %zu frames, expected %zu outside the skipped ranges\n",
+                        delivered.size(),
+                        expected.size());
+            passed = false;
+        }
+
+        if (badLayouts > 0)
+        {
+            std::printf("FAIL: %u frames with the wrong layout\n", badLayouts);
+            passed = false;
+        }
+
+        // a fault in a stretch that an earlier recovery skipped never fires
+        const std::size_t firedFaults = faults.size() - plan->remaining();
+        if (recoveries.size() != firedFaults)
+        {
+            std::printf("FAIL: %zu recoveries for %zu faults\n", recoveries.size(), firedFaults);
+            passed = false;
+        }
+
+        if (const std::size_t stale = plan->staleReleases())
+        {
+            std::printf("FAIL: %zu output buffers released to a codec session that didn't hand them out\n", stale);
+            passed = false;
+        }
+
+        double totalMs = 0.0;
+        double maxMs = 0.0;
+        std::size_t restarts = 0;
+        for (const auto& r : recoveries)
+        {
+            const std::int64_t resumedAtUs = (r.resumedAtUs < 0) ? kFrameDurationUs * frameCount : r.resumedAtUs;
+            const std::int64_t lostFrames = (resumedAtUs - 1) / kFrameDurationUs
+                                            - (r.lastDeliveredUs < 0 ? -1 : r.lastDeliveredUs / kFrameDurationUs);
+            if (r.action == sample::recovery_action::end_of_stream)
+            {
+                std::printf("error %d action code %d: no sync sample left, stream ended after pts %" PRId64 ", %" PRId64 " frames lost\n",
+                            r.error,
+                            r.actionCode,
+                            r.lastDeliveredUs,
+                            lostFrames);
+                continue;
+            }
+
+            const double ms = 1.0e3 * r.recoveryTime.count();
+            totalMs += ms;
+            maxMs = std::max(maxMs, ms);
+            ++restarts;
+            std::printf("error %d action code %d -> %s: skipped pts (%" PRId64 ", %" PRId64 "), %" PRId64 " frames, recovered in %.3f ms\n",
+                        r.error,
+                        r.actionCode,
+                        sample::toString(r.action),
+                        r.lastDeliveredUs,
+                        r.resumedAtUs,
+                        lostFrames,
+                        ms);
+
+            if (r.resumedAtUs >= 0 && !samples.isSync(r.resumedAtUs))
+            {
+                std::printf("FAIL: resumed at %" PRId64 ", which is not a sync sample\n", r.resumedAtUs);
+                passed = false;
+            }
+        }
+
+        const sample::recovery_statistics stats = decoder.getRecoveryStatistics();
+        std::printf("%zu/%u frames in %.3fs; %u errors, %u recoveries (%u codecs recreated), %u streams ended, recovery ms mean %.3f max %.3f\n",
+                    delivered.size(),
+                    frameCount,
+                    decodeSeconds,
+                    stats.errors,
+                    stats.recoveries,
+                    stats.codecsRecreated,
+                    stats.streamsEnded,
+                    totalMs / std::max<std::size_t>(restarts, 1),
+                    maxMs);
+        return passed;
+    }
+
+    int usage(const char* argv0)
+    {
+        std::fprintf(stderr,
+                     "usage: %s [--frames <n>] [--gop <frames>] [--decode-us <us>] [--fault <frame>:<kind>]... [--verbose]\n",
+                     argv0);
+        return EXIT_FAILURE;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int frameCount = 900;
+    unsigned int gopLength = 30;
+    stand_in::fault_codec::config codecConfig;
+    std::vector<stand_in::fault> faults;
+    bool drivers[2] = { true, true };   // async, polling
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == std::strcmp(argv[i], "--frames") && i + 1 < argc)
+        {
+            frameCount = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (0 == std::strcmp(argv[i], "--gop") && i + 1 < argc)
+        {
+            gopLength = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (0 == std::strcmp(argv[i], "--decode-us") && i + 1 < argc)
+        {
+            codecConfig.decodeTime = std::chrono::microseconds(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (0 == std::strcmp(argv[i], "--fault") && i + 1 < argc)
+        {
+            stand_in::fault f;
+            if (!parseFault(argv[++i], f))
+            {
+                return usage(argv[0]);
+            }
+            faults.push_back(f);
+        }
+        else if (0 == std::strcmp(argv[i], "--driver") && i + 1 < argc)
+        {
+            const bool polling = (0 == std::strcmp(argv[++i], "polling"));
+            if (!polling && 0 != std::strcmp(argv[i], "async"))
+            {
+                return usage(argv[0]);
+            }
+            drivers[!polling] = false;
+        }
+        else if (0 == std::strcmp(argv[i], "--verbose"))
+        {
+            stand_in::setLogPriority(ANDROID_LOG_VERBOSE);
+        }
+        else
+        {
+            return usage(argv[0]);
+        }
+    }
+
+    if (faults.empty())
+    {
+        // mid-GOP, so each one costs frames
+        const stand_in::fault_kind kinds[] = { stand_in::fault_kind::transient,
+                                               stand_in::fault_kind::recoverable,
+                                               stand_in::fault_kind::fatal };
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            stand_in::fault f;
+            f.presentationTimeUs = kFrameDurationUs * (frameCount * (k + 1) / 4 + gopLength / 2);
+            f.kind = kinds[k];
+            faults.push_back(f);
+        }
+
+        // no sync sample after it: the stream ends there
+        stand_in::fault last;
+        last.presentationTimeUs = kFrameDurationUs * (frameCount - std::min(frameCount, gopLength / 2 + 1));
+        last.kind = stand_in::fault_kind::transient;
+        faults.push_back(last);
+    }
+
+    bool passed = true;
+    try
+    {
+        for (const bool polling : { false, true })
+        {
+            if (drivers[polling])
+            {
+                std::printf("%s driver\n", polling ? "polling" : "async");
+                passed = runFaults(polling, frameCount, gopLength, codecConfig, faults) && passed;
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", boost::diagnostic_information(e).c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
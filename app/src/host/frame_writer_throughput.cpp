@@ -0,0 +1,140 @@
+//
+// Drives frame_writer with synthetic 4K NV12 frames, the layout hardware decoders hand out
+// in ByteBuffer mode, and reports sustained throughput and how long write() held up the
+// caller.
+//
+//   frame_writer_throughput <path> [--frames <n>] [--fps <rate>] [--format y4m|i420|nv12] [--direct]
+//
+// --fps paces the frames like a decode loop would; 0 (the default) writes flat out.
+//
+
+#include "frame_writer.hpp"
+
+#include "StopWatch.hpp"
+
+#include <boost/exception/diagnostic_information.hpp>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+    const std::int32_t kWidth   = 3840;
+    const std::int32_t kHeight  = 2160;
+    const std::int32_t kStride  = 4096;     // padded, as hardware decoders do
+
+    int usage(const char* argv0)
+    {
+        std::fprintf(stderr,
+                     "usage: %s <path> [--frames <n>] [--fps <rate>] [--format y4m|i420|nv12] [--direct]\n",
+                     argv0);
+        return EXIT_FAILURE;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* path = nullptr;
+    unsigned int frameCount = 240;
+    unsigned int frameRate = 0;
+    sample::frame_writer::config config;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == std::strcmp(argv[i], "--frames") && i + 1 < argc)
+        {
+            frameCount = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (0 == std::strcmp(argv[i], "--fps") && i + 1 < argc)
+        {
+            frameRate = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (0 == std::strcmp(argv[i], "--format") && i + 1 < argc)
+        {
+            const char* const name = argv[++i];
+            if (0 == std::strcmp(name, "y4m"))          config.format = sample::frame_file_format::y4m;
+            else if (0 == std::strcmp(name, "i420"))    config.format = sample::frame_file_format::i420;
+            else if (0 == std::strcmp(name, "nv12"))    config.format = sample::frame_file_format::nv12;
+            else                                        return usage(argv[0]);
+        }
+        else if (0 == std::strcmp(argv[i], "--direct"))
+        {
+            config.directIO = true;
+        }
+        else if (argv[i][0] != '-' && !path)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            return usage(argv[0]);
+        }
+    }
+    if (!path)
+    {
+        return usage(argv[0]);
+    }
+
+    try
+    {
+        // one NV12 picture with a moving gradient, so successive frames differ
+        std::vector<std::uint8_t> picture(std::size_t(kStride) * kHeight * 3 / 2);
+        for (std::size_t i = 0; i < picture.size(); ++i)
+        {
+            picture[i] = std::uint8_t(i * 7);
+        }
+
+        sample::yuv420_frame frame;
+        frame.width = kWidth;
+        frame.height = kHeight;
+        frame.planes[0] = { picture.data(), kStride, 1 };
+        frame.planes[1] = { picture.data() + std::size_t(kStride) * kHeight, kStride, 2 };
+        frame.planes[2] = { picture.data() + std::size_t(kStride) * kHeight + 1, kStride, 2 };
+
+        config.frameRateNum = frameRate ? frameRate : 60;
+        sample::frame_writer writer(path, kWidth, kHeight, config);
+
+        const auto frameInterval = frameRate ? std::chrono::nanoseconds(1000000000 / frameRate)
+                                             : std::chrono::nanoseconds(0);
+        const auto start = std::chrono::steady_clock::now();
+        const StopWatch timer;
+        for (unsigned int f = 0; f < frameCount; ++f)
+        {
+            if (frameRate)
+            {
+                std::this_thread::sleep_until(start + f * frameInterval);
+            }
+            writer.write(frame);
+        }
+        writer.close();
+        const double seconds = timer.getSplitTime().count();
+
+        const auto stats = writer.getStatistics();
+        std::printf("%" PRIu64 " frames %dx%d in %.3fs: %.1f fps, %.1f MB/s (pwritev %.1f MB/s, %" PRIu64 " calls)\n",
+                    stats.frames,
+                    kWidth,
+                    kHeight,
+                    seconds,
+                    stats.frames / seconds,
+                    1.0e-6 * stats.bytesWritten / seconds,
+                    1.0e-6 * stats.bytesWritten / std::max(stats.ioTime.count(), 1.0e-9),
+                    stats.writeCalls);
+        std::printf("write(): mean %.3f ms, max %.3f ms; stalls %" PRIu64 " totalling %.3f ms%s\n",
+                    1.0e3 * stats.frameTime.count() / std::max<std::uint64_t>(stats.frames, 1),
+                    1.0e3 * stats.maxFrameTime.count(),
+                    stats.stalls,
+                    1.0e3 * stats.stallTime.count(),
+                    config.directIO ? " (O_DIRECT requested)" : "");
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", boost::diagnostic_information(e).c_str());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
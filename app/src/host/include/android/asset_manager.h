@@ -0,0 +1,34 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_ANDROID_ASSET_MANAGER_H
+#define MEDIATEST_HOST_ANDROID_ASSET_MANAGER_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AAssetManager AAssetManager;
+typedef struct AAsset AAsset;
+
+enum {
+    AASSET_MODE_UNKNOWN     = 0,
+    AASSET_MODE_RANDOM      = 1,
+    AASSET_MODE_STREAMING   = 2,
+    AASSET_MODE_BUFFER      = 3
+};
+
+AAsset* AAssetManager_open(AAssetManager* mgr, const char* filename, int mode);
+int     AAsset_read(AAsset* asset, void* buf, size_t count);
+off_t   AAsset_seek(AAsset* asset, off_t offset, int whence);
+void    AAsset_close(AAsset* asset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,20 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_ANDROID_HARDWARE_BUFFER_H
+#define MEDIATEST_HOST_ANDROID_HARDWARE_BUFFER_H
+
+#include <stdint.h>
+
+enum {
+    AHARDWAREBUFFER_USAGE_CPU_READ_NEVER    = 0UL,
+    AHARDWAREBUFFER_USAGE_CPU_READ_RARELY   = 2UL,
+    AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN    = 3UL,
+    AHARDWAREBUFFER_USAGE_CPU_WRITE_NEVER   = 0UL << 4,
+    AHARDWAREBUFFER_USAGE_CPU_WRITE_RARELY  = 2UL << 4,
+    AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN   = 3UL << 4,
+};
+
+#endif
@@ -0,0 +1,22 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_ANDROID_NATIVE_WINDOW_H
+#define MEDIATEST_HOST_ANDROID_NATIVE_WINDOW_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ANativeWindow ANativeWindow;
+
+void    ANativeWindow_acquire(ANativeWindow* window);
+void    ANativeWindow_release(ANativeWindow* window);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_NDK_IMAGE_READER_H
+#define MEDIATEST_HOST_NDK_IMAGE_READER_H
+
+#include "NdkImage.h"
+
+#include <android/native_window.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AImageReader AImageReader;
+
+typedef void (*AImageReader_ImageCallback)(void* context, AImageReader* reader);
+
+typedef struct AImageReader_ImageListener {
+    void*                       context;
+    AImageReader_ImageCallback  onImageAvailable;
+} AImageReader_ImageListener;
+
+media_status_t  AImageReader_newWithUsage(int32_t width, int32_t height, int32_t format, uint64_t usage, int32_t maxImages, AImageReader** reader);
+void            AImageReader_delete(AImageReader* reader);
+media_status_t  AImageReader_getWindow(AImageReader* reader, ANativeWindow** window);
+media_status_t  AImageReader_acquireNextImage(AImageReader* reader, AImage** image);
+media_status_t  AImageReader_setImageListener(AImageReader* reader, AImageReader_ImageListener* listener);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,81 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_NDK_MEDIA_CODEC_H
+#define MEDIATEST_HOST_NDK_MEDIA_CODEC_H
+
+#include "NdkMediaCrypto.h"
+#include "NdkMediaError.h"
+#include "NdkMediaFormat.h"
+
+#include <android/native_window.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AMediaCodec AMediaCodec;
+
+typedef struct AMediaCodecBufferInfo {
+    int32_t     offset;
+    int32_t     size;
+    int64_t     presentationTimeUs;
+    uint32_t    flags;
+} AMediaCodecBufferInfo;
+
+enum {
+    AMEDIACODEC_BUFFER_FLAG_CODEC_CONFIG    = 2,
+    AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM   = 4,
+    AMEDIACODEC_BUFFER_FLAG_PARTIAL_FRAME   = 8,
+
+    AMEDIACODEC_CONFIGURE_FLAG_ENCODE       = 1,
+
+    AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED = -3,
+    AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED  = -2,
+    AMEDIACODEC_INFO_TRY_AGAIN_LATER        = -1,
+};
+
+typedef void (*AMediaCodecOnAsyncInputAvailable)(AMediaCodec* codec, void* userdata, int32_t index);
+typedef void (*AMediaCodecOnAsyncOutputAvailable)(AMediaCodec* codec, void* userdata, int32_t index, AMediaCodecBufferInfo* bufferInfo);
+typedef void (*AMediaCodecOnAsyncFormatChanged)(AMediaCodec* codec, void* userdata, AMediaFormat* format);
+typedef void (*AMediaCodecOnAsyncError)(AMediaCodec* codec, void* userdata, media_status_t error, int32_t actionCode, const char* detail);
+
+typedef struct AMediaCodecOnAsyncNotifyCallback {
+    AMediaCodecOnAsyncInputAvailable    onAsyncInputAvailable;
+    AMediaCodecOnAsyncOutputAvailable   onAsyncOutputAvailable;
+    AMediaCodecOnAsyncFormatChanged     onAsyncFormatChanged;
+    AMediaCodecOnAsyncError             onAsyncError;
+} AMediaCodecOnAsyncNotifyCallback;
+
+AMediaCodec*    AMediaCodec_createDecoderByType(const char* mime_type);
+AMediaCodec*    AMediaCodec_createEncoderByType(const char* mime_type);
+media_status_t  AMediaCodec_delete(AMediaCodec* codec);
+
+media_status_t  AMediaCodec_configure(AMediaCodec* codec, const AMediaFormat* format, ANativeWindow* surface, AMediaCrypto* crypto, uint32_t flags);
+media_status_t  AMediaCodec_setAsyncNotifyCallback(AMediaCodec* codec, AMediaCodecOnAsyncNotifyCallback callback, void* userdata);
+media_status_t  AMediaCodec_start(AMediaCodec* codec);
+media_status_t  AMediaCodec_stop(AMediaCodec* codec);
+media_status_t  AMediaCodec_flush(AMediaCodec* codec);
+
+uint8_t*        AMediaCodec_getInputBuffer(AMediaCodec* codec, size_t idx, size_t* out_size);
+uint8_t*        AMediaCodec_getOutputBuffer(AMediaCodec* codec, size_t idx, size_t* out_size);
+ssize_t         AMediaCodec_dequeueInputBuffer(AMediaCodec* codec, int64_t timeoutUs);
+ssize_t         AMediaCodec_dequeueOutputBuffer(AMediaCodec* codec, AMediaCodecBufferInfo* info, int64_t timeoutUs);
+media_status_t  AMediaCodec_queueInputBuffer(AMediaCodec* codec, size_t idx, off_t offset, size_t size, uint64_t time, uint32_t flags);
+media_status_t  AMediaCodec_releaseOutputBuffer(AMediaCodec* codec, size_t idx, bool render);
+AMediaFormat*   AMediaCodec_getOutputFormat(AMediaCodec* codec);
+AMediaFormat*   AMediaCodec_getInputFormat(AMediaCodec* codec);
+
+media_status_t  AMediaCodec_createInputSurface(AMediaCodec* codec, ANativeWindow** surface);
+media_status_t  AMediaCodec_signalEndOfInputStream(AMediaCodec* codec);
+
+bool            AMediaCodec_isTransient(int32_t actionCode);
+bool            AMediaCodec_isRecoverable(int32_t actionCode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
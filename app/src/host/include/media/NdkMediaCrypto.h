@@ -0,0 +1,11 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_NDK_MEDIA_CRYPTO_H
+#define MEDIATEST_HOST_NDK_MEDIA_CRYPTO_H
+
+typedef struct AMediaCrypto AMediaCrypto;
+
+#endif
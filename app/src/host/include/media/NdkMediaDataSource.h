@@ -0,0 +1,32 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_NDK_MEDIA_DATA_SOURCE_H
+#define MEDIATEST_HOST_NDK_MEDIA_DATA_SOURCE_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AMediaDataSource AMediaDataSource;
+
+typedef ssize_t (*AMediaDataSourceReadAt)(void* userdata, off64_t offset, void* buffer, size_t size);
+typedef ssize_t (*AMediaDataSourceGetSize)(void* userdata);
+typedef void (*AMediaDataSourceClose)(void* userdata);
+
+AMediaDataSource*   AMediaDataSource_new();
+void                AMediaDataSource_delete(AMediaDataSource* source);
+void                AMediaDataSource_setUserdata(AMediaDataSource* source, void* userdata);
+void                AMediaDataSource_setReadAt(AMediaDataSource* source, AMediaDataSourceReadAt readAt);
+void                AMediaDataSource_setGetSize(AMediaDataSource* source, AMediaDataSourceGetSize getSize);
+void                AMediaDataSource_setClose(AMediaDataSource* source, AMediaDataSourceClose close);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,34 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_NDK_MEDIA_ERROR_H
+#define MEDIATEST_HOST_NDK_MEDIA_ERROR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef enum {
+    AMEDIA_OK = 0,
+
+    AMEDIACODEC_ERROR_INSUFFICIENT_RESOURCE = 1100,
+    AMEDIACODEC_ERROR_RECLAIMED             = 1101,
+
+    AMEDIA_ERROR_BASE                   = -10000,
+    AMEDIA_ERROR_UNKNOWN                = AMEDIA_ERROR_BASE,
+    AMEDIA_ERROR_MALFORMED              = AMEDIA_ERROR_BASE - 1,
+    AMEDIA_ERROR_UNSUPPORTED            = AMEDIA_ERROR_BASE - 2,
+    AMEDIA_ERROR_INVALID_OBJECT         = AMEDIA_ERROR_BASE - 3,
+    AMEDIA_ERROR_INVALID_PARAMETER      = AMEDIA_ERROR_BASE - 4,
+    AMEDIA_ERROR_INVALID_OPERATION      = AMEDIA_ERROR_BASE - 5,
+    AMEDIA_ERROR_END_OF_STREAM          = AMEDIA_ERROR_BASE - 6,
+    AMEDIA_ERROR_IO                     = AMEDIA_ERROR_BASE - 7,
+    AMEDIA_ERROR_WOULD_BLOCK            = AMEDIA_ERROR_BASE - 8,
+
+    AMEDIA_IMGREADER_ERROR_BASE             = -30000,
+    AMEDIA_IMGREADER_NO_BUFFER_AVAILABLE    = AMEDIA_IMGREADER_ERROR_BASE - 1,
+    AMEDIA_IMGREADER_MAX_IMAGES_ACQUIRED    = AMEDIA_IMGREADER_ERROR_BASE - 2,
+} media_status_t;
+
+#endif
@@ -0,0 +1,48 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_NDK_MEDIA_EXTRACTOR_H
+#define MEDIATEST_HOST_NDK_MEDIA_EXTRACTOR_H
+
+#include "NdkMediaDataSource.h"
+#include "NdkMediaError.h"
+#include "NdkMediaFormat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AMediaExtractor AMediaExtractor;
+
+enum {
+    AMEDIAEXTRACTOR_SAMPLE_FLAG_SYNC        = 1,
+    AMEDIAEXTRACTOR_SAMPLE_FLAG_ENCRYPTED   = 2,
+};
+
+typedef enum {
+    AMEDIAEXTRACTOR_SEEK_PREVIOUS_SYNC,
+    AMEDIAEXTRACTOR_SEEK_NEXT_SYNC,
+    AMEDIAEXTRACTOR_SEEK_CLOSEST_SYNC
+} SeekMode;
+
+AMediaExtractor*    AMediaExtractor_new();
+media_status_t      AMediaExtractor_delete(AMediaExtractor* extractor);
+media_status_t      AMediaExtractor_setDataSourceFd(AMediaExtractor* extractor, int fd, off64_t offset, off64_t length);
+media_status_t      AMediaExtractor_setDataSourceCustom(AMediaExtractor* extractor, AMediaDataSource* src);
+size_t              AMediaExtractor_getTrackCount(AMediaExtractor* extractor);
+AMediaFormat*       AMediaExtractor_getTrackFormat(AMediaExtractor* extractor, size_t idx);
+media_status_t      AMediaExtractor_selectTrack(AMediaExtractor* extractor, size_t idx);
+ssize_t             AMediaExtractor_readSampleData(AMediaExtractor* extractor, uint8_t* buffer, size_t capacity);
+uint32_t            AMediaExtractor_getSampleFlags(AMediaExtractor* extractor);
+int64_t             AMediaExtractor_getSampleTime(AMediaExtractor* extractor);
+ssize_t             AMediaExtractor_getSampleSize(AMediaExtractor* extractor);
+bool                AMediaExtractor_advance(AMediaExtractor* extractor);
+media_status_t      AMediaExtractor_seekTo(AMediaExtractor* extractor, int64_t seekPosUs, SeekMode mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
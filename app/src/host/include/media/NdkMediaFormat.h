@@ -0,0 +1,54 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_NDK_MEDIA_FORMAT_H
+#define MEDIATEST_HOST_NDK_MEDIA_FORMAT_H
+
+#include "NdkMediaError.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AMediaFormat AMediaFormat;
+
+AMediaFormat*   AMediaFormat_new();
+media_status_t  AMediaFormat_delete(AMediaFormat* format);
+const char*     AMediaFormat_toString(AMediaFormat* format);
+
+bool    AMediaFormat_getInt32(AMediaFormat* format, const char* name, int32_t* out);
+bool    AMediaFormat_getInt64(AMediaFormat* format, const char* name, int64_t* out);
+bool    AMediaFormat_getString(AMediaFormat* format, const char* name, const char** out);
+bool    AMediaFormat_getBuffer(AMediaFormat* format, const char* name, void** data, size_t* size);
+
+void    AMediaFormat_setInt32(AMediaFormat* format, const char* name, int32_t value);
+void    AMediaFormat_setInt64(AMediaFormat* format, const char* name, int64_t value);
+void    AMediaFormat_setString(AMediaFormat* format, const char* name, const char* value);
+void    AMediaFormat_setBuffer(AMediaFormat* format, const char* name, const void* data, size_t size);
+
+extern const char* AMEDIAFORMAT_KEY_BIT_RATE;
+extern const char* AMEDIAFORMAT_KEY_CHANNEL_COUNT;
+extern const char* AMEDIAFORMAT_KEY_COLOR_FORMAT;
+extern const char* AMEDIAFORMAT_KEY_CSD_0;
+extern const char* AMEDIAFORMAT_KEY_CSD_1;
+extern const char* AMEDIAFORMAT_KEY_DURATION;
+extern const char* AMEDIAFORMAT_KEY_FRAME_RATE;
+extern const char* AMEDIAFORMAT_KEY_HEIGHT;
+extern const char* AMEDIAFORMAT_KEY_I_FRAME_INTERVAL;
+extern const char* AMEDIAFORMAT_KEY_MAX_INPUT_SIZE;
+extern const char* AMEDIAFORMAT_KEY_MIME;
+extern const char* AMEDIAFORMAT_KEY_SAMPLE_RATE;
+extern const char* AMEDIAFORMAT_KEY_SLICE_HEIGHT;
+extern const char* AMEDIAFORMAT_KEY_STRIDE;
+extern const char* AMEDIAFORMAT_KEY_WIDTH;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
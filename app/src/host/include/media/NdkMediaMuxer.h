@@ -0,0 +1,36 @@
+//
+// Host stand-in for the NDK header of the same name. Declares only what the pipeline
+// uses; values match the NDK so recorded timelines mean the same thing on both sides.
+//
+
+#ifndef MEDIATEST_HOST_NDK_MEDIA_MUXER_H
+#define MEDIATEST_HOST_NDK_MEDIA_MUXER_H
+
+#include "NdkMediaCodec.h"
+#include "NdkMediaError.h"
+#include "NdkMediaFormat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AMediaMuxer AMediaMuxer;
+
+typedef enum {
+    AMEDIAMUXER_OUTPUT_FORMAT_MPEG_4        = 0,
+    AMEDIAMUXER_OUTPUT_FORMAT_WEBM          = 1,
+    AMEDIAMUXER_OUTPUT_FORMAT_THREE_GPP     = 2,
+} OutputFormat;
+
+AMediaMuxer*    AMediaMuxer_new(int fd, OutputFormat format);
+media_status_t  AMediaMuxer_delete(AMediaMuxer* muxer);
+ssize_t         AMediaMuxer_addTrack(AMediaMuxer* muxer, const AMediaFormat* format);
+media_status_t  AMediaMuxer_start(AMediaMuxer* muxer);
+media_status_t  AMediaMuxer_stop(AMediaMuxer* muxer);
+media_status_t  AMediaMuxer_writeSampleData(AMediaMuxer* muxer, size_t trackIdx, const uint8_t* data, const AMediaCodecBufferInfo* info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
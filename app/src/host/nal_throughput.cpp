@@ -0,0 +1,212 @@
+//
+// Measures nal_parser classification throughput on a synthetic AVC/HEVC stream, for each
+// sample framing, and checks the classes it reports against the ones generated. The parser
+// reads NAL headers up to the first slice and no further, so the rate is in samples and
+// NAL units classified per second; the bytes in each sample don't enter into it.
+//
+//   nal_throughput [frames]
+//
+
+#include "nal_parser.hpp"
+
+#include "StopWatch.hpp"
+#include "handles.hpp"
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+    using sample::frame_class;
+    using sample::nal_parser;
+
+    struct synthetic_sample
+    {
+        std::vector<std::uint8_t>   data;
+        frame_class                 expected;
+    };
+
+    // NAL header bytes for sync, reference and non-reference slices. With two HEVC
+    // sub-layers, non-reference pictures are TRAIL_N in sub-layer 1, and every other
+    // reference picture is a TRAIL_N in sub-layer 0, which sub-layer 1 predicts from.
+    std::vector<std::uint8_t> sliceHeader(nal_parser::codec codec, frame_class c, bool temporalLayers, unsigned int frame)
+    {
+        if (codec == nal_parser::codec::avc)
+        {
+            switch (c)
+            {
+                case frame_class::sync:         return { 0x65 };        // IDR, nal_ref_idc 3
+                case frame_class::reference:    return { 0x41 };        // non-IDR, nal_ref_idc 2
+                default:                        return { 0x01 };        // non-IDR, nal_ref_idc 0
+            }
+        }
+        switch (c)
+        {
+            case frame_class::sync:             return { 19 << 1, 1 };  // IDR_W_RADL, TemporalId 0
+            case frame_class::reference:        return { std::uint8_t((temporalLayers && frame % 6 == 3) ? 0 : 1 << 1), 1 };
+            default:                            return { 0 << 1, std::uint8_t(temporalLayers ? 2 : 1) };
+        }
+    }
+
+    void appendNal(std::vector<std::uint8_t>& sample,
+                   std::size_t nalLengthSize,
+                   const std::vector<std::uint8_t>& header,
+                   std::size_t payloadSize,
+                   std::mt19937& random)
+    {
+        const std::size_t nalSize = header.size() + payloadSize;
+        if (nalLengthSize == 0)
+        {
+            sample.insert(sample.end(), { 0, 0, 0, 1 });
+        }
+        else
+        {
+            for (std::size_t i = nalLengthSize; i > 0; --i)
+            {
+                sample.push_back(std::uint8_t(nalSize >> (8 * (i - 1))));
+            }
+        }
+        sample.insert(sample.end(), header.begin(), header.end());
+
+        // never zero, so the payload can't contain a start code
+        std::uniform_int_distribution<int> byte(1, 255);
+        for (std::size_t i = 0; i < payloadSize; ++i)
+        {
+            sample.push_back(std::uint8_t(byte(random)));
+        }
+    }
+
+    // IBBPBBP... with a 30-frame GOP. Every sample starts with an SEI, as encoders
+    // commonly emit, so the parser must step over a non-slice unit first.
+    std::vector<synthetic_sample> synthesizeStream(nal_parser::codec codec,
+                                                   std::size_t nalLengthSize,
+                                                   bool temporalLayers,
+                                                   unsigned int frameCount)
+    {
+        const std::vector<std::uint8_t> seiHeader = (codec == nal_parser::codec::avc)
+                ? std::vector<std::uint8_t>{ 0x06 }
+                : std::vector<std::uint8_t>{ 39 << 1, 1 };  // PREFIX_SEI
+
+        std::mt19937 random(1234);
+        std::vector<synthetic_sample> result;
+        result.reserve(frameCount);
+        for (unsigned int i = 0; i < frameCount; ++i)
+        {
+            const frame_class c = (i % 30 == 0) ? frame_class::sync
+                                : (i % 3 == 0)  ? frame_class::reference
+                                                : frame_class::non_reference;
+            const std::size_t payloadSize = (c == frame_class::sync)      ? 200 * 1024
+                                          : (c == frame_class::reference) ? 40 * 1024
+                                                                          : 10 * 1024;
+
+            synthetic_sample sample;
+            sample.expected = c;
+            appendNal(sample.data, nalLengthSize, seiHeader, 64, random);
+            appendNal(sample.data, nalLengthSize, sliceHeader(codec, c, temporalLayers, i), payloadSize, random);
+            result.push_back(std::move(sample));
+        }
+        return result;
+    }
+
+    bool measure(const char* name, nal_parser::codec codec, std::size_t nalLengthSize, bool temporalLayers, unsigned int frameCount)
+    {
+        const auto stream = synthesizeStream(codec, nalLengthSize, temporalLayers, frameCount);
+        const nal_parser parser(codec, nalLengthSize, temporalLayers ? 1 : 0);
+
+        for (const auto& s : stream)
+        {
+            if (parser.classify(s.data.data(), s.data.size()) != s.expected)
+            {
+                std::fprintf(stderr, "%s: misclassified a %s sample\n", name, sample::toString(s.expected));
+                return false;
+            }
+        }
+
+        // repeat until the measurement is long enough to be stable
+        std::array<unsigned int, 4> counts = { 0, 0, 0, 0 };
+        unsigned int passes = 0;
+        const StopWatch timer;
+        do
+        {
+            for (const auto& s : stream)
+            {
+                ++counts[std::size_t(parser.classify(s.data.data(), s.data.size()))];
+            }
+            ++passes;
+        }
+        while (timer.getSplitTime().count() < 1.0);
+        const double seconds = timer.getSplitTime().count();
+
+        // an SEI and then the slice: the parser reads two NAL headers per sample
+        const double samplesPerSecond = double(stream.size()) * passes / seconds;
+        std::printf("%-24s %8.1f Msamples/s %8.1f M NAL units/s %7.1f ns/sample  (sync:%u reference:%u non_reference:%u per pass)\n",
+                    name,
+                    1.0e-6 * samplesPerSecond,
+                    2.0e-6 * samplesPerSecond,
+                    1.0e9 / samplesPerSecond,
+                    counts[std::size_t(frame_class::sync)] / passes,
+                    counts[std::size_t(frame_class::reference)] / passes,
+                    counts[std::size_t(frame_class::non_reference)] / passes);
+        return true;
+    }
+
+    // fromFormat must find the stream's highest sub-layer in either form of csd-0, and
+    // reject a truncated record.
+    bool checkFromFormat()
+    {
+        const sample::unique_media_format format(AMediaFormat_new());
+        AMediaFormat_setString(format.get(), AMEDIAFORMAT_KEY_MIME, "video/hevc");
+
+        // hvcC: numTemporalLayers 2, lengthSizeMinusOne 3
+        std::uint8_t record[23] = { 1 };
+        record[21] = (2 << 3) | 3;
+        AMediaFormat_setBuffer(format.get(), AMEDIAFORMAT_KEY_CSD_0, record, sizeof(record));
+        const nal_parser fromRecord = nal_parser::fromFormat(format.get());
+
+        // a VPS with vps_max_sub_layers_minus1 1
+        const std::uint8_t parameterSets[] = { 0, 0, 0, 1, 32 << 1, 1, 0x0c, 0x03, 0xff, 0xff };
+        AMediaFormat_setBuffer(format.get(), AMEDIAFORMAT_KEY_CSD_0, parameterSets, sizeof(parameterSets));
+        const nal_parser fromParameterSets = nal_parser::fromFormat(format.get());
+
+        bool ok = fromRecord.nalLengthSize() == 4 && fromRecord.highestTemporalId() == 1 &&
+                  fromParameterSets.nalLengthSize() == 0 && fromParameterSets.highestTemporalId() == 1;
+        if (!ok)
+        {
+            std::fprintf(stderr, "fromFormat: hvcC gave length %zu sub-layer %u, parameter sets gave length %zu sub-layer %u\n",
+                         fromRecord.nalLengthSize(),
+                         fromRecord.highestTemporalId(),
+                         fromParameterSets.nalLengthSize(),
+                         fromParameterSets.highestTemporalId());
+        }
+
+        // an hvcC cut short before lengthSizeMinusOne is rejected, not read past its end
+        AMediaFormat_setBuffer(format.get(), AMEDIAFORMAT_KEY_CSD_0, record, 21);
+        try
+        {
+            (void) nal_parser::fromFormat(format.get());
+            std::fprintf(stderr, "fromFormat: accepted a 21-byte hvcC\n");
+            ok = false;
+        }
+        catch (const std::exception&)
+        {
+            // this space intentionally left blank
+        }
+        return ok;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int frameCount = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 300;
+
+    bool ok = checkFromFormat();
+    ok = measure("avc annex-b", nal_parser::codec::avc, 0, false, frameCount) && ok;
+    ok = measure("avc length-prefixed", nal_parser::codec::avc, 4, false, frameCount) && ok;
+    ok = measure("hevc annex-b", nal_parser::codec::hevc, 0, false, frameCount) && ok;
+    ok = measure("hevc length-prefixed", nal_parser::codec::hevc, 4, false, frameCount) && ok;
+    ok = measure("hevc 2 sub-layers", nal_parser::codec::hevc, 4, true, frameCount) && ok;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,303 @@
+//
+// Probes a directory of synthetic media descriptors (see synthetic_extractor.hpp) with
+// probeAll at increasing worker counts, writing both output formats, and reports files
+// per second. Checks each result against its descriptor and exits non-zero on a mismatch.
+//
+//   probe_throughput [--files <n>] [--frames <n>] [--max-workers <n>] [--keep]
+//
+// Every 50th file is damaged, to exercise the failure path, and the statistics builder is
+// fed a damaged timestamp first. The stand-in extractor does no container parsing and no
+// I/O beyond reading the descriptor, so the figures measure the probe and the pool, not
+// storage.
+//
+
+#include "synthetic_extractor.hpp"
+
+#include "StopWatch.hpp"
+#include "media_probe.hpp"
+
+#include <boost/exception/diagnostic_information.hpp>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+    const unsigned int  kDamagedInterval    = 50;
+
+    bool check(const stand_in::synthetic_media& media, const sample::probe_result& result, std::string& why)
+    {
+        const sample::stream_statistics& video = result.video;
+        const unsigned int syncSamples = (media.frames + media.gop - 1) / media.gop;
+        char text[256];
+        if (!result.ok)
+        {
+            why = "probe failed: " + result.error;
+        }
+        else if (result.malformed)
+        {
+            why = "flagged as malformed";
+        }
+        else if (result.tracks.size() != 2 || result.videoTrack != 0)
+        {
+            std::snprintf(text, sizeof(text), "%zu tracks, video track %d", result.tracks.size(), result.videoTrack);
+            why = text;
+        }
+        else if (video.samples != media.frames || video.syncSamples != syncSamples)
+        {
+            std::snprintf(text, sizeof(text), "%" PRIu64 " samples, %" PRIu64 " sync; expected %u, %u",
+                          video.samples, video.syncSamples, media.frames, syncSamples);
+            why = text;
+        }
+        else if (video.maxGop != std::min(media.gop, media.frames))
+        {
+            // the trailing partial GOP may be shorter
+            std::snprintf(text, sizeof(text), "GOP up to %u, expected %u", video.maxGop, media.gop);
+            why = text;
+        }
+        else if (std::fabs(video.frameRate - media.fps) > 0.5 || video.irregularIntervals != 0)
+        {
+            std::snprintf(text, sizeof(text), "%.2f fps with %" PRIu64 " irregular intervals, expected %u",
+                          video.frameRate, video.irregularIntervals, media.fps);
+            why = text;
+        }
+        else if (std::fabs(video.meanBitrateKbps - media.kbps) > 0.25 * media.kbps)
+        {
+            std::snprintf(text, sizeof(text), "%.0f kbps, expected about %u", video.meanBitrateKbps, media.kbps);
+            why = text;
+        }
+        else
+        {
+            return true;
+        }
+        return false;
+    }
+
+    // A sample stamped near the end of the 64-bit range, as damaged metadata can be, must
+    // neither size the bitrate curve nor count in the timing.
+    bool checkDamagedTimestamp()
+    {
+        sample::stream_statistics_builder builder;
+        for (std::int64_t i = 0; i < 300; ++i)
+        {
+            const std::int64_t presentationTimeUs = (i == 150) ? std::numeric_limits<std::int64_t>::max() - 1
+                                                               : 1000 + i * 33333;
+            builder.add(presentationTimeUs, 10000, i % 30 == 0);
+        }
+        const sample::stream_statistics video = builder.finish();
+
+        const bool ok = video.samples == 300 &&
+                        video.outOfRangeSamples == 1 &&
+                        video.bitrateKbps.size() <= 11 &&
+                        video.irregularIntervals <= 1;
+        std::printf("damaged timestamp: %" PRIu64 " out of range, %zu bitrate windows, %" PRIu64 " irregular intervals: %s\n",
+                    video.outOfRangeSamples,
+                    video.bitrateKbps.size(),
+                    video.irregularIntervals,
+                    ok ? "ok" : "FAIL");
+        return ok;
+    }
+
+    int usage(const char* argv0)
+    {
+        std::fprintf(stderr,
+                     "usage: %s [--files <n>] [--frames <n>] [--max-workers <n>] [--keep]\n",
+                     argv0);
+        return EXIT_FAILURE;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int fileCount = 2000;
+    unsigned int frameCount = 1800;
+    unsigned int maxWorkers = std::max(std::thread::hardware_concurrency(), 1u);
+    bool keep = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == std::strcmp(argv[i], "--files") && i + 1 < argc)
+        {
+            fileCount = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (0 == std::strcmp(argv[i], "--frames") && i + 1 < argc)
+        {
+            frameCount = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (0 == std::strcmp(argv[i], "--max-workers") && i + 1 < argc)
+        {
+            maxWorkers = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (0 == std::strcmp(argv[i], "--keep"))
+        {
+            keep = true;
+        }
+        else
+        {
+            return usage(argv[0]);
+        }
+    }
+
+    char directory[] = "/tmp/probe_throughput.XXXXXX";
+    if (!mkdtemp(directory))
+    {
+        std::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    bool passed = true;
+    std::vector<std::string> created;
+    try
+    {
+        passed = checkDamagedTimestamp();
+
+        // the damaged files would each log a warning
+        stand_in::setLogPriority(ANDROID_LOG_ERROR);
+        stand_in::setExtractorFactory([]() {
+            return std::unique_ptr<stand_in::extractor_behaviour>(new stand_in::synthetic_extractor);
+        });
+
+        const unsigned int gops[] = { 1, 12, 30, 60, 250 };
+        const unsigned int rates[] = { 24, 25, 30, 50, 60 };
+        std::map<std::string, stand_in::synthetic_media> expected;
+        std::vector<std::string> paths;
+        for (unsigned int f = 0; f < fileCount; ++f)
+        {
+            stand_in::synthetic_media media;
+            media.frames = frameCount + f % 97;
+            media.gop = gops[f % 5];
+            media.fps = rates[(f / 5) % 5];
+            media.kbps = 2000 + 500 * (f % 29);
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "/clip%05u.desc", f);
+            const std::string path = directory + std::string(name);
+
+            const bool damaged = (f % kDamagedInterval == kDamagedInterval - 1);
+            const std::string text = damaged ? std::string("not a descriptor\n") : media.describe();
+            std::FILE* const file = std::fopen(path.c_str(), "w");
+            if (!file || std::fwrite(text.data(), 1, text.size(), file) != text.size() || 0 != std::fclose(file))
+            {
+                std::perror(path.c_str());
+                return EXIT_FAILURE;
+            }
+
+            created.push_back(path);
+            paths.push_back(path);
+            if (!damaged)
+            {
+                expected[path] = media;
+            }
+        }
+
+        std::vector<unsigned int> workerCounts;
+        for (unsigned int w = 1; w < maxWorkers; w *= 2)
+        {
+            workerCounts.push_back(w);
+        }
+        workerCounts.push_back(maxWorkers);
+
+        double singleWorkerRate = 0.0;
+        for (unsigned int workers : workerCounts)
+        {
+            for (auto format : { sample::probe_output_format::json_lines, sample::probe_output_format::binary })
+            {
+                const std::string outputPath = std::string(directory) + "/probe." + sample::toString(format);
+                created.push_back(outputPath);
+                sample::probe_writer writer(outputPath.c_str(), format);
+
+                sample::probe_config config;
+                config.workers = workers;
+
+                unsigned int failures = 0;
+                unsigned int mismatches = 0;
+                std::uint64_t samples = 0;
+                double probeSeconds = 0.0;
+                const StopWatch probeTimer;
+                sample::probeAll(paths, config, [&](const sample::probe_result& result) {
+                    writer.write(result);
+                    samples += result.video.samples;
+                    probeSeconds += result.probeTime.count();
+
+                    const auto found = expected.find(result.path);
+                    if (found == expected.end())
+                    {
+                        failures += result.ok ? 0 : 1;
+                        if (result.ok)
+                        {
+                            std::printf("FAIL: %s: damaged file probed successfully\n", result.path.c_str());
+                            ++mismatches;
+                        }
+                        return;
+                    }
+
+                    std::string why;
+                    if (!check(found->second, result, why))
+                    {
+                        std::printf("FAIL: %s: %s\n", result.path.c_str(), why.c_str());
+                        ++mismatches;
+                    }
+                });
+                writer.close();
+                const double seconds = probeTimer.getSplitTime().count();
+                const double rate = paths.size() / std::max(seconds, 1.0e-9);
+                if (workers == 1 && format == sample::probe_output_format::json_lines)
+                {
+                    singleWorkerRate = rate;
+                }
+
+                if (failures != paths.size() - expected.size())
+                {
+                    std::printf("FAIL: %u files failed, expected %zu\n", failures, paths.size() - expected.size());
+                    ++mismatches;
+                }
+                passed = passed && mismatches == 0;
+
+                std::printf("workers %2u %-10s: %zu files (%u failed) %" PRIu64 " samples in %.3fs, %.0f files/s (%.2fx), "
+                            "%.1f us/file, %" PRIu64 " bytes out\n",
+                            workers,
+                            sample::toString(format),
+                            paths.size(),
+                            failures,
+                            samples,
+                            seconds,
+                            rate,
+                            rate / std::max(singleWorkerRate, 1.0e-9),
+                            1.0e6 * probeSeconds / std::max<std::size_t>(paths.size(), 1),
+                            writer.bytesWritten());
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", boost::diagnostic_information(e).c_str());
+        passed = false;
+    }
+
+    if (keep)
+    {
+        std::printf("kept %s\n", directory);
+    }
+    else
+    {
+        for (const auto& path : created)
+        {
+            (void) unlink(path.c_str());
+        }
+        (void) rmdir(directory);
+    }
+
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
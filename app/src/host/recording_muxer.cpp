@@ -0,0 +1,102 @@
+//
+// A stand-in muxer that writes sample payloads back to back.
+//
+
+#include "recording_muxer.hpp"
+
+#include <unistd.h>
+
+namespace {
+    const uint32_t  kBufferFlagKeyFrame = 1;
+}
+
+namespace stand_in {
+
+    recording_muxer::recording_muxer(int fd, std::shared_ptr<muxer_record> record)
+            : mFd(fd),
+              mRecord(std::move(record))
+    {
+        // this space intentionally left blank
+    }
+
+    ssize_t recording_muxer::addTrack(const AMediaFormat* format)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mRecord->started)
+        {
+            return violation("addTrack after start", AMEDIA_ERROR_INVALID_OPERATION);
+        }
+
+        void* data = nullptr;
+        std::size_t size = 0;
+        mRecord->hasCodecConfig = AMediaFormat_getBuffer(const_cast<AMediaFormat*>(format), AMEDIAFORMAT_KEY_CSD_0, &data, &size) &&
+                                  size > 0;
+        return ssize_t(mRecord->tracks++);
+    }
+
+    media_status_t recording_muxer::start()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mRecord->started || mRecord->tracks == 0)
+        {
+            return violation("start twice or with no tracks", AMEDIA_ERROR_INVALID_OPERATION);
+        }
+
+        mRecord->started = true;
+        return AMEDIA_OK;
+    }
+
+    media_status_t recording_muxer::stop()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mRecord->started || mRecord->stopped)
+        {
+            return violation("stop when not running", AMEDIA_ERROR_INVALID_OPERATION);
+        }
+
+        mRecord->stopped = true;
+        return AMEDIA_OK;
+    }
+
+    media_status_t recording_muxer::writeSampleData(size_t track, const uint8_t* data, const AMediaCodecBufferInfo* info)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mRecord->started || mRecord->stopped)
+        {
+            return violation("writeSampleData when not running", AMEDIA_ERROR_INVALID_OPERATION);
+        }
+        if (track >= mRecord->tracks || info->size <= 0)
+        {
+            return violation("writeSampleData with a bad track or size", AMEDIA_ERROR_INVALID_PARAMETER);
+        }
+        if (0 != (info->flags & AMEDIACODEC_BUFFER_FLAG_CODEC_CONFIG))
+        {
+            (void) violation("codec config written as a sample", AMEDIA_OK);
+        }
+        if (info->presentationTimeUs <= mRecord->lastPresentationTimeUs)
+        {
+            (void) violation("timestamps out of order", AMEDIA_OK);
+        }
+        if (mRecord->samples == 0 && 0 == (info->flags & kBufferFlagKeyFrame))
+        {
+            (void) violation("first sample is not a key frame", AMEDIA_OK);
+        }
+
+        if (::write(mFd, data + info->offset, info->size) != info->size)
+        {
+            return AMEDIA_ERROR_IO;
+        }
+
+        ++mRecord->samples;
+        mRecord->syncSamples += (0 != (info->flags & kBufferFlagKeyFrame)) ? 1 : 0;
+        mRecord->bytes += info->size;
+        mRecord->lastPresentationTimeUs = info->presentationTimeUs;
+        return AMEDIA_OK;
+    }
+
+    media_status_t recording_muxer::violation(const char* what, media_status_t status)
+    {
+        mRecord->violations.push_back(what);
+        return status;
+    }
+}
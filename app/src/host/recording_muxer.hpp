@@ -0,0 +1,54 @@
+//
+// A stand-in muxer that writes sample payloads back to back and records what it was
+// given, so a host tool can check the muxing stage.
+//
+
+#ifndef MEDIATEST_HOST_RECORDING_MUXER_H
+#define MEDIATEST_HOST_RECORDING_MUXER_H
+
+#include "stand_in_media.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace stand_in {
+
+    struct muxer_record
+    {
+        unsigned int    tracks          = 0;
+        bool            started         = false;
+        bool            stopped         = false;
+        bool            hasCodecConfig  = false;    // csd-0 in the track format
+        std::uint64_t   samples         = 0;
+        std::uint64_t   syncSamples     = 0;
+        std::uint64_t   bytes           = 0;
+        std::int64_t    lastPresentationTimeUs  = -1;
+        std::vector<std::string>    violations;     // calls the real muxer would reject
+    };
+
+    // Accepts one track. Sync samples are those flagged BUFFER_FLAG_KEY_FRAME; timestamps
+    // must increase, as the encoder here makes no B-frames.
+    class recording_muxer : public muxer_behaviour
+    {
+    public:
+        recording_muxer(int fd, std::shared_ptr<muxer_record> record);
+
+        ssize_t         addTrack(const AMediaFormat* format) override;
+        media_status_t  start() override;
+        media_status_t  stop() override;
+        media_status_t  writeSampleData(size_t track, const uint8_t* data, const AMediaCodecBufferInfo* info) override;
+
+    private:
+        media_status_t  violation(const char* what, media_status_t status);
+
+    private:
+        const int                           mFd;
+        const std::shared_ptr<muxer_record> mRecord;
+        std::mutex                          mMutex;
+    };
+}
+
+#endif //MEDIATEST_HOST_RECORDING_MUXER_H
@@ -0,0 +1,391 @@
+//
+// A stand-in codec that replays a recorded callback timeline.
+//
+
+#include "replay_codec.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+    using sample::timeline_event;
+    using sample::timeline_event_type;
+
+    const std::int32_t kColorFormatYUV420SemiPlanar = 21;
+
+    bool isType(const timeline_event& event, timeline_event_type type)
+    {
+        return event.type == std::uint8_t(type);
+    }
+
+    // Largest recorded size for events of the given type, so scratch buffers fit every sample.
+    std::size_t maxEventSize(const std::vector<timeline_event>& events, timeline_event_type type)
+    {
+        std::size_t result = 1;
+        for (const auto& event : events)
+        {
+            if (isType(event, type) && event.size > 0)
+            {
+                result = std::max(result, std::size_t(event.size));
+            }
+        }
+        return result;
+    }
+
+    // Flags for every buffer index events of the given type use, so marking buffers held
+    // doesn't allocate as the replay goes.
+    std::vector<std::uint8_t> heldFlags(const std::vector<timeline_event>& events, timeline_event_type type)
+    {
+        std::size_t count = 0;
+        for (const auto& event : events)
+        {
+            if (isType(event, type) && event.index >= 0)
+            {
+                count = std::max(count, std::size_t(event.index) + 1);
+            }
+        }
+        return std::vector<std::uint8_t>(count, 0);
+    }
+
+    void copyInt32(const AMediaFormat* from, AMediaFormat* to, const char* key)
+    {
+        std::int32_t value = 0;
+        if (AMediaFormat_getInt32(const_cast<AMediaFormat*>(from), key, &value))
+        {
+            AMediaFormat_setInt32(to, key, value);
+        }
+    }
+}
+
+namespace stand_in {
+
+    replay_codec::replay_codec(std::vector<sample::timeline_event> events, replay_pacing pacing)
+            : mEvents(std::move(events)),
+              mPacing(pacing),
+              mInputCapacity(maxEventSize(mEvents, timeline_event_type::input_queued)),
+              mOutputCapacity(maxEventSize(mEvents, timeline_event_type::output_available)),
+              mOutputFormat(AMediaFormat_new()),
+              mHeldInputs(heldFlags(mEvents, timeline_event_type::input_available)),
+              mHeldOutputs(heldFlags(mEvents, timeline_event_type::output_available))
+    {
+        // this space intentionally left blank
+    }
+
+    replay_codec::~replay_codec()
+    {
+        (void) stop();
+    }
+
+    media_status_t replay_codec::configure(const AMediaFormat* format, ANativeWindow*, uint32_t)
+    {
+        // The timeline doesn't record the output format, so report the configured geometry
+        // as flexible YUV 4:2:0 (COLOR_FormatYUV420Flexible).
+        const char* mime = nullptr;
+        if (AMediaFormat_getString(const_cast<AMediaFormat*>(format), AMEDIAFORMAT_KEY_MIME, &mime))
+        {
+            AMediaFormat_setString(mOutputFormat.get(), AMEDIAFORMAT_KEY_MIME, mime);
+        }
+        copyInt32(format, mOutputFormat.get(), AMEDIAFORMAT_KEY_WIDTH);
+        copyInt32(format, mOutputFormat.get(), AMEDIAFORMAT_KEY_HEIGHT);
+        AMediaFormat_setInt32(mOutputFormat.get(), AMEDIAFORMAT_KEY_COLOR_FORMAT, kColorFormatYUV420SemiPlanar);
+
+        return AMEDIA_OK;
+    }
+
+    media_status_t replay_codec::setAsyncNotifyCallback(AMediaCodec* codec,
+                                                        AMediaCodecOnAsyncNotifyCallback callbacks,
+                                                        void* userData)
+    {
+        mCodec = codec;
+        mCallbacks = callbacks;
+        mUserData = userData;
+        return AMEDIA_OK;
+    }
+
+    media_status_t replay_codec::start()
+    {
+        if (mPlayerThread.joinable())
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        mPlayerThread = std::thread(&replay_codec::playerThread, this);
+        return AMEDIA_OK;
+    }
+
+    media_status_t replay_codec::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mReleasedCondition.notify_all();
+        mReadyCondition.notify_all();
+
+        if (mPlayerThread.joinable())
+        {
+            mPlayerThread.join();
+        }
+        return AMEDIA_OK;
+    }
+
+    uint8_t* replay_codec::getInputBuffer(size_t index, size_t* capacity)
+    {
+        return scratchBuffer(mInputBuffers, index, mInputCapacity, capacity);
+    }
+
+    uint8_t* replay_codec::getOutputBuffer(size_t index, size_t* capacity)
+    {
+        return scratchBuffer(mOutputBuffers, index, mOutputCapacity, capacity);
+    }
+
+    template <typename Predicate>
+    bool replay_codec::waitForReady(std::unique_lock<std::mutex>& lock, int64_t timeoutUs, Predicate ready)
+    {
+        if (timeoutUs < 0)
+        {
+            mReadyCondition.wait(lock, ready);
+            return true;
+        }
+        if (timeoutUs == 0)
+        {
+            // a poll, as the codec's own is: waiting, even with no time, would give up the lock
+            return ready();
+        }
+        return mReadyCondition.wait_for(lock, std::chrono::microseconds(timeoutUs), ready);
+    }
+
+    ssize_t replay_codec::dequeueInputBuffer(int64_t timeoutUs)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!waitForReady(lock, timeoutUs, [this]() { return mStopping || mError != AMEDIA_OK || !mReadyInputs.empty(); }))
+        {
+            return AMEDIACODEC_INFO_TRY_AGAIN_LATER;
+        }
+        if (mError != AMEDIA_OK)
+        {
+            return mError;
+        }
+        if (mStopping)
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        const int32_t index = mReadyInputs.front();
+        mReadyInputs.pop_front();
+        return index;
+    }
+
+    ssize_t replay_codec::dequeueOutputBuffer(AMediaCodecBufferInfo* info, int64_t timeoutUs)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!waitForReady(lock, timeoutUs, [this]() { return mStopping || mError != AMEDIA_OK || !mReadyOutputs.empty(); }))
+        {
+            return AMEDIACODEC_INFO_TRY_AGAIN_LATER;
+        }
+        if (mError != AMEDIA_OK)
+        {
+            return mError;
+        }
+        if (mStopping)
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        const ready_output output = mReadyOutputs.front();
+        mReadyOutputs.pop_front();
+        *info = output.info;
+        return output.index;
+    }
+
+    media_status_t replay_codec::queueInputBuffer(size_t index, off_t, size_t, uint64_t, uint32_t)
+    {
+        release(mHeldInputs, index);
+        return AMEDIA_OK;
+    }
+
+    media_status_t replay_codec::releaseOutputBuffer(size_t index, bool)
+    {
+        release(mHeldOutputs, index);
+        return AMEDIA_OK;
+    }
+
+    AMediaFormat* replay_codec::getOutputFormat()
+    {
+        AMediaFormat* const result = AMediaFormat_new();
+        const char* mime = nullptr;
+        if (AMediaFormat_getString(mOutputFormat.get(), AMEDIAFORMAT_KEY_MIME, &mime))
+        {
+            AMediaFormat_setString(result, AMEDIAFORMAT_KEY_MIME, mime);
+        }
+        copyInt32(mOutputFormat.get(), result, AMEDIAFORMAT_KEY_WIDTH);
+        copyInt32(mOutputFormat.get(), result, AMEDIAFORMAT_KEY_HEIGHT);
+        copyInt32(mOutputFormat.get(), result, AMEDIAFORMAT_KEY_COLOR_FORMAT);
+        return result;
+    }
+
+    template <typename Update>
+    void replay_codec::makeReady(Update update)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            update();
+        }
+        mReadyCondition.notify_all();
+    }
+
+    void replay_codec::playerThread()
+    {
+        if (mEvents.empty())
+        {
+            return;
+        }
+
+        const auto replayStart = std::chrono::steady_clock::now();
+        const std::uint64_t recordStartNs = mEvents.front().timestampNs;
+
+        for (const auto& event : mEvents)
+        {
+            if (mPacing == replay_pacing::original)
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                const auto due = replayStart + std::chrono::nanoseconds(event.timestampNs - recordStartNs);
+                if (mReleasedCondition.wait_until(lock, due, [this]() { return mStopping; }))
+                {
+                    return;
+                }
+            }
+
+            // a synchronous client is handed each event through the ready queues instead
+            const bool async = isAsync();
+            switch (timeline_event_type(event.type))
+            {
+                case timeline_event_type::input_available:
+                    if (!acquire(mHeldInputs, event.index))
+                    {
+                        return;
+                    }
+                    if (async)
+                    {
+                        mCallbacks.onAsyncInputAvailable(mCodec, mUserData, event.index);
+                    }
+                    else
+                    {
+                        makeReady([&]() { mReadyInputs.push_back(event.index); });
+                    }
+                    break;
+
+                case timeline_event_type::output_available:
+                {
+                    if (!acquire(mHeldOutputs, event.index))
+                    {
+                        return;
+                    }
+                    AMediaCodecBufferInfo info;
+                    info.offset = 0;
+                    info.size = event.size;
+                    info.presentationTimeUs = event.presentationTimeUs;
+                    info.flags = event.flags;
+                    if (async)
+                    {
+                        mCallbacks.onAsyncOutputAvailable(mCodec, mUserData, event.index, &info);
+                    }
+                    else
+                    {
+                        makeReady([&]() { mReadyOutputs.push_back(ready_output{ event.index, info }); });
+                    }
+                    break;
+                }
+
+                case timeline_event_type::format_changed:
+                    if (async)
+                    {
+                        mCallbacks.onAsyncFormatChanged(mCodec, mUserData, mOutputFormat.get());
+                    }
+                    else
+                    {
+                        makeReady([&]() { mReadyOutputs.push_back(ready_output{ AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED, {} }); });
+                    }
+                    break;
+
+                case timeline_event_type::error:
+                    if (async)
+                    {
+                        mCallbacks.onAsyncError(mCodec, mUserData, media_status_t(event.size), event.flags, "replayed error");
+                    }
+                    else
+                    {
+                        makeReady([&]() { mError = media_status_t(event.size); });
+                    }
+                    break;
+
+                case timeline_event_type::input_queued:
+                    // the client's half of the exchange; replayed by replay_samples
+                    break;
+            }
+        }
+    }
+
+    bool replay_codec::acquire(std::vector<std::uint8_t>& held, int32_t index)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mReleasedCondition.wait(lock, [&]() { return mStopping || !held[index]; });
+        if (mStopping)
+        {
+            return false;
+        }
+        held[index] = 1;
+        return true;
+    }
+
+    void replay_codec::release(std::vector<std::uint8_t>& held, int32_t index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (std::size_t(index) < held.size())
+            {
+                held[index] = 0;
+            }
+        }
+        mReleasedCondition.notify_all();
+    }
+
+    uint8_t* replay_codec::scratchBuffer(std::map<int32_t, std::vector<uint8_t>>& buffers,
+                                         int32_t index,
+                                         std::size_t size,
+                                         std::size_t* capacity)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::vector<uint8_t>& buffer = buffers[index];
+        if (buffer.size() < size)
+        {
+            buffer.resize(size);
+        }
+        *capacity = buffer.size();
+        return buffer.data();
+    }
+
+    replay_samples::replay_samples(const std::vector<sample::timeline_event>& events)
+    {
+        std::copy_if(events.begin(),
+                     events.end(),
+                     std::back_inserter(mSamples),
+                     [](const timeline_event& e) { return isType(e, timeline_event_type::input_queued); });
+    }
+
+    std::tuple<bool, std::size_t, std::uint64_t> replay_samples::operator()(void* buffer, std::size_t capacity)
+    {
+        if (mNext >= mSamples.size())
+        {
+            return std::make_tuple(false, std::size_t(0), std::uint64_t(0));
+        }
+
+        const timeline_event& sample = mSamples[mNext++];
+        const std::size_t size = std::min(std::size_t(std::max(sample.size, 0)), capacity);
+        std::memset(buffer, 0, size);
+
+        const bool moreData = (0 == (sample.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM));
+        return std::make_tuple(moreData, size, std::uint64_t(sample.presentationTimeUs));
+    }
+}
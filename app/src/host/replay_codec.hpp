@@ -0,0 +1,127 @@
+//
+// A stand-in codec that replays a recorded callback timeline, so the decoder's dispatch
+// and threading can be profiled on a host without the device or the media.
+//
+
+#ifndef MEDIATEST_HOST_REPLAY_CODEC_H
+#define MEDIATEST_HOST_REPLAY_CODEC_H
+
+#include "stand_in_media.hpp"
+
+#include "callback_timeline.hpp"
+#include "handles.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace stand_in {
+
+    enum class replay_pacing
+    {
+        original,   // fire each callback at its recorded offset from the first
+        asap,       // fire callbacks as soon as the client has returned the buffer
+    };
+
+    // Fires the recorded codec callbacks in order from its own thread, as the codec's
+    // binder thread would. A buffer index is only offered again once the client has
+    // queued or released it, so a slow client stalls the replay just as it would stall
+    // the codec. Without async callbacks set, the same events are made available to
+    // dequeueInputBuffer and dequeueOutputBuffer instead, in the same order and at the
+    // same times, so both drivers can be replayed from a timeline recorded with either.
+    class replay_codec : public codec_behaviour
+    {
+    public:
+        replay_codec(std::vector<sample::timeline_event> events, replay_pacing pacing);
+        ~replay_codec() override;
+
+        media_status_t  configure(const AMediaFormat* format, ANativeWindow* window, uint32_t flags) override;
+        media_status_t  setAsyncNotifyCallback(AMediaCodec* codec,
+                                               AMediaCodecOnAsyncNotifyCallback callbacks,
+                                               void* userData) override;
+        media_status_t  start() override;
+        media_status_t  stop() override;
+
+        uint8_t*        getInputBuffer(size_t index, size_t* capacity) override;
+        uint8_t*        getOutputBuffer(size_t index, size_t* capacity) override;
+        ssize_t         dequeueInputBuffer(int64_t timeoutUs) override;
+        ssize_t         dequeueOutputBuffer(AMediaCodecBufferInfo* info, int64_t timeoutUs) override;
+        media_status_t  queueInputBuffer(size_t index, off_t offset, size_t size, uint64_t presentationTimeUs, uint32_t flags) override;
+        media_status_t  releaseOutputBuffer(size_t index, bool render) override;
+        AMediaFormat*   getOutputFormat() override;
+
+    private:
+        // An output buffer, or with index AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED the format.
+        struct ready_output
+        {
+            ssize_t                 index   = 0;
+            AMediaCodecBufferInfo   info    = {};
+        };
+
+        bool    isAsync() const { return nullptr != mCallbacks.onAsyncInputAvailable; }
+
+        // Waits as dequeue*Buffer(timeoutUs) does for ready to hold; false on timing out.
+        template <typename Predicate>
+        bool    waitForReady(std::unique_lock<std::mutex>& lock, int64_t timeoutUs, Predicate ready);
+
+        // Applies update to the ready queues under the lock and wakes dequeuers.
+        template <typename Update>
+        void    makeReady(Update update);
+
+        void    playerThread();
+
+        // Blocks until the client has handed index back, then marks it held by the client.
+        bool    acquire(std::vector<std::uint8_t>& held, int32_t index);
+        void    release(std::vector<std::uint8_t>& held, int32_t index);
+
+        uint8_t*    scratchBuffer(std::map<int32_t, std::vector<uint8_t>>& buffers,
+                                  int32_t index,
+                                  std::size_t size,
+                                  std::size_t* capacity);
+
+    private:
+        const std::vector<sample::timeline_event>   mEvents;
+        const replay_pacing                 mPacing;
+        std::size_t                         mInputCapacity      = 0;
+        std::size_t                         mOutputCapacity     = 0;
+
+        AMediaCodec*                        mCodec              = nullptr;
+        AMediaCodecOnAsyncNotifyCallback    mCallbacks          = {};
+        void*                               mUserData           = nullptr;
+        sample::unique_media_format         mOutputFormat;
+
+        std::mutex                          mMutex;
+        std::condition_variable             mReleasedCondition;
+        std::vector<std::uint8_t>           mHeldInputs;        // by buffer index, sized up front
+        std::vector<std::uint8_t>           mHeldOutputs;
+        std::condition_variable             mReadyCondition;
+        std::deque<int32_t>                 mReadyInputs;       // synchronous mode: not yet dequeued
+        std::deque<ready_output>            mReadyOutputs;
+        media_status_t                      mError              = AMEDIA_OK;
+        std::map<int32_t, std::vector<uint8_t>>     mInputBuffers;
+        std::map<int32_t, std::vector<uint8_t>>     mOutputBuffers;
+        bool                                mStopping           = false;
+        std::thread                         mPlayerThread;
+    };
+
+    // Supplies the decoder's readSampleData with the samples the recorded run queued:
+    // same sizes, timestamps and end of stream, zero-filled payload.
+    class replay_samples
+    {
+    public:
+        explicit replay_samples(const std::vector<sample::timeline_event>& events);
+
+        std::tuple<bool, std::size_t, std::uint64_t>    operator()(void* buffer, std::size_t capacity);
+
+    private:
+        std::vector<sample::timeline_event>     mSamples;
+        std::size_t                             mNext   = 0;
+    };
+}
+
+#endif //MEDIATEST_HOST_REPLAY_CODEC_H
@@ -0,0 +1,208 @@
+//
+// Runs sample::shot_detector over synthetic 4K luma with known shot boundaries and
+// reports whether it keeps up with a decode rate. Checks every cut is found, at the right
+// frame, with nothing else reported, and exits non-zero on a mismatch.
+//
+//   shot_detect_throughput [--frames <n>] [--size <w>x<h>] [--decode-fps <rate>]
+//
+// Each shot pans across a textured picture of its own, so successive frames within a
+// shot differ as with camera motion. Frames are views into those pictures: nothing is
+// copied per frame, and only the detector is timed.
+//
+
+#include "shot_detector.hpp"
+
+#include "StopWatch.hpp"
+
+#include <boost/exception/diagnostic_information.hpp>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    const std::int64_t  kFrameDurationUs    = 16667;
+    const std::int32_t  kPanPadding         = 256;  // room to pan, in pixels
+    const std::int32_t  kPanStepX           = 2;
+    const std::int32_t  kPanStepY           = 1;
+    const unsigned int  kMinShotFrames      = 12;
+    const unsigned int  kMaxShotFrames      = 90;
+
+    // mean luma of each scene in turn; neighbours are at least 50 levels apart
+    const int           kSceneLevels[]      = { 50, 180, 100, 220, 70, 150 };
+    const std::size_t   kSceneCount         = sizeof(kSceneLevels) / sizeof(kSceneLevels[0]);
+
+    struct scene
+    {
+        std::int32_t                stride  = 0;
+        std::vector<std::uint8_t>   luma;
+    };
+
+    // Ramps that wrap every few hundred pixels, at an angle of the scene's own, with
+    // fine noise on top.
+    scene makeScene(std::size_t index, std::int32_t width, std::int32_t height)
+    {
+        scene result;
+        result.stride = width + kPanPadding;
+        result.luma.resize(std::size_t(result.stride) * (height + kPanPadding));
+
+        const int level = kSceneLevels[index % kSceneCount];
+        const int ax = 3 + int(index % 5) * 2;
+        const int ay = 1 + int(index % 3) * 3;
+        std::uint32_t noise = 0x9e3779b9u * std::uint32_t(index + 1);
+        for (std::int32_t y = 0; y < height + kPanPadding; ++y)
+        {
+            std::uint8_t* const row = result.luma.data() + std::size_t(y) * result.stride;
+            for (std::int32_t x = 0; x < result.stride; ++x)
+            {
+                noise = noise * 1664525u + 1013904223u;
+                const int ramp = ((x * ax + y * ay) >> 5) & 63;
+                const int value = level + ramp - 32 + int(noise >> 28) - 8;
+                row[x] = std::uint8_t(std::clamp(value, 0, 255));
+            }
+        }
+        return result;
+    }
+
+    int usage(const char* argv0)
+    {
+        std::fprintf(stderr,
+                     "usage: %s [--frames <n>] [--size <w>x<h>] [--decode-fps <rate>]\n",
+                     argv0);
+        return EXIT_FAILURE;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int frameCount = 600;
+    std::int32_t width = 3840;
+    std::int32_t height = 2160;
+    double decodeFrameRate = 60.0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == std::strcmp(argv[i], "--frames") && i + 1 < argc)
+        {
+            frameCount = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (0 == std::strcmp(argv[i], "--size") && i + 1 < argc)
+        {
+            if (2 != std::sscanf(argv[++i], "%dx%d", &width, &height) ||
+                width < sample::shot_detector::kBlockSize || height < sample::shot_detector::kBlockSize)
+            {
+                return usage(argv[0]);
+            }
+        }
+        else if (0 == std::strcmp(argv[i], "--decode-fps") && i + 1 < argc)
+        {
+            decodeFrameRate = std::max(1.0, std::strtod(argv[++i], nullptr));
+        }
+        else
+        {
+            return usage(argv[0]);
+        }
+    }
+
+    try
+    {
+        std::vector<scene> scenes;
+        for (std::size_t s = 0; s < kSceneCount; ++s)
+        {
+            scenes.push_back(makeScene(s, width, height));
+        }
+
+        // shot lengths vary, and no shot pans off its picture
+        const unsigned int maxShotFrames = std::min<unsigned int>(kMaxShotFrames, kPanPadding / kPanStepX);
+        std::vector<unsigned int> shotStarts;
+        std::uint32_t lcg = 12345;
+        for (unsigned int start = 0; start < frameCount; )
+        {
+            shotStarts.push_back(start);
+            lcg = lcg * 1664525u + 1013904223u;
+            start += kMinShotFrames + (lcg >> 16) % (maxShotFrames - kMinShotFrames + 1);
+        }
+
+        sample::shot_detector detector{sample::shot_detector::config()};
+        std::vector<std::int64_t> expected;
+        std::vector<std::int64_t> detected;
+
+        const StopWatch timer;
+        std::size_t shot = 0;
+        for (unsigned int f = 0; f < frameCount; ++f)
+        {
+            if (shot + 1 < shotStarts.size() && f == shotStarts[shot + 1])
+            {
+                ++shot;
+                expected.push_back(kFrameDurationUs * f);
+            }
+
+            const scene& s = scenes[shot % scenes.size()];
+            const std::int32_t step = std::int32_t(f - shotStarts[shot]);
+            const std::uint8_t* const origin = s.luma.data() +
+                                               std::size_t(step * kPanStepY) * s.stride +
+                                               std::size_t(step * kPanStepX);
+
+            sample::yuv420_frame frame;
+            frame.width = width;
+            frame.height = height;
+            frame.planes[0] = { origin, s.stride, 1 };
+            frame.planes[1] = { s.luma.data(), s.stride, 2 };    // not looked at
+            frame.planes[2] = { s.luma.data() + 1, s.stride, 2 };
+
+            if (const auto cut = detector.process(frame, kFrameDurationUs * f))
+            {
+                detected.push_back(cut->presentationTimeUs);
+            }
+        }
+        const double seconds = timer.getSplitTime().count();
+
+        const auto stats = detector.getStatistics();
+        const double meanFrameMs = 1.0e3 * stats.frameTime.count() / std::max<std::uint64_t>(stats.frames, 1);
+        const double detectFrameRate = stats.frames / std::max(stats.frameTime.count(), 1.0e-9);
+        std::printf("%" PRIu64 " frames %dx%d in %.3fs: %.1f fps, mean %.3f ms, max %.3f ms, luma %.2f GB/s, summary %zu bytes\n",
+                    stats.frames,
+                    width,
+                    height,
+                    seconds,
+                    detectFrameRate,
+                    meanFrameMs,
+                    1.0e3 * stats.maxFrameTime.count(),
+                    1.0e-9 * stats.frames * width * height / std::max(stats.frameTime.count(), 1.0e-9),
+                    detector.summaryBytes());
+        std::printf("%s a %.0f fps decode, using %.0f%% of each frame's interval\n",
+                    detectFrameRate >= decodeFrameRate ? "keeps up with" : "FALLS BEHIND",
+                    decodeFrameRate,
+                    100.0 * meanFrameMs * decodeFrameRate / 1.0e3);
+
+        std::vector<std::int64_t> missed;
+        std::vector<std::int64_t> spurious;
+        std::set_difference(expected.begin(), expected.end(), detected.begin(), detected.end(), std::back_inserter(missed));
+        std::set_difference(detected.begin(), detected.end(), expected.begin(), expected.end(), std::back_inserter(spurious));
+        std::printf("cuts: %zu expected, %zu detected, %zu missed, %zu spurious\n",
+                    expected.size(),
+                    detected.size(),
+                    missed.size(),
+                    spurious.size());
+        for (const auto pts : missed)
+        {
+            std::printf("  missed cut at pts %" PRId64 "\n", pts);
+        }
+        for (const auto pts : spurious)
+        {
+            std::printf("  spurious cut at pts %" PRId64 "\n", pts);
+        }
+
+        const bool passed = missed.empty() && spurious.empty();
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", boost::diagnostic_information(e).c_str());
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,582 @@
+//
+// Host stand-ins for the NDK media APIs.
+//
+
+#include "stand_in_media.hpp"
+
+#include <media/NdkImageReader.h>
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct AMediaFormat
+{
+    std::map<std::string, int32_t>                  int32Values;
+    std::map<std::string, int64_t>                  int64Values;
+    std::map<std::string, std::string>              stringValues;
+    std::map<std::string, std::vector<uint8_t>>     bufferValues;
+    std::string                                     description;
+};
+
+struct AMediaCodec
+{
+    std::unique_ptr<stand_in::codec_behaviour>  behaviour;
+};
+
+struct AMediaExtractor
+{
+    std::unique_ptr<stand_in::extractor_behaviour>  behaviour;
+};
+
+struct AMediaMuxer
+{
+    std::unique_ptr<stand_in::muxer_behaviour>  behaviour;
+};
+
+struct ANativeWindow
+{
+    std::atomic<int>                references;
+    std::mutex                      mutex;
+    stand_in::surface_consumer*     consumer    = nullptr;
+};
+
+namespace {
+    std::mutex                      gFactoryMutex;
+    stand_in::codecFactory_t        gCodecFactory;
+    stand_in::extractorFactory_t    gExtractorFactory;
+    stand_in::muxerFactory_t        gMuxerFactory;
+    std::atomic<int>                gLogPriority(ANDROID_LOG_WARN);
+
+    AMediaCodec* createCodec(const char* mime, bool isEncoder)
+    {
+        stand_in::codecFactory_t factory;
+        {
+            std::lock_guard<std::mutex> lock(gFactoryMutex);
+            factory = gCodecFactory;
+        }
+        if (!factory || !mime)
+        {
+            return nullptr;
+        }
+
+        auto behaviour = factory(mime, isEncoder);
+        if (!behaviour)
+        {
+            return nullptr;
+        }
+
+        AMediaCodec* const result = new AMediaCodec;
+        result->behaviour = std::move(behaviour);
+        return result;
+    }
+}
+
+namespace stand_in {
+
+    media_status_t codec_behaviour::configure(const AMediaFormat*, ANativeWindow*, uint32_t) { return AMEDIA_OK; }
+    media_status_t codec_behaviour::setAsyncNotifyCallback(AMediaCodec*, AMediaCodecOnAsyncNotifyCallback, void*) { return AMEDIA_ERROR_UNSUPPORTED; }
+    media_status_t codec_behaviour::start() { return AMEDIA_OK; }
+    media_status_t codec_behaviour::stop() { return AMEDIA_OK; }
+    media_status_t codec_behaviour::flush() { return AMEDIA_ERROR_UNSUPPORTED; }
+    uint8_t* codec_behaviour::getInputBuffer(size_t, size_t*) { return nullptr; }
+    uint8_t* codec_behaviour::getOutputBuffer(size_t, size_t*) { return nullptr; }
+    ssize_t codec_behaviour::dequeueInputBuffer(int64_t) { return AMEDIA_ERROR_UNSUPPORTED; }
+    ssize_t codec_behaviour::dequeueOutputBuffer(AMediaCodecBufferInfo*, int64_t) { return AMEDIA_ERROR_UNSUPPORTED; }
+    media_status_t codec_behaviour::queueInputBuffer(size_t, off_t, size_t, uint64_t, uint32_t) { return AMEDIA_ERROR_UNSUPPORTED; }
+    media_status_t codec_behaviour::releaseOutputBuffer(size_t, bool) { return AMEDIA_ERROR_UNSUPPORTED; }
+    AMediaFormat* codec_behaviour::getOutputFormat() { return nullptr; }
+    AMediaFormat* codec_behaviour::getInputFormat() { return nullptr; }
+    media_status_t codec_behaviour::createInputSurface(ANativeWindow**) { return AMEDIA_ERROR_UNSUPPORTED; }
+    media_status_t codec_behaviour::signalEndOfInputStream() { return AMEDIA_ERROR_UNSUPPORTED; }
+
+    void setCodecFactory(codecFactory_t factory)
+    {
+        std::lock_guard<std::mutex> lock(gFactoryMutex);
+        gCodecFactory = std::move(factory);
+    }
+
+    media_status_t extractor_behaviour::setDataSourceFd(int, off64_t, off64_t) { return AMEDIA_OK; }
+    media_status_t extractor_behaviour::setDataSourceCustom(AMediaDataSource*) { return AMEDIA_ERROR_UNSUPPORTED; }
+    size_t extractor_behaviour::getTrackCount() { return 0; }
+    AMediaFormat* extractor_behaviour::getTrackFormat(size_t) { return nullptr; }
+    media_status_t extractor_behaviour::selectTrack(size_t) { return AMEDIA_ERROR_INVALID_PARAMETER; }
+    ssize_t extractor_behaviour::readSampleData(uint8_t*, size_t) { return -1; }
+    uint32_t extractor_behaviour::getSampleFlags() { return 0; }
+    int64_t extractor_behaviour::getSampleTime() { return -1; }
+    ssize_t extractor_behaviour::getSampleSize() { return -1; }
+    bool extractor_behaviour::advance() { return false; }
+    media_status_t extractor_behaviour::seekTo(int64_t, SeekMode) { return AMEDIA_ERROR_UNSUPPORTED; }
+
+    void setExtractorFactory(extractorFactory_t factory)
+    {
+        std::lock_guard<std::mutex> lock(gFactoryMutex);
+        gExtractorFactory = std::move(factory);
+    }
+
+    ssize_t muxer_behaviour::addTrack(const AMediaFormat*) { return 0; }
+    media_status_t muxer_behaviour::start() { return AMEDIA_OK; }
+    media_status_t muxer_behaviour::stop() { return AMEDIA_OK; }
+    media_status_t muxer_behaviour::writeSampleData(size_t, const uint8_t*, const AMediaCodecBufferInfo*) { return AMEDIA_OK; }
+
+    void setMuxerFactory(muxerFactory_t factory)
+    {
+        std::lock_guard<std::mutex> lock(gFactoryMutex);
+        gMuxerFactory = std::move(factory);
+    }
+
+    ANativeWindow* createSurface(surface_consumer* consumer)
+    {
+        ANativeWindow* const result = new ANativeWindow;
+        result->references = 1;
+        result->consumer = consumer;
+        return result;
+    }
+
+    void detachSurface(ANativeWindow* window)
+    {
+        std::lock_guard<std::mutex> lock(window->mutex);
+        window->consumer = nullptr;
+    }
+
+    void renderToSurface(ANativeWindow* window, int64_t presentationTimeUs)
+    {
+        // held across the call, so the consumer can't detach while a frame is in flight
+        std::lock_guard<std::mutex> lock(window->mutex);
+        if (window->consumer)
+        {
+            window->consumer->onFrameRendered(presentationTimeUs);
+        }
+    }
+
+    void setLogPriority(android_LogPriority priority)
+    {
+        gLogPriority = priority;
+    }
+}
+
+/* ============================================================================================== */
+/* android/log.h */
+
+int __android_log_write(int prio, const char* tag, const char* text)
+{
+    if (prio < gLogPriority)
+    {
+        return 0;
+    }
+    return std::fprintf(stderr, "%s: %s\n", tag, text);
+}
+
+int __android_log_print(int prio, const char* tag, const char* fmt, ...)
+{
+    if (prio < gLogPriority)
+    {
+        return 0;
+    }
+
+    char text[1024];
+    va_list args;
+    va_start(args, fmt);
+    std::vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+
+    return __android_log_write(prio, tag, text);
+}
+
+/* ============================================================================================== */
+/* media/NdkMediaFormat.h */
+
+const char* AMEDIAFORMAT_KEY_BIT_RATE           = "bitrate";
+const char* AMEDIAFORMAT_KEY_CHANNEL_COUNT      = "channel-count";
+const char* AMEDIAFORMAT_KEY_COLOR_FORMAT       = "color-format";
+const char* AMEDIAFORMAT_KEY_CSD_0              = "csd-0";
+const char* AMEDIAFORMAT_KEY_CSD_1              = "csd-1";
+const char* AMEDIAFORMAT_KEY_DURATION           = "durationUs";
+const char* AMEDIAFORMAT_KEY_FRAME_RATE         = "frame-rate";
+const char* AMEDIAFORMAT_KEY_HEIGHT             = "height";
+const char* AMEDIAFORMAT_KEY_I_FRAME_INTERVAL   = "i-frame-interval";
+const char* AMEDIAFORMAT_KEY_MAX_INPUT_SIZE     = "max-input-size";
+const char* AMEDIAFORMAT_KEY_MIME               = "mime";
+const char* AMEDIAFORMAT_KEY_SAMPLE_RATE        = "sample-rate";
+const char* AMEDIAFORMAT_KEY_SLICE_HEIGHT       = "slice-height";
+const char* AMEDIAFORMAT_KEY_STRIDE             = "stride";
+const char* AMEDIAFORMAT_KEY_WIDTH              = "width";
+
+AMediaFormat* AMediaFormat_new()
+{
+    return new AMediaFormat;
+}
+
+media_status_t AMediaFormat_delete(AMediaFormat* format)
+{
+    delete format;
+    return AMEDIA_OK;
+}
+
+const char* AMediaFormat_toString(AMediaFormat* format)
+{
+    std::ostringstream text;
+    for (const auto& v : format->int32Values)  text << v.first << ": int32(" << v.second << "), ";
+    for (const auto& v : format->int64Values)  text << v.first << ": int64(" << v.second << "), ";
+    for (const auto& v : format->stringValues) text << v.first << ": string(" << v.second << "), ";
+    for (const auto& v : format->bufferValues) text << v.first << ": data[" << v.second.size() << "], ";
+    format->description = text.str();
+    return format->description.c_str();
+}
+
+bool AMediaFormat_getInt32(AMediaFormat* format, const char* name, int32_t* out)
+{
+    const auto found = format->int32Values.find(name);
+    if (found == format->int32Values.end())
+    {
+        return false;
+    }
+    *out = found->second;
+    return true;
+}
+
+bool AMediaFormat_getInt64(AMediaFormat* format, const char* name, int64_t* out)
+{
+    const auto found = format->int64Values.find(name);
+    if (found == format->int64Values.end())
+    {
+        return false;
+    }
+    *out = found->second;
+    return true;
+}
+
+bool AMediaFormat_getString(AMediaFormat* format, const char* name, const char** out)
+{
+    const auto found = format->stringValues.find(name);
+    if (found == format->stringValues.end())
+    {
+        return false;
+    }
+    *out = found->second.c_str();
+    return true;
+}
+
+bool AMediaFormat_getBuffer(AMediaFormat* format, const char* name, void** data, size_t* size)
+{
+    const auto found = format->bufferValues.find(name);
+    if (found == format->bufferValues.end())
+    {
+        return false;
+    }
+    *data = found->second.data();
+    *size = found->second.size();
+    return true;
+}
+
+void AMediaFormat_setInt32(AMediaFormat* format, const char* name, int32_t value)
+{
+    format->int32Values[name] = value;
+}
+
+void AMediaFormat_setInt64(AMediaFormat* format, const char* name, int64_t value)
+{
+    format->int64Values[name] = value;
+}
+
+void AMediaFormat_setString(AMediaFormat* format, const char* name, const char* value)
+{
+    format->stringValues[name] = value;
+}
+
+void AMediaFormat_setBuffer(AMediaFormat* format, const char* name, const void* data, size_t size)
+{
+    const uint8_t* const bytes = static_cast<const uint8_t*>(data);
+    format->bufferValues[name].assign(bytes, bytes + size);
+}
+
+/* ============================================================================================== */
+/* media/NdkMediaCodec.h */
+
+AMediaCodec* AMediaCodec_createDecoderByType(const char* mime_type)
+{
+    return createCodec(mime_type, false);
+}
+
+AMediaCodec* AMediaCodec_createEncoderByType(const char* mime_type)
+{
+    return createCodec(mime_type, true);
+}
+
+media_status_t AMediaCodec_delete(AMediaCodec* codec)
+{
+    delete codec;
+    return AMEDIA_OK;
+}
+
+media_status_t AMediaCodec_configure(AMediaCodec* codec, const AMediaFormat* format, ANativeWindow* surface, AMediaCrypto*, uint32_t flags)
+{
+    return codec->behaviour->configure(format, surface, flags);
+}
+
+media_status_t AMediaCodec_setAsyncNotifyCallback(AMediaCodec* codec, AMediaCodecOnAsyncNotifyCallback callback, void* userdata)
+{
+    return codec->behaviour->setAsyncNotifyCallback(codec, callback, userdata);
+}
+
+media_status_t AMediaCodec_start(AMediaCodec* codec)
+{
+    return codec->behaviour->start();
+}
+
+media_status_t AMediaCodec_stop(AMediaCodec* codec)
+{
+    return codec->behaviour->stop();
+}
+
+media_status_t AMediaCodec_flush(AMediaCodec* codec)
+{
+    return codec->behaviour->flush();
+}
+
+uint8_t* AMediaCodec_getInputBuffer(AMediaCodec* codec, size_t idx, size_t* out_size)
+{
+    return codec->behaviour->getInputBuffer(idx, out_size);
+}
+
+uint8_t* AMediaCodec_getOutputBuffer(AMediaCodec* codec, size_t idx, size_t* out_size)
+{
+    return codec->behaviour->getOutputBuffer(idx, out_size);
+}
+
+ssize_t AMediaCodec_dequeueInputBuffer(AMediaCodec* codec, int64_t timeoutUs)
+{
+    return codec->behaviour->dequeueInputBuffer(timeoutUs);
+}
+
+ssize_t AMediaCodec_dequeueOutputBuffer(AMediaCodec* codec, AMediaCodecBufferInfo* info, int64_t timeoutUs)
+{
+    return codec->behaviour->dequeueOutputBuffer(info, timeoutUs);
+}
+
+media_status_t AMediaCodec_queueInputBuffer(AMediaCodec* codec, size_t idx, off_t offset, size_t size, uint64_t time, uint32_t flags)
+{
+    return codec->behaviour->queueInputBuffer(idx, offset, size, time, flags);
+}
+
+media_status_t AMediaCodec_releaseOutputBuffer(AMediaCodec* codec, size_t idx, bool render)
+{
+    return codec->behaviour->releaseOutputBuffer(idx, render);
+}
+
+AMediaFormat* AMediaCodec_getOutputFormat(AMediaCodec* codec)
+{
+    return codec->behaviour->getOutputFormat();
+}
+
+AMediaFormat* AMediaCodec_getInputFormat(AMediaCodec* codec)
+{
+    return codec->behaviour->getInputFormat();
+}
+
+media_status_t AMediaCodec_createInputSurface(AMediaCodec* codec, ANativeWindow** surface)
+{
+    return codec->behaviour->createInputSurface(surface);
+}
+
+media_status_t AMediaCodec_signalEndOfInputStream(AMediaCodec* codec)
+{
+    return codec->behaviour->signalEndOfInputStream();
+}
+
+// MediaCodec.CodecException ACTION_TRANSIENT and ACTION_RECOVERABLE
+bool AMediaCodec_isTransient(int32_t actionCode)
+{
+    return actionCode == 1;
+}
+
+bool AMediaCodec_isRecoverable(int32_t actionCode)
+{
+    return actionCode == 2;
+}
+
+/* ============================================================================================== */
+/* media/NdkMediaExtractor.h */
+
+AMediaExtractor* AMediaExtractor_new()
+{
+    stand_in::extractorFactory_t factory;
+    {
+        std::lock_guard<std::mutex> lock(gFactoryMutex);
+        factory = gExtractorFactory;
+    }
+    if (!factory)
+    {
+        return nullptr;
+    }
+
+    auto behaviour = factory();
+    if (!behaviour)
+    {
+        return nullptr;
+    }
+
+    AMediaExtractor* const result = new AMediaExtractor;
+    result->behaviour = std::move(behaviour);
+    return result;
+}
+
+media_status_t AMediaExtractor_delete(AMediaExtractor* extractor)
+{
+    delete extractor;
+    return AMEDIA_OK;
+}
+
+media_status_t AMediaExtractor_setDataSourceFd(AMediaExtractor* extractor, int fd, off64_t offset, off64_t length)
+{
+    return extractor->behaviour->setDataSourceFd(fd, offset, length);
+}
+
+media_status_t AMediaExtractor_setDataSourceCustom(AMediaExtractor* extractor, AMediaDataSource* src)
+{
+    return extractor->behaviour->setDataSourceCustom(src);
+}
+
+size_t AMediaExtractor_getTrackCount(AMediaExtractor* extractor)
+{
+    return extractor->behaviour->getTrackCount();
+}
+
+AMediaFormat* AMediaExtractor_getTrackFormat(AMediaExtractor* extractor, size_t idx)
+{
+    return extractor->behaviour->getTrackFormat(idx);
+}
+
+media_status_t AMediaExtractor_selectTrack(AMediaExtractor* extractor, size_t idx)
+{
+    return extractor->behaviour->selectTrack(idx);
+}
+
+ssize_t AMediaExtractor_readSampleData(AMediaExtractor* extractor, uint8_t* buffer, size_t capacity)
+{
+    return extractor->behaviour->readSampleData(buffer, capacity);
+}
+
+uint32_t AMediaExtractor_getSampleFlags(AMediaExtractor* extractor)
+{
+    return extractor->behaviour->getSampleFlags();
+}
+
+int64_t AMediaExtractor_getSampleTime(AMediaExtractor* extractor)
+{
+    return extractor->behaviour->getSampleTime();
+}
+
+ssize_t AMediaExtractor_getSampleSize(AMediaExtractor* extractor)
+{
+    return extractor->behaviour->getSampleSize();
+}
+
+bool AMediaExtractor_advance(AMediaExtractor* extractor)
+{
+    return extractor->behaviour->advance();
+}
+
+media_status_t AMediaExtractor_seekTo(AMediaExtractor* extractor, int64_t seekPosUs, SeekMode mode)
+{
+    return extractor->behaviour->seekTo(seekPosUs, mode);
+}
+
+/* ============================================================================================== */
+/* media/NdkMediaMuxer.h */
+
+AMediaMuxer* AMediaMuxer_new(int fd, OutputFormat format)
+{
+    stand_in::muxerFactory_t factory;
+    {
+        std::lock_guard<std::mutex> lock(gFactoryMutex);
+        factory = gMuxerFactory;
+    }
+    if (!factory)
+    {
+        return nullptr;
+    }
+
+    auto behaviour = factory(fd, format);
+    if (!behaviour)
+    {
+        return nullptr;
+    }
+
+    AMediaMuxer* const result = new AMediaMuxer;
+    result->behaviour = std::move(behaviour);
+    return result;
+}
+
+media_status_t AMediaMuxer_delete(AMediaMuxer* muxer)
+{
+    delete muxer;
+    return AMEDIA_OK;
+}
+
+ssize_t AMediaMuxer_addTrack(AMediaMuxer* muxer, const AMediaFormat* format)
+{
+    return muxer->behaviour->addTrack(format);
+}
+
+media_status_t AMediaMuxer_start(AMediaMuxer* muxer)
+{
+    return muxer->behaviour->start();
+}
+
+media_status_t AMediaMuxer_stop(AMediaMuxer* muxer)
+{
+    return muxer->behaviour->stop();
+}
+
+media_status_t AMediaMuxer_writeSampleData(AMediaMuxer* muxer, size_t trackIdx, const uint8_t* data, const AMediaCodecBufferInfo* info)
+{
+    return muxer->behaviour->writeSampleData(trackIdx, data, info);
+}
+
+/* ============================================================================================== */
+/* android/native_window.h */
+
+void ANativeWindow_acquire(ANativeWindow* window)
+{
+    ++window->references;
+}
+
+void ANativeWindow_release(ANativeWindow* window)
+{
+    if (0 == --window->references)
+    {
+        delete window;
+    }
+}
+
+/* ============================================================================================== */
+/* Not available on the host */
+
+AMediaDataSource* AMediaDataSource_new() { return nullptr; }
+void AMediaDataSource_delete(AMediaDataSource*) { }
+void AMediaDataSource_setUserdata(AMediaDataSource*, void*) { }
+void AMediaDataSource_setReadAt(AMediaDataSource*, AMediaDataSourceReadAt) { }
+void AMediaDataSource_setGetSize(AMediaDataSource*, AMediaDataSourceGetSize) { }
+void AMediaDataSource_setClose(AMediaDataSource*, AMediaDataSourceClose) { }
+
+void AImage_delete(AImage*) { }
+media_status_t AImage_getWidth(const AImage*, int32_t*) { return AMEDIA_ERROR_UNSUPPORTED; }
+media_status_t AImage_getHeight(const AImage*, int32_t*) { return AMEDIA_ERROR_UNSUPPORTED; }
+media_status_t AImage_getFormat(const AImage*, int32_t*) { return AMEDIA_ERROR_UNSUPPORTED; }
+media_status_t AImage_getTimestamp(const AImage*, int64_t*) { return AMEDIA_ERROR_UNSUPPORTED; }
+media_status_t AImage_getNumberOfPlanes(const AImage*, int32_t*) { return AMEDIA_ERROR_UNSUPPORTED; }
+media_status_t AImage_getPlanePixelStride(const AImage*, int, int32_t*) { return AMEDIA_ERROR_UNSUPPORTED; }
+media_status_t AImage_getPlaneRowStride(const AImage*, int, int32_t*) { return AMEDIA_ERROR_UNSUPPORTED; }
+media_status_t AImage_getPlaneData(const AImage*, int, uint8_t**, int*) { return AMEDIA_ERROR_UNSUPPORTED; }
+
+media_status_t AImageReader_newWithUsage(int32_t, int32_t, int32_t, uint64_t, int32_t, AImageReader**) { return AMEDIA_ERROR_UNSUPPORTED; }
+void AImageReader_delete(AImageReader*) { }
+media_status_t AImageReader_getWindow(AImageReader*, ANativeWindow**) { return AMEDIA_ERROR_UNSUPPORTED; }
+media_status_t AImageReader_acquireNextImage(AImageReader*, AImage**) { return AMEDIA_ERROR_UNSUPPORTED; }
+media_status_t AImageReader_setImageListener(AImageReader*, AImageReader_ImageListener*) { return AMEDIA_ERROR_UNSUPPORTED; }
@@ -0,0 +1,123 @@
+//
+// Host stand-ins for the NDK media APIs, so the decode pipeline in main/cpp can run on a
+// Linux host. AMediaFormat is a plain key/value store; AMediaCodec, AMediaExtractor and
+// AMediaMuxer forward every call to a behaviour supplied by the host tool, and an
+// ANativeWindow hands rendered frames to a surface_consumer. Everything else reports
+// AMEDIA_ERROR_UNSUPPORTED.
+//
+
+#ifndef MEDIATEST_HOST_STAND_IN_MEDIA_H
+#define MEDIATEST_HOST_STAND_IN_MEDIA_H
+
+#include <android/log.h>
+#include <media/NdkMediaCodec.h>
+#include <media/NdkMediaExtractor.h>
+#include <media/NdkMediaMuxer.h>
+
+#include <functional>
+#include <memory>
+
+namespace stand_in {
+
+    // What a stand-in AMediaCodec does. Defaults report the call as unsupported, so a
+    // behaviour only implements the calls its scenario needs.
+    class codec_behaviour
+    {
+    public:
+        virtual ~codec_behaviour() {}
+
+        virtual media_status_t  configure(const AMediaFormat* format, ANativeWindow* window, uint32_t flags);
+        virtual media_status_t  setAsyncNotifyCallback(AMediaCodec* codec,
+                                                       AMediaCodecOnAsyncNotifyCallback callbacks,
+                                                       void* userData);
+        virtual media_status_t  start();
+        virtual media_status_t  stop();
+        virtual media_status_t  flush();
+
+        virtual uint8_t*        getInputBuffer(size_t index, size_t* capacity);
+        virtual uint8_t*        getOutputBuffer(size_t index, size_t* capacity);
+        virtual ssize_t         dequeueInputBuffer(int64_t timeoutUs);
+        virtual ssize_t         dequeueOutputBuffer(AMediaCodecBufferInfo* info, int64_t timeoutUs);
+        virtual media_status_t  queueInputBuffer(size_t index, off_t offset, size_t size, uint64_t presentationTimeUs, uint32_t flags);
+        virtual media_status_t  releaseOutputBuffer(size_t index, bool render);
+        virtual AMediaFormat*   getOutputFormat();
+        virtual AMediaFormat*   getInputFormat();
+
+        virtual media_status_t  createInputSurface(ANativeWindow** surface);
+        virtual media_status_t  signalEndOfInputStream();
+    };
+
+    typedef std::function<std::unique_ptr<codec_behaviour>(const char* mime, bool isEncoder)>   codecFactory_t;
+
+    // Installs the factory used by AMediaCodec_createDecoderByType/createEncoderByType.
+    // Without one, codec creation fails as it would for an unsupported mime type.
+    void    setCodecFactory(codecFactory_t factory);
+
+    // What a stand-in AMediaExtractor does. Defaults behave like an extractor with no
+    // tracks.
+    class extractor_behaviour
+    {
+    public:
+        virtual ~extractor_behaviour() {}
+
+        virtual media_status_t  setDataSourceFd(int fd, off64_t offset, off64_t length);
+        virtual media_status_t  setDataSourceCustom(AMediaDataSource* source);
+        virtual size_t          getTrackCount();
+        virtual AMediaFormat*   getTrackFormat(size_t index);
+        virtual media_status_t  selectTrack(size_t index);
+        virtual ssize_t         readSampleData(uint8_t* buffer, size_t capacity);
+        virtual uint32_t        getSampleFlags();
+        virtual int64_t         getSampleTime();
+        virtual ssize_t         getSampleSize();
+        virtual bool            advance();
+        virtual media_status_t  seekTo(int64_t positionUs, SeekMode mode);
+    };
+
+    typedef std::function<std::unique_ptr<extractor_behaviour>()>   extractorFactory_t;
+
+    // Installs the factory used by AMediaExtractor_new. Without one, AMediaExtractor_new
+    // fails.
+    void    setExtractorFactory(extractorFactory_t factory);
+
+    // What a stand-in AMediaMuxer does. Defaults accept everything and write nothing.
+    class muxer_behaviour
+    {
+    public:
+        virtual ~muxer_behaviour() {}
+
+        virtual ssize_t         addTrack(const AMediaFormat* format);
+        virtual media_status_t  start();
+        virtual media_status_t  stop();
+        virtual media_status_t  writeSampleData(size_t track, const uint8_t* data, const AMediaCodecBufferInfo* info);
+    };
+
+    typedef std::function<std::unique_ptr<muxer_behaviour>(int fd, OutputFormat format)>    muxerFactory_t;
+
+    // Installs the factory used by AMediaMuxer_new. Without one, AMediaMuxer_new fails.
+    void    setMuxerFactory(muxerFactory_t factory);
+
+    // The consumer end of a stand-in Surface, such as an encoder's input. Frames rendered
+    // to the window arrive on the rendering thread, which the consumer may block to apply
+    // backpressure, as a full BufferQueue would.
+    class surface_consumer
+    {
+    public:
+        virtual ~surface_consumer() {}
+
+        virtual void    onFrameRendered(int64_t presentationTimeUs) = 0;
+    };
+
+    // A window that hands frames to consumer, holding one reference for the caller. Once
+    // the consumer detaches, frames rendered to the window are dropped.
+    ANativeWindow*  createSurface(surface_consumer* consumer);
+    void            detachSurface(ANativeWindow* window);
+
+    // What a codec configured with a window does in releaseOutputBuffer(index, true).
+    void            renderToSurface(ANativeWindow* window, int64_t presentationTimeUs);
+
+    // Log records below this priority are discarded. Defaults to ANDROID_LOG_WARN so the
+    // pipeline's per-buffer logging doesn't dominate host timings.
+    void    setLogPriority(android_LogPriority priority);
+}
+
+#endif //MEDIATEST_HOST_STAND_IN_MEDIA_H
@@ -0,0 +1,181 @@
+//
+// A stand-in extractor over synthetic media described by a one-line text file.
+//
+
+#include "synthetic_extractor.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+    const int   kSyncSizeFactor = 5;
+}
+
+namespace stand_in {
+
+    std::string synthetic_media::describe() const
+    {
+        char text[128];
+        std::snprintf(text, sizeof(text), "%u %u %u %u %d %d\n", frames, gop, fps, kbps, width, height);
+        return text;
+    }
+
+    bool synthetic_media::parse(const char* text, synthetic_media& result)
+    {
+        synthetic_media media;
+        if (6 != std::sscanf(text, "%u %u %u %u %d %d",
+                             &media.frames, &media.gop, &media.fps, &media.kbps, &media.width, &media.height) ||
+            media.gop == 0 ||
+            media.fps == 0)
+        {
+            return false;
+        }
+
+        result = media;
+        return true;
+    }
+
+    media_status_t synthetic_extractor::setDataSourceFd(int fd, off64_t offset, off64_t)
+    {
+        char text[128] = {};
+        const ssize_t length = pread(fd, text, sizeof(text) - 1, offset);
+        if (length <= 0 || !synthetic_media::parse(text, mMedia))
+        {
+            return AMEDIA_ERROR_MALFORMED;
+        }
+
+        // mean frame size at the described rate, split so that sync samples are
+        // kSyncSizeFactor times the others; then +/-20% from a fixed LCG
+        const double meanSize = mMedia.kbps * 1000.0 / 8.0 / mMedia.fps;
+        const double interSize = meanSize * mMedia.gop / (mMedia.gop + kSyncSizeFactor - 1);
+
+        mSizes.resize(mMedia.frames);
+        std::uint32_t state = 0x2545f491u;
+        for (unsigned int f = 0; f < mMedia.frames; ++f)
+        {
+            state = state * 1664525u + 1013904223u;
+            const double variation = 0.8 + 0.4 * double(state >> 8) / double(1u << 24);
+            const double base = (f % mMedia.gop == 0) ? kSyncSizeFactor * interSize : interSize;
+            mSizes[f] = std::max<std::uint32_t>(1, std::uint32_t(base * variation));
+        }
+
+        mOpen = true;
+        return AMEDIA_OK;
+    }
+
+    size_t synthetic_extractor::getTrackCount()
+    {
+        return mOpen ? 2 : 0;
+    }
+
+    AMediaFormat* synthetic_extractor::getTrackFormat(size_t index)
+    {
+        if (!mOpen || index >= 2)
+        {
+            return nullptr;
+        }
+
+        const std::int64_t durationUs = std::int64_t(mMedia.frames) * 1000000 / mMedia.fps;
+        AMediaFormat* const format = AMediaFormat_new();
+        AMediaFormat_setInt64(format, AMEDIAFORMAT_KEY_DURATION, durationUs);
+        if (index == 0)
+        {
+            AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, "video/avc");
+            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, mMedia.width);
+            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, mMedia.height);
+            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_FRAME_RATE, std::int32_t(mMedia.fps));
+            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_BIT_RATE, std::int32_t(mMedia.kbps * 1000));
+        }
+        else
+        {
+            AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, "audio/mp4a-latm");
+            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_SAMPLE_RATE, 48000);
+            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_CHANNEL_COUNT, 2);
+            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_BIT_RATE, 128000);
+        }
+        return format;
+    }
+
+    media_status_t synthetic_extractor::selectTrack(size_t index)
+    {
+        // only the video track has samples
+        if (!mOpen || index != 0)
+        {
+            return AMEDIA_ERROR_INVALID_PARAMETER;
+        }
+
+        mTrack = 0;
+        mNext = 0;
+        return AMEDIA_OK;
+    }
+
+    ssize_t synthetic_extractor::readSampleData(uint8_t* buffer, size_t capacity)
+    {
+        if (atEnd() || capacity < mSizes[mNext])
+        {
+            return -1;
+        }
+
+        std::memset(buffer, int(mNext & 0xff), mSizes[mNext]);
+        return ssize_t(mSizes[mNext]);
+    }
+
+    uint32_t synthetic_extractor::getSampleFlags()
+    {
+        if (atEnd())
+        {
+            return 0;
+        }
+        return (mNext % mMedia.gop == 0) ? AMEDIAEXTRACTOR_SAMPLE_FLAG_SYNC : 0;
+    }
+
+    int64_t synthetic_extractor::getSampleTime()
+    {
+        return atEnd() ? -1 : std::int64_t(mNext) * 1000000 / mMedia.fps;
+    }
+
+    ssize_t synthetic_extractor::getSampleSize()
+    {
+        return atEnd() ? -1 : ssize_t(mSizes[mNext]);
+    }
+
+    bool synthetic_extractor::advance()
+    {
+        if (atEnd())
+        {
+            return false;
+        }
+        return ++mNext < mMedia.frames;
+    }
+
+    media_status_t synthetic_extractor::seekTo(int64_t positionUs, SeekMode mode)
+    {
+        if (mTrack < 0)
+        {
+            return AMEDIA_ERROR_INVALID_OPERATION;
+        }
+
+        unsigned int frame = unsigned(std::max<int64_t>(positionUs, 0) * mMedia.fps / 1000000);
+        switch (mode)
+        {
+            case AMEDIAEXTRACTOR_SEEK_PREVIOUS_SYNC:
+                frame = frame / mMedia.gop * mMedia.gop;
+                break;
+            case AMEDIAEXTRACTOR_SEEK_NEXT_SYNC:
+                frame = (frame + mMedia.gop - 1) / mMedia.gop * mMedia.gop;
+                break;
+            default:
+                frame = (frame + mMedia.gop / 2) / mMedia.gop * mMedia.gop;
+                break;
+        }
+        mNext = std::min(frame, mMedia.frames);
+        return AMEDIA_OK;
+    }
+
+    bool synthetic_extractor::atEnd() const
+    {
+        return mTrack < 0 || mNext >= mMedia.frames;
+    }
+}
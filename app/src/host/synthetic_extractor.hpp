@@ -0,0 +1,60 @@
+//
+// A stand-in extractor over synthetic media described by a one-line text file, so the
+// probe can run on a host without a container parser.
+//
+
+#ifndef MEDIATEST_HOST_SYNTHETIC_EXTRACTOR_H
+#define MEDIATEST_HOST_SYNTHETIC_EXTRACTOR_H
+
+#include "stand_in_media.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace stand_in {
+
+    // What a descriptor file holds, as "frames gop fps kbps width height".
+    struct synthetic_media
+    {
+        unsigned int    frames  = 300;
+        unsigned int    gop     = 30;
+        unsigned int    fps     = 30;
+        unsigned int    kbps    = 8000;
+        std::int32_t    width   = 1920;
+        std::int32_t    height  = 1080;
+
+        std::string     describe() const;
+        static bool     parse(const char* text, synthetic_media& result);
+    };
+
+    // Track 0 is AVC video at the described rate, with sync samples every gop frames about
+    // five times the size of the others and some frame-to-frame variation; track 1 is AAC
+    // audio with a format but no samples. readSampleData fills the payload with a constant.
+    class synthetic_extractor : public extractor_behaviour
+    {
+    public:
+        media_status_t  setDataSourceFd(int fd, off64_t offset, off64_t length) override;
+        size_t          getTrackCount() override;
+        AMediaFormat*   getTrackFormat(size_t index) override;
+        media_status_t  selectTrack(size_t index) override;
+        ssize_t         readSampleData(uint8_t* buffer, size_t capacity) override;
+        uint32_t        getSampleFlags() override;
+        int64_t         getSampleTime() override;
+        ssize_t         getSampleSize() override;
+        bool            advance() override;
+        media_status_t  seekTo(int64_t positionUs, SeekMode mode) override;
+
+    private:
+        bool    atEnd() const;
+
+    private:
+        synthetic_media             mMedia;
+        bool                        mOpen       = false;
+        int                         mTrack      = -1;
+        unsigned int                mNext       = 0;
+        std::vector<std::uint32_t>  mSizes;
+    };
+}
+
+#endif //MEDIATEST_HOST_SYNTHETIC_EXTRACTOR_H
@@ -0,0 +1,603 @@
+//
+// Replays a codec callback timeline recorded by sample_main through sample::decoder on a
+// Linux host, to profile and debug the decoder's dispatch without a device.
+//
+//   timeline_replay <timeline> [options]
+//   timeline_replay --synthetic <frames> [options]
+//
+// Options: --asap, --verbose, --performance (thread_policy::performance),
+// --load <threads> (busy threads competing with the pipeline), --budget <bytes> (memory
+// budget for the pipeline; input is held back while over it), --driver async|polling|both
+// (which codec driver replays the timeline; both runs each in turn and compares their
+// throughput and latency), --consumer-us <us> (time the frame consumer spends on each
+// frame), --buffers <n> (codec buffers in a synthetic timeline; with more than the
+// decoder queues for its consumer, a slow consumer exercises backpressure),
+// --delivery frames|callback|window|all (how decoded frames leave the decoder).
+//
+// Deliveries: frames awaits sample::frames() with output_target(frame_output), so frames
+// carry their output buffers; callback hands each buffer to a plain outputBuffer_t and
+// window renders to a null window, neither with a coroutine awaiting the decoder. all
+// (the default) runs each in turn and compares coroutine dispatch with the callback.
+// Heap allocations are counted between the first frame and the last, and reported per
+// frame with the decoder's mean dispatch time, so per-frame allocation in the dispatch
+// path shows up. Exits non-zero if a replay doesn't reach end of stream, or drops frames.
+//
+
+#include "replay_codec.hpp"
+
+#include "StopWatch.hpp"
+#include "callback_timeline.hpp"
+#include "memory_accounting.hpp"
+#include "sample_app.hpp"
+#include "thread_policy.hpp"
+
+#include <boost/exception/diagnostic_information.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
+#include <utility>
+
+namespace {
+    std::atomic<std::uint64_t>  gAllocations(0);
+}
+
+void* operator new(std::size_t size)
+{
+    ++gAllocations;
+    if (void* const p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+    using sample::timeline_event;
+    using sample::timeline_event_type;
+
+    timeline_event makeEvent(timeline_event_type type,
+                             std::uint64_t timestampNs,
+                             std::int32_t index,
+                             std::int32_t size = 0,
+                             std::int64_t presentationTimeUs = 0,
+                             std::uint32_t flags = 0)
+    {
+        timeline_event result;
+        result.timestampNs = timestampNs;
+        result.presentationTimeUs = presentationTimeUs;
+        result.index = index;
+        result.size = size;
+        result.flags = flags;
+        result.type = std::uint8_t(type);
+        return result;
+    }
+
+    // A 30 fps decode with a bufferCount-deep input pipeline (four by default) and a
+    // three-frame decode delay, shaped like what a hardware AVC decoder produces.
+    std::vector<timeline_event> synthesizeTimeline(unsigned int frameCount, std::int32_t bufferCount)
+    {
+        const unsigned int      kDecodeDelay    = 3;
+        const std::uint64_t     kFrameNs        = 33333333;
+        const std::int32_t      kSampleSize     = 16 * 1024;
+        const std::int32_t      kFrameSize      = 1920 * 1080 * 3 / 2;
+
+        std::vector<timeline_event> result;
+        result.push_back(makeEvent(timeline_event_type::format_changed, 0, -1));
+
+        for (unsigned int i = 0; i < frameCount + kDecodeDelay; ++i)
+        {
+            const std::uint64_t now = kFrameNs * i;
+            const std::int32_t index = std::int32_t(i % bufferCount);
+
+            if (i < frameCount)
+            {
+                const std::uint32_t flags = (i + 1 == frameCount) ? AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM : 0;
+                result.push_back(makeEvent(timeline_event_type::input_available, now, index));
+                result.push_back(makeEvent(timeline_event_type::input_queued, now + 1000, index, kSampleSize, kFrameNs * i / 1000, flags));
+            }
+
+            if (i >= kDecodeDelay)
+            {
+                const unsigned int frame = i - kDecodeDelay;
+                const bool last = (frame + 1 == frameCount);
+                result.push_back(makeEvent(timeline_event_type::output_available,
+                                           now + 500000,
+                                           std::int32_t(frame % bufferCount),
+                                           last ? 0 : kFrameSize,
+                                           kFrameNs * frame / 1000,
+                                           last ? AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM : 0));
+            }
+        }
+
+        return result;
+    }
+
+    const double    kTimeoutSeconds     = 60.0;
+
+    enum class delivery
+    {
+        frames,
+        callback,
+        window,
+    };
+
+    const delivery      kDeliveries[]       = { delivery::frames, delivery::callback, delivery::window };
+    const char* const   kDeliveryNames[]    = { "frames", "callback", "window" };
+
+    struct replay_result
+    {
+        bool                        ran             = false;
+        unsigned int                frames          = 0;
+        unsigned int                withPixels      = 0;    // frames that came with their buffer
+        std::uint64_t               allocations     = 0;    // from the first frame to the last
+        double                      seconds         = 0.0;
+        sample::latency_statistics  latency;
+        sample::frame_statistics    frameStatistics;
+        std::uint64_t               peakBytes       = 0;
+        std::uint64_t               queuePeakBytes  = 0;    // the decoder's deferred work
+    };
+
+    // Works on each frame off the decoder's thread, as a consumer handing frames on to an
+    // encoder or a renderer would, so frames queue up in the decoder while it is busy.
+    class slow_consumer
+    {
+    public:
+        explicit slow_consumer(unsigned int workUs)
+                : mWorkUs(workUs),
+                  mThread(&slow_consumer::run, this)
+        {
+            // this space intentionally left blank
+        }
+
+        ~slow_consumer()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mDone = true;
+            }
+            mCondition.notify_one();
+            mThread.join();
+        }
+
+        // Resumes the awaiting coroutine on the consumer's thread once the work is done.
+        auto work()
+        {
+            struct awaiter
+            {
+                slow_consumer&  consumer;
+
+                bool    await_ready() const noexcept { return false; }
+                void    await_suspend(std::coroutine_handle<> h)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(consumer.mMutex);
+                        consumer.mWaiting = h;
+                    }
+                    consumer.mCondition.notify_one();
+                }
+                void    await_resume() noexcept { }
+            };
+            return awaiter{ *this };
+        }
+
+    private:
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while (true)
+            {
+                mCondition.wait(lock, [this]() { return mDone || mWaiting; });
+                if (!mWaiting)
+                {
+                    return;
+                }
+                const std::coroutine_handle<> h = std::exchange(mWaiting, nullptr);
+                lock.unlock();
+                std::this_thread::sleep_for(std::chrono::microseconds(mWorkUs));
+                h.resume();
+                lock.lock();
+            }
+        }
+
+    private:
+        const unsigned int          mWorkUs;
+        std::mutex                  mMutex;
+        std::condition_variable     mCondition;
+        std::coroutine_handle<>     mWaiting;
+        bool                        mDone       = false;
+        std::thread                 mThread;
+    };
+
+    // Counts a frame, and the allocations since the first.
+    class frame_counter
+    {
+    public:
+        explicit frame_counter(replay_result& result) : mResult(result) { }
+
+        void count(const sample::output_buffer_view& buffer)
+        {
+            if (0 == mResult.frames++)
+            {
+                mFirstAllocations = gAllocations;
+            }
+            if (buffer.data() && buffer.size() > 0)
+            {
+                ++mResult.withPixels;
+            }
+            mResult.allocations = gAllocations - mFirstAllocations;
+        }
+
+    private:
+        replay_result&  mResult;
+        std::uint64_t   mFirstAllocations   = 0;
+    };
+
+    sample::task consumeFrames(sample::decoder& decoder, frame_counter& counter, slow_consumer* consumer)
+    {
+        auto stream = sample::frames(decoder);
+        while (const sample::decoded_frame* frame = co_await stream.next())
+        {
+            counter.count(frame->buffer);
+            if (consumer)
+            {
+                co_await consumer->work();
+            }
+        }
+    }
+
+    sample::output_target makeTarget(delivery how, frame_counter& counter)
+    {
+        switch (how)
+        {
+            case delivery::frames:
+                return sample::output_target(sample::frame_output());
+            case delivery::callback:
+                return sample::output_target([&counter](sample::output_buffer_view view) { counter.count(view); });
+            case delivery::window:
+                break;
+        }
+        return sample::output_target(static_cast<ANativeWindow*>(nullptr));
+    }
+
+    replay_result replay(const std::vector<timeline_event>& events,
+                         stand_in::replay_pacing pacing,
+                         bool polling,
+                         delivery how,
+                         const sample::thread_policy& threadPolicy,
+                         std::uint64_t budgetBytes,
+                         unsigned int consumerUs)
+    {
+        stand_in::setCodecFactory([&events, pacing](const char*, bool isEncoder) {
+            return isEncoder ? nullptr
+                             : std::unique_ptr<stand_in::codec_behaviour>(new stand_in::replay_codec(events, pacing));
+        });
+
+        const sample::unique_media_format format(AMediaFormat_new());
+        AMediaFormat_setString(format.get(), AMEDIAFORMAT_KEY_MIME, "video/avc");
+        AMediaFormat_setInt32(format.get(), AMEDIAFORMAT_KEY_WIDTH, 1920);
+        AMediaFormat_setInt32(format.get(), AMEDIAFORMAT_KEY_HEIGHT, 1080);
+
+        sample::memory_accountant accountant(budgetBytes);
+        sample::decoder_options options;
+        options.threadPolicy = &threadPolicy;
+        options.accountant = budgetBytes ? &accountant : nullptr;
+
+        replay_result result;
+        result.ran = true;
+        frame_counter counter(result);
+        const StopWatch replayTimer;
+
+        const sample::output_target target = makeTarget(how, counter);
+        sample::decoder decoder = polling
+                ? sample::decoder(format.get(), stand_in::replay_samples(events), target, sample::polling_driver(), options)
+                : sample::decoder(format.get(), stand_in::replay_samples(events), target, sample::async_driver(), options);
+
+        // callback and window deliveries have nothing awaiting the decoder, which must run
+        // to the end all the same
+        std::unique_ptr<slow_consumer> slow(consumerUs ? new slow_consumer(consumerUs) : nullptr);
+        std::optional<sample::task> consumer;
+        if (how == delivery::frames)
+        {
+            consumer.emplace(consumeFrames(decoder, counter, slow.get()));
+        }
+        decoder.start();
+        while (!decoder.isDone() || (consumer && !consumer->done()))
+        {
+            if (replayTimer.getSplitTime().count() > kTimeoutSeconds)
+            {
+                // the decoder's threads are stuck; there is no clean way out
+                std::printf("FAIL: %s %s replay did not reach end of stream within %.0fs (%u frames)\n",
+                            polling ? "polling" : "async",
+                            kDeliveryNames[int(how)],
+                            kTimeoutSeconds,
+                            result.frames);
+                std::fflush(stdout);
+                std::_Exit(EXIT_FAILURE);
+            }
+        }
+        if (consumer)
+        {
+            consumer->get();
+        }
+
+        result.seconds = replayTimer.getSplitTime().count();
+        if (how == delivery::window)
+        {
+            // rendered frames never reach the client; the end-of-stream marker isn't one
+            result.frames = decoder.getFrameStatistics().delivered - 1;
+        }
+        result.latency = decoder.getLatencyStatistics();
+        result.frameStatistics = decoder.getFrameStatistics();
+        result.peakBytes = accountant.getTotalUsage().peak;
+        result.queuePeakBytes = accountant.getUsage(sample::memory_category::queues).peak;
+        return result;
+    }
+
+    int usage(const char* argv0)
+    {
+        std::fprintf(stderr,
+                     "usage: %s <timeline> | --synthetic <frames> [--asap] [--verbose] [--performance] [--load <threads>] [--budget <bytes>]\n"
+                     "       [--driver async|polling|both] [--consumer-us <us>] [--buffers <n>] [--delivery frames|callback|window|all]\n",
+                     argv0);
+        return EXIT_FAILURE;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* timelinePath = nullptr;
+    unsigned int syntheticFrames = 0;
+    stand_in::replay_pacing pacing = stand_in::replay_pacing::original;
+    bool performancePolicy = false;
+    unsigned int loadThreads = 0;
+    std::uint64_t budgetBytes = 0;
+    unsigned int consumerUs = 0;
+    std::int32_t bufferCount = 4;
+    bool drivers[2] = { true, false };  // async, polling
+    bool deliveries[3] = { true, true, true };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == std::strcmp(argv[i], "--asap"))
+        {
+            pacing = stand_in::replay_pacing::asap;
+        }
+        else if (0 == std::strcmp(argv[i], "--verbose"))
+        {
+            stand_in::setLogPriority(ANDROID_LOG_VERBOSE);
+        }
+        else if (0 == std::strcmp(argv[i], "--performance"))
+        {
+            performancePolicy = true;
+        }
+        else if (0 == std::strcmp(argv[i], "--load") && i + 1 < argc)
+        {
+            loadThreads = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (0 == std::strcmp(argv[i], "--budget") && i + 1 < argc)
+        {
+            budgetBytes = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (0 == std::strcmp(argv[i], "--consumer-us") && i + 1 < argc)
+        {
+            consumerUs = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (0 == std::strcmp(argv[i], "--buffers") && i + 1 < argc)
+        {
+            bufferCount = std::max(1l, std::strtol(argv[++i], nullptr, 10));
+        }
+        else if (0 == std::strcmp(argv[i], "--driver") && i + 1 < argc)
+        {
+            const char* const driver = argv[++i];
+            drivers[0] = (0 == std::strcmp(driver, "async") || 0 == std::strcmp(driver, "both"));
+            drivers[1] = (0 == std::strcmp(driver, "polling") || 0 == std::strcmp(driver, "both"));
+            if (!drivers[0] && !drivers[1])
+            {
+                return usage(argv[0]);
+            }
+        }
+        else if (0 == std::strcmp(argv[i], "--delivery") && i + 1 < argc)
+        {
+            const char* const how = argv[++i];
+            const bool all = (0 == std::strcmp(how, "all"));
+            bool any = false;
+            for (const delivery d : kDeliveries)
+            {
+                deliveries[int(d)] = all || 0 == std::strcmp(how, kDeliveryNames[int(d)]);
+                any = any || deliveries[int(d)];
+            }
+            if (!any)
+            {
+                return usage(argv[0]);
+            }
+        }
+        else if (0 == std::strcmp(argv[i], "--synthetic") && i + 1 < argc)
+        {
+            syntheticFrames = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argv[i][0] != '-' && !timelinePath)
+        {
+            timelinePath = argv[i];
+        }
+        else
+        {
+            return usage(argv[0]);
+        }
+    }
+    if (!timelinePath == !syntheticFrames)
+    {
+        return usage(argv[0]);
+    }
+
+    std::atomic<bool> loadDone(false);
+    std::vector<std::thread> load;
+    for (unsigned int i = 0; i < loadThreads; ++i)
+    {
+        load.emplace_back([&loadDone]() {
+            while (!loadDone)
+            {
+                // this space intentionally left blank
+            }
+        });
+    }
+
+    int result = EXIT_SUCCESS;
+    try
+    {
+        const sample::thread_policy threadPolicy = performancePolicy
+                ? sample::thread_policy::performance(sample::cpu_topology::detect())
+                : sample::thread_policy();
+        (void) threadPolicy.apply(sample::thread_role::main);
+
+        const std::vector<timeline_event> events = timelinePath ? sample::loadTimeline(timelinePath)
+                                                                : synthesizeTimeline(syntheticFrames, bufferCount);
+        const double recordedSeconds = events.empty() ? 0.0 : 1.0e-9 * (events.back().timestampNs - events.front().timestampNs);
+
+        replay_result results[2][3];
+        bool passed = true;
+        for (const bool polling : { false, true })
+        {
+            if (!drivers[polling])
+            {
+                continue;
+            }
+
+            for (const delivery how : kDeliveries)
+            {
+                if (!deliveries[int(how)])
+                {
+                    continue;
+                }
+
+                char name[32];
+                std::snprintf(name, sizeof(name), "%s %s", polling ? "polling" : "async", kDeliveryNames[int(how)]);
+                const replay_result& r = results[polling][int(how)] =
+                        replay(events, pacing, polling, how, threadPolicy, budgetBytes, consumerUs);
+                std::printf("%s: replayed %zu events, %u frames in %.3fs (recorded %.3fs, %.1f fps)\n",
+                            name,
+                            events.size(),
+                            r.frames,
+                            r.seconds,
+                            recordedSeconds,
+                            r.frames / r.seconds);
+                std::printf("%s: latency ms: mean %.3f p50 <%.3f p99 <%.3f max %.3f (threads:%s load:%u)\n",
+                            name,
+                            r.latency.meanMs,
+                            r.latency.p50Ms,
+                            r.latency.p99Ms,
+                            r.latency.maxMs,
+                            performancePolicy ? "performance" : "default",
+                            loadThreads);
+                const sample::frame_statistics& f = r.frameStatistics;
+                std::printf("%s: %u of %u frames with pixels, %.2f allocations/frame, dispatch mean %.3f us/frame, held back %u, dropped %u\n",
+                            name,
+                            r.withPixels,
+                            r.frames,
+                            double(r.allocations) / std::max(r.frames, 1u),
+                            1.0e6 * f.dispatchTime.count() / std::max(f.delivered, 1u),
+                            f.heldBack,
+                            f.dropped);
+                if (budgetBytes)
+                {
+                    std::printf("%s: memory peak %" PRIu64 " bytes (queues %" PRIu64 "), budget %" PRIu64 "\n",
+                                name,
+                                r.peakBytes,
+                                r.queuePeakBytes,
+                                budgetBytes);
+                    if (r.queuePeakBytes == 0)
+                    {
+                        // the decoder's deferred-work containers report to the accountant
+                        std::printf("FAIL: %s queues were never accounted\n", name);
+                        passed = false;
+                    }
+                }
+
+                if (f.dropped > 0)
+                {
+                    std::printf("FAIL: %s dropped %u frames\n", name, f.dropped);
+                    passed = false;
+                }
+            }
+
+            // the coroutine's cost over the plain callback, each handed the same buffers
+            const replay_result& coroutine = results[polling][int(delivery::frames)];
+            const replay_result& callback = results[polling][int(delivery::callback)];
+            if (coroutine.ran && callback.ran)
+            {
+                const double coroutineUs = 1.0e6 * coroutine.frameStatistics.dispatchTime.count() /
+                                           std::max(coroutine.frameStatistics.delivered, 1u);
+                const double callbackUs = 1.0e6 * callback.frameStatistics.dispatchTime.count() /
+                                          std::max(callback.frameStatistics.delivered, 1u);
+                std::printf("%s frames vs callback: dispatch mean %.3f vs %.3f us/frame (%+.3f us), %.2f vs %.2f allocations/frame, %.2fx throughput\n",
+                            polling ? "polling" : "async",
+                            coroutineUs,
+                            callbackUs,
+                            coroutineUs - callbackUs,
+                            double(coroutine.allocations) / std::max(coroutine.frames, 1u),
+                            double(callback.allocations) / std::max(callback.frames, 1u),
+                            (coroutine.frames / coroutine.seconds) / (callback.frames / callback.seconds));
+                if (coroutine.frames != callback.frames)
+                {
+                    std::printf("FAIL: %u frames awaited, %u handed to the callback\n", coroutine.frames, callback.frames);
+                    passed = false;
+                }
+            }
+        }
+
+        if (drivers[0] && drivers[1])
+        {
+            for (const delivery how : kDeliveries)
+            {
+                const replay_result& a = results[0][int(how)];
+                const replay_result& p = results[1][int(how)];
+                if (a.ran && p.ran)
+                {
+                    std::printf("polling vs async (%s): %.2fx throughput, mean latency %+.3f ms, p99 <%.3f vs <%.3f ms\n",
+                                kDeliveryNames[int(how)],
+                                (p.frames / p.seconds) / (a.frames / a.seconds),
+                                p.latency.meanMs - a.latency.meanMs,
+                                p.latency.p99Ms,
+                                a.latency.p99Ms);
+                }
+            }
+        }
+
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        result = passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", boost::diagnostic_information(e).c_str());
+        result = EXIT_FAILURE;
+    }
+
+    loadDone = true;
+    for (auto& t : load)
+    {
+        t.join();
+    }
+
+    return result;
+}
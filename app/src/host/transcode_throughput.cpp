@@ -0,0 +1,251 @@
+//
+// Transcodes a synthetic stream through sample::transcoder with stand-in codecs and a
+// recording muxer, on the surface path and the CPU-copy path, and reports end-to-end fps
+// and CPU time for each. Checks what reached the muxer and exits non-zero on a mismatch.
+//
+//   transcode_throughput [--frames <n>] [--size <w>x<h>] [--gop <frames>] [--decode-us <us>] [--encode-us <us>] [--path surface|cpu_copy]
+//
+// The stand-in decoder's output buffers hold real frame-sized memory, so the CPU-copy
+// path pays for its copies here as it would on a device; the surface path moves only
+// timestamps, as a device moves only buffer handles.
+//
+
+#include "encoder_codec.hpp"
+#include "fault_codec.hpp"
+#include "recording_muxer.hpp"
+
+#include "StopWatch.hpp"
+#include "transcoder.hpp"
+
+#include <boost/exception/diagnostic_information.hpp>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+    const std::int64_t  kFrameDurationUs    = 33333;
+    const double        kTimeoutSeconds     = 120.0;
+
+    struct run_result
+    {
+        double          seconds     = 0.0;
+        double          cpuSeconds  = 0.0;
+        bool            passed      = false;
+    };
+
+    double cpuSeconds(const rusage& usage)
+    {
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+               1.0e-6 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+    }
+
+    run_result transcode(sample::transcode_path path,
+                         unsigned int frameCount,
+                         unsigned int gopLength,
+                         const stand_in::fault_codec::config& decoderConfig,
+                         const stand_in::encoder_codec::config& encoderConfig)
+    {
+        const auto noFaults = std::make_shared<stand_in::fault_plan>(std::vector<stand_in::fault>());
+        stand_in::setCodecFactory([noFaults, decoderConfig, encoderConfig](const char*, bool isEncoder) {
+            return isEncoder
+                    ? std::unique_ptr<stand_in::codec_behaviour>(new stand_in::encoder_codec(encoderConfig))
+                    : std::unique_ptr<stand_in::codec_behaviour>(new stand_in::fault_codec(noFaults, decoderConfig));
+        });
+
+        const auto record = std::make_shared<stand_in::muxer_record>();
+        stand_in::setMuxerFactory([record](int fd, OutputFormat) {
+            return std::unique_ptr<stand_in::muxer_behaviour>(new stand_in::recording_muxer(fd, record));
+        });
+
+        char outputPath[] = "/tmp/transcode_throughput.XXXXXX";
+        const sample::unique_fd outputFd(mkstemp(outputPath));
+        if (!outputFd)
+        {
+            std::perror("mkstemp");
+            return run_result();
+        }
+        (void) unlink(outputPath);
+
+        const sample::unique_media_format format(AMediaFormat_new());
+        AMediaFormat_setString(format.get(), AMEDIAFORMAT_KEY_MIME, "video/avc");
+        AMediaFormat_setInt32(format.get(), AMEDIAFORMAT_KEY_WIDTH, decoderConfig.width);
+        AMediaFormat_setInt32(format.get(), AMEDIAFORMAT_KEY_HEIGHT, decoderConfig.height);
+        AMediaFormat_setInt32(format.get(), AMEDIAFORMAT_KEY_FRAME_RATE, 30);
+
+        sample::transcode_options options;
+        options.path = path;
+        options.encoder.iFrameIntervalSeconds = 1;
+
+        stand_in::synthetic_samples samples(frameCount, gopLength, kFrameDurationUs);
+
+        rusage usageBefore;
+        getrusage(RUSAGE_SELF, &usageBefore);
+        const StopWatch transcodeTimer;
+
+        run_result result;
+        {
+            sample::transcoder transcoder(format.get(),
+                                          std::ref(samples),
+                                          outputFd.get(),
+                                          sample::async_driver(),
+                                          options);
+            transcoder.start();
+            while (!transcoder.isDone())
+            {
+                if (transcodeTimer.getSplitTime().count() > kTimeoutSeconds)
+                {
+                    // the pipeline's threads are stuck; there is no clean way out
+                    std::fprintf(stderr, "FAIL: %s transcode did not finish within %.0fs\n",
+                                 sample::toString(path),
+                                 kTimeoutSeconds);
+                    std::fflush(stderr);
+                    std::_Exit(EXIT_FAILURE);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            transcoder.get();
+            result.seconds = transcodeTimer.getSplitTime().count();
+
+            rusage usageAfter;
+            getrusage(RUSAGE_SELF, &usageAfter);
+            result.cpuSeconds = cpuSeconds(usageAfter) - cpuSeconds(usageBefore);
+
+            const sample::transcode_statistics stats = transcoder.getStatistics();
+            const std::uint64_t keyFrames = (frameCount + 29) / 30;
+            const off_t fileSize = lseek(outputFd.get(), 0, SEEK_END);
+
+            result.passed = true;
+            auto check = [&result](bool ok, const char* what) {
+                if (!ok)
+                {
+                    std::printf("FAIL: %s\n", what);
+                    result.passed = false;
+                }
+            };
+            check(stats.framesDecoded == frameCount, "every frame decoded");
+            check(stats.encoder.framesEncoded == frameCount && record->samples == frameCount, "every frame encoded and muxed");
+            check(record->syncSamples == keyFrames && stats.encoder.syncFrames == keyFrames, "a key frame every second");
+            check(record->lastPresentationTimeUs == kFrameDurationUs * (frameCount - 1), "the last frame's pts");
+            check(record->tracks == 1 && record->started && record->stopped && record->hasCodecConfig, "one track, with csd, finalized");
+            check(record->violations.empty(), "muxer calls in order");
+            check(fileSize >= 0 && std::uint64_t(fileSize) == record->bytes && record->bytes == stats.encoder.bytesMuxed,
+                  "every muxed byte written");
+            for (const auto& v : record->violations)
+            {
+                std::printf("  muxer: %s\n", v.c_str());
+            }
+
+            std::printf("%-8s: %" PRIu64 "/%u frames in %.3fs (%.1f fps) cpu %.3fs (%.0f%%) muxed %" PRIu64 " bytes, "
+                        "copied %.1f MB in %.3fs, waited %.3fs for encoder input\n",
+                        sample::toString(path),
+                        stats.encoder.framesEncoded,
+                        frameCount,
+                        result.seconds,
+                        frameCount / std::max(result.seconds, 1.0e-9),
+                        result.cpuSeconds,
+                        100.0 * result.cpuSeconds / std::max(result.seconds, 1.0e-9),
+                        record->bytes,
+                        1.0e-6 * stats.encoder.bytesCopied,
+                        stats.encoder.copyTime.count(),
+                        stats.encoder.inputWaitTime.count());
+        }
+        return result;
+    }
+
+    int usage(const char* argv0)
+    {
+        std::fprintf(stderr,
+                     "usage: %s [--frames <n>] [--size <w>x<h>] [--gop <frames>] [--decode-us <us>] [--encode-us <us>] [--path surface|cpu_copy]\n",
+                     argv0);
+        return EXIT_FAILURE;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int frameCount = 600;
+    unsigned int gopLength = 30;
+    stand_in::fault_codec::config decoderConfig;
+    stand_in::encoder_codec::config encoderConfig;
+    std::vector<sample::transcode_path> paths = { sample::transcode_path::surface, sample::transcode_path::cpu_copy };
+
+    decoderConfig.decodeTime = std::chrono::microseconds(1000);
+    encoderConfig.encodeTime = std::chrono::microseconds(1000);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == std::strcmp(argv[i], "--frames") && i + 1 < argc)
+        {
+            frameCount = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (0 == std::strcmp(argv[i], "--size") && i + 1 < argc)
+        {
+            if (2 != std::sscanf(argv[++i], "%dx%d", &decoderConfig.width, &decoderConfig.height) ||
+                decoderConfig.width <= 0 || decoderConfig.height <= 0 ||
+                (decoderConfig.width & 1) || (decoderConfig.height & 1))
+            {
+                return usage(argv[0]);
+            }
+        }
+        else if (0 == std::strcmp(argv[i], "--gop") && i + 1 < argc)
+        {
+            gopLength = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (0 == std::strcmp(argv[i], "--decode-us") && i + 1 < argc)
+        {
+            decoderConfig.decodeTime = std::chrono::microseconds(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (0 == std::strcmp(argv[i], "--encode-us") && i + 1 < argc)
+        {
+            encoderConfig.encodeTime = std::chrono::microseconds(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (0 == std::strcmp(argv[i], "--path") && i + 1 < argc)
+        {
+            const char* const name = argv[++i];
+            if (0 == std::strcmp(name, "surface"))          paths = { sample::transcode_path::surface };
+            else if (0 == std::strcmp(name, "cpu_copy"))    paths = { sample::transcode_path::cpu_copy };
+            else                                            return usage(argv[0]);
+        }
+        else
+        {
+            return usage(argv[0]);
+        }
+    }
+
+    bool passed = true;
+    std::vector<run_result> results;
+    try
+    {
+        for (const auto path : paths)
+        {
+            results.push_back(transcode(path, frameCount, gopLength, decoderConfig, encoderConfig));
+            passed = passed && results.back().passed;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", boost::diagnostic_information(e).c_str());
+        return EXIT_FAILURE;
+    }
+
+    if (results.size() == 2)
+    {
+        std::printf("surface vs cpu_copy: %.2fx the fps, %.2fx the cpu time\n",
+                    results[1].seconds / std::max(results[0].seconds, 1.0e-9),
+                    results[0].cpuSeconds / std::max(results[1].cpuSeconds, 1.0e-9));
+    }
+
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
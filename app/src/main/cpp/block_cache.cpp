@@ -0,0 +1,335 @@
+//
+// User-space block cache with sequential read-ahead over a file descriptor.
+//
+
+#include "block_cache.hpp"
+
+#include "sample_error.hpp"
+
+#include <boost/exception/all.hpp>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+namespace sample {
+
+    block_cache::block_cache(int fd)
+            : block_cache(fd, config())
+    {
+        // this space intentionally left blank
+    }
+
+    block_cache::block_cache(int fd, const config& cfg)
+            : mFd(fd),
+              mConfig(cfg),
+              mBytesRequested(0),
+              mBytesRead(0),
+              mCacheHits(0),
+              mCacheMisses(0),
+              mSyscalls(0),
+              mReadAheadBlocks(0),
+              mReadAheadDropped(0)
+    {
+        assert(mConfig.blockSize > 0 && 0 == (mConfig.blockSize & (mConfig.blockSize - 1)));
+        assert(mConfig.readAheadBlocks < mConfig.maxBlocks);
+
+        struct stat64 st;
+        if (fstat64(mFd, &st) < 0)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("fstat64")
+                                           << boost::errinfo_errno(errno) );
+        }
+        ++mSyscalls;
+
+        mFileSize = st.st_size;
+        mNumBlocks = (mFileSize + mConfig.blockSize - 1) / mConfig.blockSize;
+
+        if (mConfig.readAheadBlocks > 0)
+        {
+            mReadAheadThread = std::thread(&block_cache::readAheadThread, this);
+        }
+    }
+
+    block_cache::~block_cache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mShuttingDown = true;
+        }
+        mReadAheadCondition.notify_all();
+
+        if (mReadAheadThread.joinable())
+        {
+            mReadAheadThread.join();
+        }
+
+        if (mConfig.accountant)
+        {
+            mConfig.accountant->remove(memory_category::heap, mNumBuffers * mConfig.blockSize);
+        }
+    }
+
+    ssize_t block_cache::readAt(off64_t offset, void* buffer, std::size_t size)
+    {
+        if (offset < 0)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        if (offset >= mFileSize || 0 == size)
+        {
+            return 0;
+        }
+        size = std::min<std::uint64_t>(size, mFileSize - offset);
+
+        mBytesRequested += size;
+
+        std::uint8_t* dest = static_cast<std::uint8_t*>(buffer);
+        std::size_t copied = 0;
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        noteAccess(offset, size);
+
+        while (copied < size)
+        {
+            const std::uint64_t position = offset + copied;
+            const std::uint64_t index = position / mConfig.blockSize;
+            const std::size_t offsetInBlock = position % mConfig.blockSize;
+
+            const auto it = findOrLoadBlock(lock, index);
+            if (it == mBlocks.end())
+            {
+                return (copied > 0) ? ssize_t(copied) : -1;
+            }
+            if (offsetInBlock >= it->length)
+            {
+                // the file was truncated underneath us
+                break;
+            }
+
+            const std::size_t count = std::min(size - copied, it->length - offsetInBlock);
+            std::memcpy(dest + copied, it->data.get() + offsetInBlock, count);
+            copied += count;
+        }
+
+        return copied;
+    }
+
+    block_cache::statistics block_cache::getStatistics() const
+    {
+        statistics result;
+        result.bytesRequested = mBytesRequested;
+        result.bytesRead = mBytesRead;
+        result.cacheHits = mCacheHits;
+        result.cacheMisses = mCacheMisses;
+        result.syscalls = mSyscalls;
+        result.readAheadBlocks = mReadAheadBlocks;
+        result.readAheadDropped = mReadAheadDropped;
+        return result;
+    }
+
+    block_cache::block_list::iterator block_cache::findOrLoadBlock(std::unique_lock<std::mutex>& lock,
+                                                                   std::uint64_t index)
+    {
+        for (;;)
+        {
+            const auto found = mBlockIndex.find(index);
+            if (found == mBlockIndex.end())
+            {
+                ++mCacheMisses;
+                return loadBlock(lock, index);
+            }
+
+            const auto it = found->second;
+            if (it->ready)
+            {
+                ++mCacheHits;
+                mBlocks.splice(mBlocks.begin(), mBlocks, it);
+                return it;
+            }
+
+            // Another thread (usually read-ahead) is loading this block. If that load fails
+            // the placeholder disappears and the next pass loads the block itself.
+            mBlockReadyCondition.wait(lock);
+        }
+    }
+
+    block_cache::block_list::iterator block_cache::loadBlock(std::unique_lock<std::mutex>& lock,
+                                                             std::uint64_t index)
+    {
+        assert(lock.owns_lock());
+        assert(mBlockIndex.find(index) == mBlockIndex.end());
+
+        mBlocks.emplace_front();
+        const auto it = mBlocks.begin();
+        it->index = index;
+        it->data = allocateBuffer();
+        mBlockIndex[index] = it;
+
+        std::uint8_t* const data = it->data.get();
+        const off64_t blockOffset = off64_t(index) * mConfig.blockSize;
+        const std::size_t wanted = std::min<std::uint64_t>(mConfig.blockSize, mFileSize - blockOffset);
+
+        lock.unlock();
+
+        std::size_t length = 0;
+        bool failed = false;
+        while (length < wanted)
+        {
+            const ssize_t result = pread64(mFd, data + length, wanted - length, blockOffset + length);
+            ++mSyscalls;
+            if (result < 0)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                failed = true;
+                break;
+            }
+            if (0 == result)
+            {
+                break;
+            }
+            length += result;
+        }
+        mBytesRead += length;
+
+        lock.lock();
+
+        if (failed)
+        {
+            const int savedErrno = errno;
+            mFreeBuffers.push_back(std::move(it->data));
+            mBlockIndex.erase(index);
+            mBlocks.erase(it);
+            mBlockReadyCondition.notify_all();
+            errno = savedErrno;
+            return mBlocks.end();
+        }
+
+        it->length = length;
+        it->ready = true;
+        mBlockReadyCondition.notify_all();
+
+        evictBlocks();
+
+        return it;
+    }
+
+    block_cache::block_buffer block_cache::allocateBuffer()
+    {
+        if (!mFreeBuffers.empty())
+        {
+            block_buffer result = std::move(mFreeBuffers.back());
+            mFreeBuffers.pop_back();
+            return result;
+        }
+
+        const std::size_t alignment = std::max<std::size_t>(sysconf(_SC_PAGESIZE), sizeof(void*));
+        void* memory = nullptr;
+        if (0 != posix_memalign(&memory, alignment, mConfig.blockSize))
+        {
+            throw std::bad_alloc();
+        }
+
+        ++mNumBuffers;
+        if (mConfig.accountant)
+        {
+            mConfig.accountant->add(memory_category::heap, mConfig.blockSize);
+        }
+        return block_buffer(static_cast<std::uint8_t*>(memory));
+    }
+
+    void block_cache::evictBlocks()
+    {
+        auto it = mBlocks.end();
+        while (mBlocks.size() > mConfig.maxBlocks && it != mBlocks.begin())
+        {
+            --it;
+            if (!it->ready)
+            {
+                continue;
+            }
+
+            mFreeBuffers.push_back(std::move(it->data));
+            mBlockIndex.erase(it->index);
+            it = mBlocks.erase(it);
+        }
+    }
+
+    void block_cache::noteAccess(off64_t offset, std::size_t size)
+    {
+        // Treat small forward skips (within one block) as sequential; extractors commonly
+        // step over box headers and interleaved tracks.
+        const bool sequential = (mLastReadEnd >= 0 &&
+                                 offset >= mLastReadEnd &&
+                                 std::uint64_t(offset - mLastReadEnd) < mConfig.blockSize);
+        mSequentialReads = sequential ? mSequentialReads + 1 : 0;
+        mLastReadEnd = offset + size;
+        if (!sequential)
+        {
+            // blocks still queued for the old position would only evict ones near the new
+            mReadAheadDropped += mReadAheadQueue.size();
+            mReadAheadQueue.clear();
+            mReadAheadNext = 0;
+        }
+
+        if (mConfig.readAheadBlocks == 0 || mSequentialReads < mConfig.sequentialThreshold)
+        {
+            return;
+        }
+
+        const std::uint64_t lastBlock = (mLastReadEnd - 1) / mConfig.blockSize;
+        const std::uint64_t windowEnd = std::min<std::uint64_t>(lastBlock + 1 + mConfig.readAheadBlocks,
+                                                                mNumBlocks);
+        std::uint64_t next = std::max(lastBlock + 1, mReadAheadNext);
+        if (next >= windowEnd)
+        {
+            return;
+        }
+
+        for (; next < windowEnd; ++next)
+        {
+            mReadAheadQueue.push_back(next);
+        }
+        mReadAheadNext = windowEnd;
+        mReadAheadCondition.notify_one();
+    }
+
+    void block_cache::readAheadThread()
+    {
+        if (mConfig.threadPolicy)
+        {
+            (void) mConfig.threadPolicy->apply(thread_role::read_ahead);
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        for (;;)
+        {
+            mReadAheadCondition.wait(lock, [this]() { return mShuttingDown || !mReadAheadQueue.empty(); });
+            if (mShuttingDown)
+            {
+                break;
+            }
+
+            const std::uint64_t index = mReadAheadQueue.front();
+            mReadAheadQueue.pop_front();
+
+            if (mBlockIndex.find(index) == mBlockIndex.end())
+            {
+                if (loadBlock(lock, index) != mBlocks.end())
+                {
+                    ++mReadAheadBlocks;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,133 @@
+//
+// User-space block cache with sequential read-ahead over a file descriptor.
+//
+
+#ifndef MEDIATEST_BLOCK_CACHE_H
+#define MEDIATEST_BLOCK_CACHE_H
+
+#include "memory_accounting.hpp"
+#include "thread_policy.hpp"
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace sample {
+
+    // block_cache sits between a consumer issuing small, scattered reads (e.g. a media
+    // extractor) and the underlying file. Reads are served from an LRU set of fixed-size,
+    // aligned blocks. When the consumer is detected to be reading sequentially, the
+    // following blocks are fetched on a background thread so that they are resident by
+    // the time they are asked for.
+    //
+    // block_cache does not own the file descriptor; it must stay open for the lifetime of
+    // the cache. The cache depends only on POSIX and can be exercised on a Linux host.
+    class block_cache
+    {
+    public:
+        struct config
+        {
+            std::size_t     blockSize           = 256 * 1024;   // power of two
+            std::size_t     maxBlocks           = 32;
+            std::size_t     readAheadBlocks     = 4;            // 0 disables read-ahead
+            unsigned int    sequentialThreshold = 2;            // sequential reads before read-ahead kicks in
+            memory_accountant*  accountant      = nullptr;      // charged for block buffers as heap
+            const thread_policy* threadPolicy   = nullptr;      // applied to the read-ahead thread
+        };
+
+        struct statistics
+        {
+            std::uint64_t   bytesRequested  = 0;    // bytes asked of readAt
+            std::uint64_t   bytesRead       = 0;    // bytes read from the file
+            std::uint64_t   cacheHits       = 0;
+            std::uint64_t   cacheMisses     = 0;
+            std::uint64_t   syscalls        = 0;
+            std::uint64_t   readAheadBlocks = 0;    // blocks loaded by the read-ahead thread
+            std::uint64_t   readAheadDropped = 0;   // scheduled blocks abandoned at a seek
+        };
+
+        explicit block_cache(int fd);
+        block_cache(int fd, const config& cfg);
+
+        block_cache(const block_cache& other) = delete;
+        ~block_cache();
+
+        block_cache& operator=(const block_cache& other) = delete;
+
+        // pread-like: returns the number of bytes copied, 0 at end of file, -1 on error.
+        ssize_t         readAt(off64_t offset, void* buffer, std::size_t size);
+
+        off64_t         size() const { return mFileSize; }
+
+        statistics      getStatistics() const;
+
+    private:
+        struct free_deleter
+        {
+            void operator()(std::uint8_t* p) const { std::free(p); }
+        };
+        typedef std::unique_ptr<std::uint8_t, free_deleter>     block_buffer;
+
+        struct block
+        {
+            std::uint64_t   index   = 0;
+            std::size_t     length  = 0;
+            bool            ready   = false;
+            block_buffer    data;
+        };
+        typedef std::list<block>    block_list;
+
+    private:
+        // Both must be called with mMutex held; loadBlock releases it while reading.
+        block_list::iterator    findOrLoadBlock(std::unique_lock<std::mutex>& lock, std::uint64_t index);
+        block_list::iterator    loadBlock(std::unique_lock<std::mutex>& lock, std::uint64_t index);
+
+        block_buffer    allocateBuffer();
+        void            evictBlocks();
+        void            noteAccess(off64_t offset, std::size_t size);
+        void            readAheadThread();
+
+    private:
+        const int                   mFd;
+        const config                mConfig;
+        off64_t                     mFileSize   = 0;
+        std::uint64_t               mNumBlocks  = 0;
+
+        mutable std::mutex          mMutex;
+        std::condition_variable     mBlockReadyCondition;
+        block_list                  mBlocks;        // most recently used at the front
+        std::unordered_map<std::uint64_t, block_list::iterator>     mBlockIndex;
+        std::vector<block_buffer>   mFreeBuffers;
+        std::size_t                 mNumBuffers     = 0;    // allocated, whether in use or free
+
+        off64_t                     mLastReadEnd        = -1;
+        unsigned int                mSequentialReads    = 0;
+        std::uint64_t               mReadAheadNext      = 0;    // first block not yet scheduled
+
+        std::condition_variable     mReadAheadCondition;
+        std::deque<std::uint64_t>   mReadAheadQueue;
+        bool                        mShuttingDown       = false;
+        std::thread                 mReadAheadThread;
+
+        std::atomic<std::uint64_t>  mBytesRequested;
+        std::atomic<std::uint64_t>  mBytesRead;
+        std::atomic<std::uint64_t>  mCacheHits;
+        std::atomic<std::uint64_t>  mCacheMisses;
+        std::atomic<std::uint64_t>  mSyscalls;
+        std::atomic<std::uint64_t>  mReadAheadBlocks;
+        std::atomic<std::uint64_t>  mReadAheadDropped;
+    };
+}
+
+#endif //MEDIATEST_BLOCK_CACHE_H
@@ -0,0 +1,134 @@
+//
+// Compact binary timeline of codec callbacks, recorded on device and replayed on a host.
+//
+
+#include "callback_timeline.hpp"
+
+#include "sample_error.hpp"
+
+#include <boost/exception/all.hpp>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+namespace {
+    using namespace sample;
+
+    const char          kTimelineMagic[4]   = { 'M', 'T', 'T', 'L' };
+    const std::uint32_t kTimelineVersion    = 1;
+
+    struct timeline_header
+    {
+        char            magic[4];
+        std::uint32_t   version;
+        std::uint32_t   eventSize;
+        std::uint32_t   reserved;
+    };
+
+    struct file_closer
+    {
+        void operator()(std::FILE* f) const { std::fclose(f); }
+    };
+    typedef std::unique_ptr<std::FILE, file_closer>     unique_file;
+
+    unique_file openFile(const char* path, const char* mode)
+    {
+        unique_file result(std::fopen(path, mode));
+        if (!result)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("fopen")
+                                           << boost::errinfo_errno(errno)
+                                           << boost::errinfo_file_name(path) );
+        }
+        return result;
+    }
+
+    void failTimelineFile(const char* apiFunction, const char* path)
+    {
+        BOOST_THROW_EXCEPTION( sample_error()
+                                       << boost::errinfo_api_function(apiFunction)
+                                       << boost::errinfo_file_name(path) );
+    }
+}
+
+namespace sample {
+
+    callback_recorder::callback_recorder(std::size_t reserveEvents)
+    {
+        mEvents.reserve(reserveEvents);
+    }
+
+    void callback_recorder::record(timeline_event_type type,
+                                   std::int32_t index,
+                                   std::int32_t size,
+                                   std::int64_t presentationTimeUs,
+                                   std::uint32_t flags)
+    {
+        timeline_event event;
+        event.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        event.presentationTimeUs = presentationTimeUs;
+        event.index = index;
+        event.size = size;
+        event.flags = flags;
+        event.type = std::uint8_t(type);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEvents.push_back(event);
+    }
+
+    std::vector<timeline_event> callback_recorder::events() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mEvents;
+    }
+
+    void callback_recorder::save(const char* path) const
+    {
+        const auto snapshot = events();
+
+        timeline_header header;
+        std::memcpy(header.magic, kTimelineMagic, sizeof(header.magic));
+        header.version = kTimelineVersion;
+        header.eventSize = sizeof(timeline_event);
+        header.reserved = 0;
+
+        const auto file = openFile(path, "wb");
+        if (1 != std::fwrite(&header, sizeof(header), 1, file.get()) ||
+            snapshot.size() != std::fwrite(snapshot.data(), sizeof(timeline_event), snapshot.size(), file.get()))
+        {
+            failTimelineFile("fwrite", path);
+        }
+    }
+
+    std::vector<timeline_event> loadTimeline(const char* path)
+    {
+        const auto file = openFile(path, "rb");
+
+        timeline_header header;
+        if (1 != std::fread(&header, sizeof(header), 1, file.get()) ||
+            0 != std::memcmp(header.magic, kTimelineMagic, sizeof(header.magic)) ||
+            header.version != kTimelineVersion ||
+            header.eventSize != sizeof(timeline_event))
+        {
+            failTimelineFile("loadTimeline", path);
+        }
+
+        std::vector<timeline_event> result;
+        timeline_event event;
+        while (1 == std::fread(&event, sizeof(event), 1, file.get()))
+        {
+            result.push_back(event);
+        }
+        if (std::ferror(file.get()))
+        {
+            failTimelineFile("fread", path);
+        }
+
+        return result;
+    }
+}
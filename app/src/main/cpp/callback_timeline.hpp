@@ -0,0 +1,66 @@
+//
+// Compact binary timeline of codec callbacks, recorded on device and replayed on a host.
+//
+
+#ifndef MEDIATEST_CALLBACK_TIMELINE_H
+#define MEDIATEST_CALLBACK_TIMELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace sample {
+
+    enum class timeline_event_type : std::uint8_t
+    {
+        input_available,    // codec offered an input buffer
+        input_queued,       // decoder queued a sample: size, pts and flags of the sample
+        output_available,   // codec produced an output buffer
+        format_changed,
+        error,              // size holds the media_status_t, flags the action code
+    };
+
+    // Fixed-size, little-endian on every platform we run on.
+    struct timeline_event
+    {
+        std::uint64_t   timestampNs         = 0;    // steady clock
+        std::int64_t    presentationTimeUs  = 0;
+        std::int32_t    index               = -1;
+        std::int32_t    size                = 0;
+        std::uint32_t   flags               = 0;
+        std::uint8_t    type                = 0;    // timeline_event_type
+        std::uint8_t    reserved[3]         = { 0, 0, 0 };
+    };
+
+    static_assert(sizeof(timeline_event) == 32, "timeline_event is part of the file format");
+
+    // Appends events from any thread into a preallocated buffer; recording is a lock and
+    // a copy, so it can stay enabled during timing-sensitive runs.
+    class callback_recorder
+    {
+    public:
+        explicit callback_recorder(std::size_t reserveEvents = 1 << 16);
+
+        callback_recorder(const callback_recorder& other) = delete;
+        callback_recorder& operator=(const callback_recorder& other) = delete;
+
+        void    record(timeline_event_type type,
+                       std::int32_t index,
+                       std::int32_t size = 0,
+                       std::int64_t presentationTimeUs = 0,
+                       std::uint32_t flags = 0);
+
+        std::vector<timeline_event> events() const;
+
+        void    save(const char* path) const;
+
+    private:
+        mutable std::mutex              mMutex;
+        std::vector<timeline_event>     mEvents;
+    };
+
+    std::vector<timeline_event> loadTimeline(const char* path);
+}
+
+#endif //MEDIATEST_CALLBACK_TIMELINE_H
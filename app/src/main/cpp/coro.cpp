@@ -0,0 +1,68 @@
+//
+// Coroutine frame pool for the types in coro.hpp.
+//
+
+#include "coro.hpp"
+
+#include <array>
+#include <mutex>
+#include <new>
+
+namespace {
+    const std::size_t kSizeClassGranularity = 64;
+    const std::size_t kNumSizeClasses = 32;     // pool frames up to 2KiB; larger go to the heap
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    std::mutex                                      gPoolMutex;
+    std::array<free_block*, kNumSizeClasses>        gFreeLists {};
+
+    std::size_t sizeClass(std::size_t size)
+    {
+        return (size + kSizeClassGranularity - 1) / kSizeClassGranularity - 1;
+    }
+}
+
+namespace sample {
+    namespace frame_allocator {
+
+        void* allocate(std::size_t size)
+        {
+            const std::size_t cls = sizeClass(size);
+            if (cls >= kNumSizeClasses)
+            {
+                return ::operator new(size);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(gPoolMutex);
+                if (free_block* const block = gFreeLists[cls])
+                {
+                    gFreeLists[cls] = block->next;
+                    return block;
+                }
+            }
+
+            return ::operator new((cls + 1) * kSizeClassGranularity);
+        }
+
+        void deallocate(void* p, std::size_t size)
+        {
+            const std::size_t cls = sizeClass(size);
+            if (cls >= kNumSizeClasses)
+            {
+                ::operator delete(p);
+                return;
+            }
+
+            free_block* const block = static_cast<free_block*>(p);
+            std::lock_guard<std::mutex> lock(gPoolMutex);
+            block->next = gFreeLists[cls];
+            gFreeLists[cls] = block;
+        }
+
+    }
+}
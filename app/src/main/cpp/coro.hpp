@@ -0,0 +1,154 @@
+//
+// Minimal coroutine types used to consume decoder output: an eagerly started task and
+// an async generator. Coroutine frames come from a recycling pool rather than the
+// general-purpose heap.
+//
+
+#ifndef MEDIATEST_CORO_H
+#define MEDIATEST_CORO_H
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <utility>
+
+namespace sample {
+
+    // Recycles coroutine frames by size class. Frames are allocated when a coroutine is
+    // created, not per suspension, so steady-state decoding allocates nothing.
+    namespace frame_allocator {
+        void*   allocate(std::size_t size);
+        void    deallocate(void* p, std::size_t size);
+    }
+
+    struct pooled_promise
+    {
+        static void* operator new(std::size_t size) { return frame_allocator::allocate(size); }
+        static void operator delete(void* p, std::size_t size) { frame_allocator::deallocate(p, size); }
+    };
+
+    // A coroutine that starts running immediately and may finish on another thread.
+    // The owner polls done() (or blocks elsewhere) and destroys the task afterwards.
+    class task
+    {
+    public:
+        struct promise_type : pooled_promise
+        {
+            std::atomic<bool>   mDone { false };
+            std::exception_ptr  mException;
+
+            struct final_awaiter
+            {
+                bool await_ready() noexcept { return false; }
+                void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                {
+                    h.promise().mDone.store(true, std::memory_order_release);
+                }
+                void await_resume() noexcept { }
+            };
+
+            task                get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_never  initial_suspend() noexcept { return {}; }
+            final_awaiter       final_suspend() noexcept { return {}; }
+            void                return_void() { }
+            void                unhandled_exception() { mException = std::current_exception(); }
+        };
+
+        task(task&& other) noexcept : mHandle(std::exchange(other.mHandle, nullptr)) { }
+        task(const task& other) = delete;
+        ~task() { if (mHandle) mHandle.destroy(); }
+
+        task& operator=(const task& other) = delete;
+
+        bool    done() const { return mHandle.promise().mDone.load(std::memory_order_acquire); }
+
+        // Rethrows anything that escaped the coroutine body. Only valid once done().
+        void    get() const
+        {
+            if (mHandle.promise().mException)
+            {
+                std::rethrow_exception(mHandle.promise().mException);
+            }
+        }
+
+    private:
+        explicit task(std::coroutine_handle<promise_type> h) : mHandle(h) { }
+
+    private:
+        std::coroutine_handle<promise_type> mHandle;
+    };
+
+    // Lazily produces a sequence of T from a coroutine body that may itself co_await.
+    // Consumers iterate with
+    //
+    //     while (const T* value = co_await gen.next()) { ... }
+    //
+    // Control passes between consumer and producer by symmetric transfer, so a value
+    // produced on some thread is consumed on that same thread with no queueing.
+    template <typename T>
+    class async_generator
+    {
+    public:
+        struct promise_type : pooled_promise
+        {
+            const T*                    mValue = nullptr;
+            std::coroutine_handle<>     mConsumer;
+            std::exception_ptr          mException;
+
+            struct yield_awaiter
+            {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                {
+                    return h.promise().mConsumer;
+                }
+                void await_resume() noexcept { }
+            };
+
+            async_generator     get_return_object() { return async_generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            yield_awaiter       final_suspend() noexcept { mValue = nullptr; return {}; }
+            yield_awaiter       yield_value(const T& value) noexcept { mValue = &value; return {}; }
+            void                return_void() { }
+            void                unhandled_exception() { mException = std::current_exception(); }
+        };
+
+        struct next_awaiter
+        {
+            std::coroutine_handle<promise_type> mHandle;
+
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept
+            {
+                mHandle.promise().mConsumer = consumer;
+                return mHandle;
+            }
+            const T* await_resume()
+            {
+                if (mHandle.promise().mException)
+                {
+                    std::rethrow_exception(mHandle.promise().mException);
+                }
+                return mHandle.promise().mValue;
+            }
+        };
+
+        async_generator(async_generator&& other) noexcept : mHandle(std::exchange(other.mHandle, nullptr)) { }
+        async_generator(const async_generator& other) = delete;
+        ~async_generator() { if (mHandle) mHandle.destroy(); }
+
+        async_generator& operator=(const async_generator& other) = delete;
+
+        // Resumes the producer; yields nullptr once it has finished.
+        next_awaiter    next() { return next_awaiter { mHandle }; }
+
+    private:
+        explicit async_generator(std::coroutine_handle<promise_type> h) : mHandle(h) { }
+
+    private:
+        std::coroutine_handle<promise_type> mHandle;
+    };
+}
+
+#endif //MEDIATEST_CORO_H
@@ -0,0 +1,527 @@
+//
+// Asynchronous raw YUV / Y4M writer for capturing decoded frames to a file.
+//
+
+#include "frame_writer.hpp"
+
+#include "sample_app.hpp"
+#include "sample_error.hpp"
+#include "util.hpp"
+
+#include <media/NdkImage.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <boost/exception/all.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    using namespace sample;
+
+    // O_DIRECT needs buffer addresses, file offsets and lengths aligned to the logical
+    // block size; a page covers every device we write to.
+    const std::size_t kAlignment = 4096;
+
+    std::size_t alignUp(std::size_t n)
+    {
+        return (n + kAlignment - 1) & ~(kAlignment - 1);
+    }
+
+    void failErrno(const char* apiFunction, int error)
+    {
+        BOOST_THROW_EXCEPTION( sample_error()
+                                       << boost::errinfo_api_function(apiFunction)
+                                       << boost::errinfo_errno(error) );
+    }
+
+    void clearDirectIO(int fd)
+    {
+        const int flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags & ~O_DIRECT) < 0)
+        {
+            failErrno("fcntl", errno);
+        }
+    }
+
+    int openOutput(const char* path, bool& directIO)
+    {
+        const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        if (directIO)
+        {
+            const int fd = open(path, flags | O_DIRECT, 0644);
+            if (fd >= 0 || errno != EINVAL)
+            {
+                return fd;
+            }
+            LOGW("%s O_DIRECT not supported for %s, using buffered IO", __FUNCTION__, path);
+            directIO = false;
+        }
+        return open(path, flags, 0644);
+    }
+}
+
+namespace sample {
+
+    yuv420_frame yuv420_frame::fromImage(const AImage* image)
+    {
+        yuv420_frame result;
+        fail_media_error(AImage_getWidth(image, &result.width), "AImage_getWidth");
+        fail_media_error(AImage_getHeight(image, &result.height), "AImage_getHeight");
+
+        for (int p = 0; p < 3; ++p)
+        {
+            yuv_plane& plane = result.planes[p];
+            std::uint8_t* data = nullptr;
+            int length = 0;
+            fail_media_error(AImage_getPlaneData(image, p, &data, &length), "AImage_getPlaneData");
+            fail_media_error(AImage_getPlaneRowStride(image, p, &plane.rowStride), "AImage_getPlaneRowStride");
+            fail_media_error(AImage_getPlanePixelStride(image, p, &plane.pixelStride), "AImage_getPlanePixelStride");
+            plane.data = data;
+        }
+
+        return result;
+    }
+
+    yuv420_frame yuv420_frame::fromBuffer(const output_buffer_view& view)
+    {
+        const buffer_layout& layout = view.layout();
+        const buffer_layout::chroma_arrangement arrangement = layout.chroma();
+        if (arrangement == buffer_layout::chroma_arrangement::unsupported || view.size() < layout.minimumSize())
+        {
+            LOGE("%s colorFormat:%d %dx%d stride:%d sliceHeight:%d in %zu bytes is not a layout we can read",
+                 __FUNCTION__,
+                 layout.colorFormat,
+                 layout.width,
+                 layout.height,
+                 layout.stride,
+                 layout.sliceHeight,
+                 view.size());
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("yuv420_frame::fromBuffer") );
+        }
+
+        yuv420_frame result;
+        result.width = layout.width;
+        result.height = layout.height;
+
+        const std::uint8_t* const chroma = view.data() + std::size_t(layout.stride) * layout.sliceHeight;
+        result.planes[0].data = view.data();
+        result.planes[0].rowStride = layout.stride;
+
+        if (arrangement == buffer_layout::chroma_arrangement::planar)
+        {
+            const std::size_t chromaPlaneSize = std::size_t(layout.stride / 2) * (layout.sliceHeight / 2);
+            result.planes[1] = { chroma, layout.stride / 2, 1 };
+            result.planes[2] = { chroma + chromaPlaneSize, layout.stride / 2, 1 };
+        }
+        else
+        {
+            result.planes[1] = { chroma, layout.stride, 2 };
+            result.planes[2] = { chroma + 1, layout.stride, 2 };
+        }
+
+        return result;
+    }
+
+    frame_writer::frame_writer(const char* path, std::int32_t width, std::int32_t height, const config& cfg)
+            : mConfig(cfg),
+              mWidth(width),
+              mHeight(height),
+              mBufferSize(alignUp(std::max<std::size_t>(cfg.bufferSize, kAlignment))),
+              mDirectIO(cfg.directIO)
+    {
+        assert(width > 0 && height > 0 && 0 == (width & 1) && 0 == (height & 1));
+        assert(cfg.bufferCount >= 2);
+
+        mFd.reset(openOutput(path, mDirectIO));
+        if (!mFd)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("open")
+                                           << boost::errinfo_errno(errno)
+                                           << boost::errinfo_file_name(path) );
+        }
+
+        mBuffers.resize(cfg.bufferCount);
+        for (std::size_t i = 0; i < mBuffers.size(); ++i)
+        {
+            void* memory = nullptr;
+            const int error = posix_memalign(&memory, kAlignment, mBufferSize);
+            if (error != 0)
+            {
+                for (auto& b : mBuffers)
+                {
+                    std::free(b.data);
+                }
+                failErrno("posix_memalign", error);
+            }
+            mBuffers[i].data = static_cast<std::uint8_t*>(memory);
+            mFreeBuffers.push_back(i);
+        }
+        if (mConfig.accountant)
+        {
+            mConfig.accountant->add(memory_category::heap, mBuffers.size() * mBufferSize);
+        }
+        mRowScratch.resize(std::size_t(width) * 2);
+
+        mWriterThread = std::thread(&frame_writer::writerThread, this);
+
+        if (mConfig.format == frame_file_format::y4m)
+        {
+            char header[128];
+            const int length = std::snprintf(header,
+                                             sizeof(header),
+                                             "YUV4MPEG2 W%d H%d F%u:%u Ip A1:1 C420mpeg2\n",
+                                             width,
+                                             height,
+                                             mConfig.frameRateNum,
+                                             mConfig.frameRateDen);
+            put(reinterpret_cast<const std::uint8_t*>(header), length);
+        }
+    }
+
+    frame_writer::~frame_writer()
+    {
+        try
+        {
+            close();
+        }
+        catch (...)
+        {
+            LOGE("%s %s", __FUNCTION__, boost::current_exception_diagnostic_information().c_str());
+        }
+
+        for (auto& b : mBuffers)
+        {
+            std::free(b.data);
+        }
+        if (mConfig.accountant)
+        {
+            mConfig.accountant->remove(memory_category::heap, mBuffers.size() * mBufferSize);
+        }
+    }
+
+    void frame_writer::write(const yuv420_frame& frame)
+    {
+        assert(frame.width == mWidth && frame.height == mHeight);
+        assert(!mClosed);
+
+        const StopWatch frameTimer;
+
+        if (mConfig.format == frame_file_format::y4m)
+        {
+            static const char kFrameHeader[] = "FRAME\n";
+            put(reinterpret_cast<const std::uint8_t*>(kFrameHeader), sizeof(kFrameHeader) - 1);
+        }
+
+        const std::int32_t chromaWidth = mWidth / 2;
+        const std::int32_t chromaHeight = mHeight / 2;
+
+        writePlaneRows(frame.planes[0], mWidth, mHeight);
+        if (mConfig.format == frame_file_format::nv12)
+        {
+            writeInterleavedRows(frame.planes[1], frame.planes[2], chromaWidth, chromaHeight);
+        }
+        else
+        {
+            writePlaneRows(frame.planes[1], chromaWidth, chromaHeight);
+            writePlaneRows(frame.planes[2], chromaWidth, chromaHeight);
+        }
+
+        const StopWatch::duration frameTime = frameTimer.getSplitTime();
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mStatistics.frames;
+        mStatistics.frameTime += frameTime;
+        mStatistics.maxFrameTime = std::max(mStatistics.maxFrameTime, frameTime);
+    }
+
+    void frame_writer::close()
+    {
+        if (mClosed)
+        {
+            return;
+        }
+        mClosed = true;
+
+        if (mCurrent && mCurrent->used > 0)
+        {
+            submitCurrentBuffer();
+        }
+        finish();
+
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            error = mWriteError;
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    frame_writer::statistics frame_writer::getStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStatistics;
+    }
+
+    void frame_writer::writePlaneRows(const yuv_plane& plane, std::int32_t width, std::int32_t height)
+    {
+        const std::uint8_t* row = plane.data;
+        for (std::int32_t y = 0; y < height; ++y, row += plane.rowStride)
+        {
+            if (plane.pixelStride == 1)
+            {
+                put(row, width);
+            }
+            else if (plane.pixelStride == 2)
+            {
+                // semi-planar chroma; a constant stride lets the compiler vectorise this
+                for (std::int32_t x = 0; x < width; ++x)
+                {
+                    mRowScratch[x] = row[2 * x];
+                }
+                put(mRowScratch.data(), width);
+            }
+            else
+            {
+                for (std::int32_t x = 0; x < width; ++x)
+                {
+                    mRowScratch[x] = row[std::size_t(x) * plane.pixelStride];
+                }
+                put(mRowScratch.data(), width);
+            }
+        }
+    }
+
+    void frame_writer::writeInterleavedRows(const yuv_plane& u, const yuv_plane& v, std::int32_t width, std::int32_t height)
+    {
+        // already NV12 in memory: copy the UV rows as they are
+        const bool nv12 = (u.pixelStride == 2 && v.pixelStride == 2 && v.data == u.data + 1 && u.rowStride == v.rowStride);
+
+        const std::uint8_t* uRow = u.data;
+        const std::uint8_t* vRow = v.data;
+        for (std::int32_t y = 0; y < height; ++y, uRow += u.rowStride, vRow += v.rowStride)
+        {
+            if (nv12)
+            {
+                put(uRow, std::size_t(width) * 2);
+            }
+            else
+            {
+                for (std::int32_t x = 0; x < width; ++x)
+                {
+                    mRowScratch[2 * x] = uRow[std::size_t(x) * u.pixelStride];
+                    mRowScratch[2 * x + 1] = vRow[std::size_t(x) * v.pixelStride];
+                }
+                put(mRowScratch.data(), std::size_t(width) * 2);
+            }
+        }
+    }
+
+    void frame_writer::put(const std::uint8_t* data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            if (!mCurrent)
+            {
+                acquireBuffer();
+            }
+
+            const std::size_t count = std::min(size, mBufferSize - mCurrent->used);
+            std::memcpy(mCurrent->data + mCurrent->used, data, count);
+            mCurrent->used += count;
+            data += count;
+            size -= count;
+
+            if (mCurrent->used == mBufferSize)
+            {
+                submitCurrentBuffer();
+            }
+        }
+    }
+
+    void frame_writer::acquireBuffer()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mFreeBuffers.empty() && !mWriteError)
+        {
+            // backpressure: every buffer is queued for the writer
+            const StopWatch stallTimer;
+            mFreeCondition.wait(lock, [this]() { return !mFreeBuffers.empty() || mWriteError; });
+            ++mStatistics.stalls;
+            mStatistics.stallTime += stallTimer.getSplitTime();
+        }
+        if (mWriteError)
+        {
+            std::rethrow_exception(mWriteError);
+        }
+
+        mCurrentIndex = mFreeBuffers.front();
+        mFreeBuffers.pop_front();
+        mCurrent = &mBuffers[mCurrentIndex];
+        mCurrent->used = 0;
+    }
+
+    void frame_writer::submitCurrentBuffer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFullBuffers.push_back(mCurrentIndex);
+        }
+        mFullCondition.notify_one();
+        mCurrent = nullptr;
+    }
+
+    void frame_writer::finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mClosing = true;
+        }
+        mFullCondition.notify_one();
+        if (mWriterThread.joinable())
+        {
+            mWriterThread.join();
+        }
+
+        mFd.reset();
+    }
+
+    void frame_writer::writerThread()
+    {
+        if (mConfig.threadPolicy)
+        {
+            (void) mConfig.threadPolicy->apply(thread_role::frame_writer);
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        for (;;)
+        {
+            mFullCondition.wait(lock, [this]() { return mClosing || !mFullBuffers.empty(); });
+            if (mFullBuffers.empty())
+            {
+                break;
+            }
+
+            // everything queued goes out in one pwritev
+            std::vector<std::size_t> indices(mFullBuffers.begin(), mFullBuffers.end());
+            mFullBuffers.clear();
+
+            lock.unlock();
+            try
+            {
+                if (!mWriteError)
+                {
+                    writeBuffers(indices);
+                }
+            }
+            catch (...)
+            {
+                lock.lock();
+                mWriteError = std::current_exception();
+                lock.unlock();
+            }
+            lock.lock();
+
+            mFreeBuffers.insert(mFreeBuffers.end(), indices.begin(), indices.end());
+            mFreeCondition.notify_one();
+        }
+    }
+
+    void frame_writer::writeBuffers(const std::vector<std::size_t>& indices)
+    {
+        const StopWatch ioTimer;
+
+        std::vector<iovec> iov;
+        std::size_t total = 0;
+        std::size_t logicalTotal = 0;
+        for (const std::size_t i : indices)
+        {
+            buffer& b = mBuffers[i];
+            logicalTotal += b.used;
+
+            std::size_t length = b.used;
+            if (mDirectIO && length < mBufferSize)
+            {
+                // only the last buffer is short; pad it and trim the file afterwards
+                length = alignUp(length);
+                std::memset(b.data + b.used, 0, length - b.used);
+            }
+            iov.push_back({ b.data, length });
+            total += length;
+        }
+
+        std::size_t first = 0;
+        std::size_t remaining = total;
+        unsigned int calls = 0;
+        while (remaining > 0)
+        {
+            const int count = int(std::min<std::size_t>(iov.size() - first, IOV_MAX));
+            const ssize_t written = pwritev(mFd.get(), &iov[first], count, mFileOffset);
+            ++calls;
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                failErrno("pwritev", errno);
+            }
+            if (written == 0)
+            {
+                // nothing written and no error: retrying would spin
+                failErrno("pwritev", EIO);
+            }
+            if (mDirectIO && (std::size_t(written) & (kAlignment - 1)) != 0)
+            {
+                // a short write left the offset and the rest of the iov unaligned, which
+                // O_DIRECT rejects; finish in buffered IO (padding is trimmed as before)
+                LOGW("%s short O_DIRECT write of %zd bytes, using buffered IO", __FUNCTION__, written);
+                clearDirectIO(mFd.get());
+                mDirectIO = false;
+            }
+
+            mFileOffset += written;
+            remaining -= written;
+
+            // skip what was written, possibly ending part way through a buffer
+            std::size_t skip = written;
+            while (skip > 0 && skip >= iov[first].iov_len)
+            {
+                skip -= iov[first].iov_len;
+                ++first;
+            }
+            if (skip > 0)
+            {
+                iov[first].iov_base = static_cast<std::uint8_t*>(iov[first].iov_base) + skip;
+                iov[first].iov_len -= skip;
+            }
+        }
+
+        if (total != logicalTotal)
+        {
+            mFileOffset -= (total - logicalTotal);
+            if (ftruncate(mFd.get(), mFileOffset) < 0)
+            {
+                failErrno("ftruncate", errno);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStatistics.bytesWritten += logicalTotal;
+        mStatistics.writeCalls += calls;
+        mStatistics.ioTime += ioTimer.getSplitTime();
+    }
+}
@@ -0,0 +1,146 @@
+//
+// Asynchronous raw YUV / Y4M writer for capturing decoded frames to a file.
+//
+
+#ifndef MEDIATEST_FRAME_WRITER_H
+#define MEDIATEST_FRAME_WRITER_H
+
+#include "StopWatch.hpp"
+#include "handles.hpp"
+#include "memory_accounting.hpp"
+#include "thread_policy.hpp"
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sample {
+
+    class output_buffer_view;
+
+    struct yuv_plane
+    {
+        const std::uint8_t* data        = nullptr;
+        std::int32_t        rowStride   = 0;
+        std::int32_t        pixelStride = 1;    // 2 for interleaved (semi-planar) chroma
+    };
+
+    // A YUV 4:2:0 frame in caller-owned memory: Y, U and V planes with their strides.
+    struct yuv420_frame
+    {
+        std::int32_t                width   = 0;
+        std::int32_t                height  = 0;
+        std::array<yuv_plane, 3>    planes;
+
+        static yuv420_frame fromImage(const AImage* image);             // AIMAGE_FORMAT_YUV_420_888
+        static yuv420_frame fromBuffer(const output_buffer_view& view); // raw codec output
+    };
+
+    enum class frame_file_format
+    {
+        y4m,    // YUV4MPEG2, 4:2:0
+        i420,   // raw planar
+        nv12,   // raw, interleaved UV
+    };
+
+    // Copies each frame's rows into large aligned buffers and writes full buffers from a
+    // dedicated thread with pwritev, so the caller only pays for the copy. When every
+    // buffer is waiting on storage, write() blocks until one frees up: capture never
+    // drops frames, it slows the pipeline down instead.
+    class frame_writer
+    {
+    public:
+        struct config
+        {
+            frame_file_format   format          = frame_file_format::y4m;
+            std::size_t         bufferSize      = 32 * 1024 * 1024;     // rounded up to 4 KiB
+            std::size_t         bufferCount     = 2;
+            bool                directIO        = false;    // O_DIRECT; falls back if unsupported
+            unsigned int        frameRateNum    = 30;       // Y4M header only
+            unsigned int        frameRateDen    = 1;
+            memory_accountant*  accountant      = nullptr;  // charged for buffers as heap
+            const thread_policy* threadPolicy   = nullptr;  // applied to the writer thread
+        };
+
+        struct statistics
+        {
+            std::uint64_t       frames          = 0;
+            std::uint64_t       bytesWritten    = 0;
+            std::uint64_t       writeCalls      = 0;        // pwritev calls
+            std::uint64_t       stalls          = 0;        // times write() waited for a buffer
+            StopWatch::duration stallTime       = StopWatch::duration::zero();
+            StopWatch::duration frameTime       = StopWatch::duration::zero();  // total in write()
+            StopWatch::duration maxFrameTime    = StopWatch::duration::zero();
+            StopWatch::duration ioTime          = StopWatch::duration::zero();  // in pwritev
+        };
+
+        frame_writer(const char* path, std::int32_t width, std::int32_t height, const config& cfg);
+
+        frame_writer(const frame_writer& other) = delete;
+        frame_writer& operator=(const frame_writer& other) = delete;
+
+        // Closes the file, discarding any error; call close() to see it.
+        ~frame_writer();
+
+        // Frames must match the writer's dimensions. Throws sample_error if a previous
+        // write to the file failed.
+        void        write(const yuv420_frame& frame);
+
+        // Writes what is buffered and closes the file. Throws sample_error on failure.
+        void        close();
+
+        statistics  getStatistics() const;
+
+    private:
+        struct buffer
+        {
+            std::uint8_t*   data    = nullptr;
+            std::size_t     used    = 0;
+        };
+
+        void        writePlaneRows(const yuv_plane& plane, std::int32_t width, std::int32_t height);
+        void        writeInterleavedRows(const yuv_plane& u, const yuv_plane& v, std::int32_t width, std::int32_t height);
+        void        put(const std::uint8_t* data, std::size_t size);
+
+        void        acquireBuffer();
+        void        submitCurrentBuffer();
+        void        finish();
+
+        void        writerThread();
+        void        writeBuffers(const std::vector<std::size_t>& indices);
+
+    private:
+        const config                mConfig;
+        const std::int32_t          mWidth;
+        const std::int32_t          mHeight;
+        std::size_t                 mBufferSize     = 0;
+        bool                        mDirectIO       = false;
+        unique_fd                   mFd;
+
+        std::vector<buffer>         mBuffers;
+        std::vector<std::uint8_t>   mRowScratch;
+        buffer*                     mCurrent        = nullptr;
+        std::size_t                 mCurrentIndex   = 0;
+
+        mutable std::mutex          mMutex;
+        std::condition_variable     mFreeCondition;
+        std::condition_variable     mFullCondition;
+        std::deque<std::size_t>     mFreeBuffers;
+        std::deque<std::size_t>     mFullBuffers;
+        bool                        mClosing        = false;
+        bool                        mClosed         = false;
+        std::exception_ptr          mWriteError;
+        statistics                  mStatistics;
+
+        off64_t                     mFileOffset     = 0;    // writer thread only
+        std::thread                 mWriterThread;
+    };
+}
+
+#endif //MEDIATEST_FRAME_WRITER_H
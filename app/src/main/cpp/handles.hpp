@@ -0,0 +1,82 @@
+//
+// Move-only owning handles for file descriptors and NDK media objects. Deleters are
+// stateless, so each handle is exactly the size of the raw pointer or descriptor and
+// carries no control block or reference count.
+//
+
+#ifndef MEDIATEST_HANDLES_H
+#define MEDIATEST_HANDLES_H
+
+#include <android/native_window.h>
+#include <media/NdkImage.h>
+#include <media/NdkImageReader.h>
+#include <media/NdkMediaCodec.h>
+#include <media/NdkMediaDataSource.h>
+#include <media/NdkMediaExtractor.h>
+#include <media/NdkMediaFormat.h>
+#include <media/NdkMediaMuxer.h>
+
+#include <unistd.h>
+
+#include <memory>
+#include <utility>
+
+namespace sample {
+
+    template <auto DeleteFn>
+    struct ndk_deleter
+    {
+        template <typename T>
+        void operator()(T* p) const { (void) DeleteFn(p); }
+    };
+
+    typedef std::unique_ptr<AImage, ndk_deleter<&AImage_delete>>                        unique_image;
+    typedef std::unique_ptr<AImageReader, ndk_deleter<&AImageReader_delete>>            unique_image_reader;
+    typedef std::unique_ptr<AMediaCodec, ndk_deleter<&AMediaCodec_delete>>              unique_media_codec;
+    typedef std::unique_ptr<AMediaDataSource, ndk_deleter<&AMediaDataSource_delete>>    unique_media_data_source;
+    typedef std::unique_ptr<AMediaExtractor, ndk_deleter<&AMediaExtractor_delete>>      unique_media_extractor;
+    typedef std::unique_ptr<AMediaFormat, ndk_deleter<&AMediaFormat_delete>>            unique_media_format;
+    typedef std::unique_ptr<AMediaMuxer, ndk_deleter<&AMediaMuxer_delete>>              unique_media_muxer;
+    typedef std::unique_ptr<ANativeWindow, ndk_deleter<&ANativeWindow_release>>         unique_native_window;
+
+    static_assert(sizeof(unique_media_codec) == sizeof(AMediaCodec*), "handles must not carry deleter state");
+
+    // Owns a POSIX file descriptor; a negative value means "no descriptor".
+    class unique_fd
+    {
+    public:
+        unique_fd() = default;
+        explicit unique_fd(int fd) : mFd(fd) { }
+
+        unique_fd(unique_fd&& other) noexcept : mFd(other.release()) { }
+        unique_fd(const unique_fd& other) = delete;
+        ~unique_fd() { reset(); }
+
+        unique_fd& operator=(unique_fd&& other) noexcept
+        {
+            reset(other.release());
+            return *this;
+        }
+        unique_fd& operator=(const unique_fd& other) = delete;
+
+        explicit operator bool() const { return mFd >= 0; }
+
+        int     get() const { return mFd; }
+
+        int     release() { return std::exchange(mFd, -1); }
+
+        void    reset(int fd = -1)
+        {
+            const int old = std::exchange(mFd, fd);
+            if (old >= 0)
+            {
+                (void) ::close(old);
+            }
+        }
+
+    private:
+        int     mFd = -1;
+    };
+}
+
+#endif //MEDIATEST_HANDLES_H
@@ -0,0 +1,48 @@
+//
+// AMediaDataSource adapter that routes extractor reads through a block_cache.
+//
+
+#include "media_data_source.hpp"
+
+#include "sample_error.hpp"
+
+#include <boost/exception/all.hpp>
+
+namespace {
+    using namespace sample;
+
+    ssize_t dataSourceReadAt(void* userData, off64_t offset, void* buffer, size_t size)
+    {
+        return static_cast<block_cache*>(userData)->readAt(offset, buffer, size);
+    }
+
+    ssize_t dataSourceGetSize(void* userData)
+    {
+        return static_cast<block_cache*>(userData)->size();
+    }
+
+    void dataSourceClose(void* userData)
+    {
+        // the cache is owned by the caller of createMediaDataSource
+    }
+}
+
+namespace sample {
+
+    unique_media_data_source createMediaDataSource(block_cache& cache)
+    {
+        unique_media_data_source result(AMediaDataSource_new());
+        if (!result)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("AMediaDataSource_new") );
+        }
+
+        AMediaDataSource_setUserdata(result.get(), &cache);
+        AMediaDataSource_setReadAt(result.get(), &dataSourceReadAt);
+        AMediaDataSource_setGetSize(result.get(), &dataSourceGetSize);
+        AMediaDataSource_setClose(result.get(), &dataSourceClose);
+
+        return result;
+    }
+}
@@ -0,0 +1,22 @@
+//
+// AMediaDataSource adapter that routes extractor reads through a block_cache.
+//
+
+#ifndef MEDIATEST_MEDIA_DATA_SOURCE_H
+#define MEDIATEST_MEDIA_DATA_SOURCE_H
+
+#include "block_cache.hpp"
+#include "handles.hpp"
+
+#include <media/NdkMediaDataSource.h>
+
+namespace sample {
+
+    // Wraps cache in an AMediaDataSource suitable for AMediaExtractor_setDataSourceCustom.
+    // The cache must outlive the returned data source. The NDK does not reference count
+    // data sources, so the data source in turn must outlive every extractor using it.
+    unique_media_data_source createMediaDataSource(block_cache& cache);
+
+}
+
+#endif //MEDIATEST_MEDIA_DATA_SOURCE_H
@@ -0,0 +1,645 @@
+//
+// Decode-free probing of media files.
+//
+
+#include "media_probe.hpp"
+
+#include "handles.hpp"
+#include "sample_app.hpp"
+#include "util.hpp"
+
+#include <boost/exception/all.hpp>
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace {
+    using namespace sample;
+
+    const char          kProbeMagic[4]      = { 'M', 'T', 'P', 'R' };
+    const std::uint32_t kProbeVersion       = 1;
+
+    struct probe_header
+    {
+        char            magic[4];
+        std::uint32_t   version;
+        std::uint32_t   recordSize;
+        std::uint32_t   reserved;
+    };
+
+    // One line, for logs and the JSON output, rather than boost's multi-line report.
+    std::string describeError(const boost::exception& e)
+    {
+        std::string result;
+
+        if (const char* const* apiFunction = boost::get_error_info<boost::errinfo_api_function>(e))
+        {
+            result += *apiFunction;
+            result += " failed";
+        }
+        else
+        {
+            result += "failed";
+        }
+        if (const media_status_t* status = boost::get_error_info<errinfo_media_status>(e))
+        {
+            result += ": media status " + std::to_string(int(*status));
+        }
+        if (const int* error = boost::get_error_info<boost::errinfo_errno>(e))
+        {
+            result += ": ";
+            result += std::strerror(*error);
+        }
+
+        return result;
+    }
+
+    track_summary summarizeTrack(AMediaFormat* format)
+    {
+        track_summary result;
+
+        const char* mime = nullptr;
+        if (AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime))
+        {
+            result.mime = mime;
+        }
+        AMediaFormat_getInt64(format, AMEDIAFORMAT_KEY_DURATION, &result.durationUs);
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_BIT_RATE, &result.bitRate);
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_WIDTH, &result.width);
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_HEIGHT, &result.height);
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_FRAME_RATE, &result.frameRate);
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_SAMPLE_RATE, &result.sampleRate);
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_CHANNEL_COUNT, &result.channelCount);
+
+        return result;
+    }
+
+    void appendString(std::string& out, const std::string& value)
+    {
+        out += '"';
+        for (const char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(c));
+                out += escaped;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+        out += '"';
+    }
+
+    void appendKey(std::string& out, const char* key)
+    {
+        if (out.back() != '{' && out.back() != '[')
+        {
+            out += ',';
+        }
+        out += '"';
+        out += key;
+        out += "\":";
+    }
+
+    void appendInt(std::string& out, const char* key, std::int64_t value)
+    {
+        appendKey(out, key);
+        out += std::to_string(value);
+    }
+
+    void appendDouble(std::string& out, const char* key, double value)
+    {
+        appendKey(out, key);
+
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.6g", std::isfinite(value) ? value : 0.0);
+        out += text;
+    }
+}
+
+namespace sample {
+
+    stream_statistics_builder::stream_statistics_builder(std::int64_t bitrateWindowUs)
+    {
+        mStatistics.bitrateWindowUs = std::clamp<std::int64_t>(bitrateWindowUs,
+                                                               1,
+                                                               std::numeric_limits<std::int64_t>::max() / kMaxBitrateWindows);
+        mPresentationTimes.reserve(4096);
+    }
+
+    void stream_statistics_builder::add(std::int64_t presentationTimeUs, std::size_t size, bool sync)
+    {
+        // a GOP ends where the next sync sample begins
+        if (sync && mCurrentGop > 0)
+        {
+            endGop();
+        }
+        ++mCurrentGop;
+
+        ++mStatistics.samples;
+        mStatistics.syncSamples += sync ? 1 : 0;
+        mStatistics.bytes += size;
+
+        // Windows start at the first sample in decode order; reordered frames that come
+        // before it land in the first window.
+        if (mStatistics.firstPresentationTimeUs < 0)
+        {
+            mStatistics.firstPresentationTimeUs = presentationTimeUs;
+        }
+
+        // A damaged timestamp can be anywhere in the 64-bit range; left in, it would size
+        // the window array and wreck the timing. Compared unsigned, as the difference
+        // itself may not fit.
+        const std::int64_t firstUs = mStatistics.firstPresentationTimeUs;
+        const std::uint64_t distanceUs = (presentationTimeUs >= firstUs)
+                                         ? std::uint64_t(presentationTimeUs) - std::uint64_t(firstUs)
+                                         : std::uint64_t(firstUs) - std::uint64_t(presentationTimeUs);
+        if (distanceUs >= std::uint64_t(mStatistics.bitrateWindowUs) * kMaxBitrateWindows)
+        {
+            ++mStatistics.outOfRangeSamples;
+            return;
+        }
+        const std::int64_t offsetUs = presentationTimeUs - firstUs;
+        mPresentationTimes.push_back(presentationTimeUs);
+
+        const std::size_t window = std::size_t(std::max<std::int64_t>(offsetUs, 0) / mStatistics.bitrateWindowUs);
+        if (window >= mWindowBytes.size())
+        {
+            mWindowBytes.resize(window + 1, 0);
+        }
+        mWindowBytes[window] += size;
+    }
+
+    void stream_statistics_builder::endGop()
+    {
+        mGopLengths.push_back(mCurrentGop);
+        mCurrentGop = 0;
+    }
+
+    stream_statistics stream_statistics_builder::finish()
+    {
+        if (mCurrentGop > 0)
+        {
+            endGop();
+        }
+
+        stream_statistics result = std::move(mStatistics);
+        if (result.samples == 0)
+        {
+            return result;
+        }
+
+        // GOP lengths
+        std::sort(mGopLengths.begin(), mGopLengths.end());
+        result.minGop = mGopLengths.front();
+        result.maxGop = mGopLengths.back();
+        result.meanGop = double(result.samples) / mGopLengths.size();
+        for (const std::uint32_t length : mGopLengths)
+        {
+            if (result.gopHistogram.empty() || result.gopHistogram.back().first != length)
+            {
+                result.gopHistogram.emplace_back(length, 0);
+            }
+            ++result.gopHistogram.back().second;
+        }
+
+        // frame timing, in presentation order
+        std::sort(mPresentationTimes.begin(), mPresentationTimes.end());
+        const std::int64_t windowBaseUs = result.firstPresentationTimeUs;
+        result.firstPresentationTimeUs = mPresentationTimes.front();
+        result.lastPresentationTimeUs = mPresentationTimes.back();
+
+        double medianIntervalUs = 0.0;
+        if (mPresentationTimes.size() > 1)
+        {
+            std::vector<std::int64_t> intervals(mPresentationTimes.size() - 1);
+            for (std::size_t i = 1; i < mPresentationTimes.size(); ++i)
+            {
+                intervals[i - 1] = mPresentationTimes[i] - mPresentationTimes[i - 1];
+            }
+
+            const double meanIntervalUs = double(result.lastPresentationTimeUs - result.firstPresentationTimeUs) / intervals.size();
+            double sumOfSquares = 0.0;
+            for (const std::int64_t interval : intervals)
+            {
+                sumOfSquares += (interval - meanIntervalUs) * (interval - meanIntervalUs);
+            }
+            result.frameIntervalJitterUs = std::sqrt(sumOfSquares / intervals.size());
+            result.meanFrameRate = (meanIntervalUs > 0.0) ? 1.0e6 / meanIntervalUs : 0.0;
+
+            std::nth_element(intervals.begin(), intervals.begin() + intervals.size() / 2, intervals.end());
+            medianIntervalUs = double(intervals[intervals.size() / 2]);
+            result.frameRate = (medianIntervalUs > 0.0) ? 1.0e6 / medianIntervalUs : 0.0;
+
+            for (const std::int64_t interval : intervals)
+            {
+                if (std::abs(interval - medianIntervalUs) > 0.25 * medianIntervalUs)
+                {
+                    ++result.irregularIntervals;
+                }
+            }
+        }
+
+        // Bitrate. The last sample is shown for one median interval, and the final window
+        // is only as long as what it covers.
+        const double spanUs = double(result.lastPresentationTimeUs - windowBaseUs) + medianIntervalUs;
+        result.bitrateKbps.reserve(mWindowBytes.size());
+        for (std::size_t w = 0; w < mWindowBytes.size(); ++w)
+        {
+            const double windowUs = std::min(double(result.bitrateWindowUs), spanUs - double(w * result.bitrateWindowUs));
+            const double kbps = (windowUs > 0.0) ? 8.0e3 * mWindowBytes[w] / windowUs : 0.0;
+            result.bitrateKbps.push_back(std::uint32_t(kbps + 0.5));
+            result.peakBitrateKbps = std::max(result.peakBitrateKbps, kbps);
+        }
+        const double durationUs = double(result.lastPresentationTimeUs - result.firstPresentationTimeUs) + medianIntervalUs;
+        result.meanBitrateKbps = (durationUs > 0.0) ? 8.0e3 * result.bytes / durationUs : 0.0;
+
+        return result;
+    }
+
+    void probeMedia(AMediaExtractor* extractor, probe_result& result)
+    {
+        const std::size_t numTracks = AMediaExtractor_getTrackCount(extractor);
+        for (std::size_t track = 0; track < numTracks; ++track)
+        {
+            const unique_media_format format(AMediaExtractor_getTrackFormat(extractor, track));
+            if (!format)
+            {
+                BOOST_THROW_EXCEPTION( sample_error()
+                                               << boost::errinfo_api_function("AMediaExtractor_getTrackFormat") );
+            }
+
+            result.tracks.push_back(summarizeTrack(format.get()));
+            if (result.videoTrack < 0 && 0 == result.tracks.back().mime.compare(0, 6, "video/"))
+            {
+                result.videoTrack = int(track);
+            }
+        }
+
+        if (result.videoTrack < 0)
+        {
+            // audio-only, say; still a valid probe
+            return;
+        }
+
+        fail_media_error(AMediaExtractor_selectTrack(extractor, result.videoTrack),
+                         "AMediaExtractor_selectTrack");
+
+        stream_statistics_builder builder;
+        for (;;)
+        {
+            const std::int64_t presentationTimeUs = AMediaExtractor_getSampleTime(extractor);
+            if (presentationTimeUs < 0)
+            {
+                break;
+            }
+
+            const ssize_t size = AMediaExtractor_getSampleSize(extractor);
+            const bool sync = (0 != (AMediaExtractor_getSampleFlags(extractor) & AMEDIAEXTRACTOR_SAMPLE_FLAG_SYNC));
+            builder.add(presentationTimeUs, std::size_t(std::max(size, ssize_t(0))), sync);
+
+            if (!AMediaExtractor_advance(extractor))
+            {
+                break;
+            }
+        }
+        result.video = builder.finish();
+        result.malformed = (result.video.outOfRangeSamples > 0);
+    }
+
+    probe_result probeMedia(const std::string& path)
+    {
+        probe_result result;
+        result.path = path;
+
+        const StopWatch probeTimer;
+        try
+        {
+            const unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+            if (!fd)
+            {
+                BOOST_THROW_EXCEPTION( sample_error()
+                                               << boost::errinfo_api_function("open")
+                                               << boost::errinfo_errno(errno)
+                                               << boost::errinfo_file_name(path) );
+            }
+
+            const auto extractor = createMediaExtractor(fd.get());
+            probeMedia(extractor.get(), result);
+            result.ok = true;
+        }
+        catch (const boost::exception& e)
+        {
+            result.error = describeError(e);
+        }
+        catch (const std::exception& e)
+        {
+            result.error = e.what();
+        }
+        result.probeTime = probeTimer.getSplitTime();
+
+        if (!result.ok)
+        {
+            LOGW("%s %s: %s", __FUNCTION__, path.c_str(), result.error.c_str());
+        }
+        return result;
+    }
+
+    void probeAll(const std::vector<std::string>& paths,
+                  const probe_config& config,
+                  const std::function<void(const probe_result&)>& onResult)
+    {
+        const std::function<probe_result(const std::string&)> probe = config.probe
+                ? config.probe
+                : [](const std::string& path) { return probeMedia(path); };
+
+        std::atomic<std::size_t> next(0);
+        std::mutex resultMutex;
+        std::exception_ptr resultError;
+
+        auto worker = [&]() {
+            if (config.threadPolicy)
+            {
+                (void) config.threadPolicy->apply(thread_role::probe);
+            }
+
+            for (std::size_t i = next++; i < paths.size(); i = next++)
+            {
+                const probe_result result = probe(paths[i]);
+
+                std::lock_guard<std::mutex> lock(resultMutex);
+                if (resultError)
+                {
+                    break;
+                }
+                try
+                {
+                    onResult(result);
+                }
+                catch (...)
+                {
+                    // stop handing out files; rethrown once the workers are done
+                    resultError = std::current_exception();
+                    next = paths.size();
+                }
+            }
+        };
+
+        const unsigned int workerCount = unsigned(std::min<std::size_t>(std::max(config.workers, 1u), paths.size()));
+        std::vector<std::thread> workers;
+        workers.reserve(workerCount);
+        for (unsigned int w = 0; w < workerCount; ++w)
+        {
+            workers.emplace_back(worker);
+        }
+        for (auto& w : workers)
+        {
+            w.join();
+        }
+
+        if (resultError)
+        {
+            std::rethrow_exception(resultError);
+        }
+    }
+
+    const char* toString(probe_output_format format)
+    {
+        switch (format)
+        {
+            case probe_output_format::json_lines:   return "json_lines";
+            case probe_output_format::binary:       return "binary";
+            default:                                return "unknown";
+        }
+    }
+
+    std::string toJson(const probe_result& result)
+    {
+        std::string out;
+        out.reserve(512 + 8 * result.video.bitrateKbps.size());
+
+        out += '{';
+        appendKey(out, "path");
+        appendString(out, result.path);
+        appendKey(out, "ok");
+        out += result.ok ? "true" : "false";
+        if (result.malformed)
+        {
+            appendKey(out, "malformed");
+            out += "true";
+        }
+        appendDouble(out, "probeMs", 1.0e3 * result.probeTime.count());
+        if (!result.ok)
+        {
+            appendKey(out, "error");
+            appendString(out, result.error);
+            out += '}';
+            return out;
+        }
+
+        appendKey(out, "tracks");
+        out += '[';
+        for (const auto& track : result.tracks)
+        {
+            if (out.back() != '[')
+            {
+                out += ',';
+            }
+            out += '{';
+            appendKey(out, "mime");
+            appendString(out, track.mime);
+            if (track.durationUs >= 0)  appendInt(out, "durationUs", track.durationUs);
+            if (track.bitRate > 0)      appendInt(out, "bitRate", track.bitRate);
+            if (track.width > 0)        appendInt(out, "width", track.width);
+            if (track.height > 0)       appendInt(out, "height", track.height);
+            if (track.frameRate > 0)    appendInt(out, "frameRate", track.frameRate);
+            if (track.sampleRate > 0)   appendInt(out, "sampleRate", track.sampleRate);
+            if (track.channelCount > 0) appendInt(out, "channelCount", track.channelCount);
+            out += '}';
+        }
+        out += ']';
+
+        if (result.videoTrack >= 0)
+        {
+            const stream_statistics& video = result.video;
+
+            appendKey(out, "video");
+            out += '{';
+            appendInt(out, "track", result.videoTrack);
+            appendInt(out, "samples", std::int64_t(video.samples));
+            appendInt(out, "syncSamples", std::int64_t(video.syncSamples));
+            appendInt(out, "bytes", std::int64_t(video.bytes));
+            appendInt(out, "firstUs", video.firstPresentationTimeUs);
+            appendInt(out, "lastUs", video.lastPresentationTimeUs);
+
+            appendKey(out, "gop");
+            out += '{';
+            appendInt(out, "min", video.minGop);
+            appendInt(out, "max", video.maxGop);
+            appendDouble(out, "mean", video.meanGop);
+            appendKey(out, "histogram");
+            out += '[';
+            for (const auto& bucket : video.gopHistogram)
+            {
+                if (out.back() != '[')
+                {
+                    out += ',';
+                }
+                out += '[' + std::to_string(bucket.first) + ',' + std::to_string(bucket.second) + ']';
+            }
+            out += "]}";
+
+            appendKey(out, "bitrate");
+            out += '{';
+            appendInt(out, "windowUs", video.bitrateWindowUs);
+            appendDouble(out, "meanKbps", video.meanBitrateKbps);
+            appendDouble(out, "peakKbps", video.peakBitrateKbps);
+            appendKey(out, "kbps");
+            out += '[';
+            for (const std::uint32_t kbps : video.bitrateKbps)
+            {
+                if (out.back() != '[')
+                {
+                    out += ',';
+                }
+                out += std::to_string(kbps);
+            }
+            out += "]}";
+
+            appendKey(out, "timing");
+            out += '{';
+            appendDouble(out, "frameRate", video.frameRate);
+            appendDouble(out, "meanFrameRate", video.meanFrameRate);
+            appendDouble(out, "jitterUs", video.frameIntervalJitterUs);
+            appendInt(out, "irregular", std::int64_t(video.irregularIntervals));
+            appendInt(out, "outOfRange", std::int64_t(video.outOfRangeSamples));
+            out += "}}";
+        }
+
+        out += '}';
+        return out;
+    }
+
+    probe_record toRecord(const probe_result& result)
+    {
+        probe_record record;
+        record.ok = result.ok ? 1 : 0;
+        record.malformed = result.malformed ? 1 : 0;
+        record.trackCount = std::uint16_t(result.tracks.size());
+        record.pathLength = std::uint32_t(result.path.size());
+
+        if (result.videoTrack >= 0)
+        {
+            const track_summary& track = result.tracks[result.videoTrack];
+            const stream_statistics& video = result.video;
+
+            record.durationUs = track.durationUs;
+            record.width = track.width;
+            record.height = track.height;
+            const std::size_t mimeLength = std::min(track.mime.size(), sizeof(record.mime) - 1);
+            std::memcpy(record.mime, track.mime.data(), mimeLength);
+            record.mime[mimeLength] = '\0';
+
+            record.firstPresentationTimeUs = video.firstPresentationTimeUs;
+            record.lastPresentationTimeUs = video.lastPresentationTimeUs;
+            record.bytes = video.bytes;
+            record.samples = std::uint32_t(video.samples);
+            record.syncSamples = std::uint32_t(video.syncSamples);
+            record.minGop = video.minGop;
+            record.maxGop = video.maxGop;
+            record.meanGop = float(video.meanGop);
+            record.meanBitrateKbps = float(video.meanBitrateKbps);
+            record.peakBitrateKbps = float(video.peakBitrateKbps);
+            record.frameRate = float(video.frameRate);
+            record.frameIntervalJitterUs = float(video.frameIntervalJitterUs);
+            record.irregularIntervals = std::uint32_t(video.irregularIntervals);
+        }
+
+        return record;
+    }
+
+    probe_writer::probe_writer(const char* path, probe_output_format format)
+            : mPath(path),
+              mFormat(format),
+              mFile(std::fopen(path, "wb"))
+    {
+        if (!mFile)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("fopen")
+                                           << boost::errinfo_errno(errno)
+                                           << boost::errinfo_file_name(path) );
+        }
+
+        if (mFormat == probe_output_format::binary)
+        {
+            probe_header header;
+            std::memcpy(header.magic, kProbeMagic, sizeof(header.magic));
+            header.version = kProbeVersion;
+            header.recordSize = sizeof(probe_record);
+            header.reserved = 0;
+            put(&header, sizeof(header));
+        }
+    }
+
+    void probe_writer::write(const probe_result& result)
+    {
+        if (mFormat == probe_output_format::binary)
+        {
+            const probe_record record = toRecord(result);
+            put(&record, sizeof(record));
+            put(result.path.data(), result.path.size());
+        }
+        else
+        {
+            std::string line = toJson(result);
+            line += '\n';
+            put(line.data(), line.size());
+        }
+    }
+
+    void probe_writer::close()
+    {
+        if (mFile)
+        {
+            const bool ok = (0 == std::fflush(mFile.get()));
+            if (0 != std::fclose(mFile.release()) || !ok)
+            {
+                BOOST_THROW_EXCEPTION( sample_error()
+                                               << boost::errinfo_api_function("fclose")
+                                               << boost::errinfo_errno(errno)
+                                               << boost::errinfo_file_name(mPath) );
+            }
+        }
+    }
+
+    void probe_writer::put(const void* data, std::size_t size)
+    {
+        if (!mFile || size != std::fwrite(data, 1, size, mFile.get()))
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("fwrite")
+                                           << boost::errinfo_errno(errno)
+                                           << boost::errinfo_file_name(mPath) );
+        }
+        mBytesWritten += size;
+    }
+}
@@ -0,0 +1,204 @@
+//
+// Decode-free probing of media files: track formats and compressed-domain statistics of
+// the video track, from sample metadata alone, across many files in parallel.
+//
+
+#ifndef MEDIATEST_MEDIA_PROBE_H
+#define MEDIATEST_MEDIA_PROBE_H
+
+#include "StopWatch.hpp"
+#include "thread_policy.hpp"
+
+#include <media/NdkMediaExtractor.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sample {
+
+    struct track_summary
+    {
+        std::string     mime;
+        std::int64_t    durationUs      = -1;
+        std::int32_t    bitRate         = 0;    // as declared by the container
+        std::int32_t    width           = 0;    // video
+        std::int32_t    height          = 0;
+        std::int32_t    frameRate       = 0;
+        std::int32_t    sampleRate      = 0;    // audio
+        std::int32_t    channelCount    = 0;
+    };
+
+    // Compressed-domain statistics of one track, measured from sample sizes, timestamps and
+    // sync flags.
+    struct stream_statistics
+    {
+        std::uint64_t   samples                 = 0;
+        std::uint64_t   syncSamples             = 0;
+        std::uint64_t   bytes                   = 0;
+        std::int64_t    firstPresentationTimeUs = -1;
+        std::int64_t    lastPresentationTimeUs  = -1;
+
+        // GOP length in samples, sync sample to sync sample; a trailing partial GOP counts.
+        std::uint32_t   minGop                  = 0;
+        std::uint32_t   maxGop                  = 0;
+        double          meanGop                 = 0.0;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>>    gopHistogram;   // (length, count)
+
+        // Bitrate per bitrateWindowUs of presentation time.
+        std::int64_t                bitrateWindowUs = 0;
+        std::vector<std::uint32_t>  bitrateKbps;
+        double          meanBitrateKbps         = 0.0;
+        double          peakBitrateKbps         = 0.0;
+
+        // Frame timing, from intervals between consecutive presentation times. Intervals
+        // more than a quarter off the median count as irregular: dropped or duplicated
+        // frames, variable frame rate, timestamp damage.
+        double          frameRate               = 0.0;  // from the median interval
+        double          meanFrameRate           = 0.0;  // samples over the time they span
+        double          frameIntervalJitterUs   = 0.0;  // standard deviation of the intervals
+        std::uint64_t   irregularIntervals      = 0;
+
+        // Samples stamped further from the first than kMaxBitrateWindows windows, which
+        // only damaged metadata produces. They count as samples and bytes but are left
+        // out of timing and bitrate.
+        std::uint64_t   outOfRangeSamples       = 0;
+    };
+
+    // Accumulates stream_statistics one sample at a time, in decode order.
+    class stream_statistics_builder
+    {
+    public:
+        // a day, at the default window
+        static constexpr std::size_t    kMaxBitrateWindows  = 24 * 60 * 60;
+
+        explicit stream_statistics_builder(std::int64_t bitrateWindowUs = 1000000);
+
+        void                add(std::int64_t presentationTimeUs, std::size_t size, bool sync);
+        stream_statistics   finish();
+
+    private:
+        void                endGop();
+
+    private:
+        stream_statistics           mStatistics;
+        std::vector<std::int64_t>   mPresentationTimes;
+        std::vector<std::uint64_t>  mWindowBytes;
+        std::vector<std::uint32_t>  mGopLengths;
+        std::uint32_t               mCurrentGop     = 0;
+    };
+
+    struct probe_result
+    {
+        std::string                 path;
+        bool                        ok          = false;
+        bool                        malformed   = false;    // ok, but with damaged timestamps
+        std::string                 error;      // when !ok
+        std::vector<track_summary>  tracks;
+        int                         videoTrack  = -1;
+        stream_statistics           video;
+        StopWatch::duration         probeTime   = StopWatch::duration::zero();
+    };
+
+    // Walks the video track's sample metadata (size, time, flags) without reading payloads
+    // into our memory. The platform extractor still fetches each sample internally, so this
+    // saves the copy and the buffer, not the I/O. Failures are reported in the result.
+    probe_result probeMedia(const std::string& path);
+
+    // The same, for an extractor set up by the caller. Leaves the extractor at the end of
+    // the video track.
+    void probeMedia(AMediaExtractor* extractor, probe_result& result);
+
+    struct probe_config
+    {
+        unsigned int            workers         = 4;        // at most this many files open at once
+        const thread_policy*    threadPolicy    = nullptr;  // thread_role::probe
+        std::function<probe_result(const std::string&)>    probe;  // defaults to probeMedia
+    };
+
+    // Probes every path on a bounded pool of worker threads and hands each result to
+    // onResult as its file finishes, one at a time, on a worker thread. Returns once all
+    // files are done.
+    void probeAll(const std::vector<std::string>& paths,
+                  const probe_config& config,
+                  const std::function<void(const probe_result&)>& onResult);
+
+    enum class probe_output_format
+    {
+        json_lines,     // one compact JSON object per file
+        binary,         // MTPR: fixed-size probe_record per file, followed by its path
+    };
+
+    const char* toString(probe_output_format format);
+
+    std::string toJson(const probe_result& result);
+
+    // Fixed-size, little-endian on every platform we run on. Histograms and the bitrate
+    // curve are only in the JSON output.
+    struct probe_record
+    {
+        std::int64_t    durationUs              = -1;
+        std::int64_t    firstPresentationTimeUs = -1;
+        std::int64_t    lastPresentationTimeUs  = -1;
+        std::uint64_t   bytes                   = 0;
+        std::uint32_t   samples                 = 0;
+        std::uint32_t   syncSamples             = 0;
+        std::int32_t    width                   = 0;
+        std::int32_t    height                  = 0;
+        std::uint32_t   minGop                  = 0;
+        std::uint32_t   maxGop                  = 0;
+        float           meanGop                 = 0.0f;
+        float           meanBitrateKbps         = 0.0f;
+        float           peakBitrateKbps         = 0.0f;
+        float           frameRate               = 0.0f;
+        float           frameIntervalJitterUs   = 0.0f;
+        std::uint32_t   irregularIntervals      = 0;
+        char            mime[16]                = {};   // video track's, truncated
+        std::uint16_t   trackCount              = 0;
+        std::uint8_t    ok                      = 0;
+        std::uint8_t    malformed               = 0;
+        std::uint32_t   pathLength              = 0;    // bytes of path after the record
+    };
+
+    static_assert(sizeof(probe_record) == 104, "probe_record is part of the file format");
+
+    probe_record toRecord(const probe_result& result);
+
+    // Appends probe results to a file as they arrive. Not thread-safe; probeAll serializes
+    // its callbacks.
+    class probe_writer
+    {
+    public:
+        probe_writer(const char* path, probe_output_format format);
+
+        probe_writer(const probe_writer& other) = delete;
+        probe_writer& operator=(const probe_writer& other) = delete;
+
+        void    write(const probe_result& result);
+
+        // Flushes and closes the file. Throws sample_error on failure.
+        void    close();
+
+        std::uint64_t   bytesWritten() const { return mBytesWritten; }
+
+    private:
+        struct file_closer
+        {
+            void operator()(std::FILE* f) const { std::fclose(f); }
+        };
+
+        void    put(const void* data, std::size_t size);
+
+    private:
+        const std::string                           mPath;
+        const probe_output_format                   mFormat;
+        std::unique_ptr<std::FILE, file_closer>     mFile;
+        std::uint64_t                               mBytesWritten   = 0;
+    };
+}
+
+#endif //MEDIATEST_MEDIA_PROBE_H
@@ -1,26 +1,103 @@
+#include "frame_writer.hpp"
+#include "media_data_source.hpp"
+#include "media_probe.hpp"
 #include "sample_app.hpp"
+#include "shot_detector.hpp"
+#include "transcoder.hpp"
 
 #include "util.hpp"
 
 #include <boost/exception/all.hpp>
 
+#include <dirent.h>
 #include <fcntl.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 /* ============================================================================================== */
 namespace {
     unsigned int gNumImages = 0;
+
+    std::int64_t gFirstFramePresentationTimeUs = -1;
+    std::int64_t gLastFramePresentationTimeUs = -1;
+
+    sample::frame_writer* gFrameWriter = nullptr;
+    sample::shot_detector* gShotDetector = nullptr;
+
+    void detectShotCut(const sample::yuv420_frame& frame, std::int64_t presentationTimeUs)
+    {
+        if (const auto cut = gShotDetector->process(frame, presentationTimeUs))
+        {
+            LOGI("shot cut pts:%" PRId64 " after pts:%" PRId64 " blockDifference:%.1f histogramDifference:%.3f",
+                 cut->presentationTimeUs,
+                 cut->previousPresentationTimeUs,
+                 cut->blockDifference,
+                 cut->histogramDifference);
+        }
+    }
 }
 
 void imageAvailable(void* userData, AImageReader* reader)
 {
     try
     {
+        static_cast<const sample::thread_policy*>(userData)->applyOnce(sample::thread_role::image_listener);
+
         AImage *image = nullptr;
         sample::fail_media_error(AImageReader_acquireNextImage(reader, &image),
                                  "AImageReader_acquireNextImage");
+        const sample::unique_image imageHolder(image);
 
         LOGI("%s received image #%u", __FUNCTION__, gNumImages++);
-        AImage_delete(image);
+
+        if (gShotDetector)
+        {
+            std::int64_t timestampNs = 0;
+            sample::fail_media_error(AImage_getTimestamp(image, &timestampNs),
+                                     "AImage_getTimestamp");
+            detectShotCut(sample::yuv420_frame::fromImage(image), timestampNs / 1000);
+        }
+
+        if (gFrameWriter)
+        {
+            gFrameWriter->write(sample::yuv420_frame::fromImage(image));
+        }
+    }
+    catch (...)
+    {
+        LOGE("%s", boost::current_exception_diagnostic_information().c_str());
+    }
+}
+
+void bufferAvailable(sample::output_buffer_view view)
+{
+    LOGI("%s received buffer #%u pts:%" PRId64 " size:%zu",
+         __FUNCTION__,
+         gNumImages++,
+         view.presentationTimeUs(),
+         view.size());
+
+    try
+    {
+        if (gShotDetector)
+        {
+            detectShotCut(sample::yuv420_frame::fromBuffer(view), view.presentationTimeUs());
+        }
+
+        if (gFrameWriter)
+        {
+            gFrameWriter->write(sample::yuv420_frame::fromBuffer(view));
+        }
     }
     catch (...)
     {
@@ -28,15 +105,240 @@ void imageAvailable(void* userData, AImageReader* reader)
     }
 }
 
+double cpuSeconds(const rusage& usage)
+{
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           1.0e-6 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+std::vector<std::string> listFiles(const char* directory)
+{
+    const std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(directory), &closedir);
+    if (!dir)
+    {
+        BOOST_THROW_EXCEPTION( sample::sample_error()
+                                       << boost::errinfo_api_function("opendir")
+                                       << boost::errinfo_errno(errno)
+                                       << boost::errinfo_file_name(directory) );
+    }
+
+    std::vector<std::string> result;
+    while (const dirent* entry = readdir(dir.get()))
+    {
+        if (entry->d_type == DT_REG)
+        {
+            result.push_back(std::string(directory) + "/" + entry->d_name);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void probeDirectory(const char* directory,
+                    const char* outputPath,
+                    sample::probe_output_format outputFormat,
+                    const sample::thread_policy& threadPolicy)
+{
+    const std::vector<std::string> paths = listFiles(directory);
+    sample::probe_writer writer(outputPath, outputFormat);
+
+    sample::probe_config config;
+    config.workers = std::max(std::thread::hardware_concurrency(), 1u);
+    config.threadPolicy = &threadPolicy;
+
+    unsigned int failures = 0;
+    std::uint64_t samples = 0;
+    const StopWatch probeTimer;
+    sample::probeAll(paths, config, [&](const sample::probe_result& result) {
+        writer.write(result);
+        failures += result.ok ? 0 : 1;
+        samples += result.video.samples;
+    });
+    writer.close();
+    const double probeSeconds = probeTimer.getSplitTime().count();
+
+    LOGI("probed %zu files (%u failed, %" PRIu64 " samples) in %.3fs (%.1f files/s) workers:%u output:%s %" PRIu64 " bytes",
+         paths.size(),
+         failures,
+         samples,
+         probeSeconds,
+         paths.size() / std::max(probeSeconds, 1.0e-9),
+         config.workers,
+         sample::toString(outputFormat),
+         writer.bytesWritten());
+}
+
+void transcodeFile(const char* sourcePath,
+                   const char* outputPath,
+                   sample::transcode_path path,
+                   const sample::thread_policy& threadPolicy)
+{
+    const sample::unique_fd sourceFd(open(sourcePath, O_RDONLY | O_CLOEXEC));
+    const sample::unique_fd outputFd(open(outputPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (!sourceFd || !outputFd)
+    {
+        BOOST_THROW_EXCEPTION( sample::sample_error()
+                                       << boost::errinfo_api_function("open")
+                                       << boost::errinfo_errno(errno)
+                                       << boost::errinfo_file_name(sourceFd ? outputPath : sourcePath) );
+    }
+
+    const auto extractor = sample::createMediaExtractor(sourceFd.get());
+    const auto format = sample::selectVideoTrack(extractor.get());
+
+    sample::transcode_options options;
+    options.path = path;
+    options.decoder.threadPolicy = &threadPolicy;
+
+    rusage usageBefore;
+    getrusage(RUSAGE_SELF, &usageBefore);
+    const StopWatch transcodeTimer;
+
+    sample::transcoder transcoder(format.get(),
+                                  std::bind(&sample::readSampleData,
+                                            extractor.get(),
+                                            std::placeholders::_1,
+                                            std::placeholders::_2),
+                                  outputFd.get(),
+                                  sample::async_driver(),
+                                  options);
+    transcoder.start();
+    while (!transcoder.isDone())
+    {
+        // sleeps rather than spins, so the CPU figure below is the pipeline's alone
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    transcoder.get();
+
+    const double transcodeSeconds = transcodeTimer.getSplitTime().count();
+    rusage usageAfter;
+    getrusage(RUSAGE_SELF, &usageAfter);
+
+    const auto stats = transcoder.getStatistics();
+    LOGI("transcoded %" PRIu64 "/%" PRIu64 " frames in %.3fs (%.1f fps) path:%s cpu:%.3fs muxed:%" PRIu64 " bytes"
+         " sync:%" PRIu64 " copiedMB:%.1f copyMs:%.3f inputWaitMs:%.3f",
+         stats.encoder.framesEncoded,
+         stats.framesDecoded,
+         transcodeSeconds,
+         stats.encoder.framesEncoded / std::max(transcodeSeconds, 1.0e-9),
+         sample::toString(path),
+         cpuSeconds(usageAfter) - cpuSeconds(usageBefore),
+         stats.encoder.bytesMuxed,
+         stats.encoder.syncFrames,
+         1.0e-6 * stats.encoder.bytesCopied,
+         1.0e3 * stats.encoder.copyTime.count(),
+         1.0e3 * stats.encoder.inputWaitTime.count());
+}
+
+sample::task consumeFrames(sample::decoder& decoder)
+{
+    auto stream = sample::frames(decoder);
+    while (const sample::decoded_frame* frame = co_await stream.next())
+    {
+        LOGI("%s frame #%u pts:%" PRId64, __FUNCTION__, frame->frameNumber, frame->presentationTimeUs);
+
+        if (gFirstFramePresentationTimeUs < 0)
+        {
+            gFirstFramePresentationTimeUs = frame->presentationTimeUs;
+        }
+        gLastFramePresentationTimeUs = std::max(gLastFramePresentationTimeUs, frame->presentationTimeUs);
+    }
+}
+
 int sample_main(int argc, char *argv[])
 {
     const char* const mediaFilePath = "/data/local/tmp/file1.mp4";
 
+    // Compare decode throughput and per-frame latency of the two codec drivers.
+    const bool usePollingDriver = false;
+
+    // Compare CPU, memory and latency of AImageReader output against raw codec buffers.
+    const bool useByteBufferOutput = false;
+
+    // Hard cap on pipeline memory; zero means unlimited. Over budget, the decoder holds
+    // back new input until frames are released.
+    const std::uint64_t memoryBudgetBytes = 0;
+
+    // Capture the codec callback timeline for host-side replay (see app/src/host).
+    const char* const timelinePath = nullptr;   // e.g. "/data/local/tmp/file1.timeline"
+
+    // Fast-scan preview: drop frames before they reach the codec. Compare the logged scan
+    // speed against a full decode (trick_play_mode::off).
+    const sample::trick_play_mode trickPlayMode = sample::trick_play_mode::off;
+
+    // Pin pipeline threads to the fastest cores at raised priority rather than only naming
+    // them. Compare throughput and tail latency with some busy background threads running.
+    const bool usePerformanceThreadPolicy = false;
+    const unsigned int backgroundLoadThreads = 0;
+
+    // Capture decoded frames for offline quality analysis. The writer logs whether it ever
+    // held up the decode loop.
+    const char* const captureFramePath = nullptr;  // e.g. "/data/local/tmp/file1.y4m"
+    const sample::frame_file_format captureFormat = sample::frame_file_format::y4m;
+
+    // Split the decode into shots as frames arrive, logging each cut. The detector logs
+    // its per-frame cost, to compare against the decode rate.
+    const bool detectShotCuts = false;
+
+    // Recover from codec errors in place, resuming at the next sync sample, rather than
+    // stalling the decode. Damaging every Nth sample's payload provokes errors, so the
+    // logged recovery times and skipped ranges can be compared across drivers and codecs.
+    const bool recoverFromCodecErrors = false;
+    const unsigned int corruptSampleInterval = 0;   // e.g. 100; zero leaves samples intact
+
+    // Survey every file in a directory from sample metadata alone, without decoding, before
+    // the decode below. The log reports files per second.
+    const char* const probeDirectoryPath = nullptr;    // e.g. "/data/local/tmp/library"
+    const char* const probeOutputPath = "/data/local/tmp/probe.jsonl";
+    const sample::probe_output_format probeOutputFormat = sample::probe_output_format::json_lines;
+
+    // Re-encode the file into a proxy before the decode below, decoder to encoder through a
+    // surface or, for comparison, through CPU copies. The log reports fps and CPU time.
+    const char* const transcodeOutputPath = nullptr;   // e.g. "/data/local/tmp/file1.proxy.mp4"
+    const sample::transcode_path transcodePath = sample::transcode_path::surface;
+
+    std::atomic<bool> backgroundLoadDone(false);
+    std::vector<std::thread> backgroundLoad;
+    for (unsigned int i = 0; i < backgroundLoadThreads; ++i)
+    {
+        backgroundLoad.emplace_back([&backgroundLoadDone]() {
+            while (!backgroundLoadDone)
+            {
+                // this space intentionally left blank
+            }
+        });
+    }
+
     try
     {
-        // TODO mediaFd will leak if an exception is thrown
-        const auto mediaFd = open(mediaFilePath, O_RDONLY | O_CLOEXEC);
-        if (mediaFd < 0)
+        const sample::cpu_topology topology = sample::cpu_topology::detect();
+        LOGI("cpu topology: %s", topology.describe().c_str());
+
+        const sample::thread_policy threadPolicy = usePerformanceThreadPolicy
+                ? sample::thread_policy::performance(topology)
+                : sample::thread_policy();
+        (void) threadPolicy.apply(sample::thread_role::main);
+
+        if (probeDirectoryPath)
+        {
+            probeDirectory(probeDirectoryPath, probeOutputPath, probeOutputFormat, threadPolicy);
+        }
+
+        if (transcodeOutputPath)
+        {
+            transcodeFile(mediaFilePath, transcodeOutputPath, transcodePath, threadPolicy);
+        }
+
+        sample::memory_accountant accountant(memoryBudgetBytes);
+        sample::callback_recorder recorder;
+
+        sample::decoder_options decoderOptions;
+        decoderOptions.accountant = &accountant;
+        decoderOptions.recorder = timelinePath ? &recorder : nullptr;
+        decoderOptions.threadPolicy = &threadPolicy;
+
+        const sample::unique_fd mediaFd(open(mediaFilePath, O_RDONLY | O_CLOEXEC));
+        if (!mediaFd)
         {
             BOOST_THROW_EXCEPTION( sample::sample_error()
                                            << boost::errinfo_api_function("open")
@@ -44,37 +346,251 @@ int sample_main(int argc, char *argv[])
                                            << boost::errinfo_file_name(mediaFilePath) );
         }
 
-        const auto mediaExtractor = sample::createMediaExtractor(mediaFd);
+        sample::block_cache::config cacheConfig;
+        cacheConfig.accountant = &accountant;
+        cacheConfig.threadPolicy = &threadPolicy;
+        sample::block_cache blockCache(mediaFd.get(), cacheConfig);
+        const auto dataSource = sample::createMediaDataSource(blockCache);
+        const auto mediaExtractor = sample::createMediaExtractor(dataSource.get());
         const auto format = sample::selectVideoTrack(mediaExtractor.get());
-        const auto readSampleData = std::bind(&sample::readSampleData,
+
+        sample::trick_play_statistics trickPlayStats;
+        sample::decoder::readSampleData_t readSampleData = std::bind(&sample::readSampleData,
+                                                                     mediaExtractor.get(),
+                                                                     std::placeholders::_1,
+                                                                     std::placeholders::_2);
+        if (trickPlayMode != sample::trick_play_mode::off)
+        {
+            // sync_only goes by extractor flags and never consults the parser
+            const sample::nal_parser parser = (trickPlayMode == sample::trick_play_mode::drop_non_reference)
+                    ? sample::nal_parser::fromFormat(format.get())
+                    : sample::nal_parser(sample::nal_parser::codec::avc, 0);
+            readSampleData = std::bind(&sample::readTrickPlaySampleData,
+                                       mediaExtractor.get(),
+                                       parser,
+                                       trickPlayMode,
+                                       std::ref(trickPlayStats),
+                                       std::placeholders::_1,
+                                       std::placeholders::_2);
+        }
+
+        if (corruptSampleInterval > 0)
+        {
+            readSampleData = [readSampleData, sampleCount = 0u](void* buffer, size_t capacity) mutable {
+                auto result = readSampleData(buffer, capacity);
+                const std::size_t size = std::get<1>(result);
+                if (++sampleCount >= corruptSampleInterval)
+                {
+                    sampleCount = 0;
+                    if (size > 16)
+                    {
+                        // keep the length prefix and NAL header so the codec decodes into the damage
+                        std::memset(static_cast<std::uint8_t*>(buffer) + 16, 0xff, size - 16);
+                        LOGW("corrupted sample pts:%" PRIu64, std::get<2>(result));
+                    }
+                }
+                return result;
+            };
+        }
+
+        if (recoverFromCodecErrors)
+        {
+            decoderOptions.resync = std::bind(&sample::resyncToNextSyncSample,
                                               mediaExtractor.get(),
-                                              std::placeholders::_2,
-                                              std::placeholders::_3);
+                                              std::placeholders::_1);
+        }
 
-        const auto imageReader = sample::createImageReader(format.get());
+        sample::unique_image_reader imageReader;
+        sample::memory_reservation imageReaderReservation;
+        AImageReader_ImageListener imageListener = { const_cast<sample::thread_policy*>(&threadPolicy), &imageAvailable };
+        sample::output_target outputTarget = sample::outputBuffer_t(&bufferAvailable);
+        if (!useByteBufferOutput)
+        {
+            imageReader = sample::createImageReader(format.get());
+            imageReaderReservation = sample::memory_reservation(&accountant,
+                                                                sample::memory_category::images,
+                                                                sample::imageReaderFootprint(format.get()));
 
-        AImageReader_ImageListener imageListener = { nullptr, &imageAvailable };
-        sample::fail_media_error(AImageReader_setImageListener(imageReader.get(), &imageListener),
-                                 "AImageReader_setImageListener");
+            sample::fail_media_error(AImageReader_setImageListener(imageReader.get(), &imageListener),
+                                     "AImageReader_setImageListener");
 
-        ANativeWindow* window = nullptr;
-        sample::fail_media_error(AImageReader_getWindow(imageReader.get(), &window),
-                                 "AImageReader_getWindow");
+            ANativeWindow* window = nullptr;
+            sample::fail_media_error(AImageReader_getWindow(imageReader.get(), &window),
+                                     "AImageReader_getWindow");
+            outputTarget = sample::output_target(window);
+        }
 
-        sample::decoder decoder(format.get(), readSampleData, window);
+        // the block cache grows to its capacity as the extractor reads, and the image pool
+        // is held for the whole decode; under a budget below the two, input never resumes
+        const std::uint64_t fixedBytes = accountant.getUsage(sample::memory_category::images).live +
+                                         std::uint64_t(cacheConfig.maxBlocks) * cacheConfig.blockSize;
+        if (memoryBudgetBytes > 0 && fixedBytes >= memoryBudgetBytes)
+        {
+            LOGE("memory budget:%" PRIu64 " is below the image pool and block cache:%" PRIu64,
+                 memoryBudgetBytes,
+                 fixedBytes);
+            BOOST_THROW_EXCEPTION( sample::sample_error()
+                                           << boost::errinfo_api_function("memory_accountant") );
+        }
+
+        std::unique_ptr<sample::frame_writer> frameWriter;
+        if (captureFramePath)
+        {
+            std::int32_t width = 0;
+            std::int32_t height = 0;
+            std::int32_t frameRate = 0;
+            AMediaFormat_getInt32(format.get(), AMEDIAFORMAT_KEY_WIDTH, &width);
+            AMediaFormat_getInt32(format.get(), AMEDIAFORMAT_KEY_HEIGHT, &height);
+
+            sample::frame_writer::config writerConfig;
+            writerConfig.format = captureFormat;
+            writerConfig.directIO = true;
+            writerConfig.accountant = &accountant;
+            writerConfig.threadPolicy = &threadPolicy;
+            if (AMediaFormat_getInt32(format.get(), AMEDIAFORMAT_KEY_FRAME_RATE, &frameRate) && frameRate > 0)
+            {
+                writerConfig.frameRateNum = frameRate;
+            }
+
+            frameWriter.reset(new sample::frame_writer(captureFramePath, width, height, writerConfig));
+            gFrameWriter = frameWriter.get();
+        }
+
+        std::unique_ptr<sample::shot_detector> shotDetector;
+        if (detectShotCuts)
+        {
+            shotDetector.reset(new sample::shot_detector(sample::shot_detector::config()));
+            gShotDetector = shotDetector.get();
+        }
+
+        rusage usageBefore;
+        getrusage(RUSAGE_SELF, &usageBefore);
+        const StopWatch decodeTimer;
+
+        sample::decoder decoder = usePollingDriver
+                ? sample::decoder(format.get(), readSampleData, outputTarget, sample::polling_driver(), decoderOptions)
+                : sample::decoder(format.get(), readSampleData, outputTarget, sample::async_driver(), decoderOptions);
+        const auto consumer = consumeFrames(decoder);
         decoder.start();
-        while (!decoder.isDone())
+        while (!decoder.isDone() || !consumer.done())
         {
             // this space intentionally left blank
         }
+        consumer.get();
+
+        if (shotDetector)
+        {
+            gShotDetector = nullptr;
+
+            const auto detectorStats = shotDetector->getStatistics();
+            LOGI("shot_detector frames:%" PRIu64 " cuts:%" PRIu64 " meanFrameMs:%.3f maxFrameMs:%.3f fps:%.1f summaryBytes:%zu",
+                 detectorStats.frames,
+                 detectorStats.cuts,
+                 1.0e3 * detectorStats.frameTime.count() / std::max<std::uint64_t>(detectorStats.frames, 1),
+                 1.0e3 * detectorStats.maxFrameTime.count(),
+                 detectorStats.frames / std::max(detectorStats.frameTime.count(), 1.0e-9),
+                 shotDetector->summaryBytes());
+        }
+
+        if (frameWriter)
+        {
+            gFrameWriter = nullptr;
+            frameWriter->close();
 
-        close(mediaFd);
+            const auto writerStats = frameWriter->getStatistics();
+            LOGI("frame_writer frames:%" PRIu64 " bytes:%" PRIu64 " pwritev:%" PRIu64 " stalls:%" PRIu64
+                 " stallMs:%.3f meanFrameMs:%.3f maxFrameMs:%.3f ioMBps:%.1f",
+                 writerStats.frames,
+                 writerStats.bytesWritten,
+                 writerStats.writeCalls,
+                 writerStats.stalls,
+                 1.0e3 * writerStats.stallTime.count(),
+                 1.0e3 * writerStats.frameTime.count() / std::max<std::uint64_t>(writerStats.frames, 1),
+                 1.0e3 * writerStats.maxFrameTime.count(),
+                 1.0e-6 * writerStats.bytesWritten / std::max(writerStats.ioTime.count(), 1.0e-9));
+        }
+
+        if (timelinePath)
+        {
+            recorder.save(timelinePath);
+        }
+
+        const auto recoveryStats = decoder.getRecoveryStatistics();
+        LOGI("codec errors:%u recoveries:%u recreated:%u streamsEnded:%u skippedMs:%.3f meanRecoveryMs:%.3f maxRecoveryMs:%.3f",
+             recoveryStats.errors,
+             recoveryStats.recoveries,
+             recoveryStats.codecsRecreated,
+             recoveryStats.streamsEnded,
+             1.0e-3 * recoveryStats.skippedUs,
+             1.0e3 * recoveryStats.totalRecoveryTime.count() / std::max(recoveryStats.recoveries, 1u),
+             1.0e3 * recoveryStats.maxRecoveryTime.count());
+
+        const double decodeSeconds = decodeTimer.getSplitTime().count();
+        rusage usageAfter;
+        getrusage(RUSAGE_SELF, &usageAfter);
+
+        LOGI("decoded %u images in %.3fs (%.1f fps) output:%s threads:%s load:%u cpu:%.3fs maxRssKb:%ld",
+             gNumImages,
+             decodeSeconds,
+             gNumImages / decodeSeconds,
+             useByteBufferOutput ? "buffer" : "image-reader",
+             usePerformanceThreadPolicy ? "performance" : "default",
+             backgroundLoadThreads,
+             cpuSeconds(usageAfter) - cpuSeconds(usageBefore),
+             usageAfter.ru_maxrss);
+
+        const double contentSeconds = 1.0e-6 * (gLastFramePresentationTimeUs - gFirstFramePresentationTimeUs);
+        LOGI("trick-play mode:%s scanned %.3fs of content in %.3fs (%.2fx realtime)",
+             sample::toString(trickPlayMode),
+             contentSeconds,
+             decodeSeconds,
+             contentSeconds / decodeSeconds);
+        if (trickPlayMode != sample::trick_play_mode::off)
+        {
+            LOGI("trick-play dropped %" PRIu64 "/%" PRIu64 " samples (%" PRIu64 " bytes) parsed:%" PRIu64 " samples at %.1f us/sample",
+                 trickPlayStats.samplesDropped,
+                 trickPlayStats.samplesRead,
+                 trickPlayStats.bytesDropped,
+                 trickPlayStats.samplesParsed,
+                 1.0e6 * trickPlayStats.parseTime.count() / std::max<std::uint64_t>(trickPlayStats.samplesParsed, 1));
+        }
+
+        const auto cacheStats = blockCache.getStatistics();
+        LOGI("block_cache requested:%" PRIu64 " read:%" PRIu64 " hits:%" PRIu64 " misses:%" PRIu64
+             " syscalls:%" PRIu64 " readAhead:%" PRIu64 " readAheadDropped:%" PRIu64,
+             cacheStats.bytesRequested,
+             cacheStats.bytesRead,
+             cacheStats.cacheHits,
+             cacheStats.cacheMisses,
+             cacheStats.syscalls,
+             cacheStats.readAheadBlocks,
+             cacheStats.readAheadDropped);
+
+        for (std::size_t c = 0; c < std::size_t(sample::memory_category::count); ++c)
+        {
+            const auto category = sample::memory_category(c);
+            const auto usage = accountant.getUsage(category);
+            LOGI("memory %s live:%" PRIu64 " peak:%" PRIu64,
+                 sample::toString(category),
+                 usage.live,
+                 usage.peak);
+        }
+        LOGI("memory total peak:%" PRIu64 " budget:%" PRIu64 " peakRssDeltaKb:%ld",
+             accountant.getTotalUsage().peak,
+             accountant.budget(),
+             accountant.peakRssDeltaKb());
     }
     catch (...)
     {
         LOGE("%s", boost::current_exception_diagnostic_information().c_str());
     }
 
+    backgroundLoadDone = true;
+    for (auto& t : backgroundLoad)
+    {
+        t.join();
+    }
+
     LOGI("MediaTest complete!!");
 
     return 0;
@@ -0,0 +1,119 @@
+//
+// Live/peak memory accounting for a decode pipeline, with an optional hard budget.
+//
+
+#include "memory_accounting.hpp"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace sample {
+
+    const char* toString(memory_category category)
+    {
+        switch (category)
+        {
+            case memory_category::images:           return "images";
+            case memory_category::codec_buffers:    return "codec_buffers";
+            case memory_category::queues:           return "queues";
+            case memory_category::heap:             return "heap";
+            default:                                return "unknown";
+        }
+    }
+
+    memory_accountant::memory_accountant(std::uint64_t budgetBytes)
+            : mBudget(budgetBytes),
+              mInitialPeakRssKb(peakRssKb()),
+              mTotalLive(0)
+    {
+        // this space intentionally left blank
+    }
+
+    void memory_accountant::add(memory_category category, std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        usage& u = mUsage[std::size_t(category)];
+        u.live += bytes;
+        u.peak = std::max(u.peak, u.live);
+
+        mTotal.live += bytes;
+        mTotal.peak = std::max(mTotal.peak, mTotal.live);
+        mTotalLive.store(mTotal.live, std::memory_order_relaxed);
+    }
+
+    void memory_accountant::remove(memory_category category, std::size_t bytes)
+    {
+        bool released = false;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            usage& u = mUsage[std::size_t(category)];
+            assert(u.live >= bytes);
+            u.live -= bytes;
+
+            const bool wasOverBudget = (mBudget > 0 && mTotal.live >= mBudget);
+            mTotal.live -= bytes;
+            mTotalLive.store(mTotal.live, std::memory_order_relaxed);
+
+            released = (wasOverBudget && mTotal.live < mBudget);
+        }
+
+        if (released)
+        {
+            // a copy, as a listener may add or remove listeners
+            std::lock_guard<std::recursive_mutex> lock(mListenerMutex);
+            const auto listeners = mReleaseListeners;
+            for (const auto& listener : listeners)
+            {
+                listener.second();
+            }
+        }
+    }
+
+    memory_accountant::usage memory_accountant::getUsage(memory_category category) const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mUsage[std::size_t(category)];
+    }
+
+    memory_accountant::usage memory_accountant::getTotalUsage() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mTotal;
+    }
+
+    memory_accountant::listenerToken_t memory_accountant::addReleaseListener(releaseListener_t listener)
+    {
+        std::lock_guard<std::recursive_mutex> lock(mListenerMutex);
+        const listenerToken_t token = mNextListenerToken++;
+        mReleaseListeners.emplace_back(token, std::move(listener));
+        return token;
+    }
+
+    void memory_accountant::removeReleaseListener(listenerToken_t token)
+    {
+        std::lock_guard<std::recursive_mutex> lock(mListenerMutex);
+        mReleaseListeners.erase(std::remove_if(mReleaseListeners.begin(),
+                                               mReleaseListeners.end(),
+                                               [token](const auto& listener) { return listener.first == token; }),
+                                mReleaseListeners.end());
+    }
+
+    long memory_accountant::peakRssDeltaKb() const
+    {
+        return peakRssKb() - mInitialPeakRssKb;
+    }
+
+    long memory_accountant::peakRssKb()
+    {
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) < 0)
+        {
+            return 0;
+        }
+        return usage.ru_maxrss;
+    }
+}
@@ -0,0 +1,206 @@
+//
+// Live/peak memory accounting for a decode pipeline, with an optional hard budget.
+//
+
+#ifndef MEDIATEST_MEMORY_ACCOUNTING_H
+#define MEDIATEST_MEMORY_ACCOUNTING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace sample {
+
+    enum class memory_category
+    {
+        images,         // AImageReader buffer pool (NDK-owned)
+        codec_buffers,  // codec output buffers held by output_buffer_views (NDK-owned)
+        queues,         // backlog in pc_queues and decoders' deferred work
+        heap,           // our own buffers, e.g. block_cache blocks
+        count
+    };
+
+    const char* toString(memory_category category);
+
+    // Tracks live and peak bytes per category for one pipeline. NDK-owned memory is
+    // accounted explicitly by whoever creates or holds it; our own containers use
+    // accounting_allocator. With a budget, producers check overBudget() and hold back
+    // new work; release listeners fire once usage drops back under the budget. Several
+    // pipeline stages may share an accountant, each with a listener of its own.
+    //
+    // Depends only on POSIX so it can be exercised on a Linux host.
+    class memory_accountant
+    {
+    public:
+        struct usage
+        {
+            std::uint64_t   live = 0;
+            std::uint64_t   peak = 0;
+        };
+
+        typedef std::function<void()>   releaseListener_t;
+        typedef std::uint64_t           listenerToken_t;
+
+        // budgetBytes of zero means unlimited.
+        explicit memory_accountant(std::uint64_t budgetBytes = 0);
+
+        memory_accountant(const memory_accountant& other) = delete;
+        memory_accountant& operator=(const memory_accountant& other) = delete;
+
+        void    add(memory_category category, std::size_t bytes);
+        void    remove(memory_category category, std::size_t bytes);
+
+        usage   getUsage(memory_category category) const;
+        usage   getTotalUsage() const;
+
+        std::uint64_t   budget() const { return mBudget; }
+        bool            overBudget() const { return mBudget > 0 && mTotalLive.load(std::memory_order_relaxed) >= mBudget; }
+
+        // Listeners are called, on whichever thread released memory, when usage falls under
+        // budget; they may allocate and release through this accountant themselves. Once
+        // removeReleaseListener() returns, the listener is not running and won't be called.
+        listenerToken_t addReleaseListener(releaseListener_t listener);
+        void            removeReleaseListener(listenerToken_t token);
+
+        // Growth of the process' peak resident set since this accountant was created.
+        long    peakRssDeltaKb() const;
+
+        static long peakRssKb();
+
+    private:
+        typedef std::array<usage, std::size_t(memory_category::count)>  usage_table;
+
+        const std::uint64_t         mBudget;
+        const long                  mInitialPeakRssKb;
+
+        mutable std::mutex          mMutex;
+        usage_table                 mUsage;
+        usage                       mTotal;
+        std::atomic<std::uint64_t>  mTotalLive;
+
+        // Held while listeners run; recursive, as a listener may release memory in turn.
+        std::recursive_mutex        mListenerMutex;
+        std::vector<std::pair<listenerToken_t, releaseListener_t>>  mReleaseListeners;
+        listenerToken_t             mNextListenerToken  = 1;
+    };
+
+    // Holds bytes against an accountant for as long as it lives. Null accountants are
+    // allowed and make the reservation a no-op.
+    class memory_reservation
+    {
+    public:
+        memory_reservation() = default;
+        memory_reservation(memory_accountant* accountant, memory_category category, std::size_t bytes)
+                : mAccountant(accountant),
+                  mCategory(category),
+                  mBytes(bytes)
+        {
+            if (mAccountant)
+            {
+                mAccountant->add(mCategory, mBytes);
+            }
+        }
+
+        memory_reservation(memory_reservation&& other) noexcept { swap(other); }
+        memory_reservation(const memory_reservation& other) = delete;
+        ~memory_reservation() { reset(); }
+
+        memory_reservation& operator=(memory_reservation&& other) noexcept
+        {
+            memory_reservation(std::move(other)).swap(*this);
+            return *this;
+        }
+        memory_reservation& operator=(const memory_reservation& other) = delete;
+
+        void    reset()
+        {
+            if (mAccountant)
+            {
+                mAccountant->remove(mCategory, mBytes);
+                mAccountant = nullptr;
+            }
+        }
+
+        void    swap(memory_reservation& other) noexcept
+        {
+            std::swap(mAccountant, other.mAccountant);
+            std::swap(mCategory, other.mCategory);
+            std::swap(mBytes, other.mBytes);
+        }
+
+    private:
+        memory_accountant*  mAccountant = nullptr;
+        memory_category     mCategory   = memory_category::heap;
+        std::size_t         mBytes      = 0;
+    };
+
+    // Standard allocator that reports its allocations to an accountant (if any).
+    template <typename T>
+    class accounting_allocator
+    {
+    public:
+        typedef T   value_type;
+
+        accounting_allocator() = default;
+        accounting_allocator(memory_accountant* accountant, memory_category category)
+                : mAccountant(accountant),
+                  mCategory(category)
+        {
+            // this space intentionally left blank
+        }
+
+        template <typename U>
+        accounting_allocator(const accounting_allocator<U>& other)
+                : mAccountant(other.accountant()),
+                  mCategory(other.category())
+        {
+            // this space intentionally left blank
+        }
+
+        T*      allocate(std::size_t n)
+        {
+            T* const result = static_cast<T*>(::operator new(n * sizeof(T)));
+            if (mAccountant)
+            {
+                mAccountant->add(mCategory, n * sizeof(T));
+            }
+            return result;
+        }
+
+        void    deallocate(T* p, std::size_t n)
+        {
+            ::operator delete(p);
+            if (mAccountant)
+            {
+                mAccountant->remove(mCategory, n * sizeof(T));
+            }
+        }
+
+        memory_accountant*  accountant() const { return mAccountant; }
+        memory_category     category() const { return mCategory; }
+
+    private:
+        memory_accountant*  mAccountant = nullptr;
+        memory_category     mCategory   = memory_category::heap;
+    };
+
+    template <typename T, typename U>
+    bool operator==(const accounting_allocator<T>& a, const accounting_allocator<U>& b)
+    {
+        return a.accountant() == b.accountant() && a.category() == b.category();
+    }
+
+    template <typename T, typename U>
+    bool operator!=(const accounting_allocator<T>& a, const accounting_allocator<U>& b)
+    {
+        return !(a == b);
+    }
+}
+
+#endif //MEDIATEST_MEMORY_ACCOUNTING_H
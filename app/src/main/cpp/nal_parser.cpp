@@ -0,0 +1,237 @@
+//
+// Minimal AVC/HEVC NAL unit parser for trick play.
+//
+
+#include "nal_parser.hpp"
+
+#include "sample_error.hpp"
+
+#include <media/NdkMediaFormat.h>
+
+#include <boost/exception/all.hpp>
+
+#include <cassert>
+#include <cstring>
+
+namespace {
+    using namespace sample;
+
+    // configurationVersion is 1 in both records; a raw parameter set starts with a start
+    // code's zero byte.
+    const std::uint8_t kConfigurationVersion = 1;
+
+    const std::size_t kAvcLengthSizeOffset  = 4;    // AVCDecoderConfigurationRecord
+    const std::size_t kHevcLengthSizeOffset = 21;   // HEVCDecoderConfigurationRecord
+
+    const unsigned int kHevcVpsType = 32;
+
+    std::size_t readLengthSize(const std::uint8_t* csd, std::size_t csdSize, std::size_t offset)
+    {
+        if (csdSize <= offset)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("nal_parser::fromFormat") );
+        }
+        return (csd[offset] & 0x03) + 1;
+    }
+
+    // numTemporalLayers shares the byte with lengthSizeMinusOne; 0 means unknown.
+    unsigned int readRecordHighestTemporalId(const std::uint8_t* record)
+    {
+        const unsigned int layers = (record[kHevcLengthSizeOffset] >> 3) & 0x07;
+        return (layers > 0) ? layers - 1 : 0;
+    }
+
+    // vps_max_sub_layers_minus1 from the VPS among raw parameter sets. It sits in the
+    // payload's first two bytes, where no emulation prevention byte can be.
+    unsigned int readAnnexBHighestTemporalId(const std::uint8_t* csd, std::size_t csdSize)
+    {
+        for (std::size_t i = 0; i + 7 <= csdSize; ++i)
+        {
+            if (csd[i] == 0 && csd[i + 1] == 0 && csd[i + 2] == 1 && ((csd[i + 3] >> 1) & 0x3f) == kHevcVpsType)
+            {
+                return (csd[i + 6] >> 1) & 0x07;
+            }
+        }
+        return 0;
+    }
+}
+
+namespace sample {
+
+    const char* toString(frame_class c)
+    {
+        switch (c)
+        {
+            case frame_class::unknown:          return "unknown";
+            case frame_class::non_reference:    return "non_reference";
+            case frame_class::reference:        return "reference";
+            case frame_class::sync:             return "sync";
+            default:                            return "invalid";
+        }
+    }
+
+    nal_parser::nal_parser(codec c, std::size_t nalLengthSize, unsigned int highestTemporalId)
+            : mCodec(c),
+              mNalLengthSize(nalLengthSize),
+              mHighestTemporalId(highestTemporalId)
+    {
+        assert(nalLengthSize <= 4);
+    }
+
+    nal_parser nal_parser::fromFormat(AMediaFormat* format)
+    {
+        const char* mime = nullptr;
+        if (!AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime))
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("AMediaFormat_getString(AMEDIAFORMAT_KEY_MIME)") );
+        }
+
+        codec c = codec::avc;
+        if (0 == std::strcmp(mime, "video/avc"))
+        {
+            c = codec::avc;
+        }
+        else if (0 == std::strcmp(mime, "video/hevc"))
+        {
+            c = codec::hevc;
+        }
+        else
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("nal_parser::fromFormat") );
+        }
+
+        void* csd = nullptr;
+        std::size_t csdSize = 0;
+        if (!AMediaFormat_getBuffer(format, AMEDIAFORMAT_KEY_CSD_0, &csd, &csdSize) || csdSize == 0)
+        {
+            return nal_parser(c, 0);
+        }
+
+        const std::uint8_t* const data = static_cast<const std::uint8_t*>(csd);
+        if (data[0] != kConfigurationVersion)
+        {
+            return nal_parser(c, 0, (c == codec::hevc) ? readAnnexBHighestTemporalId(data, csdSize) : 0);
+        }
+
+        if (c == codec::avc)
+        {
+            return nal_parser(c, readLengthSize(data, csdSize, kAvcLengthSizeOffset));
+        }
+        // the length size checks the record is long enough for the temporal id, so it
+        // must be read first
+        const std::size_t lengthSize = readLengthSize(data, csdSize, kHevcLengthSizeOffset);
+        return nal_parser(c, lengthSize, readRecordHighestTemporalId(data));
+    }
+
+    frame_class nal_parser::classify(const std::uint8_t* sample, std::size_t size) const
+    {
+        return (mNalLengthSize > 0) ? classifyLengthPrefixed(sample, size)
+                                    : classifyAnnexB(sample, size);
+    }
+
+    frame_class nal_parser::classifyNal(const std::uint8_t* header, std::size_t size) const
+    {
+        if (mCodec == codec::avc)
+        {
+            const unsigned int type = header[0] & 0x1f;
+            const unsigned int refIdc = (header[0] >> 5) & 0x03;
+
+            if (type == 5)
+            {
+                return frame_class::sync;
+            }
+            if (type >= 1 && type <= 4)
+            {
+                return refIdc ? frame_class::reference : frame_class::non_reference;
+            }
+            return frame_class::unknown;
+        }
+        else
+        {
+            if (size < 2)
+            {
+                return frame_class::unknown;
+            }
+            const unsigned int type = (header[0] >> 1) & 0x3f;
+            const unsigned int temporalIdPlus1 = header[1] & 0x07;
+
+            if (type >= 16 && type <= 23)
+            {
+                return frame_class::sync;
+            }
+            if (type <= 15 && temporalIdPlus1 > 0)
+            {
+                const unsigned int temporalId = temporalIdPlus1 - 1;
+                if (temporalId > mHighestTemporalId)
+                {
+                    return frame_class::non_reference;
+                }
+
+                // even types up to RSV_VCL_N14 are sub-layer non-reference pictures
+                const bool subLayerNonReference = (type <= 14 && (type & 1) == 0);
+                return (subLayerNonReference && temporalId == mHighestTemporalId) ? frame_class::non_reference
+                                                                                  : frame_class::reference;
+            }
+            return frame_class::unknown;
+        }
+    }
+
+    frame_class nal_parser::classifyLengthPrefixed(const std::uint8_t* sample, std::size_t size) const
+    {
+        std::size_t offset = 0;
+        while (offset + mNalLengthSize < size)
+        {
+            std::size_t nalSize = 0;
+            for (std::size_t i = 0; i < mNalLengthSize; ++i)
+            {
+                nalSize = (nalSize << 8) | sample[offset + i];
+            }
+            offset += mNalLengthSize;
+
+            if (nalSize == 0 || nalSize > size - offset)
+            {
+                break;
+            }
+
+            // every slice of a picture has the same class, so the first one decides
+            const frame_class result = classifyNal(sample + offset, nalSize);
+            if (result != frame_class::unknown)
+            {
+                return result;
+            }
+            offset += nalSize;
+        }
+        return frame_class::unknown;
+    }
+
+    frame_class nal_parser::classifyAnnexB(const std::uint8_t* sample, std::size_t size) const
+    {
+        const std::uint8_t* p = sample;
+        const std::uint8_t* const end = sample + size;
+
+        // Find each 00 00 01 by its 01, which memchr locates far faster than a byte loop.
+        while (end - p >= 3)
+        {
+            const void* const one = std::memchr(p + 2, 0x01, end - (p + 2));
+            if (!one)
+            {
+                break;
+            }
+
+            const std::uint8_t* const header = static_cast<const std::uint8_t*>(one) + 1;
+            if (header[-2] == 0 && header[-3] == 0 && header < end)
+            {
+                const frame_class result = classifyNal(header, end - header);
+                if (result != frame_class::unknown)
+                {
+                    return result;
+                }
+            }
+            p = header - 2;
+        }
+        return frame_class::unknown;
+    }
+}
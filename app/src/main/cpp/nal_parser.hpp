@@ -0,0 +1,75 @@
+//
+// Minimal AVC/HEVC NAL unit parser that classifies access units by how disposable they are,
+// for trick-play modes that skip frames before they reach the codec.
+//
+
+#ifndef MEDIATEST_NAL_PARSER_H
+#define MEDIATEST_NAL_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+
+struct AMediaFormat;
+
+namespace sample {
+
+    // Ordered by importance: a trick-play mode keeps every sample at or above its threshold.
+    enum class frame_class
+    {
+        unknown,        // no slice found; always kept
+        non_reference,  // nothing decoded predicts from it (AVC nal_ref_idc 0; see nal_parser for HEVC)
+        reference,
+        sync,           // IDR, or an HEVC IRAP picture
+    };
+
+    const char* toString(frame_class c);
+
+    // An HEVC sub-layer non-reference picture (*_N) may still be predicted from by pictures
+    // in higher sub-layers, so it is only non_reference in the highest sub-layer decoded.
+    // Pictures above that sub-layer are non_reference whatever their type: nothing at or
+    // below it predicts from them.
+    class nal_parser
+    {
+    public:
+        enum class codec
+        {
+            avc,
+            hevc,
+        };
+
+        // nalLengthSize is the size of each NAL unit's big-endian length prefix, or zero for
+        // Annex B start codes. highestTemporalId is the highest HEVC sub-layer decoded; 0,
+        // the base layer alone, is safe when the stream's layering is unknown.
+        nal_parser(codec c, std::size_t nalLengthSize, unsigned int highestTemporalId = 0);
+
+        // Picks the codec from the mime type, and the sample framing and the stream's
+        // highest sub-layer from csd-0: an avcC/hvcC record means length-prefixed samples,
+        // raw parameter sets mean Annex B, which is what AMediaExtractor produces. Throws
+        // sample_error for other codecs.
+        static nal_parser fromFormat(AMediaFormat* format);
+
+        codec           getCodec() const { return mCodec; }
+        std::size_t     nalLengthSize() const { return mNalLengthSize; }
+        unsigned int    highestTemporalId() const { return mHighestTemporalId; }
+
+        // Looks only as far as the first slice's NAL header, which carries enough to
+        // classify the whole access unit, so cost doesn't grow with the sample size for
+        // length-prefixed samples.
+        frame_class     classify(const std::uint8_t* sample, std::size_t size) const;
+
+    private:
+        // Class of the NAL unit starting at header, or unknown for non-slice units and
+        // headers cut short.
+        frame_class     classifyNal(const std::uint8_t* header, std::size_t size) const;
+
+        frame_class     classifyLengthPrefixed(const std::uint8_t* sample, std::size_t size) const;
+        frame_class     classifyAnnexB(const std::uint8_t* sample, std::size_t size) const;
+
+    private:
+        codec           mCodec;
+        std::size_t     mNalLengthSize;
+        unsigned int    mHighestTemporalId;
+    };
+}
+
+#endif //MEDIATEST_NAL_PARSER_H
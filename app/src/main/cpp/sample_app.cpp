@@ -10,12 +10,22 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cinttypes>
 #include <cstdint>
+#include <cstring>
 
 namespace {
     using namespace sample;
 
-    std::shared_ptr<AMediaCodec> createMediaCodec(AMediaFormat* format, ANativeWindow* window)
+    const std::int32_t  kMaxImageCount = 5;
+
+    // Raw YUV 4:2:0 buffer formats (MediaCodecInfo.CodecCapabilities)
+    const std::int32_t  kColorFormatYUV420Planar            = 19;
+    const std::int32_t  kColorFormatYUV420PackedPlanar      = 20;
+    const std::int32_t  kColorFormatYUV420SemiPlanar        = 21;
+    const std::int32_t  kColorFormatYUV420PackedSemiPlanar  = 39;
+
+    unique_media_codec createMediaCodec(AMediaFormat* format, ANativeWindow* window)
     {
         const char* mime = nullptr;
         if (!AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime))
@@ -24,7 +34,7 @@ namespace {
                                            << boost::errinfo_api_function("AMediaFormat_getString(AMEDIAFORMAT_KEY_MIME)") );
         }
 
-        std::shared_ptr<AMediaCodec> result(AMediaCodec_createDecoderByType(mime), AMediaCodec_delete);
+        unique_media_codec result(AMediaCodec_createDecoderByType(mime));
         if (!result)
         {
             BOOST_THROW_EXCEPTION( sample_error()
@@ -40,6 +50,58 @@ namespace {
 
         return result;
     }
+
+    // AMediaFormat_copy needs API 29, so copy what configuring a decoder reads.
+    unique_media_format copyDecoderFormat(AMediaFormat* format)
+    {
+        unique_media_format result(AMediaFormat_new());
+
+        const char* mime = nullptr;
+        if (AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime))
+        {
+            AMediaFormat_setString(result.get(), AMEDIAFORMAT_KEY_MIME, mime);
+        }
+
+        for (const char* key : { AMEDIAFORMAT_KEY_WIDTH,
+                                 AMEDIAFORMAT_KEY_HEIGHT,
+                                 AMEDIAFORMAT_KEY_MAX_INPUT_SIZE,
+                                 AMEDIAFORMAT_KEY_COLOR_FORMAT,
+                                 AMEDIAFORMAT_KEY_FRAME_RATE })
+        {
+            std::int32_t value = 0;
+            if (AMediaFormat_getInt32(format, key, &value))
+            {
+                AMediaFormat_setInt32(result.get(), key, value);
+            }
+        }
+
+        for (const char* key : { AMEDIAFORMAT_KEY_CSD_0, AMEDIAFORMAT_KEY_CSD_1 })
+        {
+            void* data = nullptr;
+            std::size_t size = 0;
+            if (AMediaFormat_getBuffer(format, key, &data, &size))
+            {
+                AMediaFormat_setBuffer(result.get(), key, data, size);
+            }
+        }
+
+        return result;
+    }
+
+    // Action codes of AMediaCodec errors: MediaCodec.CodecException.isTransient() and
+    // isRecoverable(). Anything else needs a new codec.
+    recovery_action recoveryActionFor(int32_t actionCode)
+    {
+        if (AMediaCodec_isTransient(actionCode))
+        {
+            return recovery_action::flush;
+        }
+        if (AMediaCodec_isRecoverable(actionCode))
+        {
+            return recovery_action::restart;
+        }
+        return recovery_action::recreate;
+    }
 }
 
 namespace sample {
@@ -54,7 +116,7 @@ namespace sample {
         }
     }
 
-    std::shared_ptr<AImageReader> createImageReader(AMediaFormat* format)
+    unique_image_reader createImageReader(AMediaFormat* format)
     {
         std::int32_t    width = 0;
         std::int32_t    height = 0;
@@ -64,23 +126,33 @@ namespace sample {
             LOGI("%s width=%d height=%d", __FUNCTION__, width, height);
         }
 
-        const std::int32_t  maxImageCount = 5;
-
         AImageReader* imageReader;
         fail_media_error(AImageReader_newWithUsage(width,
                                                    height,
                                                    AIMAGE_FORMAT_YUV_420_888,
                                                    AHARDWAREBUFFER_USAGE_CPU_WRITE_NEVER | AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN,
-                                                   maxImageCount,
+                                                   kMaxImageCount,
                                                    &imageReader),
                          "AImageReader_newWithUsage");
 
-        return std::shared_ptr<AImageReader>(imageReader, AImageReader_delete);
+        return unique_image_reader(imageReader);
+    }
+
+    std::size_t imageReaderFootprint(AMediaFormat* format)
+    {
+        std::int32_t    width = 0;
+        std::int32_t    height = 0;
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_WIDTH, &width);
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_HEIGHT, &height);
+
+        // AIMAGE_FORMAT_YUV_420_888: full-resolution luma plus two quarter-resolution chroma planes
+        const std::size_t imageBytes = std::size_t(width) * height * 3 / 2;
+        return kMaxImageCount * imageBytes;
     }
 
-    std::shared_ptr<AMediaExtractor> createMediaExtractor(int fd)
+    unique_media_extractor createMediaExtractor(int fd)
     {
-        std::shared_ptr<AMediaExtractor> result(AMediaExtractor_new(), AMediaExtractor_delete);
+        unique_media_extractor result(AMediaExtractor_new());
         if (!result)
         {
             BOOST_THROW_EXCEPTION( sample_error()
@@ -96,31 +168,47 @@ namespace sample {
         return result;
     }
 
-    std::shared_ptr<AMediaFormat> selectVideoTrack(AMediaExtractor* extractor)
+    unique_media_extractor createMediaExtractor(AMediaDataSource* dataSource)
+    {
+        unique_media_extractor result(AMediaExtractor_new());
+        if (!result)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("AMediaExtractor_new") );
+        }
+
+        fail_media_error(
+                AMediaExtractor_setDataSourceCustom(result.get(), dataSource),
+                "AMediaExtractor_setDataSourceCustom");
+
+        return result;
+    }
+
+    unique_media_format selectVideoTrack(AMediaExtractor* extractor)
     {
         LOGI("%s BEGIN", __FUNCTION__);
 
         const std::size_t numTracks = AMediaExtractor_getTrackCount(extractor);
         LOGI("%s numTracks:%zd", __FUNCTION__, numTracks);
 
-        AMediaFormat* result = nullptr;
+        unique_media_format result;
         for (std::size_t track = 0; track < numTracks; ++track)
         {
-            AMediaFormat* const format = AMediaExtractor_getTrackFormat(extractor, track);
+            unique_media_format format(AMediaExtractor_getTrackFormat(extractor, track));
 
             const char* mime = nullptr;
-            if (AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime) &&
+            if (AMediaFormat_getString(format.get(), AMEDIAFORMAT_KEY_MIME, &mime) &&
                 0 == std::strncmp(mime, "video/", 6))
             {
                 AMediaExtractor_selectTrack(extractor, track);
-                result = format;
-                LOGI("%s trackNum:%zd format:'%s'", __FUNCTION__, track, AMediaFormat_toString(result));
+                result = std::move(format);
+                LOGI("%s trackNum:%zd format:'%s'", __FUNCTION__, track, AMediaFormat_toString(result.get()));
                 break;
             }
         }
 
         LOGI("%s END", __FUNCTION__);
-        return std::shared_ptr<AMediaFormat>(result, AMediaFormat_delete);
+        return result;
     }
 
     std::tuple<bool, std::size_t, std::uint64_t> readSampleData(AMediaExtractor* extractor,
@@ -139,35 +227,246 @@ namespace sample {
                                std::uint64_t( std::abs( presentationTimeUs ) ));
     }
 
-    decoder::decoder()
+    const char* toString(trick_play_mode mode)
+    {
+        switch (mode)
+        {
+            case trick_play_mode::off:                  return "off";
+            case trick_play_mode::drop_non_reference:   return "drop_non_reference";
+            case trick_play_mode::sync_only:            return "sync_only";
+            default:                                    return "unknown";
+        }
+    }
+
+    std::tuple<bool, std::size_t, std::uint64_t> readTrickPlaySampleData(AMediaExtractor* extractor,
+                                                                         const nal_parser& parser,
+                                                                         trick_play_mode mode,
+                                                                         trick_play_statistics& statistics,
+                                                                         void* buffer,
+                                                                         size_t capacity)
+    {
+        for (;;)
+        {
+            const std::int64_t presentationTimeUs = AMediaExtractor_getSampleTime(extractor);
+            if (presentationTimeUs >= 0)
+            {
+                if (statistics.firstPresentationTimeUs < 0)
+                {
+                    statistics.firstPresentationTimeUs = presentationTimeUs;
+                }
+                statistics.lastPresentationTimeUs = std::max(statistics.lastPresentationTimeUs, presentationTimeUs);
+            }
+            ++statistics.samplesRead;
+
+            bool drop = false;
+            ssize_t bytesRead = 0;
+            if (mode == trick_play_mode::sync_only &&
+                0 == (AMediaExtractor_getSampleFlags(extractor) & AMEDIAEXTRACTOR_SAMPLE_FLAG_SYNC))
+            {
+                drop = true;
+                bytesRead = std::max(AMediaExtractor_getSampleSize(extractor), ssize_t(0));
+            }
+            else
+            {
+                bytesRead = AMediaExtractor_readSampleData(extractor,
+                                                           static_cast<std::uint8_t*>(buffer),
+                                                           capacity);
+                if (mode == trick_play_mode::drop_non_reference && bytesRead > 0)
+                {
+                    const StopWatch parseTimer;
+                    drop = (frame_class::non_reference == parser.classify(static_cast<const std::uint8_t*>(buffer),
+                                                                          bytesRead));
+                    statistics.parseTime += parseTimer.getSplitTime();
+                    ++statistics.samplesParsed;
+                    statistics.bytesParsed += bytesRead;
+                }
+            }
+
+            const bool moreDataAvailable = (bytesRead >= 0 && AMediaExtractor_advance(extractor));
+
+            if (!drop)
+            {
+                return std::make_tuple(moreDataAvailable,
+                                       size_t( std::max(bytesRead, ssize_t(0)) ),
+                                       std::uint64_t( std::abs( presentationTimeUs ) ));
+            }
+
+            ++statistics.samplesDropped;
+            statistics.bytesDropped += bytesRead;
+
+            if (!moreDataAvailable)
+            {
+                // the stream ended on a dropped sample; queue an empty end-of-stream buffer
+                return std::make_tuple(false,
+                                       size_t(0),
+                                       std::uint64_t( std::abs( presentationTimeUs ) ));
+            }
+        }
+    }
+
+    std::int64_t resyncToNextSyncSample(AMediaExtractor* extractor, std::int64_t afterUs)
+    {
+        if (AMEDIA_OK != AMediaExtractor_seekTo(extractor, afterUs + 1, AMEDIAEXTRACTOR_SEEK_NEXT_SYNC))
+        {
+            return -1;
+        }
+
+        const std::int64_t result = AMediaExtractor_getSampleTime(extractor);
+        return (result > afterUs) ? result : -1;
+    }
+
+    const char* toString(recovery_action action)
+    {
+        switch (action)
+        {
+            case recovery_action::flush:        return "flush";
+            case recovery_action::restart:      return "restart";
+            case recovery_action::recreate:     return "recreate";
+            case recovery_action::end_of_stream:    return "end_of_stream";
+            default:                            return "unknown";
+        }
+    }
+
+    buffer_layout buffer_layout::fromFormat(AMediaFormat* format)
+    {
+        buffer_layout result;
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, &result.colorFormat);
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_WIDTH, &result.width);
+        AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_HEIGHT, &result.height);
+
+        // Codecs that omit stride or slice-height pack their planes tightly.
+        if (!AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_STRIDE, &result.stride) || result.stride <= 0)
+        {
+            result.stride = result.width;
+        }
+        if (!AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_SLICE_HEIGHT, &result.sliceHeight) || result.sliceHeight <= 0)
+        {
+            result.sliceHeight = result.height;
+        }
+
+        return result;
+    }
+
+    buffer_layout::chroma_arrangement buffer_layout::chroma() const
+    {
+        if (width <= 0 || height <= 0 || (width & 1) || (height & 1) || stride < width || sliceHeight < height)
+        {
+            return chroma_arrangement::unsupported;
+        }
+
+        switch (colorFormat)
+        {
+            case kColorFormatYUV420Planar:
+            case kColorFormatYUV420PackedPlanar:
+                return (stride & 1) ? chroma_arrangement::unsupported : chroma_arrangement::planar;
+            case kColorFormatYUV420SemiPlanar:
+            case kColorFormatYUV420PackedSemiPlanar:
+                return chroma_arrangement::semi_planar;
+            default:
+                return chroma_arrangement::unsupported;
+        }
+    }
+
+    std::size_t buffer_layout::minimumSize() const
+    {
+        const std::size_t lumaSize = std::size_t(stride) * sliceHeight;
+        switch (chroma())
+        {
+            case chroma_arrangement::planar:
+            {
+                const std::size_t chromaPlaneSize = std::size_t(stride / 2) * (sliceHeight / 2);
+                return lumaSize + chromaPlaneSize + std::size_t(stride / 2) * (height / 2 - 1) + width / 2;
+            }
+            case chroma_arrangement::semi_planar:
+                return lumaSize + std::size_t(stride) * (height / 2 - 1) + width;
+            default:
+                return 0;
+        }
+    }
+
+    decoder_core::decoder_core(const decoder_options& options)
             : mAtInputEOS(false),
-              mAtOutputEOS(false)
+              mAtOutputEOS(false),
+              mAccountant(options.accountant),
+              mRecorder(options.recorder),
+              mThreadPolicy(options.threadPolicy),
+              mDeferredInputs(accounting_allocator<int32_t>(options.accountant, memory_category::queues)),
+              mDeferredOutputs(accounting_allocator<io_event>(options.accountant, memory_category::queues)),
+              mRetryInputs(false),
+              mRetryOutputs(false),
+              mResyncFn(options.resync),
+              mRecoveryListener(options.onRecovery),
+              mCodecGeneration(0)
     {
-        // this space intentionally left blank
+        mInputTimes.fill(input_time(-1, StopWatch::clock::time_point()));
+        mLatencyHistogram.fill(0);
+
+        if (mAccountant && mAccountant->overBudget())
+        {
+            // nothing would ever be fed: the budget doesn't cover what is already held
+            LOGE("%s memory budget:%" PRIu64 " already used:%" PRIu64,
+                 __FUNCTION__,
+                 mAccountant->budget(),
+                 mAccountant->getTotalUsage().live);
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("decoder_core") );
+        }
+
+        mDeferredOutputs.reserve(kIOQueueCapacity);
     }
 
-    decoder::decoder(AMediaFormat* format,
-                     readSampleData_t readSampleData,
-                     ANativeWindow* window)
-            : decoder()
+    decoder_core::decoder_core(AMediaFormat* format,
+                               readSampleData_t readSampleData,
+                               output_target target,
+                               const async_driver& driver,
+                               const decoder_options& options)
+            : decoder_core(options)
     {
-        mReadSampleDataFn = readSampleData;
+        mReadSampleDataFn = std::move(readSampleData);
+        mOutputBufferFn = std::move(target.onOutputBuffer);
+        mFrameOutput = target.toFrames;
+        mFormat = copyDecoderFormat(format);
+        mWindow = target.window;
 
-        mMediaCodec = createMediaCodec(format, window);
+        mMediaCodec = createMediaCodec(format, target.window);
+        setAsyncCallbacks();
 
-        AMediaCodecOnAsyncNotifyCallback callbacks;
-        callbacks.onAsyncError = &decoder::asyncErrorCallback;
-        callbacks.onAsyncFormatChanged = &decoder::asyncFormatChangedCallback;
-        callbacks.onAsyncInputAvailable= &decoder::asyncInputAvailableCallback;
-        callbacks.onAsyncOutputAvailable = &decoder::asyncOutputAvailableCallback;
-        fail_media_error(AMediaCodec_setAsyncNotifyCallback(mMediaCodec.get(), callbacks, this),
-                         "AMediaCodec_setAsyncNotifyCallback");
+        if (mAccountant)
+        {
+            mReleaseListenerToken = mAccountant->addReleaseListener([this]() {
+                mRetryInputs = true;
+                mIOQueue.wake();
+            });
+        }
     }
 
-    decoder::~decoder()
+    decoder_core::decoder_core(AMediaFormat* format,
+                               readSampleData_t readSampleData,
+                               output_target target,
+                               const polling_driver& driver,
+                               const decoder_options& options)
+            : decoder_core(options)
+    {
+        mReadSampleDataFn = std::move(readSampleData);
+        mOutputBufferFn = std::move(target.onOutputBuffer);
+        mFrameOutput = target.toFrames;
+        mFormat = copyDecoderFormat(format);
+        mWindow = target.window;
+        mPolling = true;
+        mPollingDriver = driver;
+
+        mMediaCodec = createMediaCodec(format, target.window);
+    }
+
+    decoder_core::~decoder_core()
     {
         assert(isDone());
 
+        if (mReleaseListenerToken)
+        {
+            mAccountant->removeReleaseListener(mReleaseListenerToken);
+        }
+
         if (mIOThread.joinable())
         {
             mIOThread.join();
@@ -179,20 +478,65 @@ namespace sample {
         }
     }
 
-    void decoder::start()
+    void decoder_core::setAsyncCallbacks()
+    {
+        AMediaCodecOnAsyncNotifyCallback callbacks;
+        callbacks.onAsyncError = &decoder_core::asyncErrorCallback;
+        callbacks.onAsyncFormatChanged = &decoder_core::asyncFormatChangedCallback;
+        callbacks.onAsyncInputAvailable= &decoder_core::asyncInputAvailableCallback;
+        callbacks.onAsyncOutputAvailable = &decoder_core::asyncOutputAvailableCallback;
+        fail_media_error(AMediaCodec_setAsyncNotifyCallback(mMediaCodec.get(), callbacks, this),
+                         "AMediaCodec_setAsyncNotifyCallback");
+    }
+
+    void decoder_core::start()
     {
         assert(mMediaCodec);
 
-        mIOThread = std::thread(&decoder::ioThread, this);
-        fail_media_error(AMediaCodec_start(mMediaCodec.get()),
-                         "AMediaCodec_start");
+        if (mPolling)
+        {
+            // the codec must be running before the first dequeue
+            fail_media_error(AMediaCodec_start(mMediaCodec.get()),
+                             "AMediaCodec_start");
+            mIOThread = std::thread(&decoder_core::pollingThread, this);
+        }
+        else
+        {
+            mIOThread = std::thread(&decoder_core::ioThread, this);
+            fail_media_error(AMediaCodec_start(mMediaCodec.get()),
+                             "AMediaCodec_start");
+        }
     }
 
-    void decoder::onInputAvailable(AMediaCodec* codec,
-                                   int32_t index)
+    void decoder_core::onInputAvailable(AMediaCodec* codec,
+                                        int32_t index)
     {
         assert(codec == mMediaCodec.get() && codec);
 
+        if (mAccountant && mAccountant->overBudget())
+        {
+            // Backpressure: keep the buffer until downstream releases memory.
+            LOGI("%s index:%d deferred, over memory budget", __FUNCTION__, index);
+            mDeferredInputs.push_back(index);
+            return;
+        }
+
+        feedInput(codec, index);
+    }
+
+    void decoder_core::retryDeferredInputs()
+    {
+        while (!mDeferredInputs.empty() && !mAccountant->overBudget())
+        {
+            const int32_t index = mDeferredInputs.front();
+            mDeferredInputs.erase(mDeferredInputs.begin());
+            feedInput(mMediaCodec.get(), index);
+        }
+    }
+
+    void decoder_core::feedInput(AMediaCodec* codec,
+                                 int32_t index)
+    {
         LOGI("%s index:%d", __FUNCTION__, index);
 
         std::size_t     bufferCapacity = 0;
@@ -209,9 +553,7 @@ namespace sample {
         ssize_t bytesRead = 0;
         std::int64_t presentationTimeUs = 0;
         bool moreDataAvailable = true;
-        std::tie(moreDataAvailable, bytesRead, presentationTimeUs) = mReadSampleDataFn(*this,
-                                                                                       buffer,
-                                                                                       bufferCapacity);
+        std::tie(moreDataAvailable, bytesRead, presentationTimeUs) = mReadSampleDataFn(buffer, bufferCapacity);
 
         LOGI("%s bytesRead:%zd presentationTimeUs:%" PRId64 " moreData:%s",
              __FUNCTION__,
@@ -219,28 +561,91 @@ namespace sample {
              presentationTimeUs,
              moreDataAvailable ? "TRUE" : "FALSE");
 
-        fail_media_error(AMediaCodec_queueInputBuffer(codec,
-                                                      index,
-                                                      0, // offset
-                                                      bytesRead,
-                                                      presentationTimeUs,
-                                                      moreDataAvailable ? 0
-                                                                        : AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM), // flags
-                         "AMediaCodec_queueInputBuffer");
+        const media_status_t status = AMediaCodec_queueInputBuffer(codec,
+                                                                   index,
+                                                                   0, // offset
+                                                                   bytesRead,
+                                                                   presentationTimeUs,
+                                                                   moreDataAvailable ? 0
+                                                                                     : AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM); // flags
+        if (status != AMEDIA_OK)
+        {
+            // the sample is lost either way; resync skips past it
+            mLastQueuedUs = std::max(mLastQueuedUs, presentationTimeUs);
+            failOrRecover(status, "AMediaCodec_queueInputBuffer");
+            return;
+        }
+
+        if (mRecorder)
+        {
+            mRecorder->record(timeline_event_type::input_queued,
+                              index,
+                              bytesRead,
+                              presentationTimeUs,
+                              moreDataAvailable ? 0 : AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM);
+        }
+
+        mInputTimes[mNumInputBuffers++ % kMaxInputTimes] = std::make_pair(presentationTimeUs, StopWatch::clock::now());
+        if (moreDataAvailable)
+        {
+            mLastQueuedUs = std::max(mLastQueuedUs, presentationTimeUs);
+        }
 
         mAtInputEOS = !moreDataAvailable;
     }
 
-    void decoder::onOutputAvailable(AMediaCodec* codec,
-                                    int32_t index,
-                                    AMediaCodecBufferInfo *bufferInfo)
+    void decoder_core::onOutputAvailable(AMediaCodec* codec,
+                                         int32_t index,
+                                         AMediaCodecBufferInfo *bufferInfo)
     {
         assert(codec == mMediaCodec.get());
 
-        fail_media_error(AMediaCodec_releaseOutputBuffer(codec,
-                                                         index,
-                                                         true), // render the buffer to the bound surface
-                         "AMediaCodec_releaseOutputBuffer");
+        decoded_frame frame;
+        if (!mOutputBufferFn && !mFrameOutput)
+        {
+            fail_media_error(AMediaCodec_releaseOutputBuffer(codec,
+                                                             index,
+                                                             true), // render the buffer to the bound surface
+                             "AMediaCodec_releaseOutputBuffer");
+        }
+        else if (bufferInfo->size > 0)
+        {
+            std::size_t         bufferCapacity = 0;
+            const std::uint8_t* buffer = AMediaCodec_getOutputBuffer(codec, index, &bufferCapacity);
+            if (!buffer)
+            {
+                BOOST_THROW_EXCEPTION( sample_error()
+                                               << boost::errinfo_api_function("AMediaCodec_getOutputBuffer")
+                                               << errinfo_buffer_index(index) );
+            }
+
+            output_buffer_view view(codec,
+                                    index,
+                                    buffer + bufferInfo->offset,
+                                    bufferInfo->size,
+                                    mOutputLayout,
+                                    bufferInfo->presentationTimeUs,
+                                    memory_reservation(mAccountant,
+                                                       memory_category::codec_buffers,
+                                                       bufferInfo->size),
+                                    &mBufferGeneration);
+            if (mFrameOutput)
+            {
+                frame.buffer = std::move(view);
+            }
+            else
+            {
+                const StopWatch callbackTimer;
+                mOutputBufferFn(std::move(view));
+                mFrameStatistics.dispatchTime += callbackTimer.getSplitTime();
+            }
+        }
+        else
+        {
+            // nothing to show, typically the end-of-stream marker
+            fail_media_error(AMediaCodec_releaseOutputBuffer(codec, index, false),
+                             "AMediaCodec_releaseOutputBuffer");
+        }
 
         mAtOutputEOS = (0 != (bufferInfo->flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM));
 
@@ -248,77 +653,701 @@ namespace sample {
              __FUNCTION__,
              index,
              mAtOutputEOS ? "TRUE" : "FALSE",
-             mNumOutputBuffers++);
+             mNumOutputBuffers);
+
+        const auto inputTime = std::find_if(mInputTimes.begin(),
+                                            mInputTimes.end(),
+                                            [bufferInfo](const input_time& t) { return t.first == bufferInfo->presentationTimeUs; });
+        if (inputTime != mInputTimes.end() && !mAtOutputEOS)
+        {
+            recordLatency(StopWatch::clock::now() - inputTime->second);
+        }
+
+        if (mRecovering)
+        {
+            finishRecovery();
+        }
+        if (!mAtOutputEOS)
+        {
+            mLastDeliveredUs = bufferInfo->presentationTimeUs;
+        }
+
+        frame.presentationTimeUs = bufferInfo->presentationTimeUs;
+        frame.flags = bufferInfo->flags;
+        frame.frameNumber = mNumOutputBuffers++;
+
+        const StopWatch dispatchTimer;
+        deliverFrame(std::move(frame));
+        mFrameStatistics.dispatchTime += dispatchTimer.getSplitTime();
+
+        if (mAtOutputEOS)
+        {
+            LOGI("%s dispatched:%u meanDispatchUs:%.3f heldBack:%u dropped:%u",
+                 __FUNCTION__,
+                 mNumOutputBuffers,
+                 1.0e6 * mFrameStatistics.dispatchTime.count() / std::max(mNumOutputBuffers, 1u),
+                 mFrameStatistics.heldBack,
+                 mFrameStatistics.dropped);
+            const latency_statistics latency = getLatencyStatistics();
+            LOGI("%s driver:%s meanLatencyMs:%.3f p50LatencyMs:<%.3f p99LatencyMs:<%.3f maxLatencyMs:%.3f",
+                 __FUNCTION__,
+                 mPolling ? "polling" : "async",
+                 latency.meanMs,
+                 latency.p50Ms,
+                 latency.p99Ms,
+                 latency.maxMs);
+        }
     }
 
-    void decoder::onFormatChanged(AMediaCodec *codec,
+    void decoder_core::recordLatency(StopWatch::duration latency)
+    {
+        mTotalFrameLatency += latency;
+        mMaxFrameLatency = std::max(mMaxFrameLatency, latency);
+        ++mNumLatencySamples;
+
+        std::size_t bucket = 0;
+        for (auto us = static_cast<std::uint64_t>(1.0e6 * latency.count()); us > 1 && bucket + 1 < kLatencyBuckets; us >>= 1)
+        {
+            ++bucket;
+        }
+        ++mLatencyHistogram[bucket];
+    }
+
+    latency_statistics decoder_core::getLatencyStatistics() const
+    {
+        latency_statistics result;
+        result.samples = mNumLatencySamples;
+        result.meanMs = 1.0e3 * mTotalFrameLatency.count() / std::max(mNumLatencySamples, 1u);
+        result.p50Ms = latencyPercentileMs(0.50);
+        result.p99Ms = latencyPercentileMs(0.99);
+        result.maxMs = 1.0e3 * mMaxFrameLatency.count();
+        return result;
+    }
+
+    double decoder_core::latencyPercentileMs(double percentile) const
+    {
+        // upper bound of the bucket holding the percentile
+        const unsigned int rank = static_cast<unsigned int>(percentile * mNumLatencySamples);
+        unsigned int count = 0;
+        for (std::size_t bucket = 0; bucket < kLatencyBuckets; ++bucket)
+        {
+            count += mLatencyHistogram[bucket];
+            if (count > rank)
+            {
+                return 1.0e-3 * (std::uint64_t(2) << bucket);
+            }
+        }
+        return 1.0e3 * mMaxFrameLatency.count();
+    }
+
+    bool decoder_core::waitForFrameRoom(std::int64_t timeoutUs)
+    {
+        std::unique_lock<std::mutex> lock(mFrameMutex);
+        return mFrameRoomCondition.wait_for(lock,
+                                            std::chrono::microseconds(std::max<std::int64_t>(timeoutUs, 0)),
+                                            [this]() { return !mFrameConsumer || mFrameAwaiter || mPendingFrameCount < kMaxPendingFrames; });
+    }
+
+    void decoder_core::deliverFrame(decoded_frame&& frame)
+    {
+        frame_awaiter* awaiter = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mFrameMutex);
+            ++mFrameStatistics.delivered;
+            if (frame.isEndOfStream())
+            {
+                // kept rather than queued: it is what every await gets once the queue is empty
+                mDeliveredEOS = true;
+                mEOSFrame.presentationTimeUs = frame.presentationTimeUs;
+                mEOSFrame.flags = frame.flags;
+                mEOSFrame.frameNumber = frame.frameNumber;
+            }
+
+            if (mFrameAwaiter)
+            {
+                awaiter = mFrameAwaiter;
+                mFrameAwaiter = nullptr;
+                awaiter->mFrame = std::move(frame);
+            }
+            else if (mFrameConsumer && !frame.isEndOfStream())
+            {
+                if (mPendingFrameCount == kMaxPendingFrames)
+                {
+                    // output waits for room, so only a frame from recovery gets here
+                    LOGW("%s dropped frame #%u pts:%" PRId64 ", consumer is behind",
+                         __FUNCTION__,
+                         mPendingFrames[mPendingFrameHead].frameNumber,
+                         mPendingFrames[mPendingFrameHead].presentationTimeUs);
+                    mPendingFrames[mPendingFrameHead] = decoded_frame();
+                    mPendingFrameHead = (mPendingFrameHead + 1) % kMaxPendingFrames;
+                    --mPendingFrameCount;
+                    ++mFrameStatistics.dropped;
+                }
+                mPendingFrames[(mPendingFrameHead + mPendingFrameCount) % kMaxPendingFrames] = std::move(frame);
+                ++mPendingFrameCount;
+            }
+        }
+
+        if (awaiter)
+        {
+            // resume the consumer right here on the IO thread
+            awaiter->mHandle.resume();
+        }
+    }
+
+    bool decoder_core::frame_awaiter::await_suspend(std::coroutine_handle<> h)
+    {
+        std::lock_guard<std::mutex> lock(mDecoder.mFrameMutex);
+        mDecoder.mFrameConsumer = true;
+        if (mDecoder.mPendingFrameCount > 0)
+        {
+            const bool wasFull = (mDecoder.mPendingFrameCount == kMaxPendingFrames);
+            mFrame = std::move(mDecoder.mPendingFrames[mDecoder.mPendingFrameHead]);
+            mDecoder.mPendingFrameHead = (mDecoder.mPendingFrameHead + 1) % kMaxPendingFrames;
+            --mDecoder.mPendingFrameCount;
+
+            if (wasFull)
+            {
+                // output held back for want of room can go on
+                mDecoder.mFrameRoomCondition.notify_one();
+                mDecoder.mRetryOutputs = true;
+                mDecoder.mIOQueue.wake();
+            }
+            return false;
+        }
+        if (mDecoder.mDeliveredEOS)
+        {
+            mFrame.presentationTimeUs = mDecoder.mEOSFrame.presentationTimeUs;
+            mFrame.flags = mDecoder.mEOSFrame.flags;
+            mFrame.frameNumber = mDecoder.mEOSFrame.frameNumber;
+            return false;
+        }
+
+        assert(!mDecoder.mFrameAwaiter);
+        mHandle = h;
+        mDecoder.mFrameAwaiter = this;
+        return true;
+    }
+
+    void decoder_core::onFormatChanged(AMediaCodec *codec,
                                   AMediaFormat *format)
     {
         assert(codec == mMediaCodec.get() && codec && format);
         LOGE("%s { %s }", __FUNCTION__, AMediaFormat_toString(format));
+
+        mOutputLayout = buffer_layout::fromFormat(format);
+        LOGI("%s colorFormat:%d %dx%d stride:%d sliceHeight:%d",
+             __FUNCTION__,
+             mOutputLayout.colorFormat,
+             mOutputLayout.width,
+             mOutputLayout.height,
+             mOutputLayout.stride,
+             mOutputLayout.sliceHeight);
     }
 
-    void decoder::onError(AMediaCodec *codec,
+    void decoder_core::onError(AMediaCodec *codec,
                           media_status_t error,
                           int32_t actionCode,
                           const char *detail)
     {
-        assert(codec == mMediaCodec.get() && codec && detail);
-        LOGE("%s %d %d '%s", __FUNCTION__, error, actionCode, detail);
+        assert(codec == mMediaCodec.get() && codec);
+        LOGE("%s %d %d '%s'", __FUNCTION__, error, actionCode, detail ? detail : "");
+
+        ++mRecoveryStatistics.errors;
+        if (mResyncFn)
+        {
+            recover(error, actionCode, recoveryActionFor(actionCode));
+        }
+    }
+
+    void decoder_core::failOrRecover(media_status_t status, const char* apiFunction)
+    {
+        if (!mResyncFn)
+        {
+            fail_media_error(status, apiFunction);
+        }
+
+        LOGE("%s %s failed: %d", __FUNCTION__, apiFunction, status);
+        ++mRecoveryStatistics.errors;
+
+        // No action code outside the error callback: try the least drastic step first, and
+        // escalate if the codec fails again before producing anything.
+        recovery_action action = recovery_action::flush;
+        if (mRecovering)
+        {
+            action = (mRecovery.action == recovery_action::flush) ? recovery_action::restart
+                                                                  : recovery_action::recreate;
+        }
+        recover(status, 0, action);
     }
 
-    void decoder::ioThread()
+    void decoder_core::recover(media_status_t error, int32_t actionCode, recovery_action action)
     {
+        if (!mRecovering)
+        {
+            mRecovering = true;
+            mRecoveryStart = StopWatch::clock::now();
+            mRecovery = recovery_event();
+            mRecovery.error = error;
+            mRecovery.actionCode = actionCode;
+            mRecovery.lastDeliveredUs = mLastDeliveredUs;
+        }
+
+        // a second failure before the codec produced anything escalates
+        mRecovery.action = std::max(mRecovery.action, action);
+
+        // Everything queued may depend on the sample that broke the codec, so restart from
+        // the first sync sample after the last one it was given.
+        mRecovery.resumedAtUs = mResyncFn(mLastQueuedUs);
+
+        mDeferredInputs.clear();
+        mDeferredOutputs.clear();
+        mInputTimes.fill(input_time(-1, StopWatch::clock::time_point()));
+
+        if (mRecovery.resumedAtUs < 0)
+        {
+            // No sync sample left to resume at: a restarted codec would never be given
+            // anything, so the stream ends here.
+            LOGW("%s error:%d no sync sample after %" PRId64 ", ending the stream",
+                 __FUNCTION__,
+                 error,
+                 mLastQueuedUs);
+            mRecovery.action = recovery_action::end_of_stream;
+            finishRecovery();
+            endStream();
+            return;
+        }
+
+        mAtInputEOS = false;
+        restartCodec(mRecovery.action);
+
+        LOGW("%s error:%d action:%s lastDeliveredUs:%" PRId64 " resumedAtUs:%" PRId64,
+             __FUNCTION__,
+             error,
+             toString(mRecovery.action),
+             mRecovery.lastDeliveredUs,
+             mRecovery.resumedAtUs);
+    }
+
+    void decoder_core::restartCodec(recovery_action action)
+    {
+        // Output buffers go back to the session that handed them out, or not at all: its
+        // indices may name other buffers after a flush or a stop.
+        releasePendingBuffers();
+        mBufferGeneration.advance();
+
+        // Stopping or flushing waits out callbacks in flight, so everything queued for the
+        // IO thread from here on belongs to the new generation.
+        switch (action)
+        {
+            case recovery_action::flush:
+                fail_media_error(AMediaCodec_flush(mMediaCodec.get()), "AMediaCodec_flush");
+                ++mCodecGeneration;
+                if (!mPolling)
+                {
+                    // in async mode a flushed codec stays paused until started again
+                    fail_media_error(AMediaCodec_start(mMediaCodec.get()), "AMediaCodec_start");
+                }
+                break;
+
+            case recovery_action::restart:
+                (void) AMediaCodec_stop(mMediaCodec.get());
+                ++mCodecGeneration;
+                mOutputLayout = buffer_layout();    // a reconfigured codec reports its own
+                fail_media_error(AMediaCodec_configure(mMediaCodec.get(), mFormat.get(), mWindow, nullptr, 0),
+                                 "AMediaCodec_configure");
+                if (!mPolling)
+                {
+                    setAsyncCallbacks();
+                }
+                fail_media_error(AMediaCodec_start(mMediaCodec.get()), "AMediaCodec_start");
+                break;
+
+            case recovery_action::recreate:
+            case recovery_action::end_of_stream:
+                (void) AMediaCodec_stop(mMediaCodec.get());
+                ++mCodecGeneration;
+                mOutputLayout = buffer_layout();
+                mRetiredCodecs.push_back(std::move(mMediaCodec));
+                mMediaCodec = createMediaCodec(mFormat.get(), mWindow);
+                if (!mPolling)
+                {
+                    setAsyncCallbacks();
+                }
+                fail_media_error(AMediaCodec_start(mMediaCodec.get()), "AMediaCodec_start");
+                ++mRecoveryStatistics.codecsRecreated;
+                break;
+        }
+    }
+
+    void decoder_core::releasePendingBuffers()
+    {
+        if (!mFrameOutput)
+        {
+            // queued frames carry no buffers
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mFrameMutex);
+        if (0 == mPendingFrameCount)
+        {
+            return;
+        }
+
+        // The consumer hasn't seen these yet; they are lost with the rest of the session's
+        // output, and the gap reported for the recovery starts before them.
+        const std::int64_t firstUs = mPendingFrames[mPendingFrameHead].presentationTimeUs;
+        LOGW("%s dropping %zu queued frames from pts %" PRId64,
+             __FUNCTION__,
+             mPendingFrameCount,
+             firstUs);
+        mRecovery.lastDeliveredUs = std::min(mRecovery.lastDeliveredUs, firstUs - 1);
+        for (auto& frame : mPendingFrames)
+        {
+            frame = decoded_frame();
+        }
+        mPendingFrameHead = 0;
+        mPendingFrameCount = 0;
+        mFrameRoomCondition.notify_one();
+    }
+
+    void decoder_core::finishRecovery()
+    {
+        mRecovering = false;
+        mRecovery.recoveryTime = StopWatch::clock::now() - mRecoveryStart;
+
+        if (mRecovery.action == recovery_action::end_of_stream)
+        {
+            // nothing was restarted, so there is no recovery time to speak of
+            ++mRecoveryStatistics.streamsEnded;
+            LOGW("%s stream ended after error %d, last delivered %" PRId64,
+                 __FUNCTION__,
+                 mRecovery.error,
+                 mRecovery.lastDeliveredUs);
+            if (mRecoveryListener)
+            {
+                mRecoveryListener(mRecovery);
+            }
+            return;
+        }
+
+        ++mRecoveryStatistics.recoveries;
+        mRecoveryStatistics.totalRecoveryTime += mRecovery.recoveryTime;
+        mRecoveryStatistics.maxRecoveryTime = std::max(mRecoveryStatistics.maxRecoveryTime, mRecovery.recoveryTime);
+        if (mRecovery.lastDeliveredUs >= 0 && mRecovery.resumedAtUs > mRecovery.lastDeliveredUs)
+        {
+            mRecoveryStatistics.skippedUs += mRecovery.resumedAtUs - mRecovery.lastDeliveredUs;
+        }
+
+        LOGW("%s action:%s skipped (%" PRId64 ", %" PRId64 ") recoveryMs:%.3f",
+             __FUNCTION__,
+             toString(mRecovery.action),
+             mRecovery.lastDeliveredUs,
+             mRecovery.resumedAtUs,
+             1.0e3 * mRecovery.recoveryTime.count());
+
+        if (mRecoveryListener)
+        {
+            mRecoveryListener(mRecovery);
+        }
+    }
+
+    void decoder_core::endStream()
+    {
+        // callbacks still in flight from the failed codec are dropped
+        ++mCodecGeneration;
+        mAtInputEOS = true;
+        mAtOutputEOS = true;
+
+        decoded_frame frame;
+        frame.presentationTimeUs = std::max<std::int64_t>(mLastDeliveredUs, 0);
+        frame.flags = AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM;
+        frame.frameNumber = mNumOutputBuffers++;
+        deliverFrame(std::move(frame));
+    }
+
+    void decoder_core::ioThread()
+    {
+        if (mThreadPolicy)
+        {
+            (void) mThreadPolicy->apply(thread_role::io);
+        }
+
+        while (!isDone())
+        {
+            io_event event;
+            if (mIOQueue.pop(event))
+            {
+                dispatch(event);
+            }
+
+            if (mRetryOutputs.exchange(false))
+            {
+                retryDeferredOutputs();
+            }
+            if (mRetryInputs.exchange(false) && mAccountant)
+            {
+                retryDeferredInputs();
+            }
+        }
+    }
+
+    void decoder_core::dispatch(const io_event& event)
+    {
+        if (event.generation != mCodecGeneration)
+        {
+            // from a codec since flushed or replaced
+            return;
+        }
+
+        switch (event.type)
+        {
+            case io_event::kind::input_available:
+                onInputAvailable(event.codec, event.index);
+                break;
+
+            case io_event::kind::output_available:
+                if (!mDeferredOutputs.empty() || !waitForFrameRoom(0))
+                {
+                    // Backpressure: the codec keeps the buffer until the consumer catches up.
+                    mDeferredOutputs.push_back(event);
+                    ++mFrameStatistics.heldBack;
+                }
+                else
+                {
+                    AMediaCodecBufferInfo bufferInfo = event.bufferInfo;
+                    onOutputAvailable(event.codec, event.index, &bufferInfo);
+                }
+                break;
+
+            case io_event::kind::format_changed:
+                onFormatChanged(event.codec, event.format);
+                break;
+
+            case io_event::kind::error:
+                onError(event.codec, event.error, event.actionCode, event.detail);
+                break;
+        }
+    }
+
+    void decoder_core::retryDeferredOutputs()
+    {
+        std::size_t done = 0;
+        while (done < mDeferredOutputs.size() && waitForFrameRoom(0))
+        {
+            const io_event& event = mDeferredOutputs[done++];
+            if (event.generation == mCodecGeneration)
+            {
+                AMediaCodecBufferInfo bufferInfo = event.bufferInfo;
+                onOutputAvailable(event.codec, event.index, &bufferInfo);
+            }
+        }
+        mDeferredOutputs.erase(mDeferredOutputs.begin(), mDeferredOutputs.begin() + done);
+    }
+
+    void decoder_core::pollingThread()
+    {
+        if (mThreadPolicy)
+        {
+            (void) mThreadPolicy->apply(thread_role::io);
+        }
+
         while (!isDone())
         {
-            auto task = mIOQueue.pop();
-            task();
+            // recovery may replace the codec, so it is looked up afresh after each stage
+            const unsigned int generation = mCodecGeneration;
+            AMediaCodec* const codec = mMediaCodec.get();
+
+            // Feed every input buffer the codec has free before waiting on output; while it
+            // is still taking input, output is only polled.
+            bool fed = false;
+            while (!isInputDone() && !(mAccountant && mAccountant->overBudget()))
+            {
+                const ssize_t index = AMediaCodec_dequeueInputBuffer(codec, mPollingDriver.inputTimeoutUs);
+                if (index < 0)
+                {
+                    if (index != AMEDIACODEC_INFO_TRY_AGAIN_LATER)
+                    {
+                        failOrRecover(media_status_t(index), "AMediaCodec_dequeueInputBuffer");
+                    }
+                    break;
+                }
+
+                if (mRecorder)
+                {
+                    mRecorder->record(timeline_event_type::input_available, index);
+                }
+                onInputAvailable(codec, index);
+                fed = true;
+
+                if (generation != mCodecGeneration)
+                {
+                    break;
+                }
+            }
+            if (generation != mCodecGeneration)
+            {
+                continue;
+            }
+
+            const std::int64_t outputTimeoutUs = fed ? 0 : mPollingDriver.outputTimeoutUs;
+            if (!waitForFrameRoom(outputTimeoutUs))
+            {
+                // Backpressure: output stays with the codec until the consumer catches up.
+                ++mFrameStatistics.heldBack;
+                continue;
+            }
+
+            AMediaCodecBufferInfo bufferInfo;
+            const ssize_t index = AMediaCodec_dequeueOutputBuffer(codec,
+                                                                  &bufferInfo,
+                                                                  outputTimeoutUs);
+            if (index >= 0)
+            {
+                if (mRecorder)
+                {
+                    mRecorder->record(timeline_event_type::output_available,
+                                      index,
+                                      bufferInfo.size,
+                                      bufferInfo.presentationTimeUs,
+                                      bufferInfo.flags);
+                }
+                onOutputAvailable(codec, index, &bufferInfo);
+            }
+            else if (index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED)
+            {
+                if (mRecorder)
+                {
+                    mRecorder->record(timeline_event_type::format_changed, -1);
+                }
+                const unique_media_format format(AMediaCodec_getOutputFormat(codec));
+                onFormatChanged(codec, format.get());
+            }
+            else if (index != AMEDIACODEC_INFO_TRY_AGAIN_LATER &&
+                     index != AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED)
+            {
+                failOrRecover(media_status_t(index), "AMediaCodec_dequeueOutputBuffer");
+            }
+        }
+    }
+
+    void decoder_core::asyncInputAvailableCallback(AMediaCodec* codec,
+                                                   void* userData,
+                                                   int32_t index)
+    {
+        decoder_core* const self = static_cast<decoder_core*>(userData);
+
+        if (self->mRecorder)
+        {
+            self->mRecorder->record(timeline_event_type::input_available, index);
         }
+
+        io_event event;
+        event.type = io_event::kind::input_available;
+        event.generation = self->mCodecGeneration;
+        event.codec = codec;
+        event.index = index;
+        self->mIOQueue.push(event);
     }
 
-    void decoder::asyncInputAvailableCallback(AMediaCodec* codec,
-                                              void* userData,
-                                              int32_t index)
+    void decoder_core::asyncOutputAvailableCallback(AMediaCodec* codec,
+                                                    void* userData,
+                                                    int32_t index,
+                                                    AMediaCodecBufferInfo *bufferInfo)
     {
-        decoder* const self = static_cast<decoder*>(userData);
+        decoder_core* const self = static_cast<decoder_core*>(userData);
+
+        if (self->mRecorder)
+        {
+            self->mRecorder->record(timeline_event_type::output_available,
+                                    index,
+                                    bufferInfo->size,
+                                    bufferInfo->presentationTimeUs,
+                                    bufferInfo->flags);
+        }
 
-        self->mIOQueue.push([self, codec, index]() { self->onInputAvailable(codec, index); });
+        io_event event;
+        event.type = io_event::kind::output_available;
+        event.generation = self->mCodecGeneration;
+        event.codec = codec;
+        event.index = index;
+        event.bufferInfo = *bufferInfo;
+        self->mIOQueue.push(event);
     }
 
-    void decoder::asyncOutputAvailableCallback(AMediaCodec* codec,
-                                               void* userData,
-                                               int32_t index,
-                                               AMediaCodecBufferInfo *bufferInfo)
+    void decoder_core::asyncFormatChangedCallback(AMediaCodec *codec,
+                                                  void* userData,
+                                                  AMediaFormat *format)
     {
-        decoder* const self = static_cast<decoder*>(userData);
+        decoder_core* const self = static_cast<decoder_core*>(userData);
 
-        AMediaCodecBufferInfo bufferInfoCopy = *bufferInfo;
+        if (self->mRecorder)
+        {
+            self->mRecorder->record(timeline_event_type::format_changed, -1);
+        }
 
-        self->mIOQueue.push([self, codec, index, bufferInfoCopy]() {
-            AMediaCodecBufferInfo bc = bufferInfoCopy;
-            self->onOutputAvailable(codec, index, &bc);
-        });
+        io_event event;
+        event.type = io_event::kind::format_changed;
+        event.generation = self->mCodecGeneration;
+        event.codec = codec;
+        event.format = format;
+        self->mIOQueue.push(event);
     }
 
-    void decoder::asyncFormatChangedCallback(AMediaCodec *codec,
-                                             void* userData,
-                                             AMediaFormat *format)
+    void decoder_core::asyncErrorCallback(AMediaCodec *codec,
+                                          void* userData,
+                                          media_status_t error,
+                                          int32_t actionCode,
+                                          const char *detail)
     {
-        decoder* const self = static_cast<decoder*>(userData);
+        decoder_core* const self = static_cast<decoder_core*>(userData);
+
+        if (self->mRecorder)
+        {
+            self->mRecorder->record(timeline_event_type::error, -1, error, 0, actionCode);
+        }
+
+        io_event event;
+        event.type = io_event::kind::error;
+        event.generation = self->mCodecGeneration;
+        event.codec = codec;
+        event.error = error;
+        event.actionCode = actionCode;
 
-        self->mIOQueue.push([self, codec, format]() { self->onFormatChanged(codec, format); });
+        // detail is only valid for the duration of the callback
+        if (detail)
+        {
+            const std::size_t length = std::min(std::strlen(detail), sizeof(event.detail) - 1);
+            std::memcpy(event.detail, detail, length);
+            event.detail[length] = '\0';
+        }
+        self->mIOQueue.push(event);
     }
 
-    void decoder::asyncErrorCallback(AMediaCodec *codec,
-                                     void* userData,
-                                     media_status_t error,
-                                     int32_t actionCode,
-                                     const char *detail)
+    decoder& decoder::operator=(decoder&& other)
     {
-        decoder* const self = static_cast<decoder*>(userData);
+        if (this != &other)
+        {
+            if (mCore && !mCore->isDone())
+            {
+                BOOST_THROW_EXCEPTION( sample_error()
+                                               << boost::errinfo_api_function("decoder::operator=") );
+            }
+            mCore = std::move(other.mCore);
+        }
+        return *this;
+    }
 
-        self->mIOQueue.push([self, codec, error, actionCode, detail]() {
-            self->onError(codec, error, actionCode, detail);
-        });
+    async_generator<decoded_frame> frames(decoder& dec)
+    {
+        for (;;)
+        {
+            decoded_frame frame = co_await dec.next_frame();
+            if (frame.isEndOfStream())
+            {
+                co_return;
+            }
+            co_yield frame;
+        }
     }
-}
\ No newline at end of file
+}
@@ -6,57 +6,108 @@
 #define MEDIATEST_SAMPLE_APP_H
 
 #include "StopWatch.hpp"
+#include "callback_timeline.hpp"
+#include "coro.hpp"
+#include "handles.hpp"
+#include "memory_accounting.hpp"
+#include "nal_parser.hpp"
+#include "thread_policy.hpp"
+#include "sample_error.hpp"
 
 #include <media/NdkImageReader.h>
 #include <media/NdkMediaCodec.h>
 #include <media/NdkMediaExtractor.h>
 
-#include <boost/exception/exception.hpp>
-#include <boost/exception/error_info.hpp>
-
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <list>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace sample {
 
     typedef boost::error_info<struct tag_media_status,media_status_t> errinfo_media_status;
     typedef boost::error_info<struct tag_buffer_index,ssize_t> errinfo_buffer_index;
 
-    struct sample_error: virtual boost::exception, virtual std::exception { };
-
     void fail_media_error(media_status_t status, const char* apiFunction);
 
     std::tuple<bool, std::size_t, std::uint64_t> readSampleData(AMediaExtractor* extractor,
                                                                 void* buffer,
                                                                 size_t capacity);
 
-    std::shared_ptr<AMediaExtractor> createMediaExtractor(int fd);
+    // Fast-scan modes. Dropped samples are still read from the extractor but never reach
+    // the codec, so decode bandwidth goes only to frames that are shown.
+    enum class trick_play_mode
+    {
+        off,
+        drop_non_reference,     // classify each sample with a nal_parser
+        sync_only,              // keyframes only, by extractor flags; dropped samples aren't read
+    };
+
+    const char* toString(trick_play_mode mode);
+
+    struct trick_play_statistics
+    {
+        std::uint64_t       samplesRead                 = 0;
+        std::uint64_t       samplesDropped              = 0;
+        std::uint64_t       samplesParsed               = 0;
+        std::uint64_t       bytesParsed                 = 0;    // handed to the parser; it reads only NAL headers
+        std::uint64_t       bytesDropped                = 0;
+        std::int64_t        firstPresentationTimeUs     = -1;
+        std::int64_t        lastPresentationTimeUs      = -1;
+        StopWatch::duration parseTime                   = StopWatch::duration::zero();
+    };
+
+    // readSampleData that skips samples the mode drops.
+    std::tuple<bool, std::size_t, std::uint64_t> readTrickPlaySampleData(AMediaExtractor* extractor,
+                                                                         const nal_parser& parser,
+                                                                         trick_play_mode mode,
+                                                                         trick_play_statistics& statistics,
+                                                                         void* buffer,
+                                                                         size_t capacity);
+
+    // Moves the extractor to the first sync sample after afterUs; returns its pts, or -1 if
+    // there is none.
+    std::int64_t resyncToNextSyncSample(AMediaExtractor* extractor, std::int64_t afterUs);
+
+    unique_media_extractor createMediaExtractor(int fd);
 
-    std::shared_ptr<AMediaFormat> selectVideoTrack(AMediaExtractor* extractor);
+    unique_media_extractor createMediaExtractor(AMediaDataSource* dataSource);
 
-    std::shared_ptr<AImageReader> createImageReader(AMediaFormat* format);
+    unique_media_format selectVideoTrack(AMediaExtractor* extractor);
 
-    template <typename T>
+    unique_image_reader createImageReader(AMediaFormat* format);
+
+    // Bytes held by the buffer pool of a reader made by createImageReader(format).
+    std::size_t imageReaderFootprint(AMediaFormat* format);
+
+    // Elements travel in list nodes that are allocated and freed outside the lock, so an
+    // allocator reporting to a memory_accountant may fire release listeners that push
+    // onto this same queue.
+    template <typename T, typename Allocator = std::allocator<T>>
     class pc_queue
     {
     public:
         pc_queue() {}
+        explicit pc_queue(const Allocator& allocator) : mQueue(allocator) {}
         ~pc_queue() {}
 
         void push(T elem)
         {
+            std::list<T, Allocator> node(mQueue.get_allocator());
+            node.push_back(std::move(elem));
+
             bool needsNotify = false;
             {
                 std::lock_guard<std::mutex> lock(mMutex);
                 needsNotify = mQueue.empty();
-                mQueue.push(std::move(elem));
+                mQueue.splice(mQueue.end(), node);
             }
 
             if (needsNotify)
@@ -67,37 +118,416 @@ namespace sample {
 
         T pop()
         {
-            std::unique_lock<std::mutex> lock(mMutex);
-            if (mQueue.empty())
+            std::list<T, Allocator> node(mQueue.get_allocator());
             {
-                mQueueNotEmptyCondition.wait(lock, [this]() { return !mQueue.empty(); });
+                std::unique_lock<std::mutex> lock(mMutex);
+                if (mQueue.empty())
+                {
+                    mQueueNotEmptyCondition.wait(lock, [this]() { return !mQueue.empty(); });
+                }
+                node.splice(node.end(), mQueue, mQueue.begin());
             }
-            auto result = mQueue.front();
-            mQueue.pop();
-            return result;
+            return std::move(node.front());
         }
 
     private:
         std::mutex              mMutex;
         std::condition_variable mQueueNotEmptyCondition;
-        std::queue<T>           mQueue;
+        std::list<T, Allocator> mQueue;
     };
 
-    class decoder
+    // Bounded producer-consumer queue over a fixed array, for traffic that mustn't
+    // allocate. push() waits while the queue is full. pop() waits while it is empty, and
+    // returns false with nothing popped when woken by wake(), so a single consumer can
+    // also be told to look at state of its own.
+    template <typename T, std::size_t Capacity>
+    class ring_queue
     {
     public:
-        typedef std::function<std::tuple<bool,std::size_t,std::uint64_t>(decoder&, void*, size_t)>    readSampleData_t;
+        void push(const T& elem)
+        {
+            bool needsNotify = false;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                if (mCount == Capacity)
+                {
+                    mNotFullCondition.wait(lock, [this]() { return mCount < Capacity; });
+                }
+                needsNotify = (mCount == 0);
+                mElems[(mHead + mCount) % Capacity] = elem;
+                ++mCount;
+            }
 
-        decoder();
+            if (needsNotify)
+            {
+                mNotEmptyCondition.notify_one();
+            }
+        }
 
-        decoder(AMediaFormat* format,
-                readSampleData_t readSampleData,
-                ANativeWindow* window);
+        bool pop(T& result)
+        {
+            bool needsNotify = false;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                if (mCount == 0 && !mWoken)
+                {
+                    mNotEmptyCondition.wait(lock, [this]() { return mCount > 0 || mWoken; });
+                }
+                mWoken = false;
+                if (mCount == 0)
+                {
+                    return false;
+                }
+                result = mElems[mHead];
+                mHead = (mHead + 1) % Capacity;
+                needsNotify = (mCount-- == Capacity);
+            }
 
-        decoder(const decoder& other) = delete;
-        ~decoder();
+            if (needsNotify)
+            {
+                mNotFullCondition.notify_one();
+            }
+            return true;
+        }
 
-        decoder& operator=(const decoder& other) = delete;
+        void wake()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mWoken = true;
+            }
+            mNotEmptyCondition.notify_one();
+        }
+
+    private:
+        std::mutex              mMutex;
+        std::condition_variable mNotEmptyCondition;
+        std::condition_variable mNotFullCondition;
+        std::array<T, Capacity> mElems;
+        std::size_t             mHead       = 0;
+        std::size_t             mCount      = 0;
+        bool                    mWoken      = false;
+    };
+
+    // Codec driver policies, chosen when a decoder is constructed. async_driver feeds the
+    // codec from AMediaCodec's async callbacks via the IO task queue. polling_driver runs a
+    // dequeue loop on the IO thread instead, avoiding the binder-thread callback and queue
+    // hop per buffer at the cost of a thread that is busy for the whole decode.
+    struct async_driver { };
+
+    struct polling_driver
+    {
+        std::int64_t    inputTimeoutUs  = 0;        // don't stall output while the codec is full
+        std::int64_t    outputTimeoutUs = 10000;    // only once the codec takes no more input
+    };
+
+    // Geometry of raw decoder output buffers, parsed from the codec's output format.
+    struct buffer_layout
+    {
+        // Where chroma sits after the luma plane. Only the fixed YUV 4:2:0 formats say;
+        // in a flexible format's buffer the arrangement is the codec's own.
+        enum class chroma_arrangement
+        {
+            unsupported,
+            planar,         // U, then V, each at half the stride (I420)
+            semi_planar,    // interleaved UV at the full stride (NV12)
+        };
+
+        std::int32_t    colorFormat = 0;    // MediaCodecInfo.CodecCapabilities COLOR_Format*
+        std::int32_t    width       = 0;
+        std::int32_t    height      = 0;
+        std::int32_t    stride      = 0;    // bytes per luma row
+        std::int32_t    sliceHeight = 0;    // luma rows before the first chroma plane
+
+        static buffer_layout fromFormat(AMediaFormat* format);
+
+        // unsupported also for geometry no 4:2:0 buffer can have.
+        chroma_arrangement  chroma() const;
+
+        // Bytes up to the end of the last chroma row; 0 when chroma() is unsupported.
+        std::size_t         minimumSize() const;
+    };
+
+    // Counts a decoder's codec sessions, so output buffers handed out before a flush or a
+    // stop aren't released to the session after it, where their indices may name buffers
+    // it owns.
+    class buffer_generation
+    {
+    public:
+        unsigned int    current() const
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            return mGeneration;
+        }
+
+        // Once this returns, releases of buffers from earlier generations are skipped,
+        // and none is still in progress.
+        void            advance()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mGeneration;
+        }
+
+        // Releases index if generation is still current; false if it is stale.
+        bool            release(AMediaCodec* codec, std::size_t index, unsigned int generation) const
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (generation != mGeneration)
+            {
+                return false;
+            }
+            (void) AMediaCodec_releaseOutputBuffer(codec, index, false);
+            return true;
+        }
+
+    private:
+        mutable std::mutex  mMutex;
+        unsigned int        mGeneration = 0;
+    };
+
+    // A decoded frame in a codec-owned output buffer. The buffer goes back to the codec
+    // when the view is destroyed, so views must not outlive their decoder, and holding
+    // too many of them stalls decoding. A view from a codec session that has since been
+    // flushed or stopped is let go without touching the codec.
+    class output_buffer_view
+    {
+    public:
+        output_buffer_view() = default;
+        output_buffer_view(AMediaCodec* codec,
+                           std::size_t index,
+                           const std::uint8_t* data,
+                           std::size_t size,
+                           const buffer_layout& layout,
+                           std::int64_t presentationTimeUs,
+                           memory_reservation reservation = memory_reservation(),
+                           const buffer_generation* generation = nullptr)
+                : mCodec(codec),
+                  mIndex(index),
+                  mData(data),
+                  mSize(size),
+                  mLayout(layout),
+                  mPresentationTimeUs(presentationTimeUs),
+                  mReservation(std::move(reservation)),
+                  mGenerationSource(generation),
+                  mGeneration(generation ? generation->current() : 0)
+        {
+            // this space intentionally left blank
+        }
+
+        output_buffer_view(output_buffer_view&& other) noexcept { swap(other); }
+        output_buffer_view(const output_buffer_view& other) = delete;
+        ~output_buffer_view() { release(); }
+
+        output_buffer_view& operator=(output_buffer_view&& other) noexcept
+        {
+            output_buffer_view(std::move(other)).swap(*this);
+            return *this;
+        }
+        output_buffer_view& operator=(const output_buffer_view& other) = delete;
+
+        const std::uint8_t*     data() const { return mData; }
+        std::size_t             size() const { return mSize; }
+        const buffer_layout&    layout() const { return mLayout; }
+        std::int64_t            presentationTimeUs() const { return mPresentationTimeUs; }
+
+        void    release()
+        {
+            if (mCodec)
+            {
+                if (mGenerationSource)
+                {
+                    (void) mGenerationSource->release(mCodec, mIndex, mGeneration);
+                }
+                else
+                {
+                    (void) AMediaCodec_releaseOutputBuffer(mCodec, mIndex, false);
+                }
+                mCodec = nullptr;
+            }
+            mReservation.reset();
+        }
+
+        void    swap(output_buffer_view& other) noexcept
+        {
+            std::swap(mCodec, other.mCodec);
+            std::swap(mIndex, other.mIndex);
+            std::swap(mData, other.mData);
+            std::swap(mSize, other.mSize);
+            std::swap(mLayout, other.mLayout);
+            std::swap(mPresentationTimeUs, other.mPresentationTimeUs);
+            mReservation.swap(other.mReservation);
+            std::swap(mGenerationSource, other.mGenerationSource);
+            std::swap(mGeneration, other.mGeneration);
+        }
+
+    private:
+        AMediaCodec*            mCodec              = nullptr;
+        std::size_t             mIndex              = 0;
+        const std::uint8_t*     mData               = nullptr;
+        std::size_t             mSize               = 0;
+        buffer_layout           mLayout;
+        std::int64_t            mPresentationTimeUs = 0;
+        memory_reservation      mReservation;
+        const buffer_generation* mGenerationSource  = nullptr;
+        unsigned int            mGeneration         = 0;
+    };
+
+    struct decoded_frame
+    {
+        std::int64_t        presentationTimeUs  = 0;
+        std::uint32_t       flags               = 0;
+        unsigned int        frameNumber         = 0;
+
+        // The frame's pixels with output_target(frame_output); empty otherwise and at end of
+        // stream. The codec gets the buffer back when the frame is destroyed.
+        output_buffer_view  buffer;
+
+        bool isEndOfStream() const { return 0 != (flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM); }
+    };
+
+    typedef std::function<void(output_buffer_view)>     outputBuffer_t;
+
+    struct frame_output { };
+
+    // Where decoded frames go: rendered to a window (e.g. an AImageReader's), or, with no
+    // window, straight from the codec's output buffers, skipping the Surface round trip:
+    // either handed to a callback on the IO thread, or with frame_output carried in the
+    // decoded_frame to the coroutine awaiting it.
+    struct output_target
+    {
+        output_target(ANativeWindow* w) : window(w) { }
+        output_target(outputBuffer_t fn) : onOutputBuffer(std::move(fn)) { }
+        output_target(frame_output) : toFrames(true) { }
+
+        ANativeWindow*  window      = nullptr;
+        outputBuffer_t  onOutputBuffer;
+        bool            toFrames    = false;
+    };
+
+    // How a decoder got its codec going again after an error, or ended the stream.
+    enum class recovery_action
+    {
+        flush,          // transient error: flush and restart the codec in place
+        restart,        // recoverable error: stop, reconfigure and start the same codec
+        recreate,       // anything else: replace the codec with a new instance
+        end_of_stream,  // no sync sample left to resume at: the stream ended, no codec action ran
+    };
+
+    const char* toString(recovery_action action);
+
+    // One recovery from a codec error. Frames with pts strictly between lastDeliveredUs and
+    // resumedAtUs were lost: decoding resumed at the first sync sample after the last input
+    // the failed codec was given.
+    struct recovery_event
+    {
+        media_status_t      error           = AMEDIA_OK;
+        int32_t             actionCode      = 0;
+        recovery_action     action          = recovery_action::flush;
+        std::int64_t        lastDeliveredUs = -1;   // -1: no frame delivered before the error
+        std::int64_t        resumedAtUs     = -1;   // -1: no sync sample left, decoding ended
+        StopWatch::duration recoveryTime    = StopWatch::duration::zero();  // error to next output
+    };
+
+    typedef std::function<std::int64_t(std::int64_t afterUs)>  resyncSampleData_t;
+    typedef std::function<void(const recovery_event&)>          recoveryListener_t;
+
+    struct recovery_statistics
+    {
+        unsigned int        errors          = 0;
+        unsigned int        recoveries      = 0;
+        unsigned int        codecsRecreated = 0;
+        unsigned int        streamsEnded    = 0;    // errors with no sync sample left, not recoveries
+        std::int64_t        skippedUs       = 0;    // content lost, summed over recoveries
+        StopWatch::duration totalRecoveryTime   = StopWatch::duration::zero();
+        StopWatch::duration maxRecoveryTime     = StopWatch::duration::zero();
+    };
+
+    // Optional collaborators for a decoder. All are borrowed and must outlive it.
+    struct decoder_options
+    {
+        // Charged for queue backlog and held output buffers; new input is held back while
+        // it is over budget.
+        memory_accountant*  accountant  = nullptr;
+
+        // Captures every codec callback for later replay.
+        callback_recorder*  recorder    = nullptr;
+
+        // Placement and priority of the IO thread, and so of the frame consumers it resumes.
+        const thread_policy*    threadPolicy    = nullptr;
+
+        // Repositions the sample source after a codec error (e.g. resyncToNextSyncSample).
+        // With it the decoder recovers in place and keeps emitting frames; without it codec
+        // errors are only logged.
+        resyncSampleData_t      resync;
+
+        // Told about each recovery on the IO thread, once the codec has produced output again.
+        recoveryListener_t      onRecovery;
+    };
+
+    // Input-to-output latency of the frames decoded so far. Percentiles are upper bounds at
+    // power-of-two microsecond resolution.
+    struct latency_statistics
+    {
+        unsigned int    samples = 0;
+        double          meanMs  = 0.0;
+        double          p50Ms   = 0.0;
+        double          p99Ms   = 0.0;
+        double          maxMs   = 0.0;
+    };
+
+    // How frames got to the consumer.
+    struct frame_statistics
+    {
+        unsigned int        delivered       = 0;
+        unsigned int        heldBack        = 0;    // times output waited with the codec for the consumer
+        unsigned int        dropped         = 0;
+        StopWatch::duration dispatchTime    = StopWatch::duration::zero();  // total, callbacks and resumed consumers included
+    };
+
+    // Owns the codec and the IO thread. Codec callbacks and the IO thread keep pointers to
+    // it, so it never moves; clients use the movable decoder handle below.
+    class decoder_core
+    {
+    public:
+        typedef std::function<std::tuple<bool,std::size_t,std::uint64_t>(void*, size_t)>    readSampleData_t;
+
+        // Awaitable returned by next_frame(). If no frame is pending the awaiting coroutine
+        // is resumed on the IO thread, inline with the codec's output callback.
+        class frame_awaiter
+        {
+        public:
+            explicit frame_awaiter(decoder_core& owner) : mDecoder(owner) { }
+
+            bool            await_ready() const noexcept { return false; }
+            bool            await_suspend(std::coroutine_handle<> h);
+            decoded_frame   await_resume() noexcept { return std::move(mFrame); }
+
+        private:
+            friend class decoder_core;
+
+            decoder_core&               mDecoder;
+            std::coroutine_handle<>     mHandle;
+            decoded_frame               mFrame;
+        };
+
+        explicit decoder_core(const decoder_options& options = decoder_options());
+
+        decoder_core(AMediaFormat* format,
+                     readSampleData_t readSampleData,
+                     output_target target,
+                     const async_driver& driver,
+                     const decoder_options& options = decoder_options());
+
+        decoder_core(AMediaFormat* format,
+                     readSampleData_t readSampleData,
+                     output_target target,
+                     const polling_driver& driver,
+                     const decoder_options& options = decoder_options());
+
+        decoder_core(const decoder_core& other) = delete;
+        ~decoder_core();
+
+        decoder_core& operator=(const decoder_core& other) = delete;
 
         void    start();
 
@@ -105,15 +535,37 @@ namespace sample {
         bool    isOutputDone() const { return mAtOutputEOS; }
         bool    isDone() const { return isInputDone() && isOutputDone(); }
 
+        // Only one coroutine may await the decoder at a time. Once the end-of-stream frame
+        // has been delivered, further awaits complete immediately with that frame. Frames
+        // are only kept for a consumer, and only hold output back, once a coroutine has
+        // awaited one; until then they are rendered or handed to the callback as usual,
+        // and otherwise let go, so a decoder nobody awaits still runs to the end.
+        frame_awaiter   next_frame() { return frame_awaiter(*this); }
+
+        // Only meaningful once the decoder is done; the IO thread updates them until then.
+        latency_statistics  getLatencyStatistics() const;
+        recovery_statistics getRecoveryStatistics() const { return mRecoveryStatistics; }
+        frame_statistics    getFrameStatistics() const { return mFrameStatistics; }
+
     private:
+        void    setAsyncCallbacks();
+
         void    ioThread();
+        void    pollingThread();
+
+        // Waits up to timeoutUs for an awaiting coroutine or a free pending-frame slot.
+        bool    waitForFrameRoom(std::int64_t timeoutUs);
+        void    deliverFrame(decoded_frame&& frame);
 
     private:
         void    onInputAvailable(AMediaCodec* codec, int32_t index);
+        void    feedInput(AMediaCodec* codec, int32_t index);
+        void    retryDeferredInputs();
 
         void    onOutputAvailable(AMediaCodec* codec,
                                   int32_t index,
                                   AMediaCodecBufferInfo *bufferInfo);
+        void    retryDeferredOutputs();
 
         void    onFormatChanged(AMediaCodec *codec,
                                 AMediaFormat *format);
@@ -123,6 +575,13 @@ namespace sample {
                         int32_t actionCode,
                         const char *detail);
 
+        void    failOrRecover(media_status_t status, const char* apiFunction);
+        void    recover(media_status_t error, int32_t actionCode, recovery_action action);
+        void    restartCodec(recovery_action action);
+        void    releasePendingBuffers();
+        void    finishRecovery();
+        void    endStream();
+
     private:
         static void asyncInputAvailableCallback(AMediaCodec* codec,
                                                 void* userData,
@@ -141,18 +600,169 @@ namespace sample {
                                        const char *detail);
 
     private:
-        typedef std::function<void()>   IOTask;
+        // A codec callback as queued for the IO thread. Plain data, so that queuing one
+        // never allocates.
+        struct io_event
+        {
+            enum class kind : std::uint8_t
+            {
+                input_available,
+                output_available,
+                format_changed,
+                error,
+            };
+
+            kind                    type        = kind::input_available;
+            unsigned int            generation  = 0;
+            AMediaCodec*            codec       = nullptr;
+            int32_t                 index       = -1;
+            AMediaCodecBufferInfo   bufferInfo  = {};
+            AMediaFormat*           format      = nullptr;
+            media_status_t          error       = AMEDIA_OK;
+            int32_t                 actionCode  = 0;
+            char                    detail[64]  = {};   // truncated
+        };
+
+        void    dispatch(const io_event& event);
+
+        // Ample for every buffer a codec has, several generations over; a full queue
+        // holds the codec's callback thread back.
+        static const std::size_t            kIOQueueCapacity    = 128;
 
     private:
         unsigned int                        mNumOutputBuffers   = 0;
         readSampleData_t                    mReadSampleDataFn;
-        std::shared_ptr<AMediaCodec>        mMediaCodec;
+        unique_media_codec                  mMediaCodec;
         std::atomic<bool>                   mAtInputEOS;
         std::atomic<bool>                   mAtOutputEOS;
 
-        pc_queue<IOTask>                    mIOQueue;
+        outputBuffer_t                      mOutputBufferFn;
+        buffer_layout                       mOutputLayout;
+
+        bool                                mPolling            = false;
+        polling_driver                      mPollingDriver;
+
+        memory_accountant*                  mAccountant         = nullptr;
+        memory_accountant::listenerToken_t  mReleaseListenerToken = 0;
+        callback_recorder*                  mRecorder           = nullptr;
+        const thread_policy*                mThreadPolicy       = nullptr;
+        // held back while over budget, and while the consumer is behind; both accounted
+        // as memory_category::queues
+        std::vector<int32_t, accounting_allocator<int32_t>>     mDeferredInputs;
+        std::vector<io_event, accounting_allocator<io_event>>   mDeferredOutputs;
+        std::atomic<bool>                   mRetryInputs;       // set, with the IO thread woken, to retry
+        std::atomic<bool>                   mRetryOutputs;
+        bool                                mFrameOutput        = false;
+
+        // Error recovery. Callbacks carry the generation current when they were issued, and
+        // events from a codec that has since been flushed or replaced are dropped. Replaced
+        // codecs are stopped but kept, as output_buffer_views may still refer to them.
+        unique_media_format                 mFormat;            // for reconfiguring
+        ANativeWindow*                      mWindow             = nullptr;
+        resyncSampleData_t                  mResyncFn;
+        recoveryListener_t                  mRecoveryListener;
+        std::atomic<unsigned int>           mCodecGeneration;
+        std::vector<unique_media_codec>     mRetiredCodecs;
+        buffer_generation                   mBufferGeneration;  // advanced before each flush or stop
+        std::int64_t                        mLastQueuedUs       = -1;
+        std::int64_t                        mLastDeliveredUs    = -1;
+        bool                                mRecovering         = false;
+        recovery_event                      mRecovery;
+        StopWatch::clock::time_point        mRecoveryStart;
+        recovery_statistics                 mRecoveryStatistics;
+
+        ring_queue<io_event, kIOQueueCapacity>  mIOQueue;
         std::thread                         mIOThread;
+
+        // Queue times of recent input samples, keyed by pts, for input-to-output latency.
+        typedef std::pair<std::int64_t, StopWatch::clock::time_point>  input_time;
+        static const std::size_t            kMaxInputTimes      = 64;
+
+        std::array<input_time, kMaxInputTimes>  mInputTimes;
+        unsigned int                        mNumInputBuffers    = 0;
+        unsigned int                        mNumLatencySamples  = 0;
+        StopWatch::duration                 mTotalFrameLatency  = StopWatch::duration::zero();
+        StopWatch::duration                 mMaxFrameLatency    = StopWatch::duration::zero();
+
+        // Frame latencies in power-of-two microsecond buckets, for tail percentiles.
+        static const std::size_t            kLatencyBuckets     = 32;
+        std::array<unsigned int, kLatencyBuckets>   mLatencyHistogram;
+
+        void            recordLatency(StopWatch::duration latency);
+        double          latencyPercentileMs(double percentile) const;
+
+        // Frames produced while the consumer is busy. Fixed capacity so that delivery
+        // never allocates; once it is full, output is left with the codec until the
+        // consumer catches up.
+        static const std::size_t            kMaxPendingFrames   = 16;
+
+        std::mutex                          mFrameMutex;
+        std::condition_variable             mFrameRoomCondition;
+        frame_awaiter*                      mFrameAwaiter       = nullptr;
+        bool                                mFrameConsumer      = false;    // a coroutine has awaited
+        std::array<decoded_frame, kMaxPendingFrames>    mPendingFrames;
+        std::size_t                         mPendingFrameHead   = 0;
+        std::size_t                         mPendingFrameCount  = 0;
+        bool                                mDeliveredEOS       = false;
+        decoded_frame                       mEOSFrame;          // no buffer; handed out again to late awaits
+        frame_statistics                    mFrameStatistics;
     };
+
+    // Movable handle to a decoder_core, so decoders can live in containers and pools.
+    //
+    // The indirection is deliberate. The move-only NDK handles wrap a pointer the NDK
+    // already owns, but a decoder's state is what the codec callbacks and the IO thread
+    // point at, so it can't move; the handle costs one allocation per decoder, none per
+    // frame. Nor can a running decoder's core be dropped: assigning over a decoder whose
+    // decode isn't done throws, and destroying one fails an assertion, rather than
+    // either waiting for the decode to finish.
+    class decoder
+    {
+    public:
+        typedef decoder_core::readSampleData_t  readSampleData_t;
+        typedef decoder_core::frame_awaiter     frame_awaiter;
+
+        decoder() = default;
+
+        // Driver is async_driver or polling_driver; the public API is the same for both.
+        template <typename Driver = async_driver>
+        decoder(AMediaFormat* format,
+                readSampleData_t readSampleData,
+                output_target target,
+                const Driver& driver = Driver(),
+                const decoder_options& options = decoder_options())
+                : mCore(new decoder_core(format, std::move(readSampleData), std::move(target), driver, options))
+        {
+            // this space intentionally left blank
+        }
+
+        decoder(decoder&& other) noexcept = default;
+        decoder(const decoder& other) = delete;
+
+        // Throws sample_error if this decoder is still running.
+        decoder& operator=(decoder&& other);
+        decoder& operator=(const decoder& other) = delete;
+
+        explicit operator bool() const { return bool(mCore); }
+
+        void    start() { mCore->start(); }
+
+        bool    isInputDone() const { return mCore->isInputDone(); }
+        bool    isOutputDone() const { return mCore->isOutputDone(); }
+        bool    isDone() const { return mCore->isDone(); }
+
+        frame_awaiter   next_frame() { return mCore->next_frame(); }
+
+        latency_statistics  getLatencyStatistics() const { return mCore->getLatencyStatistics(); }
+        recovery_statistics getRecoveryStatistics() const { return mCore->getRecoveryStatistics(); }
+        frame_statistics    getFrameStatistics() const { return mCore->getFrameStatistics(); }
+
+    private:
+        std::unique_ptr<decoder_core>   mCore;
+    };
+
+    // Adapts decoder::next_frame() to an async generator that finishes at end of stream.
+    async_generator<decoded_frame> frames(decoder& dec);
 }
 
 
@@ -0,0 +1,20 @@
+//
+// Exception types shared by the sample pipeline. Kept free of NDK headers so that the
+// host-portable pieces of the pipeline can report errors the same way.
+//
+
+#ifndef MEDIATEST_SAMPLE_ERROR_H
+#define MEDIATEST_SAMPLE_ERROR_H
+
+#include <boost/exception/exception.hpp>
+#include <boost/exception/error_info.hpp>
+
+#include <exception>
+
+namespace sample {
+
+    struct sample_error: virtual boost::exception, virtual std::exception { };
+
+}
+
+#endif //MEDIATEST_SAMPLE_ERROR_H
@@ -0,0 +1,285 @@
+//
+// Streaming shot-boundary detection over decoded luma.
+//
+
+#include "shot_detector.hpp"
+
+#include "sample_error.hpp"
+
+#include <boost/exception/all.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    using sample::shot_detector;
+
+    const std::int32_t  kBlockSize      = shot_detector::kBlockSize;
+    const std::size_t   kHistogramBins  = shot_detector::kHistogramBins;
+    const int           kHistogramShift = 2;    // 256 levels into 64 bins
+    const std::int32_t  kHistogramStep  = 2;    // every other pixel of every other row
+
+    // Adds up each 16x16 block in a band of 16 rows, leaving the sums in sums.
+    void sumBlocks(const std::uint8_t* band, std::int32_t stride, std::int32_t blocksAcross, std::uint32_t* sums)
+    {
+        for (std::int32_t b = 0; b < blocksAcross; ++b)
+        {
+            const std::uint8_t* p = band + std::size_t(b) * kBlockSize;
+#if defined(__ARM_NEON)
+            // 16 rows of pairwise sums stay below 2 * 16 * 255, so u16 lanes don't overflow
+            uint16x8_t acc = vdupq_n_u16(0);
+            for (std::int32_t y = 0; y < kBlockSize; ++y, p += stride)
+            {
+                acc = vpadalq_u8(acc, vld1q_u8(p));
+            }
+#if defined(__aarch64__)
+            sums[b] = vaddlvq_u16(acc);
+#else
+            const uint64x2_t total = vpaddlq_u32(vpaddlq_u16(acc));
+            sums[b] = std::uint32_t(vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1));
+#endif
+#elif defined(__SSE2__)
+            // SAD against zero sums each half of a row into a 64-bit lane
+            const __m128i zero = _mm_setzero_si128();
+            __m128i acc = zero;
+            for (std::int32_t y = 0; y < kBlockSize; ++y, p += stride)
+            {
+                acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), zero));
+            }
+            // a block sums to at most 256 * 255, so the low 32 bits of each lane are enough
+            sums[b] = std::uint32_t(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc)));
+#else
+            std::uint32_t sum = 0;
+            for (std::int32_t y = 0; y < kBlockSize; ++y, p += stride)
+            {
+                for (std::int32_t x = 0; x < kBlockSize; ++x)
+                {
+                    sum += p[x];
+                }
+            }
+            sums[b] = sum;
+#endif
+        }
+    }
+
+    std::uint64_t sumAbsoluteDifferences(const std::uint8_t* a, const std::uint8_t* b, std::size_t size)
+    {
+        std::uint64_t result = 0;
+        std::size_t i = 0;
+#if defined(__ARM_NEON)
+        uint32x4_t acc = vdupq_n_u32(0);
+        for (; i + 16 <= size; i += 16)
+        {
+            acc = vpadalq_u16(acc, vpaddlq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i))));
+        }
+        const uint64x2_t total = vpaddlq_u32(acc);
+        result = vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1);
+#elif defined(__SSE2__)
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= size; i += 16)
+        {
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+        }
+        // the lanes are 64 bits wide and may hold more than fits in the low 32
+        std::uint64_t lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        result = lanes[0] + lanes[1];
+#endif
+        for (; i < size; ++i)
+        {
+            result += (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+        }
+        return result;
+    }
+
+    // Four interleaved tables, so neighbouring equal pixels don't wait on each other's
+    // increments; SIMD has no scatter to do better with. Returns the pixels counted.
+    std::uint64_t countRow(const std::uint8_t* row, std::int32_t width, std::uint32_t (&counts)[4][kHistogramBins])
+    {
+        std::int32_t x = 0;
+        for (; x + 4 * kHistogramStep <= width; x += 4 * kHistogramStep)
+        {
+            ++counts[0][row[x] >> kHistogramShift];
+            ++counts[1][row[x + kHistogramStep] >> kHistogramShift];
+            ++counts[2][row[x + 2 * kHistogramStep] >> kHistogramShift];
+            ++counts[3][row[x + 3 * kHistogramStep] >> kHistogramShift];
+        }
+        for (; x < width; x += kHistogramStep)
+        {
+            ++counts[0][row[x] >> kHistogramShift];
+        }
+        return (width + kHistogramStep - 1) / kHistogramStep;
+    }
+}
+
+namespace sample {
+
+    shot_detector::shot_detector(const config& cfg)
+            : mConfig(cfg)
+    {
+        // this space intentionally left blank
+    }
+
+    std::optional<shot_cut> shot_detector::process(const yuv420_frame& frame, std::int64_t presentationTimeUs)
+    {
+        const StopWatch frameTimer;
+
+        const yuv_plane& luma = frame.planes[0];
+        if (luma.pixelStride != 1 || !luma.data)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("shot_detector::process") );
+        }
+
+        if (mHavePrevious && (frame.width != mPrevious.width || frame.height != mPrevious.height))
+        {
+            reset();
+        }
+
+        summarize(luma, frame.width, frame.height, mCurrent);
+
+        std::optional<shot_cut> result;
+        if (mHavePrevious && mCurrent.pixels > 0)
+        {
+            const double blockDifference = double(sumAbsoluteDifferences(mCurrent.blockMeans.data(),
+                                                                         mPrevious.blockMeans.data(),
+                                                                         mCurrent.blockMeans.size())) /
+                                           mCurrent.blockMeans.size();
+
+            std::uint64_t binDifferences = 0;
+            for (std::size_t i = 0; i < kHistogramBins; ++i)
+            {
+                const std::uint32_t a = mCurrent.histogram[i];
+                const std::uint32_t b = mPrevious.histogram[i];
+                binDifferences += (a > b) ? a - b : b - a;
+            }
+            const double histogramDifference = 0.5 * binDifferences / mCurrent.pixels;
+
+            ++mFramesSinceCut;
+            const bool candidate =
+                    blockDifference > mBlockHistory.threshold(mConfig.blockFloor, mConfig.sigmas) &&
+                    histogramDifference > mHistogramHistory.threshold(mConfig.histogramFloor, mConfig.sigmas);
+            if (candidate && mFramesSinceCut >= mConfig.minShotFrames)
+            {
+                result = shot_cut{ presentationTimeUs, mPreviousPresentationTimeUs, blockDifference, histogramDifference };
+                ++mStatistics.cuts;
+
+                // the new shot's motion is its own
+                mFramesSinceCut = 0;
+                mBlockHistory.clear();
+                mHistogramHistory.clear();
+            }
+            else if (!candidate)
+            {
+                // a suppressed candidate is a flash; it says nothing about the shot's motion
+                mBlockHistory.add(blockDifference, mConfig.historyFrames);
+                mHistogramHistory.add(histogramDifference, mConfig.historyFrames);
+            }
+        }
+
+        std::swap(mPrevious, mCurrent);
+        mPreviousPresentationTimeUs = presentationTimeUs;
+        mHavePrevious = true;
+
+        const StopWatch::duration frameTime = frameTimer.getSplitTime();
+        ++mStatistics.frames;
+        mStatistics.frameTime += frameTime;
+        mStatistics.maxFrameTime = std::max(mStatistics.maxFrameTime, frameTime);
+        return result;
+    }
+
+    void shot_detector::reset()
+    {
+        mHavePrevious = false;
+        mFramesSinceCut = 0;
+        mBlockHistory.clear();
+        mHistogramHistory.clear();
+    }
+
+    std::size_t shot_detector::summaryBytes() const
+    {
+        return mPrevious.blockMeans.size() + mPrevious.histogram.size() * sizeof(std::uint32_t);
+    }
+
+    void shot_detector::summarize(const yuv_plane& luma, std::int32_t width, std::int32_t height, summary& s)
+    {
+        const std::int32_t blocksAcross = std::max(width, 0) / kBlockSize;
+        const std::int32_t blocksDown = std::max(height, 0) / kBlockSize;
+        const std::int32_t coveredWidth = blocksAcross * kBlockSize;
+
+        s.width = width;
+        s.height = height;
+        s.blockMeans.resize(std::size_t(blocksAcross) * blocksDown);
+        s.histogram.assign(kHistogramBins, 0);
+        s.pixels = 0;
+        mBlockSums.resize(blocksAcross);
+
+        // the histogram samples the same whole blocks, each band while it is in cache; a
+        // quarter of the pixels tell shots apart as well as all of them, at a quarter of
+        // the cost, which counting otherwise dominates
+        std::uint32_t counts[4][kHistogramBins];
+        std::memset(counts, 0, sizeof(counts));
+
+        for (std::int32_t by = 0; by < blocksDown; ++by)
+        {
+            const std::uint8_t* const band = luma.data + std::size_t(by) * kBlockSize * luma.rowStride;
+            sumBlocks(band, luma.rowStride, blocksAcross, mBlockSums.data());
+
+            std::uint8_t* const means = s.blockMeans.data() + std::size_t(by) * blocksAcross;
+            for (std::int32_t bx = 0; bx < blocksAcross; ++bx)
+            {
+                means[bx] = std::uint8_t((mBlockSums[bx] + kBlockSize * kBlockSize / 2) / (kBlockSize * kBlockSize));
+            }
+
+            for (std::int32_t y = 0; y < kBlockSize; y += kHistogramStep)
+            {
+                s.pixels += countRow(band + std::size_t(y) * luma.rowStride, coveredWidth, counts);
+            }
+        }
+
+        for (std::size_t i = 0; i < kHistogramBins; ++i)
+        {
+            s.histogram[i] = counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+        }
+    }
+
+    double shot_detector::history::threshold(double floor, double sigmas) const
+    {
+        if (values.size() < 2)
+        {
+            return floor;
+        }
+
+        const double mean = sum / values.size();
+        const double variance = std::max(sumSquares / values.size() - mean * mean, 0.0);
+        return std::max(floor, mean + sigmas * std::sqrt(variance));
+    }
+
+    void shot_detector::history::add(double value, std::size_t capacity)
+    {
+        values.push_back(value);
+        sum += value;
+        sumSquares += value * value;
+        while (values.size() > std::max<std::size_t>(capacity, 1))
+        {
+            sum -= values.front();
+            sumSquares -= values.front() * values.front();
+            values.pop_front();
+        }
+    }
+
+    void shot_detector::history::clear()
+    {
+        values.clear();
+        sum = 0.0;
+        sumSquares = 0.0;
+    }
+}
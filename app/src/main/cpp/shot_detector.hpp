@@ -0,0 +1,113 @@
+//
+// Streaming shot-boundary detection over decoded luma, one frame at a time.
+//
+
+#ifndef MEDIATEST_SHOT_DETECTOR_H
+#define MEDIATEST_SHOT_DETECTOR_H
+
+#include "StopWatch.hpp"
+#include "frame_writer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+namespace sample {
+
+    struct shot_cut
+    {
+        std::int64_t    presentationTimeUs          = 0;    // first frame of the new shot
+        std::int64_t    previousPresentationTimeUs  = 0;    // last frame of the old one
+        double          blockDifference             = 0.0;  // mean luma levels per block
+        double          histogramDifference         = 0.0;  // 0 (same) to 1 (disjoint)
+    };
+
+    // Compares each frame with the one before through a summary of it: the mean luma of
+    // every 16x16 block and a histogram of sampled luma, about 32 KiB at 4K rather than a
+    // frame copy. A frame starts a new shot when both differences stand out from the recent
+    // ones within the shot: the block means catch changes in layout that keep the
+    // histogram, the histogram keeps camera and object motion from passing for a cut.
+    //
+    // Summaries use NEON or SSE2 where the target has them. Chroma is not looked at.
+    class shot_detector
+    {
+    public:
+        static constexpr std::int32_t   kBlockSize      = 16;
+        static constexpr std::size_t    kHistogramBins  = 64;
+
+        struct config
+        {
+            // A difference is a cut candidate when it exceeds both its floor and the mean
+            // of the last historyFrames differences by sigmas standard deviations.
+            std::size_t         historyFrames       = 24;
+            double              sigmas              = 4.0;
+            double              blockFloor          = 12.0;
+            double              histogramFloor      = 0.25;
+
+            // A candidate this soon after a cut is not taken for one: the return from a
+            // flash, say.
+            unsigned int        minShotFrames       = 6;
+        };
+
+        struct statistics
+        {
+            std::uint64_t       frames          = 0;
+            std::uint64_t       cuts            = 0;
+            StopWatch::duration frameTime       = StopWatch::duration::zero();  // total in process()
+            StopWatch::duration maxFrameTime    = StopWatch::duration::zero();
+        };
+
+        explicit shot_detector(const config& cfg);
+
+        // Returns a cut when this frame starts a new shot. The first frame, and the first
+        // after a change of dimensions, is compared with nothing. Throws sample_error for
+        // a luma plane that isn't one byte per pixel.
+        std::optional<shot_cut>     process(const yuv420_frame& frame, std::int64_t presentationTimeUs);
+
+        // Forgets the previous frame and the history, as at a seek.
+        void                        reset();
+
+        std::size_t                 summaryBytes() const;
+
+        statistics                  getStatistics() const { return mStatistics; }
+
+    private:
+        struct summary
+        {
+            std::int32_t                width       = 0;
+            std::int32_t                height      = 0;
+            std::vector<std::uint8_t>   blockMeans;     // whole blocks only, row by row
+            std::vector<std::uint32_t>  histogram;
+            std::uint64_t               pixels      = 0;    // in the histogram
+        };
+
+        struct history
+        {
+            std::deque<double>  values;
+            double              sum         = 0.0;
+            double              sumSquares  = 0.0;
+
+            double  threshold(double floor, double sigmas) const;
+            void    add(double value, std::size_t capacity);
+            void    clear();
+        };
+
+        void    summarize(const yuv_plane& luma, std::int32_t width, std::int32_t height, summary& s);
+
+    private:
+        const config                mConfig;
+        summary                     mPrevious;
+        summary                     mCurrent;
+        std::int64_t                mPreviousPresentationTimeUs = 0;
+        bool                        mHavePrevious   = false;
+        unsigned int                mFramesSinceCut = 0;
+        history                     mBlockHistory;
+        history                     mHistogramHistory;
+        std::vector<std::uint32_t>  mBlockSums;     // one band of blocks
+        statistics                  mStatistics;
+    };
+}
+
+#endif //MEDIATEST_SHOT_DETECTOR_H
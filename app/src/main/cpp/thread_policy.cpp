@@ -0,0 +1,327 @@
+//
+// CPU topology detection and per-role placement, priority and naming for pipeline threads.
+//
+
+#include "thread_policy.hpp"
+
+#include "util.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace {
+    using namespace sample;
+
+    bool readValue(const std::string& path, long& value)
+    {
+        std::ifstream file(path);
+        return bool(file >> value);
+    }
+
+    // Parses a sysfs CPU list such as "0-3,6,8-11".
+    std::vector<unsigned int> parseCpuList(const std::string& list)
+    {
+        std::vector<unsigned int> result;
+        std::istringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ','))
+        {
+            unsigned int first = 0;
+            unsigned int last = 0;
+            const int fields = std::sscanf(range.c_str(), "%u-%u", &first, &last);
+            if (fields < 1)
+            {
+                continue;
+            }
+            if (fields == 1)
+            {
+                last = first;
+            }
+            for (unsigned int cpu = first; cpu <= last; ++cpu)
+            {
+                result.push_back(cpu);
+            }
+        }
+        return result;
+    }
+
+    std::uint64_t nextPolicyId()
+    {
+        static std::atomic<std::uint64_t> next(1);
+        return next++;
+    }
+
+    pid_t currentThreadId()
+    {
+        return pid_t(syscall(SYS_gettid));
+    }
+
+    const char* const kDefaultThreadNames[] = {
+        "mt-main",
+        "mt-io",
+        "mt-image",
+        "mt-readahead",
+        "mt-writer",
+        "mt-probe",
+        "mt-encoder",
+    };
+    static_assert(sizeof(kDefaultThreadNames) / sizeof(kDefaultThreadNames[0]) == std::size_t(thread_role::count),
+                  "one default name per role");
+}
+
+namespace sample {
+
+    cpu_topology cpu_topology::detect(const char* sysfsRoot)
+    {
+        const std::string root(sysfsRoot);
+
+        std::vector<unsigned int> online;
+        std::ifstream onlineFile(root + "/online");
+        std::string onlineList;
+        if (std::getline(onlineFile, onlineList))
+        {
+            online = parseCpuList(onlineList);
+        }
+        if (online.empty())
+        {
+            for (unsigned int i = 0; i < std::max(std::thread::hardware_concurrency(), 1u); ++i)
+            {
+                online.push_back(i);
+            }
+        }
+
+        cpu_topology result;
+        for (const unsigned int id : online)
+        {
+            const std::string cpuDir = root + "/cpu" + std::to_string(id);
+
+            cpu c;
+            c.id = id;
+
+            long value = 0;
+            if (readValue(cpuDir + "/cpu_capacity", value) ||
+                readValue(cpuDir + "/cpufreq/cpuinfo_max_freq", value))
+            {
+                c.capacity = static_cast<unsigned int>(value);
+            }
+            if (readValue(cpuDir + "/topology/cluster_id", value) && value >= 0)
+            {
+                c.cluster = int(value);
+            }
+            else if (readValue(cpuDir + "/topology/physical_package_id", value))
+            {
+                c.cluster = int(value);
+            }
+
+            result.mCpus.push_back(c);
+        }
+
+        return result;
+    }
+
+    std::vector<unsigned int> cpu_topology::allCpus() const
+    {
+        std::vector<unsigned int> result;
+        for (const auto& c : mCpus)
+        {
+            result.push_back(c.id);
+        }
+        return result;
+    }
+
+    std::vector<unsigned int> cpu_topology::fastestCpus() const
+    {
+        const auto fastest = std::max_element(mCpus.begin(),
+                                              mCpus.end(),
+                                              [](const cpu& a, const cpu& b) { return a.capacity < b.capacity; });
+        return (fastest == mCpus.end()) ? std::vector<unsigned int>() : cpusWithCapacity(fastest->capacity);
+    }
+
+    std::vector<unsigned int> cpu_topology::slowestCpus() const
+    {
+        const auto slowest = std::min_element(mCpus.begin(),
+                                              mCpus.end(),
+                                              [](const cpu& a, const cpu& b) { return a.capacity < b.capacity; });
+        return (slowest == mCpus.end()) ? std::vector<unsigned int>() : cpusWithCapacity(slowest->capacity);
+    }
+
+    std::vector<unsigned int> cpu_topology::cpusWithCapacity(unsigned int capacity) const
+    {
+        std::vector<unsigned int> result;
+        for (const auto& c : mCpus)
+        {
+            if (c.capacity == capacity)
+            {
+                result.push_back(c.id);
+            }
+        }
+        return result;
+    }
+
+    std::string cpu_topology::describe() const
+    {
+        std::ostringstream result;
+        for (const auto& c : mCpus)
+        {
+            result << "cpu" << c.id << "(capacity:" << c.capacity << " cluster:" << c.cluster << ") ";
+        }
+        return result.str();
+    }
+
+    const char* toString(thread_role role)
+    {
+        switch (role)
+        {
+            case thread_role::main:             return "main";
+            case thread_role::io:               return "io";
+            case thread_role::image_listener:   return "image_listener";
+            case thread_role::read_ahead:       return "read_ahead";
+            case thread_role::frame_writer:     return "frame_writer";
+            case thread_role::probe:            return "probe";
+            case thread_role::encoder:          return "encoder";
+            default:                            return "unknown";
+        }
+    }
+
+    thread_policy::thread_policy()
+            : mId(nextPolicyId())
+    {
+        for (std::size_t r = 0; r < mSettings.size(); ++r)
+        {
+            mSettings[r].name = kDefaultThreadNames[r];
+        }
+    }
+
+    thread_policy thread_policy::performance(const cpu_topology& topology)
+    {
+        thread_policy result;
+
+        // Main spins; sharing a core with the IO thread at the same raised priority, it
+        // would delay the very callbacks it is waiting for.
+        std::vector<unsigned int> fastest = topology.fastestCpus();
+        std::vector<unsigned int> mainCpus;
+        for (const unsigned int cpu : topology.allCpus())
+        {
+            if (std::find(fastest.begin(), fastest.end(), cpu) == fastest.end())
+            {
+                mainCpus.push_back(cpu);
+            }
+        }
+        if (mainCpus.empty() && fastest.size() > 1)
+        {
+            mainCpus.push_back(fastest.back());
+            fastest.pop_back();
+        }
+
+        for (const thread_role role : { thread_role::io, thread_role::image_listener, thread_role::encoder })
+        {
+            thread_settings settings = result.get(role);
+            settings.cpus = fastest;
+            settings.setNice = true;
+            settings.nice = -8;     // ANDROID_PRIORITY_URGENT_DISPLAY
+            result.set(role, std::move(settings));
+        }
+
+        // on a single core there is nothing to keep apart
+        thread_settings mainSettings = result.get(thread_role::main);
+        mainSettings.cpus = std::move(mainCpus);
+        result.set(thread_role::main, std::move(mainSettings));
+
+        return result;
+    }
+
+    void thread_policy::set(thread_role role, thread_settings settings)
+    {
+        mSettings[std::size_t(role)] = std::move(settings);
+        mId = nextPolicyId();
+    }
+
+    bool thread_policy::apply(thread_role role) const
+    {
+        const thread_settings& settings = get(role);
+        const pid_t tid = currentThreadId();
+        bool result = true;
+
+        if (!settings.name.empty())
+        {
+            // the kernel keeps 15 characters plus the terminator
+            const std::string name = settings.name.substr(0, 15);
+            const int error = pthread_setname_np(pthread_self(), name.c_str());
+            if (error != 0)
+            {
+                LOGE("%s %s pthread_setname_np: %s", __FUNCTION__, toString(role), std::strerror(error));
+                result = false;
+            }
+        }
+
+        if (!settings.cpus.empty())
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for (const unsigned int cpu : settings.cpus)
+            {
+                CPU_SET(cpu, &cpus);
+            }
+            if (sched_setaffinity(tid, sizeof(cpus), &cpus) < 0)
+            {
+                LOGE("%s %s sched_setaffinity: %s", __FUNCTION__, toString(role), std::strerror(errno));
+                result = false;
+            }
+        }
+
+        if (settings.realtimePriority > 0)
+        {
+            sched_param param;
+            std::memset(&param, 0, sizeof(param));
+            param.sched_priority = settings.realtimePriority;
+            const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (error != 0)
+            {
+                LOGE("%s %s SCHED_FIFO %d: %s", __FUNCTION__, toString(role), settings.realtimePriority, std::strerror(error));
+                result = false;
+            }
+        }
+        else if (settings.setNice)
+        {
+            // Linux nice values are per thread when addressed by tid
+            if (setpriority(PRIO_PROCESS, tid, settings.nice) < 0)
+            {
+                LOGE("%s %s setpriority(%d): %s", __FUNCTION__, toString(role), settings.nice, std::strerror(errno));
+                result = false;
+            }
+        }
+
+        LOGI("%s %s name:%s cpus:%zu nice:%d realtime:%d",
+             __FUNCTION__,
+             toString(role),
+             settings.name.c_str(),
+             settings.cpus.size(),
+             settings.setNice ? settings.nice : 0,
+             settings.realtimePriority);
+
+        return result;
+    }
+
+    void thread_policy::applyOnce(thread_role role) const
+    {
+        // a thread may serve more than one role, or policy, over its life
+        thread_local std::vector<std::pair<std::uint64_t, thread_role>> applied;
+        const auto key = std::make_pair(mId, role);
+        if (std::find(applied.begin(), applied.end(), key) == applied.end())
+        {
+            applied.push_back(key);
+            (void) apply(role);
+        }
+    }
+}
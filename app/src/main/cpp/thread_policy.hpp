@@ -0,0 +1,99 @@
+//
+// CPU topology detection and per-role placement, priority and naming for pipeline threads.
+//
+
+#ifndef MEDIATEST_THREAD_POLICY_H
+#define MEDIATEST_THREAD_POLICY_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sample {
+
+    // Online CPUs as described by sysfs. On big.LITTLE parts cpu_capacity (or, failing that,
+    // cpuinfo_max_freq) separates the clusters; on homogeneous machines every CPU ranks equal.
+    class cpu_topology
+    {
+    public:
+        struct cpu
+        {
+            unsigned int    id          = 0;
+            unsigned int    capacity    = 0;    // cpu_capacity, else max frequency in kHz, else 0
+            int             cluster     = -1;   // topology/cluster_id, else physical_package_id
+        };
+
+        static cpu_topology detect(const char* sysfsRoot = "/sys/devices/system/cpu");
+
+        const std::vector<cpu>& cpus() const { return mCpus; }
+
+        std::vector<unsigned int>   allCpus() const;
+        std::vector<unsigned int>   fastestCpus() const;    // the highest-capacity class
+        std::vector<unsigned int>   slowestCpus() const;    // the lowest-capacity class
+
+        std::string                 describe() const;
+
+    private:
+        std::vector<unsigned int>   cpusWithCapacity(unsigned int capacity) const;
+
+    private:
+        std::vector<cpu>    mCpus;
+    };
+
+    enum class thread_role
+    {
+        main,
+        io,                 // decoder IO thread: codec callbacks, frame delivery, consumers
+        image_listener,     // AImageReader's listener thread
+        read_ahead,         // block_cache read-ahead
+        frame_writer,       // frame_writer's file writer
+        probe,              // probeAll's workers
+        encoder,            // encoder IO thread: encoder callbacks and muxing
+        count
+    };
+
+    const char* toString(thread_role role);
+
+    struct thread_settings
+    {
+        std::string                 name;                   // at most 15 characters are kept
+        std::vector<unsigned int>   cpus;                   // empty: leave affinity alone
+        bool                        setNice     = false;
+        int                         nice        = 0;
+        int                         realtimePriority = 0;   // > 0: SCHED_FIFO at this priority
+    };
+
+    // Settings for each pipeline thread role, applied by the thread itself when it starts.
+    // The default policy only names threads. Failures, such as real-time priority without
+    // the privilege for it, are logged and otherwise ignored: placement is a hint.
+    class thread_policy
+    {
+    public:
+        thread_policy();
+
+        // The IO, image listener and encoder threads on the fastest cluster at raised
+        // priority. The main thread, which spins while it waits on frames, keeps off
+        // their cores at default priority: on the other clusters, or on one fast core of
+        // its own when every core is alike. Read-ahead, the frame writer and probe
+        // workers, which mostly wait on storage, stay unpinned.
+        static thread_policy performance(const cpu_topology& topology);
+
+        void                    set(thread_role role, thread_settings settings);
+        const thread_settings&  get(thread_role role) const { return mSettings[std::size_t(role)]; }
+
+        // Applies role's settings to the calling thread; false if any part failed.
+        bool    apply(thread_role role) const;
+
+        // As apply(), for threads we don't create (e.g. listener callbacks): only the first
+        // call on each thread for this policy, as last set(), and role does anything.
+        void    applyOnce(thread_role role) const;
+
+    private:
+        std::array<thread_settings, std::size_t(thread_role::count)>    mSettings;
+        std::uint64_t   mId;    // new with every set(); copies share it
+    };
+}
+
+#endif //MEDIATEST_THREAD_POLICY_H
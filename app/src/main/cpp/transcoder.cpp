@@ -0,0 +1,596 @@
+//
+// Transcoding through an encoder and AMediaMuxer.
+//
+
+#include "transcoder.hpp"
+
+#include "util.hpp"
+
+#include <boost/exception/all.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cstring>
+
+namespace {
+    using namespace sample;
+
+    // MediaCodecInfo.CodecCapabilities
+    const std::int32_t  kColorFormatSurface             = 0x7f000789;
+    const std::int32_t  kColorFormatYUV420Flexible      = 0x7f420888;
+
+    // MediaCodec.BUFFER_FLAG_KEY_FRAME; the NDK only names it from API 34
+    const std::uint32_t kBufferFlagKeyFrame             = 1;
+
+    const std::int32_t  kDefaultFrameRate               = 30;
+
+    void copyRows(const yuv_plane& source,
+                  std::uint8_t* destination,
+                  std::int32_t destinationStride,
+                  std::int32_t width,
+                  std::int32_t height)
+    {
+        for (std::int32_t y = 0; y < height; ++y)
+        {
+            const std::uint8_t* const src = source.data + std::size_t(y) * source.rowStride;
+            std::uint8_t* const dst = destination + std::size_t(y) * destinationStride;
+            if (source.pixelStride == 1)
+            {
+                std::memcpy(dst, src, width);
+            }
+            else
+            {
+                for (std::int32_t x = 0; x < width; ++x)
+                {
+                    dst[x] = src[std::size_t(x) * source.pixelStride];
+                }
+            }
+        }
+    }
+
+    // Copies a frame into a codec input buffer laid out as layout describes: planar for the
+    // planar color formats, semi-planar (NV12) otherwise. Returns the bytes the frame takes.
+    std::size_t copyFrame(const yuv420_frame& frame,
+                          std::uint8_t* buffer,
+                          std::size_t capacity,
+                          const buffer_layout& layout)
+    {
+        const buffer_layout::chroma_arrangement arrangement = layout.chroma();
+        const std::size_t lumaSize = std::size_t(layout.stride) * layout.sliceHeight;
+        const std::size_t frameSize = lumaSize + lumaSize / 2;
+        if (arrangement == buffer_layout::chroma_arrangement::unsupported ||
+            frame.width != layout.width || frame.height != layout.height || capacity < frameSize)
+        {
+            LOGE("%s can't fill colorFormat:%d %dx%d stride:%d sliceHeight:%d in %zu bytes from a %dx%d frame",
+                 __FUNCTION__,
+                 layout.colorFormat,
+                 layout.width,
+                 layout.height,
+                 layout.stride,
+                 layout.sliceHeight,
+                 capacity,
+                 frame.width,
+                 frame.height);
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("copyFrame") );
+        }
+
+        const std::int32_t chromaWidth = frame.width / 2;
+        const std::int32_t chromaHeight = frame.height / 2;
+        std::uint8_t* const chroma = buffer + lumaSize;
+
+        copyRows(frame.planes[0], buffer, layout.stride, frame.width, frame.height);
+
+        if (arrangement == buffer_layout::chroma_arrangement::planar)
+        {
+            const std::int32_t chromaStride = layout.stride / 2;
+            copyRows(frame.planes[1], chroma, chromaStride, chromaWidth, chromaHeight);
+            copyRows(frame.planes[2], chroma + lumaSize / 4, chromaStride, chromaWidth, chromaHeight);
+        }
+        else if (frame.planes[1].pixelStride == 2 && frame.planes[2].data == frame.planes[1].data + 1)
+        {
+            // NV12 to NV12: interleaved rows copy whole
+            const yuv_plane uv = { frame.planes[1].data, frame.planes[1].rowStride, 1 };
+            copyRows(uv, chroma, layout.stride, frame.width, chromaHeight);
+        }
+        else
+        {
+            for (std::int32_t y = 0; y < chromaHeight; ++y)
+            {
+                std::uint8_t* const dst = chroma + std::size_t(y) * layout.stride;
+                for (std::int32_t x = 0; x < chromaWidth; ++x)
+                {
+                    dst[2 * x] = frame.planes[1].data[std::size_t(y) * frame.planes[1].rowStride + std::size_t(x) * frame.planes[1].pixelStride];
+                    dst[2 * x + 1] = frame.planes[2].data[std::size_t(y) * frame.planes[2].rowStride + std::size_t(x) * frame.planes[2].pixelStride];
+                }
+            }
+        }
+
+        return frameSize;
+    }
+
+    unique_media_format createEncoderFormat(AMediaFormat* sourceFormat, const encoder_settings& settings)
+    {
+        std::int32_t width = 0;
+        std::int32_t height = 0;
+        if (!AMediaFormat_getInt32(sourceFormat, AMEDIAFORMAT_KEY_WIDTH, &width) ||
+            !AMediaFormat_getInt32(sourceFormat, AMEDIAFORMAT_KEY_HEIGHT, &height))
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("AMediaFormat_getInt32(AMEDIAFORMAT_KEY_WIDTH)") );
+        }
+
+        std::int32_t frameRate = settings.frameRate;
+        if (frameRate <= 0 &&
+            (!AMediaFormat_getInt32(sourceFormat, AMEDIAFORMAT_KEY_FRAME_RATE, &frameRate) || frameRate <= 0))
+        {
+            frameRate = kDefaultFrameRate;
+        }
+
+        unique_media_format result(AMediaFormat_new());
+        AMediaFormat_setString(result.get(), AMEDIAFORMAT_KEY_MIME, settings.mime.c_str());
+        AMediaFormat_setInt32(result.get(), AMEDIAFORMAT_KEY_WIDTH, width);
+        AMediaFormat_setInt32(result.get(), AMEDIAFORMAT_KEY_HEIGHT, height);
+        AMediaFormat_setInt32(result.get(), AMEDIAFORMAT_KEY_BIT_RATE, settings.bitRate);
+        AMediaFormat_setInt32(result.get(), AMEDIAFORMAT_KEY_FRAME_RATE, frameRate);
+        AMediaFormat_setInt32(result.get(), AMEDIAFORMAT_KEY_I_FRAME_INTERVAL, settings.iFrameIntervalSeconds);
+        return result;
+    }
+}
+
+namespace sample {
+
+    const char* toString(transcode_path path)
+    {
+        switch (path)
+        {
+            case transcode_path::surface:   return "surface";
+            case transcode_path::cpu_copy:  return "cpu_copy";
+            default:                        return "unknown";
+        }
+    }
+
+    muxer_stage::muxer_stage(int fd, OutputFormat container)
+            : mMuxer(AMediaMuxer_new(fd, container))
+    {
+        if (!mMuxer)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("AMediaMuxer_new") );
+        }
+    }
+
+    void muxer_stage::addTrack(AMediaFormat* format)
+    {
+        assert(!mStarted);
+
+        mTrack = AMediaMuxer_addTrack(mMuxer.get(), format);
+        if (mTrack < 0)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("AMediaMuxer_addTrack")
+                                           << errinfo_media_status(media_status_t(mTrack)) );
+        }
+
+        fail_media_error(AMediaMuxer_start(mMuxer.get()),
+                         "AMediaMuxer_start");
+        mStarted = true;
+    }
+
+    void muxer_stage::write(const std::uint8_t* data, const AMediaCodecBufferInfo& info)
+    {
+        assert(mStarted && !mStopped);
+
+        fail_media_error(AMediaMuxer_writeSampleData(mMuxer.get(), mTrack, data, &info),
+                         "AMediaMuxer_writeSampleData");
+    }
+
+    void muxer_stage::stop()
+    {
+        if (mStarted && !mStopped)
+        {
+            mStopped = true;
+            fail_media_error(AMediaMuxer_stop(mMuxer.get()),
+                             "AMediaMuxer_stop");
+        }
+    }
+
+    encoder_core::encoder_core(AMediaFormat* format,
+                               transcode_path path,
+                               muxer_stage& muxer,
+                               const thread_policy* threadPolicy,
+                               memory_accountant* accountant)
+            : mPath(path),
+              mMuxer(muxer),
+              mThreadPolicy(threadPolicy),
+              mIOQueue(IOTaskAllocator(accountant, memory_category::queues)),
+              mDone(false),
+              mFailed(false)
+    {
+        const char* mime = nullptr;
+        if (!AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime))
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("AMediaFormat_getString(AMEDIAFORMAT_KEY_MIME)") );
+        }
+
+        mMediaCodec.reset(AMediaCodec_createEncoderByType(mime));
+        if (!mMediaCodec)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("AMediaCodec_createEncoderByType") );
+        }
+
+        AMediaFormat_setInt32(format,
+                              AMEDIAFORMAT_KEY_COLOR_FORMAT,
+                              (mPath == transcode_path::surface) ? kColorFormatSurface : kColorFormatYUV420Flexible);
+        fail_media_error(AMediaCodec_configure(mMediaCodec.get(),
+                                               format,
+                                               nullptr, // surface
+                                               nullptr, // AMediaCrypto
+                                               AMEDIACODEC_CONFIGURE_FLAG_ENCODE),
+                         "AMediaCodec_configure");
+
+        if (mPath == transcode_path::surface)
+        {
+            // between configure and start, as the platform requires
+            ANativeWindow* surface = nullptr;
+            fail_media_error(AMediaCodec_createInputSurface(mMediaCodec.get(), &surface),
+                             "AMediaCodec_createInputSurface");
+            mInputSurface.reset(surface);
+        }
+        else
+        {
+            const unique_media_format inputFormat(AMediaCodec_getInputFormat(mMediaCodec.get()));
+            mInputLayout = buffer_layout::fromFormat(inputFormat ? inputFormat.get() : format);
+            LOGI("%s input colorFormat:%d %dx%d stride:%d sliceHeight:%d",
+                 __FUNCTION__,
+                 mInputLayout.colorFormat,
+                 mInputLayout.width,
+                 mInputLayout.height,
+                 mInputLayout.stride,
+                 mInputLayout.sliceHeight);
+        }
+
+        AMediaCodecOnAsyncNotifyCallback callbacks;
+        callbacks.onAsyncError = &encoder_core::asyncErrorCallback;
+        callbacks.onAsyncFormatChanged = &encoder_core::asyncFormatChangedCallback;
+        callbacks.onAsyncInputAvailable = &encoder_core::asyncInputAvailableCallback;
+        callbacks.onAsyncOutputAvailable = &encoder_core::asyncOutputAvailableCallback;
+        fail_media_error(AMediaCodec_setAsyncNotifyCallback(mMediaCodec.get(), callbacks, this),
+                         "AMediaCodec_setAsyncNotifyCallback");
+    }
+
+    encoder_core::~encoder_core()
+    {
+        if (mIOThread.joinable())
+        {
+            // lets the IO thread out if the encoder never finished
+            mIOQueue.push([this]() { finish(true); });
+            mIOThread.join();
+        }
+
+        if (mMediaCodec)
+        {
+            (void) AMediaCodec_stop(mMediaCodec.get());
+        }
+    }
+
+    void encoder_core::start()
+    {
+        mIOThread = std::thread(&encoder_core::ioThread, this);
+        fail_media_error(AMediaCodec_start(mMediaCodec.get()),
+                         "AMediaCodec_start");
+    }
+
+    std::int32_t encoder_core::waitForInputBuffer()
+    {
+        const StopWatch waitTimer;
+
+        std::unique_lock<std::mutex> lock(mInputMutex);
+        mInputCondition.wait(lock, [this]() { return !mFreeInputs.empty() || mInputClosed; });
+        if (mFreeInputs.empty())
+        {
+            return -1;
+        }
+
+        const std::int32_t index = mFreeInputs.front();
+        mFreeInputs.pop_front();
+        mStatistics.inputWaitTime += waitTimer.getSplitTime();
+        return index;
+    }
+
+    void encoder_core::encodeFrame(const yuv420_frame& frame, std::int64_t presentationTimeUs)
+    {
+        assert(mPath == transcode_path::cpu_copy);
+
+        const std::int32_t index = waitForInputBuffer();
+        if (index < 0)
+        {
+            // the encoder failed; the frame has nowhere to go
+            return;
+        }
+
+        std::size_t capacity = 0;
+        std::uint8_t* const buffer = AMediaCodec_getInputBuffer(mMediaCodec.get(), index, &capacity);
+        if (!buffer)
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("AMediaCodec_getInputBuffer")
+                                           << errinfo_buffer_index(index) );
+        }
+
+        const StopWatch copyTimer;
+        const std::size_t size = copyFrame(frame, buffer, capacity, mInputLayout);
+        mStatistics.copyTime += copyTimer.getSplitTime();
+        mStatistics.bytesCopied += size;
+
+        fail_media_error(AMediaCodec_queueInputBuffer(mMediaCodec.get(), index, 0, size, presentationTimeUs, 0),
+                         "AMediaCodec_queueInputBuffer");
+    }
+
+    void encoder_core::signalEndOfStream()
+    {
+        if (mPath == transcode_path::surface)
+        {
+            fail_media_error(AMediaCodec_signalEndOfInputStream(mMediaCodec.get()),
+                             "AMediaCodec_signalEndOfInputStream");
+            return;
+        }
+
+        const std::int32_t index = waitForInputBuffer();
+        if (index >= 0)
+        {
+            fail_media_error(AMediaCodec_queueInputBuffer(mMediaCodec.get(), index, 0, 0, 0, AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM),
+                             "AMediaCodec_queueInputBuffer");
+        }
+    }
+
+    void encoder_core::abort()
+    {
+        mIOQueue.push([this]() { finish(true); });
+    }
+
+    void encoder_core::finish(bool failed)
+    {
+        if (mDone)
+        {
+            return;
+        }
+
+        mFailed = failed;
+        try
+        {
+            mMuxer.stop();
+        }
+        catch (...)
+        {
+            LOGE("%s %s", __FUNCTION__, boost::current_exception_diagnostic_information().c_str());
+            mFailed = true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mInputMutex);
+            mInputClosed = true;
+        }
+        mInputCondition.notify_all();
+
+        LOGI("%s frames:%" PRIu64 " sync:%" PRIu64 " bytes:%" PRIu64 " failed:%s",
+             __FUNCTION__,
+             mStatistics.framesEncoded,
+             mStatistics.syncFrames,
+             mStatistics.bytesMuxed,
+             mFailed ? "TRUE" : "FALSE");
+        mDone = true;
+    }
+
+    void encoder_core::ioThread()
+    {
+        if (mThreadPolicy)
+        {
+            (void) mThreadPolicy->apply(thread_role::encoder);
+        }
+
+        while (!isDone())
+        {
+            auto task = mIOQueue.pop();
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                LOGE("%s %s", __FUNCTION__, boost::current_exception_diagnostic_information().c_str());
+                ++mStatistics.errors;
+                finish(true);
+            }
+        }
+    }
+
+    void encoder_core::onInputAvailable(int32_t index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mInputMutex);
+            mFreeInputs.push_back(index);
+        }
+        mInputCondition.notify_one();
+    }
+
+    void encoder_core::onOutputAvailable(int32_t index, const AMediaCodecBufferInfo& bufferInfo)
+    {
+        // codec config travels in the output format's csd buffers instead
+        if (bufferInfo.size > 0 && 0 == (bufferInfo.flags & AMEDIACODEC_BUFFER_FLAG_CODEC_CONFIG))
+        {
+            std::size_t capacity = 0;
+            const std::uint8_t* const buffer = AMediaCodec_getOutputBuffer(mMediaCodec.get(), index, &capacity);
+            if (!buffer)
+            {
+                BOOST_THROW_EXCEPTION( sample_error()
+                                               << boost::errinfo_api_function("AMediaCodec_getOutputBuffer")
+                                               << errinfo_buffer_index(index) );
+            }
+
+            mMuxer.write(buffer + bufferInfo.offset, bufferInfo);
+
+            ++mStatistics.framesEncoded;
+            mStatistics.bytesMuxed += bufferInfo.size;
+            mStatistics.lastPresentationTimeUs = bufferInfo.presentationTimeUs;
+            if (0 != (bufferInfo.flags & kBufferFlagKeyFrame))
+            {
+                ++mStatistics.syncFrames;
+            }
+        }
+
+        fail_media_error(AMediaCodec_releaseOutputBuffer(mMediaCodec.get(), index, false),
+                         "AMediaCodec_releaseOutputBuffer");
+
+        if (0 != (bufferInfo.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM))
+        {
+            finish(false);
+        }
+    }
+
+    void encoder_core::onFormatChanged(AMediaFormat* format)
+    {
+        LOGI("%s { %s }", __FUNCTION__, AMediaFormat_toString(format));
+        mMuxer.addTrack(format);
+    }
+
+    void encoder_core::onError(media_status_t error, int32_t actionCode, const char* detail)
+    {
+        // no recovery: a half-encoded proxy is finalized and reported as failed
+        LOGE("%s %d %d '%s'", __FUNCTION__, error, actionCode, detail ? detail : "");
+        ++mStatistics.errors;
+        finish(true);
+    }
+
+    void encoder_core::asyncInputAvailableCallback(AMediaCodec*,
+                                                   void* userData,
+                                                   int32_t index)
+    {
+        encoder_core* const self = static_cast<encoder_core*>(userData);
+        self->mIOQueue.push([self, index]() { self->onInputAvailable(index); });
+    }
+
+    void encoder_core::asyncOutputAvailableCallback(AMediaCodec*,
+                                                    void* userData,
+                                                    int32_t index,
+                                                    AMediaCodecBufferInfo *bufferInfo)
+    {
+        encoder_core* const self = static_cast<encoder_core*>(userData);
+        const AMediaCodecBufferInfo bufferInfoCopy = *bufferInfo;
+        self->mIOQueue.push([self, index, bufferInfoCopy]() { self->onOutputAvailable(index, bufferInfoCopy); });
+    }
+
+    void encoder_core::asyncFormatChangedCallback(AMediaCodec *codec,
+                                                  void* userData,
+                                                  AMediaFormat*)
+    {
+        // take a format we own rather than rely on the callback's outliving the hop
+        encoder_core* const self = static_cast<encoder_core*>(userData);
+        const std::shared_ptr<AMediaFormat> format(AMediaCodec_getOutputFormat(codec), &AMediaFormat_delete);
+        self->mIOQueue.push([self, format]() { self->onFormatChanged(format.get()); });
+    }
+
+    void encoder_core::asyncErrorCallback(AMediaCodec*,
+                                          void* userData,
+                                          media_status_t error,
+                                          int32_t actionCode,
+                                          const char *detail)
+    {
+        // detail is only valid for the duration of the callback
+        encoder_core* const self = static_cast<encoder_core*>(userData);
+        const std::string detailCopy(detail ? detail : "");
+        self->mIOQueue.push([self, error, actionCode, detailCopy]() { self->onError(error, actionCode, detailCopy.c_str()); });
+    }
+
+    transcoder::transcoder(AMediaFormat* sourceFormat, int outputFd, const transcode_options& options)
+            : mPath(options.path),
+              mMuxer(outputFd, options.container),
+              mFramesDecoded(0)
+    {
+        const unique_media_format encoderFormat = createEncoderFormat(sourceFormat, options.encoder);
+        mEncoder.reset(new encoder_core(encoderFormat.get(),
+                                         mPath,
+                                         mMuxer,
+                                         options.decoder.threadPolicy,
+                                         options.decoder.accountant));
+    }
+
+    output_target transcoder::decoderTarget()
+    {
+        if (mPath == transcode_path::surface)
+        {
+            return output_target(mEncoder->inputSurface());
+        }
+
+        // on the decoder's IO thread, so a slow encoder holds up decoding rather than
+        // letting frames pile up
+        encoder_core* const encoder = mEncoder.get();
+        return output_target(outputBuffer_t([encoder](output_buffer_view view) {
+            try
+            {
+                encoder->encodeFrame(yuv420_frame::fromBuffer(view), view.presentationTimeUs());
+            }
+            catch (...)
+            {
+                LOGE("%s", boost::current_exception_diagnostic_information().c_str());
+                encoder->abort();
+            }
+        }));
+    }
+
+    task transcoder::pumpFrames()
+    {
+        try
+        {
+            auto stream = frames(mDecoder);
+            while (co_await stream.next())
+            {
+                ++mFramesDecoded;
+            }
+
+            // every frame has been rendered or copied by now: both happen before the
+            // decoder hands the frame out
+            mEncoder->signalEndOfStream();
+        }
+        catch (...)
+        {
+            mEncoder->abort();
+            throw;
+        }
+    }
+
+    void transcoder::start()
+    {
+        mEncoder->start();
+        mPump.emplace(pumpFrames());
+        mDecoder.start();
+    }
+
+    bool transcoder::isDone() const
+    {
+        return mPump && mPump->done() && mDecoder.isDone() && mEncoder->isDone();
+    }
+
+    void transcoder::get() const
+    {
+        assert(isDone());
+
+        mPump->get();
+        if (mEncoder->failed())
+        {
+            BOOST_THROW_EXCEPTION( sample_error()
+                                           << boost::errinfo_api_function("encoder_core") );
+        }
+    }
+
+    transcode_statistics transcoder::getStatistics() const
+    {
+        transcode_statistics result;
+        result.framesDecoded = mFramesDecoded;
+        result.encoder = mEncoder->getStatistics();
+        return result;
+    }
+}
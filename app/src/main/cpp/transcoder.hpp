@@ -0,0 +1,248 @@
+//
+// Transcoding through an encoder and AMediaMuxer. On the surface path the decoder renders
+// straight into the encoder's input surface, so frames never pass through CPU memory; the
+// CPU-copy path, through codec buffers, is kept to measure what that saves.
+//
+
+#ifndef MEDIATEST_TRANSCODER_H
+#define MEDIATEST_TRANSCODER_H
+
+#include "StopWatch.hpp"
+#include "coro.hpp"
+#include "frame_writer.hpp"
+#include "handles.hpp"
+#include "sample_app.hpp"
+#include "thread_policy.hpp"
+
+#include <media/NdkMediaCodec.h>
+#include <media/NdkMediaMuxer.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace sample {
+
+    enum class transcode_path
+    {
+        surface,        // decoder renders into the encoder's input surface
+        cpu_copy,       // decoder output buffers are copied into encoder input buffers
+    };
+
+    const char* toString(transcode_path path);
+
+    struct encoder_settings
+    {
+        std::string     mime                    = "video/avc";
+        std::int32_t    bitRate                 = 2000000;
+        std::int32_t    frameRate               = 0;    // 0: the source's, or 30 if it has none
+        std::int32_t    iFrameIntervalSeconds   = 1;
+    };
+
+    struct encoder_statistics
+    {
+        std::uint64_t       framesEncoded           = 0;
+        std::uint64_t       syncFrames              = 0;
+        std::uint64_t       bytesMuxed              = 0;
+        std::int64_t        lastPresentationTimeUs  = -1;
+        unsigned int        errors                  = 0;
+
+        // cpu_copy only
+        std::uint64_t       bytesCopied             = 0;
+        StopWatch::duration copyTime                = StopWatch::duration::zero();
+        StopWatch::duration inputWaitTime           = StopWatch::duration::zero();  // for an input buffer
+    };
+
+    // Writes a single encoded video track. The track is added, and the muxer started, when
+    // the encoder reports its output format.
+    class muxer_stage
+    {
+    public:
+        muxer_stage(int fd, OutputFormat container);
+
+        muxer_stage(const muxer_stage& other) = delete;
+        muxer_stage& operator=(const muxer_stage& other) = delete;
+
+        void    addTrack(AMediaFormat* format);
+        void    write(const std::uint8_t* data, const AMediaCodecBufferInfo& info);
+
+        // Finalizes the file. Does nothing if the muxer never started or has stopped.
+        void    stop();
+
+        bool    isStarted() const { return mStarted; }
+
+    private:
+        unique_media_muxer  mMuxer;
+        ssize_t             mTrack      = -1;
+        bool                mStarted    = false;
+        bool                mStopped    = false;
+    };
+
+    // An encoder driven by AMediaCodec's async callbacks on its own IO thread, which also
+    // does the muxing. Input arrives either through inputSurface(), from a codec rendering
+    // into it, or through encodeFrame().
+    class encoder_core
+    {
+    public:
+        // format is the encoder's: mime, size, bitrate, frame rate, I-frame interval. The
+        // color format is chosen here, by path.
+        encoder_core(AMediaFormat* format,
+                     transcode_path path,
+                     muxer_stage& muxer,
+                     const thread_policy* threadPolicy = nullptr,
+                     memory_accountant* accountant = nullptr);
+
+        encoder_core(const encoder_core& other) = delete;
+        encoder_core& operator=(const encoder_core& other) = delete;
+
+        ~encoder_core();
+
+        // surface path only; owned by the encoder, and must outlive anything rendering to it
+        ANativeWindow*  inputSurface() const { return mInputSurface.get(); }
+
+        void    start();
+
+        // cpu_copy path. Blocks until the encoder has a free input buffer, then copies the
+        // frame into it. Frames must match the encoder's dimensions.
+        void    encodeFrame(const yuv420_frame& frame, std::int64_t presentationTimeUs);
+
+        // Call once the last frame has been rendered or encoded.
+        void    signalEndOfStream();
+
+        // Gives up: stops the muxer with what it has and lets the IO thread finish.
+        void    abort();
+
+        bool    isDone() const { return mDone; }
+        bool    failed() const { return mFailed; }
+
+        // Only meaningful once the encoder is done; the IO thread updates them until then.
+        encoder_statistics  getStatistics() const { return mStatistics; }
+
+    private:
+        std::int32_t    waitForInputBuffer();
+        void            finish(bool failed);
+
+        void    ioThread();
+
+        void    onInputAvailable(int32_t index);
+        void    onOutputAvailable(int32_t index, const AMediaCodecBufferInfo& bufferInfo);
+        void    onFormatChanged(AMediaFormat* format);
+        void    onError(media_status_t error, int32_t actionCode, const char* detail);
+
+        static void asyncInputAvailableCallback(AMediaCodec* codec,
+                                                void* userData,
+                                                int32_t index);
+        static void asyncOutputAvailableCallback(AMediaCodec* codec,
+                                                 void* userData,
+                                                 int32_t index,
+                                                 AMediaCodecBufferInfo *bufferInfo);
+        static void asyncFormatChangedCallback(AMediaCodec *codec,
+                                               void* userData,
+                                               AMediaFormat *format);
+        static void asyncErrorCallback(AMediaCodec *codec,
+                                       void* userData,
+                                       media_status_t error,
+                                       int32_t actionCode,
+                                       const char *detail);
+
+    private:
+        typedef std::function<void()>               IOTask;
+        typedef accounting_allocator<IOTask>        IOTaskAllocator;
+
+    private:
+        const transcode_path        mPath;
+        muxer_stage&                mMuxer;
+        const thread_policy*        mThreadPolicy   = nullptr;
+
+        unique_media_codec          mMediaCodec;
+        unique_native_window        mInputSurface;
+        buffer_layout               mInputLayout;   // cpu_copy
+
+        pc_queue<IOTask, IOTaskAllocator>   mIOQueue;   // backlog accounted as memory_category::queues
+        std::thread                 mIOThread;
+        std::atomic<bool>           mDone;
+        std::atomic<bool>           mFailed;
+        encoder_statistics          mStatistics;
+
+        // cpu_copy: input buffers the codec has offered, taken by encodeFrame on the
+        // decoder's IO thread
+        std::mutex                  mInputMutex;
+        std::condition_variable     mInputCondition;
+        std::deque<std::int32_t>    mFreeInputs;
+        bool                        mInputClosed    = false;
+    };
+
+    struct transcode_options
+    {
+        transcode_path      path        = transcode_path::surface;
+        encoder_settings    encoder;
+        OutputFormat        container   = AMEDIAMUXER_OUTPUT_FORMAT_MPEG_4;
+
+        // The decoder's collaborators. Its thread policy places the encoder thread too.
+        decoder_options     decoder;
+    };
+
+    struct transcode_statistics
+    {
+        std::uint64_t       framesDecoded   = 0;
+        encoder_statistics  encoder;
+    };
+
+    // Decodes a video track and re-encodes it into a file. Codec callbacks keep pointers
+    // to it, so it never moves.
+    class transcoder
+    {
+    public:
+        template <typename Driver = async_driver>
+        transcoder(AMediaFormat* sourceFormat,
+                   decoder::readSampleData_t readSampleData,
+                   int outputFd,
+                   const Driver& driver = Driver(),
+                   const transcode_options& options = transcode_options())
+                : transcoder(sourceFormat, outputFd, options)
+        {
+            mDecoder = decoder(sourceFormat, std::move(readSampleData), decoderTarget(), driver, options.decoder);
+        }
+
+        transcoder(const transcoder& other) = delete;
+        transcoder& operator=(const transcoder& other) = delete;
+
+        void    start();
+
+        bool    isDone() const;
+
+        // Once done: rethrows whatever stopped the transcode early, and throws sample_error
+        // if the encoder failed.
+        void    get() const;
+
+        decoder&    source() { return mDecoder; }
+
+        transcode_statistics    getStatistics() const;
+
+    private:
+        transcoder(AMediaFormat* sourceFormat, int outputFd, const transcode_options& options);
+
+        output_target   decoderTarget();
+        task            pumpFrames();
+
+    private:
+        const transcode_path            mPath;
+        muxer_stage                     mMuxer;
+        std::unique_ptr<encoder_core>   mEncoder;
+
+        // Declared ahead of the decoder, so the decoder, and with it the IO thread that
+        // resumes the pump, is gone before the pump's coroutine frame is destroyed.
+        std::optional<task>             mPump;
+        decoder                         mDecoder;           // renders into mEncoder's surface
+        std::atomic<std::uint64_t>      mFramesDecoded;
+    };
+}
+
+#endif //MEDIATEST_TRANSCODER_H